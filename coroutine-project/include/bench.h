@@ -0,0 +1,192 @@
+/**
+ * bench.h
+ * Shared Definitions for the Benchmark Suite
+ *
+ * bench.c owns the command-line configuration and the driver. Larger
+ * scenarios live in their own bench_*.c file and use the configuration
+ * and timing helpers declared here.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <time.h>
+#include "coro_backend.h"
+
+/* Upper bound on --bench patterns */
+#define MAX_PATTERNS 32
+
+/* Runtime benchmark configuration */
+typedef struct {
+    long long num_switches;     /* Measured switches per sample */
+    bool switches_set;          /* --switches given explicitly */
+    long long warmup_switches;  /* Unmeasured switches before each sample */
+    int num_samples;            /* Samples per benchmark */
+    bool calibrate;             /* Pick num_switches per benchmark */
+    double target_ms;           /* Calibration target per sample */
+    double time_budget_s;       /* Total budget (0 = unlimited) */
+    long long max_coros;        /* Cap for sweeps over coroutine count (0 = pool limit) */
+    const char *trace_path;     /* --trace output, NULL = tracing off */
+    int metrics_interval_ms;    /* --metrics publish interval, 0 = not published */
+    const char *patterns[MAX_PATTERNS];
+    int num_patterns;
+    const char *backend_patterns[MAX_PATTERNS];  /* --backend selection */
+    int num_backend_patterns;
+} bench_config_t;
+
+/* Configuration parsed from the command line */
+extern bench_config_t bench_config;
+
+/**
+ * Get current time in nanoseconds
+ */
+static inline long long get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Calculate statistics from samples
+ */
+void calculate_stats(double *samples, int n, double *mean, double *min, double *max);
+
+/**
+ * qsort() comparator for doubles, ascending
+ */
+int bench_compare_double(const void *a, const void *b);
+
+/**
+ * Sample below which per_mille/1000 of n sorted samples fall
+ * (500 = median, 990 = p99, 999 = p99.9); sorted must be ascending, n > 0
+ */
+double bench_percentile(const double *sorted, int n, int per_mille);
+
+/**
+ * xorshift64 step; suites seed it with a constant so runs are comparable
+ */
+static inline unsigned long long bench_rand(unsigned long long *state) {
+    unsigned long long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+/**
+ * Fisher-Yates shuffle of order[0..n) with a fixed seed
+ */
+void bench_shuffle(int *order, int n);
+
+/**
+ * Resident set size of this process in bytes, from /proc/self/statm
+ * Returns: the size, or 0 if it cannot be read
+ */
+long long bench_rss_bytes(void);
+
+/**
+ * Check whether a backend is selected by --backend (all by default)
+ * Suites iterate coro_backend_get() and skip unselected backends.
+ */
+bool bench_backend_selected(const coro_backend_t *backend);
+
+/**
+ * Units (pings, wakes, lookups, ...) one row of a suite runs
+ * With --calibrate, as many as take row_ms at unit_ns each; without it
+ * (or with unit_ns <= 0), --switches read as the suite's own unit, else
+ * def. Clamped to [1, max], so a -n sized for ping-pong switches cannot
+ * blow up a suite's sample buffers; a clamped -n is reported.
+ * Returns: the count
+ */
+long long bench_suite_count(double row_ms, double unit_ns, long long def, long long max);
+
+/**
+ * Two-coroutine ping-pong against one backend
+ * Returns: ns per switch, or -1 on error
+ */
+double benchmark_pingpong(const coro_backend_t *backend, long long num_switches,
+                          long long warmup_switches);
+
+/*
+ * Baseline primitives (bench_baseline.c), same contract as the coroutine
+ * ping-pong benchmarks: ns per round-trip switch, or -1 on error
+ */
+double benchmark_call(long long num_switches, long long warmup_switches);
+double benchmark_icall(long long num_switches, long long warmup_switches);
+double benchmark_setjmp(long long num_switches, long long warmup_switches);
+double benchmark_condvar(long long num_switches, long long warmup_switches);
+double benchmark_futex(long long num_switches, long long warmup_switches);
+double benchmark_pipe(long long num_switches, long long warmup_switches);
+double benchmark_eventfd(long long num_switches, long long warmup_switches);
+
+/*
+ * Benchmark suites: each sweeps a parameter, prints its own table and
+ * writes <name>_results.txt. With --calibrate, budget_ms is the time
+ * the whole suite should take; suites split it over their points.
+ * Returns: 0 on success, BENCH_SKIPPED if nothing could run (no results
+ *          file written), -1 on error
+ */
+#define BENCH_SKIPPED 1
+
+int bench_scaling(double budget_ms);
+int bench_stackws(double budget_ms);
+int bench_cold(double budget_ms);
+int bench_stacksize(double budget_ms);
+int bench_density(double budget_ms);
+int bench_hugestack(double budget_ms);
+int bench_coloring(double budget_ms);
+int bench_stats(double budget_ms);
+
+/**
+ * Coroutine-local storage vs __thread and pthread keys (bench_cls.c)
+ */
+int bench_cls(double budget_ms);
+
+/**
+ * Handler wake latency under runnable bulk load, per scheduling class (bench_sched.c)
+ */
+int bench_sched(double budget_ms);
+
+/**
+ * Short-coroutine wait next to CPU-bound ones, preemption off vs on (bench_preempt.c)
+ */
+int bench_preempt(double budget_ms);
+
+/**
+ * Cost of coro_maybe_yield() when it does not yield (bench_slice.c)
+ */
+int bench_slice(double budget_ms);
+
+/**
+ * Offload round trip and throughput against concurrency (bench_offload.c)
+ */
+int bench_offload(double budget_ms);
+
+/**
+ * Unmodified blocking echo server on coroutines under LD_PRELOAD hooks (bench_hook.c)
+ */
+int bench_hook(double budget_ms);
+
+/**
+ * Batched vs unbatched coroutine writes over loopback UDP and TCP (bench_batch.c)
+ */
+int bench_batch(double budget_ms);
+
+/**
+ * Blocking vs spinning vs adaptive reactor waits on a loopback ping-pong (bench_busypoll.c)
+ */
+int bench_busypoll(double budget_ms);
+
+/**
+ * Wake latency vs idle CPU of the scheduler idle strategies (bench_idle.c)
+ */
+int bench_idle(double budget_ms);
+
+/**
+ * Sequential vs interleaved prefetching pointer-chasing lookups (bench_interleave.c)
+ */
+int bench_interleave(double budget_ms);
+
+#endif /* BENCH_H */
@@ -0,0 +1,56 @@
+/**
+ * bench_perf.h
+ * Hardware Performance Counter Helper for the Benchmark Suite
+ *
+ * Thin wrapper around perf_event_open(2) counting user-space cache and
+ * TLB misses for the calling thread. Counters that the CPU, kernel or
+ * perf_event_paranoid setting do not allow are reported as unavailable
+ * instead of failing the benchmark.
+ */
+
+#ifndef BENCH_PERF_H
+#define BENCH_PERF_H
+
+#include <stdbool.h>
+
+/* Counters collected around a measured loop */
+typedef enum {
+    BENCH_PERF_L1D_MISS = 0,  /* L1 data cache read misses */
+    BENCH_PERF_LLC_MISS,      /* Last-level cache misses */
+    BENCH_PERF_DTLB_MISS,     /* Data TLB read misses */
+    BENCH_PERF_NUM_COUNTERS
+} bench_perf_counter_t;
+
+/* Open counter set */
+typedef struct {
+    int fd[BENCH_PERF_NUM_COUNTERS];  /* -1 if the counter is unavailable */
+} bench_perf_t;
+
+/**
+ * Open all counters for the calling thread
+ * Returns: number of counters that could be opened (0 if none)
+ */
+int bench_perf_open(bench_perf_t *perf);
+
+/**
+ * Reset and enable all open counters
+ */
+void bench_perf_start(bench_perf_t *perf);
+
+/**
+ * Disable the counters and read them into values[]
+ * Unavailable counters are reported as -1.
+ */
+void bench_perf_stop(bench_perf_t *perf, long long values[BENCH_PERF_NUM_COUNTERS]);
+
+/**
+ * Close all counters
+ */
+void bench_perf_close(bench_perf_t *perf);
+
+/**
+ * Short column name of a counter (e.g. "L1D")
+ */
+const char *bench_perf_name(bench_perf_counter_t counter);
+
+#endif /* BENCH_PERF_H */
@@ -0,0 +1,94 @@
+/**
+ * coro_backend.h
+ * Pluggable Coroutine Backend Interface
+ *
+ * Every coroutine implementation describes itself with a function
+ * table and registers it here, so benchmark scenarios (or any other
+ * client) can be written once and run against every backend.
+ *
+ * Two ways of creating a coroutine are offered:
+ *   - create(): a step function called once per resume; returning 0
+ *     yields, non-zero finishes. Every backend supports this.
+ *   - create_stackful(): a normal function that may call yield() from
+ *     any call depth. Only backends with CORO_BACKEND_CAP_STACKFUL.
+ */
+
+#ifndef CORO_BACKEND_H
+#define CORO_BACKEND_H
+
+#include <stdbool.h>
+
+/* Maximum number of registered backends */
+#define CORO_BACKEND_MAX 16
+
+/* Backend capabilities */
+#define CORO_BACKEND_CAP_STACKFUL   (1u << 0)  /* create_stackful() and yield() */
+#define CORO_BACKEND_CAP_DEEP_STACK (1u << 1)  /* Stacks hold deep calls/large frames */
+
+/* Step function: one unit of work per resume; 0 = yield, non-zero = finished */
+typedef int (*coro_step_fn_t)(void *arg);
+
+/* Entry function of a stackful coroutine */
+typedef void (*coro_entry_fn_t)(void *arg);
+
+/* Per-coroutine accounting (see coro_stats.h) */
+struct coro_stats_counters;
+
+/* Backend function table */
+typedef struct {
+    const char *name;         /* Short name, e.g. "ucontext" (selection, file names) */
+    const char *label;        /* Human-readable name for reports */
+    unsigned int caps;        /* CORO_BACKEND_CAP_* flags */
+    int max_coros;            /* Pool limit */
+    
+    void (*init)(void);
+    void (*cleanup)(void);
+    
+    /* Returns: coroutine ID on success, -1 on failure */
+    int (*create)(coro_step_fn_t step, void *arg);
+    int (*create_stackful)(coro_entry_fn_t func, void *arg);  /* NULL if not stackful */
+    
+    /* Returns: 0 if yielded, 1 if finished, -1 on error */
+    int (*resume)(int coro_id);
+    void (*yield)(void);      /* From a stackful coroutine; NULL if not stackful */
+    void (*destroy)(int coro_id);
+    
+    /* Accounting indexed by coroutine ID, so a scheduler can mark parks and wakes; may be NULL */
+    struct coro_stats_counters *stats;
+} coro_backend_t;
+
+/**
+ * Register a backend
+ * Returns: 0 on success, -1 if the table is full or the name is taken
+ */
+int coro_backend_register(const coro_backend_t *backend);
+
+/**
+ * Register the built-in backends (stackless, ucontext)
+ * Safe to call more than once.
+ */
+void coro_backend_register_builtin(void);
+
+/**
+ * Number of registered backends
+ */
+int coro_backend_count(void);
+
+/**
+ * Get a backend by registration index (NULL if out of range)
+ */
+const coro_backend_t *coro_backend_get(int index);
+
+/**
+ * Find a backend by name (NULL if not registered)
+ */
+const coro_backend_t *coro_backend_find(const char *name);
+
+/**
+ * Check whether a backend has all of the given capabilities
+ */
+static inline bool coro_backend_has(const coro_backend_t *backend, unsigned int caps) {
+    return (backend->caps & caps) == caps;
+}
+
+#endif /* CORO_BACKEND_H */
@@ -0,0 +1,153 @@
+/**
+ * coro_metrics.h
+ * Live Runtime Metrics in Shared Memory
+ *
+ * Every thread has a block of counters in thread-local storage: resumes,
+ * creates and destroys per backend, plus the ucontext stack bytes it
+ * holds. Only the owning thread writes its block, with a plain load and
+ * store (relaxed atomics, no lock prefix), so counting costs the hot
+ * path one add to memory.
+ *
+ * coro_metrics_open() maps a /dev/shm segment and starts a publisher
+ * thread that copies every block into it each interval. Readers (see
+ * scripts/coro_metrics.py) map the segment read-only and take a
+ * consistent snapshot with the seqlock in the header; the runtime never
+ * waits on them. Define CORO_NO_METRICS to compile the counting out.
+ */
+
+#ifndef CORO_METRICS_H
+#define CORO_METRICS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Segment layout; bump CORO_METRICS_VERSION on any change below */
+#define CORO_METRICS_MAGIC 0x5352544d4f524f43ULL   /* "COROMTRS" little-endian */
+#define CORO_METRICS_VERSION 1
+#define CORO_METRICS_MAX_THREADS 64
+
+/* Default publish interval of coro_metrics_open() */
+#define CORO_METRICS_DEFAULT_INTERVAL_MS 100
+
+/* Backends counted (index into the per-backend arrays) */
+typedef enum {
+    CORO_METRICS_STACKLESS = 0,
+    CORO_METRICS_UCONTEXT,
+    CORO_METRICS_NUM_BACKENDS
+} coro_metrics_backend_t;
+
+/* Counters of one backend on one thread (all fields uint64_t) */
+typedef struct {
+    uint64_t resumes;         /* Switches into a coroutine */
+    uint64_t creates;
+    uint64_t destroys;
+    uint64_t stack_bytes;     /* Stack currently allocated (gauge, ucontext only) */
+} coro_metrics_counters_t;
+
+/* Published copy of one thread's block */
+typedef struct {
+    int32_t tid;              /* 0: the summed counts of every exited thread */
+    uint32_t reserved;
+    coro_metrics_counters_t backend[CORO_METRICS_NUM_BACKENDS];
+} coro_metrics_thread_shm_t;
+
+/*
+ * Segment header, followed by max_threads coro_metrics_thread_shm_t.
+ * seq is odd while a publish is in progress: a reader copies the
+ * segment between two reads of an equal, even seq.
+ */
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;     /* sizeof(coro_metrics_shm_t) */
+    uint32_t thread_size;     /* sizeof(coro_metrics_thread_shm_t) */
+    uint32_t max_threads;
+    uint32_t num_backends;
+    int32_t pid;
+    _Atomic uint64_t seq;
+    uint64_t publish_ns;      /* CLOCK_MONOTONIC of the last publish */
+    uint64_t publishes;
+    uint32_t num_threads;     /* Thread blocks in use */
+    uint32_t interval_ms;
+    uint64_t capacity[CORO_METRICS_NUM_BACKENDS];  /* Pool slots per backend */
+} coro_metrics_shm_t;
+
+/* Live counters of one backend (the owner stores, the publisher loads) */
+typedef struct {
+    _Atomic uint64_t resumes;
+    _Atomic uint64_t creates;
+    _Atomic uint64_t destroys;
+    _Atomic uint64_t stack_bytes;
+} coro_metrics_live_t;
+
+/* Live counters of one thread */
+typedef struct coro_metrics_thread {
+    coro_metrics_live_t backend[CORO_METRICS_NUM_BACKENDS];
+    int32_t tid;
+    bool attached;            /* Attach done (listed unless the list was full) */
+    struct coro_metrics_thread *next;
+} coro_metrics_thread_t;
+
+/*
+ * The calling thread's block. Creating a coroutine attaches it to the
+ * published list; on thread exit its final counts are added to the
+ * retired entry (tid 0) and its slot is freed.
+ */
+extern _Thread_local coro_metrics_thread_t coro_metrics_thread;
+
+/**
+ * Put the calling thread's block on the published list (used by the backends)
+ * Threads beyond CORO_METRICS_MAX_THREADS - 1 live ones (a slot is kept for
+ * the retired entry) count but are not published.
+ */
+void coro_metrics_attach(void);
+
+/**
+ * Create /dev/shm/<name> and publish into it every interval_ms
+ * name must start with '/'; NULL picks "/coro-metrics.<pid>".
+ * Returns: 0 on success, -1 on error
+ */
+int coro_metrics_open(const char *name, int interval_ms);
+
+/**
+ * Publish immediately (also done by the publisher thread)
+ */
+void coro_metrics_publish(void);
+
+/**
+ * Publish once more, stop the publisher and unlink the segment
+ */
+void coro_metrics_close(void);
+
+/**
+ * Name of the open segment, or NULL
+ */
+const char *coro_metrics_name(void);
+
+/**
+ * Add delta to a counter owned by the calling thread (no read-modify-write)
+ */
+static inline void coro_metrics_add(_Atomic uint64_t *counter, int64_t delta) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) +
+                          (uint64_t)delta, memory_order_relaxed);
+}
+
+/* Count on the calling thread, e.g. CORO_METRICS_COUNT(CORO_METRICS_UCONTEXT, resumes, 1) */
+#ifndef CORO_NO_METRICS
+#define CORO_METRICS_COUNT(b, field, delta) \
+    coro_metrics_add(&coro_metrics_thread.backend[(b)].field, (delta))
+#else
+#define CORO_METRICS_COUNT(b, field, delta) ((void)0)
+#endif
+
+/**
+ * Attach the calling thread on its first coroutine create
+ */
+static inline void coro_metrics_attach_once(void) {
+    if (__builtin_expect(!coro_metrics_thread.attached, 0)) {
+        coro_metrics_attach();
+    }
+}
+
+#endif /* CORO_METRICS_H */
@@ -0,0 +1,70 @@
+/**
+ * coro_offload.h
+ * Blocking-Call Offload Pool
+ *
+ * Runs calls that cannot be made asynchronous (getaddrinfo, compression,
+ * stat on a slow disk) on a fixed pool of helper threads, so they stall
+ * only the coroutine that made them. The calling coroutine is parked on
+ * its scheduler (see coro_sched.h) and woken on its home thread when
+ * the call returns.
+ *
+ * Stackful coroutines use coro_run_blocking(). Step functions (any
+ * backend) submit a job and return 0; their next step sees the result.
+ */
+
+#ifndef CORO_OFFLOAD_H
+#define CORO_OFFLOAD_H
+
+#include "coro_sched.h"
+
+/* Helper thread limits */
+#define CORO_OFFLOAD_MAX_THREADS 64
+#define CORO_OFFLOAD_DEFAULT_THREADS 4
+
+/* Call run on a helper thread */
+typedef void *(*coro_offload_fn_t)(void *arg);
+
+/* One offloaded call, owned by the submitting coroutine until it is woken */
+typedef struct coro_offload_job {
+    coro_sched_remote_t remote;       /* Wakes the submitter */
+    coro_sched_t *home;               /* Submitter's scheduler */
+    coro_offload_fn_t fn;
+    void *arg;
+    void *result;                     /* fn's return value, set before the wake */
+    struct coro_offload_job *next;    /* Pool queue */
+} coro_offload_job_t;
+
+/**
+ * Start the helper threads (0 = CORO_OFFLOAD_DEFAULT_THREADS)
+ * Returns: 0 on success, -1 if already started or no thread could start
+ */
+int coro_offload_start(int threads);
+
+/**
+ * Finish the queued calls and join the helper threads
+ */
+void coro_offload_stop(void);
+
+/**
+ * Number of helper threads running
+ */
+int coro_offload_threads(void);
+
+/**
+ * Queue fn(arg) and park the running coroutine until it has returned
+ * Must be called from a scheduler step; a step function then returns 0
+ * and reads job->result in its next step.
+ * Returns: 0 on success, -1 if not in a step or the pool is not started
+ */
+int coro_offload_submit(coro_offload_job_t *job, coro_offload_fn_t fn, void *arg);
+
+/**
+ * Run fn(arg) on a helper thread from a stackful coroutine, yielding
+ * until it returns
+ * Outside a stackful scheduler step, or without a started pool, fn runs
+ * inline on the calling thread.
+ * Returns: fn's return value
+ */
+void *coro_run_blocking(coro_offload_fn_t fn, void *arg);
+
+#endif /* CORO_OFFLOAD_H */
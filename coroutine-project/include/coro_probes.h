@@ -0,0 +1,81 @@
+/**
+ * coro_probes.h
+ * USDT Static Probe Points
+ *
+ * Probes for bpftrace, perf and SystemTap at coroutine create, resume,
+ * yield, finish and destroy. Each probe is a single nop plus an ELF
+ * note (.note.stapsdt) describing where its arguments live, so it costs
+ * nothing until a tracer attaches and patches the nop.
+ *
+ * Providers are coro_stackless and coro_ucontext:
+ *   create(id, func, arg)   resume(id)   yield(id)   finish(id)   destroy(id)
+ *
+ *   bpftrace -e 'usdt:./bin/bench:coro_ucontext:resume { @[arg0] = count(); }'
+ *
+ * <sys/sdt.h> is used when available. Otherwise the note is emitted
+ * here, in the same format, on 64-bit targets. Define CORO_NO_PROBES
+ * to compile every probe out.
+ */
+
+#ifndef CORO_PROBES_H
+#define CORO_PROBES_H
+
+#if defined(CORO_NO_PROBES)
+
+#define CORO_PROBE1(provider, name, a1) ((void)0)
+#define CORO_PROBE3(provider, name, a1, a2, a3) ((void)0)
+
+#elif defined(__has_include) && __has_include(<sys/sdt.h>)
+
+#include <sys/sdt.h>
+#define CORO_PROBE1(provider, name, a1) DTRACE_PROBE1(provider, name, a1)
+#define CORO_PROBE3(provider, name, a1, a2, a3) DTRACE_PROBE3(provider, name, a1, a2, a3)
+
+#elif defined(__GNUC__) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+
+/*
+ * Minimal stapsdt v3 note: probe address, shared base address, no
+ * semaphore, then provider, name and argument specs ("SIZE@OPERAND";
+ * a negative size is signed). Operands use the "nor" constraint so the
+ * compiler leaves each argument wherever it already is.
+ */
+#define CORO_PROBE_ASM(provider, name, args, ...) \
+    __asm__ __volatile__ ( \
+        "990: nop\n" \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+        ".balign 4\n" \
+        ".4byte 992f-991f, 994f-993f, 3\n" \
+        "991: .asciz \"stapsdt\"\n" \
+        "992: .balign 4\n" \
+        "993: .8byte 990b\n" \
+        ".8byte _.stapsdt.base\n" \
+        ".8byte 0\n" \
+        ".asciz \"" #provider "\"\n" \
+        ".asciz \"" #name "\"\n" \
+        ".asciz \"" args "\"\n" \
+        "994: .balign 4\n" \
+        ".popsection\n" \
+        ".ifndef _.stapsdt.base\n" \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n" \
+        ".hidden _.stapsdt.base\n" \
+        "_.stapsdt.base: .space 1\n" \
+        ".size _.stapsdt.base, 1\n" \
+        ".popsection\n" \
+        ".endif\n" \
+        :: __VA_ARGS__)
+
+#define CORO_PROBE1(provider, name, a1) \
+    CORO_PROBE_ASM(provider, name, "-4@%0", "nor"((int)(a1)))
+#define CORO_PROBE3(provider, name, a1, a2, a3) \
+    CORO_PROBE_ASM(provider, name, "-4@%0 8@%1 8@%2", \
+                   "nor"((int)(a1)), "nor"((unsigned long)(a2)), "nor"((unsigned long)(a3)))
+
+#else
+
+#define CORO_PROBE1(provider, name, a1) ((void)0)
+#define CORO_PROBE3(provider, name, a1, a2, a3) ((void)0)
+
+#endif
+
+#endif /* CORO_PROBES_H */
@@ -0,0 +1,195 @@
+/**
+ * coro_reactor.h
+ * I/O Reactor and Blocking-Call Hooks
+ *
+ * An epoll reactor that drives a scheduler (see coro_sched.h) on one
+ * thread. A stackful coroutine that would block on a descriptor or a
+ * sleep parks on its scheduler and yields; the reactor wakes it when
+ * epoll reports the descriptor ready or its timer expires.
+ *
+ * coro_io_read() and the other coro_io_ calls have the signatures and
+ * blocking semantics of their libc namesakes. Inside a stackful
+ * coroutine run by coro_reactor_run() they wait on the reactor; anywhere
+ * else they make the plain system call. lib/libcoro_hook.so, loaded
+ * with LD_PRELOAD, sends the libc calls of unmodified code to them
+ * through coro_io_hooks (see coro_hook.c).
+ *
+ * A descriptor first used from a coroutine is switched to O_NONBLOCK
+ * and registered edge-triggered with that reactor. Its blocking
+ * behaviour is kept for the program: outside coroutines a call that gets
+ * EAGAIN waits in ppoll() and retries. Descriptors the program made
+ * non-blocking itself keep returning EAGAIN. coro_io_close() clears the
+ * flag again before closing, and descriptors still open at exit() get
+ * it cleared then, so a shared file description (a terminal, an
+ * inherited pipe) is not left non-blocking. Each descriptor should be
+ * used by one reactor thread at a time, and closed with coro_io_close()
+ * (close() under the shim) so its state is reset before the number is
+ * reused.
+ *
+ * With batching on (coro_reactor_set_batching), a coroutine's write or
+ * sendto on such a descriptor is queued and the coroutine parked. At the
+ * end of each pass the reactor flushes every descriptor's queue with one
+ * writev() (streams) or sendmmsg() (datagram sockets) per
+ * CORO_IO_BATCH_MAX messages, and resumes each writer with its result.
+ * Batched writes are all-or-error: a partial writev() keeps the rest
+ * queued until the descriptor is writable again.
+ *
+ * When nothing is runnable the reactor blocks in epoll_wait() by default.
+ * coro_reactor_set_polling() makes it first poll without waiting for a
+ * bounded time, which saves the sleep and wakeup when the next event is
+ * near. The adaptive mode sizes that budget from recent idle gaps, the
+ * way KVM's halt polling does: it doubles after a wait the budget just
+ * missed and halves after one no affordable spin would have caught.
+ */
+
+#ifndef CORO_REACTOR_H
+#define CORO_REACTOR_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "coro_sched.h"
+
+/* Descriptors with reactor state; higher ones are passed through */
+#define CORO_IO_MAX_FDS (64 * 1024)
+
+/* epoll events collected per reactor poll */
+#define CORO_REACTOR_EVENTS 256
+
+/* Messages per writev()/sendmmsg() when flushing batched writes */
+#define CORO_IO_BATCH_MAX 256
+
+/* First adaptive spin budget; below it the budget drops to 0 */
+#define CORO_REACTOR_SPIN_START_NS 2000ULL
+
+/* Symbol lib/libcoro_hook.so looks up, and the table layout it expects */
+#define CORO_IO_HOOKS_SYMBOL "coro_io_hooks"
+#define CORO_IO_HOOKS_VERSION 1
+
+/* Timer of a waiting coroutine, on its stack while it waits */
+typedef struct {
+    uint64_t deadline_ns;     /* Absolute coro_sched_now_ns() time */
+    int id;                   /* Coroutine to wake */
+    int heap_index;           /* Position in the timer heap, -1 = not queued */
+} coro_io_timer_t;
+
+/* How coro_reactor_poll() waits when nothing is runnable */
+typedef enum {
+    CORO_POLL_BLOCK = 0,      /* Block in epoll_wait() at once */
+    CORO_POLL_SPIN,           /* Poll for up to spin_max_ns, then block */
+    CORO_POLL_ADAPTIVE        /* Poll for an adapted budget of up to spin_max_ns, then block */
+} coro_poll_mode_t;
+
+/* Reactor for one scheduler */
+typedef struct {
+    coro_sched_t *sched;
+    int epfd;
+    int wake_fd;                      /* eventfd written by remote wakes */
+    coro_io_timer_t **timers;         /* Min-heap by deadline */
+    int num_timers;
+    int max_timers;
+    long long waits;                  /* Coroutine waits on a descriptor or timer */
+    long long polls;                  /* epoll_wait() calls */
+    bool batch_writes;                /* Queue coroutine writes until the end of the pass */
+    int dirty;                        /* First descriptor with queued writes, -1 = none */
+    long long write_calls;            /* write/sendto/writev/sendmmsg calls for coroutines */
+    long long writes;                 /* Coroutine writes and datagrams completed */
+    coro_poll_mode_t poll_mode;
+    uint64_t spin_max_ns;             /* Spin budget limit */
+    uint64_t spin_ns;                 /* Current spin budget */
+    long long spins;                  /* Waits that began by spinning */
+    long long spin_hits;              /* ...and ended with an event before the budget ran out */
+    long long blocks;                 /* Waits that blocked in epoll_wait() */
+} coro_reactor_t;
+
+/* Reactor running on this thread (NULL = none) */
+extern _Thread_local coro_reactor_t *coro_reactor_current;
+
+/* Entry points of lib/libcoro_hook.so */
+typedef struct {
+    int version;                      /* CORO_IO_HOOKS_VERSION */
+    void (*attach)(void);             /* Called once when the shim finds the table */
+    ssize_t (*read)(int fd, void *buf, size_t count);
+    ssize_t (*write)(int fd, const void *buf, size_t count);
+    int (*connect)(int fd, const struct sockaddr *addr, socklen_t len);
+    int (*accept)(int fd, struct sockaddr *addr, socklen_t *len);
+    int (*poll)(struct pollfd *fds, nfds_t nfds, int timeout_ms);
+    int (*usleep)(useconds_t usec);
+    int (*close)(int fd);
+} coro_io_hooks_t;
+
+extern const coro_io_hooks_t coro_io_hooks;
+
+/**
+ * Create the epoll instance for s and take over its remote wakes
+ * Returns: 0 on success, -1 on failure
+ */
+int coro_reactor_init(coro_reactor_t *r, coro_sched_t *s);
+
+/**
+ * Close the epoll instance and give s back its futex wakes
+ */
+void coro_reactor_cleanup(coro_reactor_t *r);
+
+/**
+ * Coalesce the writes coroutines make in one pass (off by default)
+ * Writes already queued are still flushed after turning it off.
+ */
+void coro_reactor_set_batching(coro_reactor_t *r, bool on);
+
+/**
+ * Choose how the reactor waits when idle; spin_max_ns bounds the spin
+ * (ignored for CORO_POLL_BLOCK). The adaptive budget starts at 0.
+ */
+void coro_reactor_set_polling(coro_reactor_t *r, coro_poll_mode_t mode, uint64_t spin_max_ns);
+
+/**
+ * Run the scheduler until every coroutine has finished
+ * Each pass runs the coroutines runnable at its start, flushes batched
+ * writes, then collects I/O readiness and expired timers: without
+ * waiting if something is still runnable, otherwise until the next
+ * event or timer.
+ * Returns: steps run, or -1 on error
+ */
+long long coro_reactor_run(coro_reactor_t *r);
+
+/**
+ * Wait up to timeout_ms (-1 = until the next event or timer) for I/O,
+ * spinning first if the poll mode says so, then wake the coroutines
+ * whose descriptors are ready or timers expired
+ * Returns: epoll events handled, or -1 on error
+ */
+int coro_reactor_poll(coro_reactor_t *r, int timeout_ms);
+
+/**
+ * Check that the caller is a stackful coroutine run by coro_reactor_run()
+ */
+bool coro_io_in_coroutine(void);
+
+/**
+ * Park the running coroutine until fd has one of events (POLLIN/POLLOUT)
+ * or timeout_ms passes (-1 = no timeout)
+ * Returns: 1 if ready (or may be), 0 on timeout, -1 outside a reactor coroutine
+ */
+int coro_io_wait(int fd, short events, int timeout_ms);
+
+/* Blocking calls with libc semantics (see the file comment) */
+ssize_t coro_io_read(int fd, void *buf, size_t count);
+ssize_t coro_io_write(int fd, const void *buf, size_t count);
+int coro_io_connect(int fd, const struct sockaddr *addr, socklen_t len);
+int coro_io_accept(int fd, struct sockaddr *addr, socklen_t *len);
+int coro_io_poll(struct pollfd *fds, nfds_t nfds, int timeout_ms);
+int coro_io_usleep(useconds_t usec);
+int coro_io_close(int fd);
+ssize_t coro_io_sendto(int fd, const void *buf, size_t len, int flags,
+                       const struct sockaddr *addr, socklen_t addr_len);
+
+/**
+ * Check whether lib/libcoro_hook.so has attached to coro_io_hooks
+ */
+bool coro_io_hooks_attached(void);
+
+#endif /* CORO_REACTOR_H */
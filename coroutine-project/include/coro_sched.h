@@ -0,0 +1,289 @@
+/**
+ * coro_sched.h
+ * Priority and Deadline Scheduler
+ *
+ * A run loop over the coroutines of one backend (see coro_backend.h).
+ * Runnable coroutines wait in one of two kinds of class:
+ *   - the deadline class, earliest deadline first (a binary heap)
+ *   - CORO_SCHED_PRIORITIES FIFO priority classes, 0 the highest
+ * The deadline class runs before every priority class. Enqueue is O(1)
+ * into a priority class and O(log n) into the deadline class; picking
+ * the next coroutine is a bitmap scan or a heap pop.
+ *
+ * A coroutine that yields goes to the back of its class. One that calls
+ * coro_sched_park() during its step waits until coro_sched_wake().
+ * Coroutines that finish are destroyed by the scheduler.
+ *
+ * With a time slice set (coro_sched_set_slice), long-running coroutines
+ * call coro_maybe_yield() or CORO_STEP_MAYBE_YIELD() in their loops; these
+ * yield only once the slice is used up and another coroutine is ready.
+ *
+ * Only the home thread (the one calling coro_sched_run_one) touches a
+ * scheduler, except for coro_sched_wake_remote(), which other threads
+ * use to wake a parked coroutine.
+ *
+ * A home thread with every coroutine parked waits for a remote wake in
+ * coro_sched_wait_remote(). By default it sleeps on a futex at once;
+ * coro_sched_set_idle() trades CPU for wake latency by spinning on the
+ * inbox first (see coro_sched_idle_t).
+ */
+
+#ifndef CORO_SCHED_H
+#define CORO_SCHED_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "coro_backend.h"
+#include "coro_trace.h"
+
+/* FIFO priority classes (0 = highest) */
+#define CORO_SCHED_PRIORITIES 8
+
+/* coro_sched_should_yield() calls per clock read (override with -D; 1 = every call) */
+#ifndef CORO_SCHED_CLOCK_STRIDE
+#define CORO_SCHED_CLOCK_STRIDE 16
+#endif
+
+/* First adaptive idle spin budget; below it the budget drops to 0 */
+#define CORO_SCHED_SPIN_START_NS 2000ULL
+
+/* Class of coroutines scheduled by deadline */
+#define CORO_SCHED_DEADLINE (-1)
+
+/* Scheduling state of a coroutine */
+typedef enum {
+    CORO_SCHED_FREE = 0,      /* Not managed by this scheduler */
+    CORO_SCHED_READY,         /* Queued in its class */
+    CORO_SCHED_RUNNING,       /* Inside its step */
+    CORO_SCHED_PARKED         /* Waiting for coro_sched_wake() */
+} coro_sched_state_t;
+
+/* How coro_sched_wait_remote() waits for a remote wake */
+typedef enum {
+    CORO_IDLE_PARK = 0,       /* Sleep on the futex at once */
+    CORO_IDLE_SPIN,           /* Spin on the inbox, never sleep */
+    CORO_IDLE_SPIN_YIELD,     /* Spin for spin_max_ns, then sched_yield() until woken */
+    CORO_IDLE_SPIN_PARK       /* Spin for an adapted budget of up to spin_max_ns, then sleep */
+} coro_sched_idle_t;
+
+/* Per-coroutine scheduling data, indexed by coroutine ID */
+typedef struct {
+    int next;                 /* Next in its FIFO class, -1 = last */
+    int heap_index;           /* Position in the deadline heap */
+    int8_t priority;          /* 0..CORO_SCHED_PRIORITIES-1 or CORO_SCHED_DEADLINE */
+    uint8_t state;            /* coro_sched_state_t */
+    uint64_t deadline_ns;     /* Absolute coro_sched_now_ns() deadline */
+} coro_sched_task_t;
+
+/* Wake request from another thread, owned by the coroutine it wakes */
+typedef struct coro_sched_remote {
+    struct coro_sched_remote *next;
+    int id;                   /* Coroutine to wake */
+} coro_sched_remote_t;
+
+/* Rouses a home thread that sleeps somewhere other than the futex */
+typedef void (*coro_sched_notify_fn_t)(void *ctx);
+
+/* One FIFO priority class */
+typedef struct {
+    int head;
+    int tail;
+} coro_sched_fifo_t;
+
+/* Scheduler for one backend on one thread */
+typedef struct {
+    const coro_backend_t *backend;
+    coro_sched_task_t *tasks;         /* backend->max_coros entries */
+    coro_sched_fifo_t fifo[CORO_SCHED_PRIORITIES];
+    unsigned int nonempty;            /* Bit p set while fifo[p] has coroutines */
+    int *heap;                        /* Deadline class, min-heap of coroutine IDs */
+    int heap_size;
+    int ready;                        /* Runnable coroutines in all classes */
+    int live;                         /* Coroutines created and not finished */
+    int current;                      /* Coroutine inside its step, -1 = none */
+    bool park_current;                /* coro_sched_park() called by current */
+    uint64_t slice_ticks;             /* coro_trace_clock() ticks per slice, 0 = no slices */
+    _Atomic(coro_sched_remote_t *) inbox;  /* Remote wakes, newest first */
+    atomic_int sleeping;              /* Home thread waits in coro_sched_wait_remote() */
+    coro_sched_notify_fn_t notify;    /* Replaces the futex wake when set */
+    void *notify_ctx;
+    coro_sched_idle_t idle;
+    uint64_t spin_max_ns;             /* Idle spin limit */
+    uint64_t spin_ns;                 /* Current CORO_IDLE_SPIN_PARK budget */
+    long long idle_waits;             /* coro_sched_wait_remote() calls that waited */
+    long long idle_hits;              /* ...and were woken while spinning */
+} coro_sched_t;
+
+/* Scheduler running a step on this thread (NULL = none), its slice end,
+ * and checks left before the next clock read */
+extern _Thread_local coro_sched_t *coro_sched_running;
+extern _Thread_local uint64_t coro_sched_slice_end;
+extern _Thread_local int coro_sched_clock_countdown;
+
+/**
+ * Monotonic time in nanoseconds (the clock deadlines are given in)
+ */
+static inline uint64_t coro_sched_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Initialize a scheduler and its backend
+ * Returns: 0 on success, -1 if out of memory
+ */
+int coro_sched_init(coro_sched_t *s, const coro_backend_t *backend);
+
+/**
+ * Destroy every coroutine still managed, free the scheduler and clean
+ * up the backend
+ */
+void coro_sched_cleanup(coro_sched_t *s);
+
+/**
+ * Create a runnable coroutine in priority class priority
+ * Returns: coroutine ID on success, -1 on failure
+ */
+int coro_sched_spawn(coro_sched_t *s, coro_step_fn_t step, void *arg, int priority);
+
+/**
+ * Create a runnable coroutine in the deadline class
+ * Returns: coroutine ID on success, -1 on failure
+ */
+int coro_sched_spawn_deadline(coro_sched_t *s, coro_step_fn_t step, void *arg,
+                              uint64_t deadline_ns);
+
+/**
+ * Park the running coroutine once its current step returns
+ * Only valid from inside a step run by s.
+ */
+void coro_sched_park(coro_sched_t *s);
+
+/**
+ * Make a parked coroutine runnable again in its class
+ * Waking a runnable coroutine does nothing; waking the running one
+ * cancels its park.
+ * Returns: 0 on success, -1 if id is not managed by s
+ */
+int coro_sched_wake(coro_sched_t *s, int id);
+
+/**
+ * Wake a parked (or the running) coroutine into the deadline class with
+ * a new deadline; a runnable deadline coroutine just moves in the heap
+ * Returns: 0 on success, -1 if id is not managed by s or is queued in a
+ * priority class
+ */
+int coro_sched_wake_deadline(coro_sched_t *s, int id, uint64_t deadline_ns);
+
+/**
+ * Run the next coroutine for one step
+ * Remote wakes that have arrived are applied first.
+ * Returns: 1 if a coroutine ran, 0 if none was runnable, -1 on error
+ */
+int coro_sched_run_one(coro_sched_t *s);
+
+/**
+ * Run until no coroutine is runnable
+ * Returns: steps run, or -1 on error
+ */
+long long coro_sched_run(coro_sched_t *s);
+
+/**
+ * Run until every coroutine has finished, sleeping while all of them
+ * are parked until a remote wake arrives
+ * A coroutine parked with no wake coming keeps this waiting forever.
+ * Returns: steps run, or -1 on error
+ */
+long long coro_sched_run_all(coro_sched_t *s);
+
+/**
+ * Wake a parked coroutine of s from any thread
+ * node->id must be set; node must stay valid until the coroutine runs.
+ * The wake is applied on the home thread at its next step.
+ */
+void coro_sched_wake_remote(coro_sched_t *s, coro_sched_remote_t *node);
+
+/**
+ * Have remote wakes call fn(ctx) instead of the futex wake when the home
+ * thread is sleeping (fn = NULL restores the futex)
+ * For a home thread that waits in its own poll loop (see coro_reactor.h):
+ * it sets s->sleeping to 1 and rechecks s->inbox before blocking.
+ */
+void coro_sched_set_notify(coro_sched_t *s, coro_sched_notify_fn_t fn, void *ctx);
+
+/**
+ * Apply the remote wakes that have arrived (home thread only)
+ * Returns: number of wakes applied
+ */
+int coro_sched_poll_remote(coro_sched_t *s);
+
+/**
+ * Wait until a remote wake arrives (home thread only), as set by
+ * coro_sched_set_idle()
+ */
+void coro_sched_wait_remote(coro_sched_t *s);
+
+/**
+ * Choose how the home thread waits for remote wakes; spin_max_ns bounds
+ * the spin of CORO_IDLE_SPIN_YIELD and CORO_IDLE_SPIN_PARK
+ * CORO_IDLE_SPIN_PARK adapts its budget like the reactor's adaptive
+ * polling (coro_reactor.h): it doubles, from CORO_SCHED_SPIN_START_NS,
+ * after a sleep that ended within spin_max_ns and halves after a longer
+ * one. The budget starts at 0. A reactor's home thread waits in
+ * epoll_wait() instead; see coro_reactor_set_polling().
+ */
+void coro_sched_set_idle(coro_sched_t *s, coro_sched_idle_t idle, uint64_t spin_max_ns);
+
+/**
+ * Number of runnable coroutines
+ */
+static inline int coro_sched_ready_count(const coro_sched_t *s) {
+    return s->ready;
+}
+
+/**
+ * Give each step a time slice of slice_us, measured from its resume
+ * 0 (the default) turns slices off: coro_maybe_yield() never yields.
+ */
+void coro_sched_set_slice(coro_sched_t *s, int slice_us);
+
+/**
+ * Check whether the running coroutine should give up the thread: its
+ * slice is used up and another coroutine is ready
+ * The ready count is checked first, so with nothing else runnable the
+ * clock is not read. Otherwise the clock is read on every
+ * CORO_SCHED_CLOCK_STRIDE-th call, so a slice can overrun by that many
+ * calls. Outside a scheduler step this is always false.
+ */
+static inline bool coro_sched_should_yield(void) {
+    coro_sched_t *s = coro_sched_running;
+    if (!s || s->ready == 0 || --coro_sched_clock_countdown > 0) {
+        return false;
+    }
+    coro_sched_clock_countdown = CORO_SCHED_CLOCK_STRIDE;
+    return coro_trace_clock() >= coro_sched_slice_end;
+}
+
+/**
+ * Yield from a stackful coroutine if coro_sched_should_yield()
+ * Callable at any call depth. On a backend without yield() (stackless)
+ * nothing is switched; the step itself must return 0.
+ * Returns: true if the coroutine should have yielded or did
+ */
+static inline bool coro_maybe_yield(void) {
+    if (__builtin_expect(!coro_sched_should_yield(), 1)) {
+        return false;
+    }
+    if (coro_sched_running->backend->yield) {
+        coro_sched_running->backend->yield();
+    }
+    return true;
+}
+
+/* In a step function on any backend: end the step early if the slice is up */
+#define CORO_STEP_MAYBE_YIELD() do { if (coro_sched_should_yield()) return 0; } while (0)
+
+#endif /* CORO_SCHED_H */
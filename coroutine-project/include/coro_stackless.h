@@ -5,6 +5,12 @@
  * This library implements user-space coroutines without maintaining separate stacks.
  * Instead, it uses a state machine approach where each coroutine remembers its 
  * execution state and resumes from that point.
+ *
+ * Because a switch costs a few nanoseconds, well under a cache miss, a
+ * batch of coroutines doing independent lookups can hide memory latency:
+ * each prefetches the line it needs next and yields (CORO_YIELD_PREFETCH)
+ * while coro_stackless_interleave() runs the rest of the batch, and by
+ * the time its turn comes round again the line has arrived.
  */
 
 #ifndef CORO_STACKLESS_H
@@ -12,9 +18,17 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include "coro_backend.h"
+#include "coro_trace.h"
+#include "coro_stats.h"
+#include "coro_probes.h"
+#include "coro_metrics.h"
+#include "coro_sched.h"
 
-/* Maximum number of coroutines that can be managed */
-#define MAX_COROUTINES 1024
+/* Maximum number of coroutines that can be managed (override with -D) */
+#ifndef MAX_COROUTINES
+#define MAX_COROUTINES (1024 * 1024)
+#endif
 
 /* Coroutine states */
 typedef enum {
@@ -75,9 +89,107 @@ void coro_stackless_cleanup(void);
  */
 coro_state_t coro_stackless_get_state(int coro_id);
 
+/**
+ * Get a coroutine's run time, resume count and ready-to-run wait
+ * Only counted while coro_stats_enable(true) is in effect.
+ * Returns: 0 on success, -1 if coro_id is not a live coroutine
+ */
+int coro_stackless_get_stats(int coro_id, coro_stats_t *out);
+
+/**
+ * Resume the coroutines in ids round-robin until all have finished
+ * Each pass resumes every unfinished one once, in order. ids is used as
+ * the work list: finished coroutines are removed by moving the rest
+ * down, so its contents are undefined afterwards.
+ * Returns: resumes made
+ */
+long long coro_stackless_interleave(int *ids, int count);
+
+/* Backend descriptor for the registry (see coro_backend.h) */
+extern const coro_backend_t coro_stackless_backend;
+
+/* ============================================================
+ * INLINE FAST PATH
+ * ============================================================ */
+
+/* Library state, exported only for the inline functions below */
+extern coro_stackless_t coro_stackless_pool[MAX_COROUTINES];
+extern coro_func_t coro_stackless_funcs[MAX_COROUTINES];
+extern void *coro_stackless_args[MAX_COROUTINES];
+extern int coro_stackless_current;
+extern coro_stats_counters_t coro_stackless_stats[MAX_COROUTINES];
+
+/* Resume with run time accounting (out of line, see coro_stats.h) */
+int coro_stackless_resume_accounted(int coro_id);
+
+/**
+ * Resume a coroutine without leaving the caller's translation unit
+ * coro_id must be a live ID returned by coro_stackless_create(); it is
+ * not range or liveness checked (coro_stackless_resume() does that).
+ * Returns: 0 if coroutine yielded, 1 if finished
+ */
+static inline int coro_stackless_resume_fast(int coro_id) {
+    coro_stackless_t *coro = &coro_stackless_pool[coro_id];
+    
+    if (__builtin_expect(coro->state == CORO_STATE_FINISHED, 0)) {
+        return 1;
+    }
+    CORO_METRICS_COUNT(CORO_METRICS_STACKLESS, resumes, 1);
+    if (__builtin_expect(coro_stats_enabled, 0)) {
+        return coro_stackless_resume_accounted(coro_id);
+    }
+    
+    /* Save previous coroutine context */
+    int prev_coro = coro_stackless_current;
+    coro_stackless_current = coro_id;
+    
+    /* Execute the coroutine function */
+    CORO_PROBE1(coro_stackless, resume, coro_id);
+    CORO_TRACE_EVENT(CORO_TRACE_STACKLESS, CORO_TRACE_RESUME, coro_id);
+    coro->state = CORO_STATE_RUNNING;
+    coro_stackless_funcs[coro_id](coro, coro_stackless_args[coro_id]);
+    
+    /* Check final state */
+    if (coro->state == CORO_STATE_RUNNING) {
+        coro->state = CORO_STATE_SUSPENDED;
+    }
+    if (coro->state == CORO_STATE_FINISHED) {
+        CORO_PROBE1(coro_stackless, finish, coro_id);
+    } else {
+        CORO_PROBE1(coro_stackless, yield, coro_id);
+    }
+    CORO_TRACE_EVENT(CORO_TRACE_STACKLESS, coro->state == CORO_STATE_FINISHED ?
+                     CORO_TRACE_FINISH : CORO_TRACE_YIELD, coro_id);
+    
+    /* Restore previous context */
+    coro_stackless_current = prev_coro;
+    
+    return (coro->state == CORO_STATE_FINISHED) ? 1 : 0;
+}
+
+/**
+ * Inline version of coro_stackless_yield()
+ */
+static inline void coro_stackless_yield_fast(coro_stackless_t *coro) {
+    coro->state = CORO_STATE_SUSPENDED;
+}
+
 /* Macros for implementing state machine logic in coroutines */
 #define CORO_BEGIN(coro) switch((coro)->resume_point) { case 0:
 #define CORO_YIELD(coro) do { (coro)->resume_point = __LINE__; return; case __LINE__:; } while(0)
 #define CORO_END(coro) } (coro)->state = CORO_STATE_FINISHED
 
+/*
+ * Yield only once the scheduler's time slice is used up and another
+ * coroutine is ready. Slices belong to coro_sched: this only yields in a
+ * native coroutine resumed from a scheduler step. Under a direct
+ * coro_stackless_resume() or coro_stackless_interleave() there is no
+ * slice and it never yields.
+ */
+#define CORO_MAYBE_YIELD(coro) do { if (coro_sched_should_yield()) CORO_YIELD(coro); } while(0)
+
+/* Prefetch addr for reading, then yield; the access belongs after it */
+#define CORO_YIELD_PREFETCH(coro, addr) \
+    do { __builtin_prefetch((addr), 0, 3); CORO_YIELD(coro); } while(0)
+
 #endif /* CORO_STACKLESS_H */
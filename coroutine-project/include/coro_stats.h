@@ -0,0 +1,145 @@
+/**
+ * coro_stats.h
+ * Per-Coroutine Run Time and Scheduling Latency Accounting
+ *
+ * With accounting enabled, every resume records how long the coroutine
+ * ran and how long it waited since it last became ready (created,
+ * yielded back to its resumer, or woken by a scheduler after a park). Counters are kept per coroutine and
+ * summed per entry function, so hogs (long runs) and starved coroutines
+ * (long waits) can be found at runtime.
+ *
+ * Timestamps come from coro_trace_clock() (the TSC on x86) and are
+ * converted to nanoseconds when queried. Accounting is off by default;
+ * while off, a resume pays one predicted branch.
+ */
+
+#ifndef CORO_STATS_H
+#define CORO_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "coro_trace.h"
+
+/* Entry functions tracked per process; later ones are only counted per coroutine */
+#define CORO_STATS_MAX_FUNCS 64
+
+/* Generic entry function pointer (cast from coro_func_t, ucoro_func_t, ...) */
+typedef void (*coro_stats_func_t)(void);
+
+/* Raw counters, in coro_trace_clock() ticks */
+typedef struct coro_stats_counters {
+    long long resumes;
+    uint64_t run_ticks;       /* Total time running */
+    uint64_t max_run_ticks;   /* Longest single run */
+    uint64_t wait_ticks;      /* Total time ready but not running */
+    uint64_t max_wait_ticks;  /* Longest single wait */
+    uint64_t ready_since;     /* When the coroutine last became ready, 0 = not ready */
+    struct coro_stats_counters *func_stats;  /* Entry function totals, or NULL */
+} coro_stats_counters_t;
+
+/* Counters converted for reporting */
+typedef struct {
+    coro_stats_func_t func;   /* Entry function (per-function queries only) */
+    const char *backend;      /* Backend name (per-function queries only) */
+    long long coroutines;     /* Coroutines started from func (per-function queries only) */
+    long long resumes;
+    double run_ns;
+    double max_run_ns;
+    double wait_ns;
+    double max_wait_ns;
+} coro_stats_t;
+
+/* Runtime switch */
+extern bool coro_stats_enabled;
+
+/**
+ * Start or stop accounting
+ * Only coroutines created while accounting is on are summed per function.
+ */
+void coro_stats_enable(bool enable);
+
+/**
+ * Clear every per-function total (per-coroutine counters restart on create)
+ * Entry functions stay registered.
+ */
+void coro_stats_reset(void);
+
+/**
+ * Number of entry functions with totals
+ */
+int coro_stats_func_count(void);
+
+/**
+ * Totals of one entry function by index
+ * Returns: 0 on success, -1 if index is out of range
+ */
+int coro_stats_func(int index, coro_stats_t *out);
+
+/**
+ * Reset a coroutine's counters at create time and, if accounting is on,
+ * link them to the totals of func (used by the backends)
+ */
+void coro_stats_attach(coro_stats_counters_t *c, coro_stats_func_t func, const char *backend);
+
+/**
+ * Convert raw counters for reporting
+ */
+void coro_stats_convert(const coro_stats_counters_t *c, coro_stats_t *out);
+
+/**
+ * Account the wait before a run
+ * Returns: timestamp the run started at
+ */
+static inline uint64_t coro_stats_run_begin(coro_stats_counters_t *c) {
+    uint64_t now = coro_trace_clock();
+    coro_stats_counters_t *f = c->func_stats;
+    
+    if (c->ready_since) {
+        uint64_t wait = now - c->ready_since;
+        c->wait_ticks += wait;
+        if (wait > c->max_wait_ticks) c->max_wait_ticks = wait;
+        if (f) {
+            f->wait_ticks += wait;
+            if (wait > f->max_wait_ticks) f->max_wait_ticks = wait;
+        }
+    }
+    return now;
+}
+
+/**
+ * Account a run that started at start; a coroutine that did not finish
+ * is ready again from now on
+ */
+static inline void coro_stats_run_end(coro_stats_counters_t *c, uint64_t start, bool finished) {
+    uint64_t now = coro_trace_clock();
+    uint64_t run = now - start;
+    coro_stats_counters_t *f = c->func_stats;
+    
+    c->resumes++;
+    c->run_ticks += run;
+    if (run > c->max_run_ticks) c->max_run_ticks = run;
+    c->ready_since = finished ? 0 : now;
+    if (f) {
+        f->resumes++;
+        f->run_ticks += run;
+        if (run > f->max_run_ticks) f->max_run_ticks = run;
+    }
+}
+
+/**
+ * Stop counting wait: the coroutine is blocked, not ready (used by schedulers on park)
+ */
+static inline void coro_stats_parked(coro_stats_counters_t *c) {
+    c->ready_since = 0;
+}
+
+/**
+ * Start counting wait from now (used by schedulers on wake)
+ */
+static inline void coro_stats_ready(coro_stats_counters_t *c) {
+    if (coro_stats_enabled) {
+        c->ready_since = coro_trace_clock();
+    }
+}
+
+#endif /* CORO_STATS_H */
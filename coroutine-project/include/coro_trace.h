@@ -0,0 +1,133 @@
+/**
+ * coro_trace.h
+ * Coroutine Switch Tracer
+ *
+ * Records resume, yield and finish events with a cycle-counter timestamp
+ * and the coroutine ID into a per-thread ring buffer. Each ring has a
+ * single writer (its thread), so recording takes no locks or atomic
+ * read-modify-writes. The rings can be exported as Chrome trace JSON and
+ * opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * The recording hooks in the resume paths are only compiled in when
+ * CORO_TRACE is defined (make trace); otherwise they expand to nothing.
+ */
+
+#ifndef CORO_TRACE_H
+#define CORO_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Events kept per thread (power of two); older events are overwritten */
+#define CORO_TRACE_RING_SIZE (64 * 1024)
+
+/* Event kinds */
+typedef enum {
+    CORO_TRACE_RESUME = 0,    /* Control enters the coroutine */
+    CORO_TRACE_YIELD,         /* Coroutine yielded back to the resumer */
+    CORO_TRACE_FINISH         /* Coroutine returned */
+} coro_trace_event_t;
+
+/* Coroutine implementation an event belongs to */
+typedef enum {
+    CORO_TRACE_STACKLESS = 0,
+    CORO_TRACE_UCONTEXT
+} coro_trace_backend_t;
+
+/* One recorded event (16 bytes) */
+typedef struct {
+    uint64_t tsc;             /* coro_trace_clock() when recorded */
+    int32_t coro_id;
+    uint8_t backend;          /* coro_trace_backend_t */
+    uint8_t event;            /* coro_trace_event_t */
+} coro_trace_record_t;
+
+/* Per-thread ring buffer */
+typedef struct coro_trace_ring {
+    coro_trace_record_t records[CORO_TRACE_RING_SIZE];
+    _Atomic uint64_t head;    /* Events ever recorded; only the owner writes */
+    int thread_index;         /* Trace thread ID, in attach order */
+    struct coro_trace_ring *next;
+} coro_trace_ring_t;
+
+/* Runtime switch, and the calling thread's ring (NULL until first event) */
+extern bool coro_trace_enabled;
+extern _Thread_local coro_trace_ring_t *coro_trace_ring;
+
+/**
+ * Allocate and register the calling thread's ring
+ * Returns: the ring, or NULL if out of memory
+ */
+coro_trace_ring_t *coro_trace_ring_attach(void);
+
+/**
+ * Start or stop recording
+ * Enabling also sets the time origin of the exported trace.
+ */
+void coro_trace_enable(bool enable);
+
+/**
+ * Drop every recorded event
+ * Only call while no thread is recording.
+ */
+void coro_trace_reset(void);
+
+/**
+ * Write all rings to path as Chrome trace JSON
+ * Each resume-to-yield interval becomes a slice named after the
+ * coroutine, on a track per traced thread. Only call while no thread
+ * is recording.
+ * Returns: number of events written, or -1 on error
+ */
+long long coro_trace_export_chrome(const char *path);
+
+/**
+ * Timestamp source: the TSC on x86, CLOCK_MONOTONIC ns elsewhere
+ */
+static inline uint64_t coro_trace_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Append one event to the calling thread's ring
+ */
+static inline void coro_trace_record(coro_trace_backend_t backend, coro_trace_event_t event,
+                                     int coro_id) {
+    coro_trace_ring_t *ring = coro_trace_ring;
+    if (__builtin_expect(!ring, 0) && !(ring = coro_trace_ring_attach())) {
+        return;
+    }
+    
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    coro_trace_record_t *rec = &ring->records[head & (CORO_TRACE_RING_SIZE - 1)];
+    rec->tsc = coro_trace_clock();
+    rec->coro_id = coro_id;
+    rec->backend = (uint8_t)backend;
+    rec->event = (uint8_t)event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/* Recording hook used by the resume paths */
+#ifdef CORO_TRACE
+#define CORO_TRACE_EVENT(backend, event, coro_id) \
+    do { \
+        if (__builtin_expect(coro_trace_enabled, 0)) { \
+            coro_trace_record((backend), (event), (coro_id)); \
+        } \
+    } while (0)
+#else
+#define CORO_TRACE_EVENT(backend, event, coro_id) ((void)0)
+#endif
+
+#endif /* CORO_TRACE_H */
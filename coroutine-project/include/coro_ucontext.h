@@ -11,13 +11,102 @@
 #define CORO_UCONTEXT_H
 
 #include <ucontext.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "coro_backend.h"
+#include "coro_trace.h"
+#include "coro_stats.h"
+#include "coro_probes.h"
+#include "coro_metrics.h"
 
 /* Stack size for each coroutine (64KB) */
 #define CORO_STACK_SIZE (64 * 1024)
 
-/* Maximum number of coroutines */
-#define MAX_UCONTEXT_COROUTINES 1024
+/* Maximum number of coroutines (override with -D) */
+#ifndef MAX_UCONTEXT_COROUTINES
+#define MAX_UCONTEXT_COROUTINES (128 * 1024)
+#endif
+
+/* Adaptive stack sizing (see coro_ucontext_set_stack_mode) */
+#define UCORO_STACK_MIN_CLASS (4 * 1024)     /* Smallest stack size class */
+#define UCORO_STACK_HEADROOM (4 * 1024)      /* Kept above the high-water mark for signal frames */
+#define UCORO_STACK_ADAPT_SAMPLES 16         /* Samples needed before a function is resized */
+#define UCORO_STACK_CANARY_BYTES 256         /* Painted bottom of resized stacks */
+#define UCORO_MAX_STACK_PROFILES 64          /* Entry functions tracked */
+
+/* Coroutine-local storage keys per process (see coro_ucontext_local_key_create) */
+#define UCORO_LOCAL_KEYS 32
+
+/* Time-slice preemption (see coro_ucontext_preempt_start) */
+#ifndef UCORO_PREEMPT_SIGNAL
+#define UCORO_PREEMPT_SIGNAL SIGURG          /* Ignored by default, rarely used */
+#endif
+#define UCORO_PREEMPT_TICKS 4                /* Timer ticks per slice */
+
+/* Stack top coloring (see coro_ucontext_set_stack_colors) */
+#define UCORO_STACK_COLOR_STRIDE 64          /* Bytes per color (one cache line) */
+#define UCORO_STACK_COLORS_4K (4096 / UCORO_STACK_COLOR_STRIDE)  /* Colors spanning a 4 KB page */
+#define UCORO_STACK_COLOR_MAX_SHARE 8        /* Color offset stays below 1/8 of the stack */
+
+/* Stack sizing modes */
+typedef enum {
+    UCORO_STACK_FIXED = 0,    /* Every stack is CORO_STACK_SIZE, unpainted */
+    UCORO_STACK_PAINT,        /* Fixed size, painted to record high-water marks */
+    UCORO_STACK_ADAPTIVE      /* Painted until profiled, then a fitted size class */
+} ucoro_stack_mode_t;
+
+/* How a coroutine's stack was painted */
+typedef enum {
+    UCORO_PAINT_NONE = 0,
+    UCORO_PAINT_FULL,         /* Whole stack: high-water mark is measured */
+    UCORO_PAINT_CANARY        /* Lowest UCORO_STACK_CANARY_BYTES: overflow check only */
+} ucoro_paint_t;
+
+/*
+ * Stack provider: hands out stack memory for coro_ucontext_create_ex().
+ * alloc returns the lowest usable address of a size-byte stack with
+ * guard_size inaccessible bytes below it (or NULL); free gets the same
+ * size and guard_size back.
+ */
+typedef struct {
+    const char *name;
+    void *(*alloc)(size_t size, size_t guard_size, void *ctx);
+    void (*free)(void *stack, size_t size, size_t guard_size, void *ctx);
+    void *ctx;                /* Passed to alloc and free */
+} ucoro_stack_provider_t;
+
+/* Attributes for coro_ucontext_create_ex() */
+typedef struct {
+    size_t stack_size;        /* Bytes; 0 = CORO_STACK_SIZE or adaptive class */
+    size_t guard_size;        /* Inaccessible bytes below the stack, 0 = none */
+    bool prefault;            /* Touch every stack page at create time */
+    bool preemptible;         /* May be preempted when its time slice expires */
+    const ucoro_stack_provider_t *provider;  /* NULL = malloc, or mmap with a guard */
+} ucoro_attr_t;
+
+/* Huge page size assumed for stack arenas */
+#define UCORO_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Page backing of a stack arena */
+typedef enum {
+    UCORO_ARENA_SMALL_PAGES = 0,  /* Base pages, transparent huge pages disabled */
+    UCORO_ARENA_THP,              /* madvise(MADV_HUGEPAGE) on an aligned region */
+    UCORO_ARENA_HUGETLB           /* MAP_HUGETLB, needs reserved vm.nr_hugepages */
+} ucoro_arena_pages_t;
+
+/* Fixed-size stacks carved back to back out of one large region */
+typedef struct {
+    char *base;               /* Start of the region */
+    size_t region_size;       /* Bytes mapped */
+    size_t slot_size;         /* Bytes per stack (page multiple) */
+    size_t num_slots;         /* Stacks the region holds */
+    size_t next;              /* Next never-used slot */
+    void *free_list;          /* Freed stacks, linked through their first word */
+    ucoro_arena_pages_t pages;
+    ucoro_stack_provider_t provider;  /* Use &arena->provider in ucoro_attr_t */
+} ucoro_stack_arena_t;
 
 /* Coroutine states */
 typedef enum {
@@ -33,14 +122,37 @@ typedef struct {
     ucontext_t context;       /* Execution context */
     ucontext_t *caller;       /* Caller's context */
     char *stack;              /* Stack memory */
+    size_t stack_size;        /* Stack size in bytes */
+    ucoro_paint_t stack_paint; /* How the stack was painted */
+    size_t guard_size;        /* Guard bytes below the stack */
+    size_t stack_color;       /* Bytes left unused above the initial stack pointer */
+    const ucoro_stack_provider_t *stack_provider;  /* Owner of the stack memory */
     ucoro_state_t state;      /* Current state */
     bool active;              /* In use flag */
     void *user_data;          /* User data pointer */
+    void **locals;            /* UCORO_LOCAL_KEYS local slots, NULL until first set */
+    bool preemptible;         /* Created with attr.preemptible */
+    int preempt_disabled;     /* coro_ucontext_preempt_disable() nesting depth */
+    volatile sig_atomic_t preempt_ticks;    /* Ticks seen this resume, -1 while switching */
+    volatile sig_atomic_t preempt_pending;  /* Slice expired while preemption was disabled */
 } coro_ucontext_t;
 
 /* Coroutine function pointer type */
 typedef void (*ucoro_func_t)(void *arg);
 
+/* Coroutine-local storage key */
+typedef int ucoro_local_key_t;
+
+/* Stack usage of all coroutines started from one entry function */
+typedef struct {
+    ucoro_func_t func;        /* Entry function */
+    long long samples;        /* High-water marks recorded */
+    size_t max_used;          /* Largest high-water mark (bytes) */
+    size_t total_used;        /* Sum of high-water marks (bytes) */
+    size_t stack_class;       /* Size used in adaptive mode, 0 until profiled */
+    long long overflows;      /* Resized stacks whose canary was overwritten */
+} ucoro_stack_profile_t;
+
 /**
  * Initialize the ucontext coroutine system
  */
@@ -52,6 +164,36 @@ void coro_ucontext_init(void);
  */
 int coro_ucontext_create(ucoro_func_t func, void *arg);
 
+/**
+ * Fill attributes with the defaults used by coro_ucontext_create()
+ */
+void coro_ucontext_attr_init(ucoro_attr_t *attr);
+
+/**
+ * Create a new stackful coroutine with explicit stack attributes
+ * attr may be NULL for the defaults. Sizes are rounded up to the page
+ * size when a guard is requested.
+ * Returns: coroutine ID on success, -1 on failure
+ */
+int coro_ucontext_create_ex(ucoro_func_t func, void *arg, const ucoro_attr_t *attr);
+
+/* Built-in stack providers */
+extern const ucoro_stack_provider_t coro_ucontext_malloc_stacks;  /* No guard support */
+extern const ucoro_stack_provider_t coro_ucontext_mmap_stacks;    /* One mapping per stack */
+
+/**
+ * Map a stack arena for num_stacks stacks of up to stack_size bytes
+ * Guard pages are not supported; stacks are adjacent in memory.
+ * Returns: 0 on success, -1 if the region cannot be mapped
+ */
+int coro_ucontext_arena_open(ucoro_stack_arena_t *arena, size_t stack_size,
+                             size_t num_stacks, ucoro_arena_pages_t pages);
+
+/**
+ * Unmap a stack arena; every coroutine using it must be destroyed first
+ */
+void coro_ucontext_arena_close(ucoro_stack_arena_t *arena);
+
 /**
  * Resume execution of a coroutine
  * Returns: 0 if yielded, 1 if finished, -1 on error
@@ -78,4 +220,224 @@ void coro_ucontext_cleanup(void);
  */
 ucoro_state_t coro_ucontext_get_state(int coro_id);
 
+/**
+ * Get a coroutine's run time, resume count and ready-to-run wait
+ * Only counted while coro_stats_enable(true) is in effect.
+ * Returns: 0 on success, -1 if coro_id is not a live coroutine
+ */
+int coro_ucontext_get_stats(int coro_id, coro_stats_t *out);
+
+/**
+ * Offset the initial stack pointer of coroutines created from now on by
+ * a rotating color of 0..colors-1 cache lines
+ * Stacks handed out at the same alignment otherwise start in the same
+ * L1/L2 sets and alias at 4 KB. UCORO_STACK_COLORS_4K colors cover every
+ * line of a page; 0 or 1 turns coloring off (the default).
+ */
+void coro_ucontext_set_stack_colors(int colors);
+
+/**
+ * Set how stacks of coroutines created from now on are sized and painted
+ * Painted stacks record their high-water mark per entry function when the
+ * coroutine finishes or is destroyed. In adaptive mode, once a function
+ * has UCORO_STACK_ADAPT_SAMPLES samples, its later coroutines get the
+ * smallest power-of-two class holding 1.25x the largest high-water mark
+ * plus UCORO_STACK_HEADROOM; a damaged canary sends it back to full size.
+ */
+void coro_ucontext_set_stack_mode(ucoro_stack_mode_t mode);
+
+/**
+ * Number of entry functions with a stack profile
+ */
+int coro_ucontext_stack_profile_count(void);
+
+/**
+ * Get a stack profile by index (NULL if out of range)
+ */
+const ucoro_stack_profile_t *coro_ucontext_stack_profile(int index);
+
+/**
+ * Forget all stack profiles
+ */
+void coro_ucontext_stack_profile_reset(void);
+
+/**
+ * Total bytes of stack currently allocated to live coroutines
+ */
+size_t coro_ucontext_stack_bytes(void);
+
+/**
+ * Create a coroutine-local storage key (the coroutine analogue of
+ * pthread_key_create)
+ * Every coroutine, and the main context, sees its own value for the key,
+ * initially NULL. When a coroutine is destroyed, destructor (if not NULL)
+ * is called with each of its non-NULL values, on the destroying context.
+ * Returns: 0 on success, -1 if all UCORO_LOCAL_KEYS keys are in use
+ */
+int coro_ucontext_local_key_create(ucoro_local_key_t *key, void (*destructor)(void *));
+
+/**
+ * Delete a key; its values in every coroutine are dropped without
+ * calling the destructor
+ */
+void coro_ucontext_local_key_delete(ucoro_local_key_t key);
+
+/**
+ * Set the running coroutine's (or the main context's) value for key
+ * Returns: 0 on success, -1 if key is invalid or out of memory
+ */
+int coro_ucontext_local_set(ucoro_local_key_t key, void *value);
+
+/**
+ * Start preempting coroutines created with attr.preemptible on the
+ * calling thread
+ * A timer sends UCORO_PREEMPT_SIGNAL to this thread UCORO_PREEMPT_TICKS
+ * times per slice. A preemptible coroutine that has run for more than
+ * slice_us since its resume is made to yield from the signal handler, as
+ * if it had called coro_ucontext_yield() at the interrupted instruction.
+ * The library's own calls (coro_ucontext_create/create_ex/destroy,
+ * coro_sched_, coro_offload_, coro_io_ and coroutine-local storage)
+ * defer preemption while they run. Preemptible
+ * code must not be interrupted while it holds a lock of its own or is
+ * inside a non-async-signal-safe call (malloc, stdio, ...): wrap such
+ * calls in coro_ucontext_preempt_disable()/enable().
+ * Returns: 0 on success, -1 if already started or the timer cannot be set
+ */
+int coro_ucontext_preempt_start(int slice_us);
+
+/**
+ * Stop the preemption timer and restore the previous signal handler
+ */
+void coro_ucontext_preempt_stop(void);
+
+/**
+ * Defer preemption of the running coroutine (nests; no-op on main)
+ */
+void coro_ucontext_preempt_disable(void);
+
+/**
+ * End a coro_ucontext_preempt_disable() region; at the outermost one,
+ * yield now if the slice expired inside the region
+ */
+void coro_ucontext_preempt_enable(void);
+
+/**
+ * Make a coroutine preemptible or not after creation (e.g. one created
+ * through coro_ucontext_backend by a scheduler)
+ * Returns: 0 on success, -1 if coro_id is not a live coroutine
+ */
+int coro_ucontext_set_preemptible(int coro_id, bool preemptible);
+
+/**
+ * Number of forced yields since coro_ucontext_init()
+ */
+long long coro_ucontext_preemptions(void);
+
+/* Backend descriptor for the registry (see coro_backend.h) */
+extern const coro_backend_t coro_ucontext_backend;
+
+/* ============================================================
+ * INLINE FAST PATH
+ * ============================================================ */
+
+/* Library state, exported only for the inline functions below */
+extern coro_ucontext_t coro_ucontext_pool[MAX_UCONTEXT_COROUTINES];
+extern int coro_ucontext_current;
+extern ucontext_t coro_ucontext_main;
+extern coro_stats_counters_t coro_ucontext_stats[MAX_UCONTEXT_COROUTINES];
+extern void **coro_ucontext_locals;   /* Local slots of the running context, or NULL */
+
+/* Resume with run time accounting (out of line, see coro_stats.h) */
+int coro_ucontext_resume_accounted(int coro_id);
+
+/**
+ * Resume a coroutine without the out-of-line call and checks
+ * coro_id must be a live ID returned by coro_ucontext_create(); it is
+ * not range or liveness checked (coro_ucontext_resume() does that).
+ * Returns: 0 if yielded, 1 if finished
+ */
+static inline int coro_ucontext_resume_fast(int coro_id) {
+    coro_ucontext_t *coro = &coro_ucontext_pool[coro_id];
+    
+    if (__builtin_expect(coro->state == UCORO_STATE_FINISHED, 0)) {
+        return 1;
+    }
+    CORO_METRICS_COUNT(CORO_METRICS_UCONTEXT, resumes, 1);
+    if (__builtin_expect(coro_stats_enabled, 0)) {
+        return coro_ucontext_resume_accounted(coro_id);
+    }
+    
+    /* Save current coroutine ID and local slots */
+    int prev_id = coro_ucontext_current;
+    void **prev_locals = coro_ucontext_locals;
+    coro_ucontext_current = coro_id;
+    coro_ucontext_locals = coro->locals;
+    
+    /* Switch to coroutine context */
+    CORO_PROBE1(coro_ucontext, resume, coro_id);
+    CORO_TRACE_EVENT(CORO_TRACE_UCONTEXT, CORO_TRACE_RESUME, coro_id);
+    coro->state = UCORO_STATE_RUNNING;
+    swapcontext(&coro_ucontext_main, &coro->context);
+    
+    /* Returned from coroutine */
+    coro_ucontext_current = prev_id;
+    coro_ucontext_locals = prev_locals;
+    CORO_TRACE_EVENT(CORO_TRACE_UCONTEXT, coro->state == UCORO_STATE_FINISHED ?
+                     CORO_TRACE_FINISH : CORO_TRACE_YIELD, coro_id);
+    
+    return (coro->state == UCORO_STATE_FINISHED) ? 1 : 0;
+}
+
+/**
+ * Yield back to the caller; must run inside a coroutine
+ */
+static inline void coro_ucontext_yield_fast(void) {
+    coro_ucontext_t *coro = &coro_ucontext_pool[coro_ucontext_current];
+    
+    /* Fired on the coroutine's own stack */
+    CORO_PROBE1(coro_ucontext, yield, coro_ucontext_current);
+    coro->state = UCORO_STATE_SUSPENDED;
+    coro->preempt_ticks = -1;
+    swapcontext(&coro->context, &coro_ucontext_main);
+    coro->preempt_pending = 0;
+    coro->preempt_ticks = 0;
+}
+
+/**
+ * Inline coro_ucontext_preempt_disable(), for the library's entry points
+ * The signal fence keeps the region's code after the count; the handler
+ * only reads it.
+ */
+static inline void coro_ucontext_preempt_disable_fast(void) {
+    if (coro_ucontext_current >= 0) {
+        coro_ucontext_pool[coro_ucontext_current].preempt_disabled++;
+        atomic_signal_fence(memory_order_seq_cst);
+    }
+}
+
+/**
+ * Inline coro_ucontext_preempt_enable(); the deferred yield stays out of line
+ */
+static inline void coro_ucontext_preempt_enable_fast(void) {
+    if (coro_ucontext_current >= 0) {
+        coro_ucontext_t *coro = &coro_ucontext_pool[coro_ucontext_current];
+        atomic_signal_fence(memory_order_seq_cst);
+        if (__builtin_expect(coro->preempt_disabled == 1 && coro->preempt_pending, 0)) {
+            coro_ucontext_preempt_enable();
+        } else {
+            coro->preempt_disabled--;
+        }
+    }
+}
+
+/**
+ * Get the running coroutine's (or the main context's) value for key
+ * key must come from coro_ucontext_local_key_create(); it is not checked.
+ * Returns: the value, or NULL if never set
+ */
+static inline void *coro_ucontext_local_get(ucoro_local_key_t key) {
+    void **locals = coro_ucontext_locals;
+    return locals ? locals[key] : NULL;
+}
+
 #endif /* CORO_UCONTEXT_H */
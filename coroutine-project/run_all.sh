@@ -265,6 +265,7 @@ main() {
     echo "  • Read results: stackless_results.txt, ucontext_results.txt"
     echo "  • Run again: ./run_all.sh"
     echo "  • Run specific: ./bin/bench [stackless|ucontext|both]"
+    echo "  • Options: ./bin/bench --help"
     echo ""
 }
 
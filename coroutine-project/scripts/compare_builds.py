@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""
+compare_builds.py
+Switch-Cost Comparison Between Builds
+
+Runs the same benchmark selection with several builds of the benchmark
+(e.g. default, -flto, PGO) and reports the mean ns/switch of each build
+and its delta against the first one.
+
+Usage: compare_builds.py [--args "BENCH ARGS"] BINARY...
+"""
+
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+# Benchmarks compared when no --args are given
+DEFAULT_ARGS = "--samples=5 --calibrate=100 both inline"
+
+RESULTS_FILE = "builds_results.txt"
+
+def run_build(binary, args):
+    """
+    Run one build and collect its mean ns/switch per benchmark
+    Returns: dict label -> mean, or None if the run failed
+    """
+    # Run in a scratch directory so the build's own *_results.txt files
+    # do not overwrite the ones of the regular build
+    with tempfile.TemporaryDirectory() as scratch:
+        proc = subprocess.run([os.path.abspath(binary)] + shlex.split(args),
+                              cwd=scratch, capture_output=True, text=True)
+    if proc.returncode != 0:
+        print(f"Error: {binary} failed:\n{proc.stderr}")
+        return None
+    
+    means = {}
+    label = None
+    for line in proc.stdout.splitlines():
+        match = re.match(r"^(.+) Results:$", line)
+        if match:
+            label = match.group(1)
+            continue
+        match = re.match(r"^\s+Mean:\s+([0-9.]+) ns/switch", line)
+        if match and label:
+            means[label] = float(match.group(1))
+            label = None
+    return means
+
+def main():
+    argv = sys.argv[1:]
+    args = DEFAULT_ARGS
+    if len(argv) >= 2 and argv[0] == "--args":
+        args = argv[1] or DEFAULT_ARGS
+        argv = argv[2:]
+    
+    binaries = [b for b in argv if os.path.exists(b)]
+    if not binaries:
+        print(__doc__)
+        return 1
+    
+    results = []
+    for binary in binaries:
+        print(f"Running {binary} {args}...")
+        means = run_build(binary, args)
+        if means is None:
+            return 1
+        results.append(means)
+    
+    labels = [label for label in results[0] if all(label in r for r in results)]
+    names = [os.path.basename(b) for b in binaries]
+    
+    print("")
+    header = f"{'Benchmark':<20}" + "".join(f"{name:>14}" for name in names)
+    header += "".join(f"{name + ' delta':>18}" for name in names[1:])
+    print(header)
+    print("-" * len(header))
+    
+    with open(RESULTS_FILE, "w") as f:
+        f.write("benchmark,build,mean,delta_pct\n")
+        for label in labels:
+            base = results[0][label]
+            row = f"{label:<20}" + "".join(f"{r[label]:>11.2f} ns" for r in results)
+            for name, r in zip(names, results):
+                delta = (r[label] - base) / base * 100.0 if base > 0 else 0.0
+                if r is not results[0]:
+                    row += f"{delta:>+17.1f}%"
+                f.write(f"{label},{name},{r[label]:.2f},{delta:.2f}\n")
+            print(row)
+    
+    print(f"\nResults saved to {RESULTS_FILE}")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""
+coro_metrics.py
+Live Metrics Reader
+
+Maps the shared-memory segment published by coro_metrics_open() and
+prints, per backend and every interval: switches/sec, live coroutines,
+pool occupancy and ucontext stack memory. The segment is read without
+locks; a snapshot is retried while the publisher is writing it.
+
+Usage: coro_metrics.py [--interval SEC] [--count N] [--threads] PID|NAME
+"""
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+# Layout version 1 (include/coro_metrics.h)
+MAGIC = 0x5352544d4f524f43
+VERSION = 1
+HEADER = struct.Struct("=QIIIIIiQQQII")
+BACKENDS = ["stackless", "ucontext"]
+COUNTERS = struct.Struct("=QQQQ")   # resumes, creates, destroys, stack_bytes
+THREAD_HEAD = struct.Struct("=iI")
+
+MASK64 = (1 << 64) - 1
+
+def open_segment(target):
+    """
+    Map /dev/shm/coro-metrics.<pid> (or /dev/shm/<name>) read-only
+    Returns: the mapping, or None if it does not exist or is not valid
+    """
+    name = f"coro-metrics.{target}" if target.isdigit() else target.lstrip("/")
+    path = os.path.join("/dev/shm", name)
+    try:
+        with open(path, "rb") as f:
+            mem = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+    except OSError as e:
+        print(f"Error: Cannot open {path}: {e.strerror}")
+        return None
+    
+    if len(mem) < HEADER.size:
+        print(f"Error: {path} is too small for a metrics segment")
+        return None
+    fields = HEADER.unpack_from(mem, 0)
+    if fields[0] != MAGIC:
+        print(f"Error: {path} is not a coroutine metrics segment")
+        return None
+    if fields[1] != VERSION:
+        print(f"Error: {path} has layout version {fields[1]}, this reader knows {VERSION}")
+        return None
+    return mem
+
+def read_snapshot(mem):
+    """
+    Copy one consistent snapshot of the segment
+    Returns: dict with publish_ns, capacity, threads [(tid, [counters per backend])]
+    """
+    while True:
+        seq_before = struct.unpack_from("=Q", mem, 32)[0]
+        if seq_before & 1:
+            time.sleep(0.001)
+            continue
+        data = mem[:]
+        seq_after = struct.unpack_from("=Q", mem, 32)[0]
+        if seq_before == seq_after:
+            break
+    
+    (_, _, header_size, thread_size, max_threads, num_backends, pid, _,
+     publish_ns, publishes, num_threads, interval_ms) = HEADER.unpack_from(data, 0)
+    capacity = struct.unpack_from(f"={num_backends}Q", data, HEADER.size)
+    
+    threads = []
+    for i in range(min(num_threads, max_threads)):
+        off = header_size + i * thread_size
+        tid, _ = THREAD_HEAD.unpack_from(data, off)
+        counters = [COUNTERS.unpack_from(data, off + THREAD_HEAD.size + b * COUNTERS.size)
+                    for b in range(min(num_backends, len(BACKENDS)))]
+        threads.append((tid, counters))
+    return {"pid": pid, "publish_ns": publish_ns, "publishes": publishes,
+            "interval_ms": interval_ms, "capacity": capacity, "threads": threads}
+
+def totals(threads, b):
+    """
+    Sum one backend's counters over threads (gauges wrap per thread)
+    """
+    resumes = sum(t[1][b][0] for t in threads)
+    live = sum(t[1][b][1] - t[1][b][2] for t in threads)
+    stack = sum(t[1][b][3] for t in threads) & MASK64
+    return resumes, live, stack
+
+def print_rates(prev, cur, show_threads):
+    """
+    Print one line per backend (and per thread with --threads)
+    """
+    dt = (cur["publish_ns"] - prev["publish_ns"]) / 1e9
+    prev_threads = {t[0]: t for t in prev["threads"]}
+    for b, name in enumerate(BACKENDS):
+        resumes, live, stack = totals(cur["threads"], b)
+        prev_resumes = totals(prev["threads"], b)[0]
+        rate = (resumes - prev_resumes) / dt if dt > 0 else 0.0
+        occupancy = 100.0 * live / cur["capacity"][b] if cur["capacity"][b] else 0.0
+        print(f"  {name:>10} {rate:14,.0f} {live:10} {occupancy:9.2f}% "
+              f"{stack / (1024 * 1024):10.1f}")
+        if not show_threads:
+            continue
+        for tid, counters in cur["threads"]:
+            before = prev_threads.get(tid, (tid, [(0, 0, 0, 0)] * len(BACKENDS)))[1][b][0]
+            thread_rate = (counters[b][0] - before) / dt if dt > 0 else 0.0
+            label = "retired" if tid == 0 else "tid " + str(tid)
+            print(f"  {label:>10} {thread_rate:14,.0f} "
+                  f"{counters[b][1] - counters[b][2]:10}")
+
+def main():
+    argv = sys.argv[1:]
+    interval = 1.0
+    count = 0
+    show_threads = False
+    while argv and argv[0].startswith("--"):
+        opt = argv.pop(0)
+        if opt == "--threads":
+            show_threads = True
+        elif opt in ("--interval", "--count") and argv:
+            value = argv.pop(0)
+            if opt == "--interval":
+                interval = float(value)
+            else:
+                count = int(value)
+        else:
+            argv = []
+            break
+    if len(argv) != 1:
+        print("Usage: coro_metrics.py [--interval SEC] [--count N] [--threads] PID|NAME")
+        return 1
+    
+    mem = open_segment(argv[0])
+    if mem is None:
+        return 1
+    
+    prev = read_snapshot(mem)
+    print(f"Process {prev['pid']}, published every {prev['interval_ms']} ms")
+    printed = 0
+    try:
+        while count == 0 or printed < count:
+            time.sleep(interval)
+            cur = read_snapshot(mem)
+            if cur["publishes"] == prev["publishes"]:
+                print("  (no new publish; process stopped or exited)")
+                break
+            print(f"\n  {'backend':>10} {'switches/s':>14} {'live':>10} {'pool':>10} "
+                  f"{'stack MB':>10}")
+            print_rates(prev, cur, show_threads)
+            sys.stdout.flush()
+            prev = cur
+            printed += 1
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2,46 +2,144 @@
  * bench.c
  * Coroutine Performance Benchmark Suite
  * 
- * This program benchmarks context-switch performance for both
- * stackless and stackful (ucontext) coroutine implementations.
+ * This program benchmarks context-switch performance for every
+ * registered coroutine backend (stackless and ucontext built in).
  * Measures time in nanoseconds using high-resolution clock.
+ *
+ * Iteration counts, sample counts and benchmark selection are taken
+ * from the command line (see --help). With --calibrate or --time-budget
+ * the number of switches is picked per benchmark so that each sample
+ * runs for roughly the same wall-clock time.
  */
-#define _POSIX_C_SOURCE 199309L
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include "bench.h"
+#include "coro_backend.h"
 #include "coro_stackless.h"
 #include "coro_ucontext.h"
+#include "coro_trace.h"
+#include "coro_metrics.h"
 
-/* Number of context switches to perform */
-#define NUM_SWITCHES 10000000  /* 10 million switches */
-#define WARMUP_SWITCHES 100000  /* Warmup iterations */
+/* Default number of context switches to perform */
+#define DEFAULT_NUM_SWITCHES 10000000  /* 10 million switches */
+#define DEFAULT_WARMUP_SWITCHES 100000  /* Warmup iterations */
 
-/* Statistical sampling */
-#define NUM_SAMPLES 10
+/* Default statistical sampling */
+#define DEFAULT_NUM_SAMPLES 10
+
+/* Default calibration target per sample (milliseconds) */
+#define DEFAULT_TARGET_MS 100
+
+/* Calibration probe limits */
+#define CALIBRATE_MIN_SWITCHES 1000
+#define CALIBRATE_MIN_PROBE_NS 10000000LL  /* probe until >= 10 ms */
+
+/* Calibrated samples warm up with at most this share of their switches */
+#define CALIBRATE_WARMUP_DIVISOR 10
+
+bench_config_t bench_config = {
+    .num_switches = DEFAULT_NUM_SWITCHES,
+    .switches_set = false,
+    .warmup_switches = DEFAULT_WARMUP_SWITCHES,
+    .num_samples = DEFAULT_NUM_SAMPLES,
+    .calibrate = false,
+    .target_ms = DEFAULT_TARGET_MS,
+    .time_budget_s = 0.0,
+    .max_coros = 0,
+    .trace_path = NULL,
+    .metrics_interval_ms = 0,
+    .num_patterns = 0,
+    .num_backend_patterns = 0
+};
+
+/* ============================================================
+ * COROUTINE PING-PONG BENCHMARK
+ * ============================================================ */
+
+/* Ping-pong step: bump the shared counter and yield */
+static int pingpong_step(void *arg) {
+    long long *counter = (long long *)arg;
+    (*counter)++;
+    return 0;
+}
 
 /**
- * Get current time in nanoseconds
+ * Benchmark context switches of one coroutine backend
+ * Two coroutines are resumed alternately; every resume is one switch.
  */
-static inline long long get_time_ns(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+double benchmark_pingpong(const coro_backend_t *backend, long long num_switches,
+                          long long warmup_switches) {
+    long long counter = 0;
+    
+    backend->init();
+    
+    /* Create two coroutines for ping-pong */
+    int coro1 = backend->create(pingpong_step, &counter);
+    int coro2 = backend->create(pingpong_step, &counter);
+    
+    if (coro1 < 0 || coro2 < 0) {
+        fprintf(stderr, "Failed to create %s coroutines\n", backend->name);
+        backend->cleanup();
+        return -1.0;
+    }
+    
+    /* Warmup */
+    counter = 0;
+    while (counter < warmup_switches) {
+        backend->resume(coro1);
+        backend->resume(coro2);
+    }
+    
+    /* Actual benchmark */
+    counter = 0;
+    long long start = get_time_ns();
+    
+    while (counter < num_switches) {
+        backend->resume(coro1);
+        backend->resume(coro2);
+    }
+    
+    long long end = get_time_ns();
+    long long total_time = end - start;
+    
+    /* Calculate average time per switch */
+    double avg_ns = (double)total_time / counter;
+    
+    /* Cleanup */
+    backend->destroy(coro1);
+    backend->destroy(coro2);
+    backend->cleanup();
+    
+    return avg_ns;
 }
 
 /* ============================================================
- * STACKLESS COROUTINE BENCHMARKS
+ * INLINE FAST-PATH BENCHMARKS
  * ============================================================ */
 
-/* Simple ping-pong coroutine for stackless */
-static void stackless_worker(coro_stackless_t *coro, void *arg) {
-    int *counter = (int *)arg;
+/*
+ * Same ping-pong as above, but written directly against each library
+ * and switched with the header-inline resume/yield fast path, so
+ * neither the registry nor an out-of-line resume call is on the path.
+ * The difference to the registry numbers is the cost of the call, the
+ * argument checks and the step trampoline.
+ */
+
+/* Native stackless ping-pong coroutine */
+static void stackless_inline_worker(coro_stackless_t *coro, void *arg) {
+    long long *counter = (long long *)arg;
     
     CORO_BEGIN(coro);
     
-    while (*counter < NUM_SWITCHES) {
+    for (;;) {
         (*counter)++;
         CORO_YIELD(coro);
     }
@@ -50,45 +148,40 @@ static void stackless_worker(coro_stackless_t *coro, void *arg) {
 }
 
 /**
- * Benchmark stackless coroutine context switches
+ * Benchmark stackless switches through coro_stackless_resume_fast()
  */
-double benchmark_stackless(void) {
-    int counter = 0;
+static double benchmark_stackless_inline(long long num_switches, long long warmup_switches) {
+    long long counter = 0;
     
     coro_stackless_init();
     
-    /* Create two coroutines for ping-pong */
-    int coro1 = coro_stackless_create(stackless_worker, &counter);
-    int coro2 = coro_stackless_create(stackless_worker, &counter);
+    int coro1 = coro_stackless_create(stackless_inline_worker, &counter);
+    int coro2 = coro_stackless_create(stackless_inline_worker, &counter);
     
     if (coro1 < 0 || coro2 < 0) {
         fprintf(stderr, "Failed to create stackless coroutines\n");
+        coro_stackless_cleanup();
         return -1.0;
     }
     
     /* Warmup */
-    counter = 0;
-    while (counter < WARMUP_SWITCHES) {
-        coro_stackless_resume(coro1);
-        coro_stackless_resume(coro2);
+    while (counter < warmup_switches) {
+        coro_stackless_resume_fast(coro1);
+        coro_stackless_resume_fast(coro2);
     }
     
     /* Actual benchmark */
     counter = 0;
     long long start = get_time_ns();
     
-    while (counter < NUM_SWITCHES) {
-        coro_stackless_resume(coro1);
-        coro_stackless_resume(coro2);
+    while (counter < num_switches) {
+        coro_stackless_resume_fast(coro1);
+        coro_stackless_resume_fast(coro2);
     }
     
-    long long end = get_time_ns();
-    long long total_time = end - start;
-    
-    /* Calculate average time per switch */
-    double avg_ns = (double)total_time / NUM_SWITCHES;
+    long long total_time = get_time_ns() - start;
+    double avg_ns = (double)total_time / counter;
     
-    /* Cleanup */
     coro_stackless_destroy(coro1);
     coro_stackless_destroy(coro2);
     coro_stackless_cleanup();
@@ -96,60 +189,52 @@ double benchmark_stackless(void) {
     return avg_ns;
 }
 
-/* ============================================================
- * UCONTEXT COROUTINE BENCHMARKS
- * ============================================================ */
-
-static int ucontext_counter = 0;
-
-/* Simple worker for ucontext */
-static void ucontext_worker(void *arg) {
-    while (ucontext_counter < NUM_SWITCHES) {
-        ucontext_counter++;
-        coro_ucontext_yield();
+/* Native ucontext ping-pong coroutine */
+static void ucontext_inline_worker(void *arg) {
+    long long *counter = (long long *)arg;
+    
+    for (;;) {
+        (*counter)++;
+        coro_ucontext_yield_fast();
     }
 }
 
 /**
- * Benchmark ucontext coroutine context switches
+ * Benchmark ucontext switches through coro_ucontext_resume_fast()
  */
-double benchmark_ucontext(void) {
-    ucontext_counter = 0;
+static double benchmark_ucontext_inline(long long num_switches, long long warmup_switches) {
+    long long counter = 0;
     
     coro_ucontext_init();
     
-    /* Create two coroutines for ping-pong */
-    int coro1 = coro_ucontext_create(ucontext_worker, NULL);
-    int coro2 = coro_ucontext_create(ucontext_worker, NULL);
+    int coro1 = coro_ucontext_create(ucontext_inline_worker, &counter);
+    int coro2 = coro_ucontext_create(ucontext_inline_worker, &counter);
     
     if (coro1 < 0 || coro2 < 0) {
         fprintf(stderr, "Failed to create ucontext coroutines\n");
+        coro_ucontext_cleanup();
         return -1.0;
     }
     
     /* Warmup */
-    ucontext_counter = 0;
-    while (ucontext_counter < WARMUP_SWITCHES) {
-        coro_ucontext_resume(coro1);
-        coro_ucontext_resume(coro2);
+    counter = 0;
+    while (counter < warmup_switches) {
+        coro_ucontext_resume_fast(coro1);
+        coro_ucontext_resume_fast(coro2);
     }
     
     /* Actual benchmark */
-    ucontext_counter = 0;
+    counter = 0;
     long long start = get_time_ns();
     
-    while (ucontext_counter < NUM_SWITCHES) {
-        coro_ucontext_resume(coro1);
-        coro_ucontext_resume(coro2);
+    while (counter < num_switches) {
+        coro_ucontext_resume_fast(coro1);
+        coro_ucontext_resume_fast(coro2);
     }
     
-    long long end = get_time_ns();
-    long long total_time = end - start;
-    
-    /* Calculate average time per switch */
-    double avg_ns = (double)total_time / NUM_SWITCHES;
+    long long total_time = get_time_ns() - start;
+    double avg_ns = (double)total_time / counter;
     
-    /* Cleanup */
     coro_ucontext_destroy(coro1);
     coro_ucontext_destroy(coro2);
     coro_ucontext_cleanup();
@@ -157,6 +242,67 @@ double benchmark_ucontext(void) {
     return avg_ns;
 }
 
+/* ============================================================
+ * BENCHMARK REGISTRY AND DRIVER
+ * ============================================================ */
+
+/* Benchmark entry: returns ns per switch, or a negative value on error */
+typedef double (*bench_fn_t)(long long num_switches, long long warmup_switches);
+
+/* Suite entry: sweeps a parameter and reports a table (see bench.h) */
+typedef int (*bench_suite_fn_t)(double budget_ms);
+
+typedef struct {
+    const char *name;         /* Selection name (matched by --bench) */
+    const char *group;        /* Group name, also matched by --bench */
+    const char *label;        /* Human-readable name for the report */
+    char results_file[64];    /* Output file for plotting */
+    bench_fn_t run;           /* Sampled ns/switch benchmark, or NULL */
+    bench_suite_fn_t suite;   /* Table-style suite, or NULL */
+    const coro_backend_t *backend;  /* Ping-pong against this backend, or NULL */
+} bench_entry_t;
+
+/* Fixed benchmarks; one coroutine ping-pong entry per backend is added in main() */
+static const bench_entry_t static_benchmarks[] = {
+    { "stackless-inline", "inline", "Stackless inline", "stackless_inline_results.txt",
+      benchmark_stackless_inline, NULL, NULL },
+    { "ucontext-inline",  "inline", "Ucontext inline",  "ucontext_inline_results.txt",
+      benchmark_ucontext_inline,  NULL, NULL },
+    { "call",      "baseline",  "Direct call",    "call_results.txt",    benchmark_call,    NULL, NULL },
+    { "icall",     "baseline",  "Indirect call",  "icall_results.txt",   benchmark_icall,   NULL, NULL },
+    { "setjmp",    "baseline",  "Setjmp/longjmp", "setjmp_results.txt",  benchmark_setjmp,  NULL, NULL },
+    { "condvar",   "baseline",  "Condvar ping-pong", "condvar_results.txt", benchmark_condvar, NULL, NULL },
+    { "futex",     "baseline",  "Futex ping-pong",   "futex_results.txt",   benchmark_futex,   NULL, NULL },
+    { "pipe",      "baseline",  "Pipe ping-pong",    "pipe_results.txt",    benchmark_pipe,    NULL, NULL },
+    { "eventfd",   "baseline",  "Eventfd ping-pong", "eventfd_results.txt", benchmark_eventfd, NULL, NULL },
+    { "scaling",   "suite",     "Scaling",   "scaling_results.txt",   NULL, bench_scaling, NULL },
+    { "stackws",   "suite",     "Stack working-set", "stackws_results.txt", NULL, bench_stackws, NULL },
+    { "cold",      "suite",     "Cold-cache switch", "cold_results.txt",    NULL, bench_cold, NULL },
+    { "stacksize", "suite",     "Stack sizing",      "stacksize_results.txt", NULL, bench_stacksize, NULL },
+    { "density",   "suite",     "Stack density",     "density_results.txt",   NULL, bench_density, NULL },
+    { "hugestack", "suite",     "Huge-page stacks",  "hugestack_results.txt", NULL, bench_hugestack, NULL },
+    { "coloring",  "suite",     "Stack coloring",    "coloring_results.txt",  NULL, bench_coloring, NULL },
+    { "stats",     "suite",     "Run time accounting", "stats_results.txt",   NULL, bench_stats, NULL },
+    { "cls",       "suite",     "Coroutine-local storage", "cls_results.txt", NULL, bench_cls, NULL },
+    { "sched",     "suite",     "Scheduling classes", "sched_results.txt",    NULL, bench_sched, NULL },
+    { "preempt",   "suite",     "Time-slice preemption", "preempt_results.txt", NULL, bench_preempt, NULL },
+    { "slice",     "suite",     "Time-slice check",  "slice_results.txt",     NULL, bench_slice, NULL },
+    { "offload",   "suite",     "Blocking-call offload", "offload_results.txt", NULL, bench_offload, NULL },
+    { "hook",      "suite",     "Hooked echo server", "hook_results.txt",     NULL, bench_hook, NULL },
+    { "batch",     "suite",     "Batched writes",     "batch_results.txt",    NULL, bench_batch, NULL },
+    { "busypoll",  "suite",     "Reactor busy-polling", "busypoll_results.txt", NULL, bench_busypoll, NULL },
+    { "idle",      "suite",     "Idle strategies",    "idle_results.txt",     NULL, bench_idle, NULL },
+    { "interleave", "suite",    "Interleaved lookups", "interleave_results.txt", NULL, bench_interleave, NULL },
+};
+
+#define NUM_STATIC_BENCHMARKS ((int)(sizeof(static_benchmarks) / sizeof(static_benchmarks[0])))
+
+static bench_entry_t benchmarks[CORO_BACKEND_MAX + NUM_STATIC_BENCHMARKS];
+static int num_benchmarks = 0;
+
+/* --list requested */
+static bool list_only = false;
+
 /**
  * Calculate statistics from samples
  */
@@ -175,80 +321,517 @@ void calculate_stats(double *samples, int n, double *mean, double *min, double *
 }
 
 /**
- * Main benchmark driver
+ * Order doubles ascending
  */
-int main(int argc, char *argv[]) {
-    printf("=======================================================\n");
-    printf("  Coroutine Context-Switch Benchmark Suite\n");
-    printf("=======================================================\n");
-    printf("Number of switches: %d\n", NUM_SWITCHES);
-    printf("Number of samples: %d\n", NUM_SAMPLES);
-    printf("-------------------------------------------------------\n\n");
+int bench_compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Index a sorted sample array by a fraction in thousandths
+ */
+double bench_percentile(const double *sorted, int n, int per_mille) {
+    long long i = (long long)n * per_mille / 1000;
+    return sorted[i < n ? i : n - 1];
+}
+
+/**
+ * Shuffle with the seed every suite's shuffled orders have used
+ */
+void bench_shuffle(int *order, int n) {
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(bench_rand(&state) % (unsigned long long)(i + 1));
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+/**
+ * Read the resident page count and scale it to bytes
+ */
+long long bench_rss_bytes(void) {
+    long long size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) {
+        return 0;
+    }
+    if (fscanf(f, "%lld %lld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Parse a count with an optional k/M/G suffix (e.g. "10M")
+ * Returns: the value, or -1 if the string is not a valid count
+ */
+static long long parse_count(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
     
-    /* Determine which benchmark to run */
-    char *benchmark_type = (argc > 1) ? argv[1] : "both";
+    switch (*end) {
+        case 'k': case 'K': v *= 1e3; end++; break;
+        case 'm': case 'M': v *= 1e6; end++; break;
+        case 'g': case 'G': v *= 1e9; end++; break;
+        default: break;
+    }
     
-    if (strcmp(benchmark_type, "stackless") == 0 || strcmp(benchmark_type, "both") == 0) {
-        printf("Running STACKLESS coroutine benchmark...\n");
-        fflush(stdout);
-        
-        double stackless_samples[NUM_SAMPLES];
-        for (int i = 0; i < NUM_SAMPLES; i++) {
-            stackless_samples[i] = benchmark_stackless();
-            printf("  Sample %d: %.2f ns/switch\n", i + 1, stackless_samples[i]);
-            fflush(stdout);
+    if (end == s || *end != '\0' || v < 0) {
+        return -1;
+    }
+    return (long long)v;
+}
+
+/**
+ * Check whether a benchmark is selected by the --bench patterns
+ * Patterns match the name or the group; "both" (the default) is an
+ * alias for the "coroutine" group, one ping-pong benchmark per backend.
+ */
+static bool is_selected(const bench_entry_t *b) {
+    static const char *const default_patterns[] = { "both" };
+    const char *const *patterns = bench_config.patterns;
+    int num_patterns = bench_config.num_patterns;
+    
+    if (num_patterns == 0) {
+        patterns = default_patterns;
+        num_patterns = 1;
+    }
+    
+    for (int i = 0; i < num_patterns; i++) {
+        const char *pat = patterns[i];
+        if (strcmp(pat, "all") == 0) return true;
+        if (strcmp(pat, "both") == 0) pat = "coroutine";
+        if (fnmatch(pat, b->name, 0) == 0) return true;
+        if (fnmatch(pat, b->group, 0) == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * Check whether a backend is selected by the --backend patterns
+ */
+bool bench_backend_selected(const coro_backend_t *backend) {
+    if (bench_config.num_backend_patterns == 0) {
+        return true;
+    }
+    
+    for (int i = 0; i < bench_config.num_backend_patterns; i++) {
+        if (fnmatch(bench_config.backend_patterns[i], backend->name, 0) == 0) {
+            return true;
         }
+    }
+    return false;
+}
+
+/**
+ * Pick a suite row's unit count from the time budget or --switches
+ */
+long long bench_suite_count(double row_ms, double unit_ns, long long def, long long max) {
+    long long count = bench_config.switches_set ? bench_config.num_switches : def;
+    
+    if (bench_config.calibrate && unit_ns > 0) {
+        count = (long long)(row_ms * 1e6 / unit_ns);
+    } else if (bench_config.switches_set && count > max) {
+        printf("  (--switches=%lld is more than this suite runs per row, clamped to %lld)\n",
+               count, max);
+    }
+    if (count > max) count = max;
+    return count < 1 ? 1 : count;
+}
+
+/**
+ * Add a comma-separated list of patterns to a selection
+ */
+static int add_patterns(char *list, const char **patterns, int *num_patterns) {
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        if (*num_patterns >= MAX_PATTERNS) {
+            fprintf(stderr, "Error: Too many patterns (max %d)\n", MAX_PATTERNS);
+            return -1;
+        }
+        patterns[(*num_patterns)++] = tok;
+    }
+    return 0;
+}
+
+/**
+ * Build the benchmark table: one ping-pong entry per selected backend,
+ * followed by the fixed baselines and suites
+ */
+static void build_benchmarks(void) {
+    num_benchmarks = 0;
+    
+    for (int i = 0; i < coro_backend_count(); i++) {
+        const coro_backend_t *backend = coro_backend_get(i);
+        if (!bench_backend_selected(backend)) continue;
         
-        double mean, min, max;
-        calculate_stats(stackless_samples, NUM_SAMPLES, &mean, &min, &max);
-        
-        printf("\nStackless Results:\n");
-        printf("  Mean:  %.2f ns/switch\n", mean);
-        printf("  Min:   %.2f ns/switch\n", min);
-        printf("  Max:   %.2f ns/switch\n", max);
-        printf("-------------------------------------------------------\n\n");
-        
-        /* Save results to file */
-        FILE *f = fopen("stackless_results.txt", "w");
-        if (f) {
-            fprintf(f, "mean=%.2f\n", mean);
-            fprintf(f, "min=%.2f\n", min);
-            fprintf(f, "max=%.2f\n", max);
-            fclose(f);
-            printf("Results saved to stackless_results.txt\n\n");
+        bench_entry_t *b = &benchmarks[num_benchmarks++];
+        memset(b, 0, sizeof(*b));
+        b->name = backend->name;
+        b->group = "coroutine";
+        b->label = backend->label;
+        snprintf(b->results_file, sizeof(b->results_file), "%s_results.txt", backend->name);
+        b->backend = backend;
+    }
+    
+    for (int i = 0; i < NUM_STATIC_BENCHMARKS; i++) {
+        benchmarks[num_benchmarks++] = static_benchmarks[i];
+    }
+}
+
+/**
+ * Run one sample of a sampled benchmark
+ * With calibration the warmup is scaled down with the switch count, so a
+ * short sample is not dominated by a fixed --warmup.
+ */
+static double run_sample(const bench_entry_t *b, long long num_switches) {
+    long long warmup = bench_config.warmup_switches;
+    if (bench_config.calibrate && warmup > num_switches / CALIBRATE_WARMUP_DIVISOR) {
+        warmup = num_switches / CALIBRATE_WARMUP_DIVISOR;
+    }
+    
+    if (b->backend) {
+        return benchmark_pingpong(b->backend, num_switches, warmup);
+    }
+    return b->run(num_switches, warmup);
+}
+
+/**
+ * Measure the cost of one switch
+ * Doubles a probe run until it is long enough to time reliably.
+ * Returns: ns per switch, or -1 on failure
+ */
+static double calibrate_switch_ns(const bench_entry_t *b) {
+    long long n = CALIBRATE_MIN_SWITCHES;
+    
+    for (;;) {
+        double ns = run_sample(b, n);
+        if (ns < 0 || ns * n >= CALIBRATE_MIN_PROBE_NS) {
+            return ns;
         }
+        n *= 2;
+    }
+}
+
+/**
+ * Run all samples of one benchmark, print and save its statistics
+ */
+static int run_benchmark(const bench_entry_t *b, double target_ms) {
+    char upper[64];
+    size_t i;
+    for (i = 0; b->label[i] && i < sizeof(upper) - 1; i++) {
+        upper[i] = (char)toupper((unsigned char)b->label[i]);
     }
+    upper[i] = '\0';
     
-    if (strcmp(benchmark_type, "ucontext") == 0 || strcmp(benchmark_type, "both") == 0) {
-        printf("Running UCONTEXT coroutine benchmark...\n");
+    if (b->suite) {
+        printf("Running %s benchmark...\n", upper);
         fflush(stdout);
-        
-        double ucontext_samples[NUM_SAMPLES];
-        for (int i = 0; i < NUM_SAMPLES; i++) {
-            ucontext_samples[i] = benchmark_ucontext();
-            printf("  Sample %d: %.2f ns/switch\n", i + 1, ucontext_samples[i]);
-            fflush(stdout);
+        /* A suite gets the time share of one full sampled benchmark */
+        int rc = b->suite(target_ms * (bench_config.num_samples + 1));
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc == BENCH_SKIPPED) {
+            printf("\n");
+        } else {
+            printf("Results saved to %s\n\n", b->results_file);
+        }
+        return 0;
+    }
+    
+    long long num_switches = bench_config.num_switches;
+    if (bench_config.calibrate) {
+        long long start = get_time_ns();
+        double ns = calibrate_switch_ns(b);
+        if (ns < 0) {
+            fprintf(stderr, "Calibration failed for %s\n", b->name);
+            return -1;
         }
         
-        double mean, min, max;
-        calculate_stats(ucontext_samples, NUM_SAMPLES, &mean, &min, &max);
-        
-        printf("\nUcontext Results:\n");
-        printf("  Mean:  %.2f ns/switch\n", mean);
-        printf("  Min:   %.2f ns/switch\n", min);
-        printf("  Max:   %.2f ns/switch\n", max);
-        printf("-------------------------------------------------------\n\n");
-        
-        /* Save results to file */
-        FILE *f = fopen("ucontext_results.txt", "w");
-        if (f) {
-            fprintf(f, "mean=%.2f\n", mean);
-            fprintf(f, "min=%.2f\n", min);
-            fprintf(f, "max=%.2f\n", max);
-            fclose(f);
-            printf("Results saved to ucontext_results.txt\n\n");
+        /* Under a budget the probe and the warmups come out of the share */
+        double sample_ms = target_ms;
+        if (bench_config.time_budget_s > 0) {
+            double left_ms = target_ms * (bench_config.num_samples + 1) -
+                             (double)(get_time_ns() - start) / 1e6;
+            sample_ms = left_ms / (bench_config.num_samples * (1.0 + 1.0 / CALIBRATE_WARMUP_DIVISOR));
+        }
+        num_switches = (long long)(sample_ms * 1e6 / ns);
+        if (num_switches < CALIBRATE_MIN_SWITCHES) num_switches = CALIBRATE_MIN_SWITCHES;
+        printf("Calibrated %s: %lld switches/sample (target %.0f ms)\n",
+               b->name, num_switches, sample_ms > 0 ? sample_ms : 0.0);
+    }
+    
+    printf("Running %s %s benchmark...\n", upper, b->group);
+    fflush(stdout);
+    
+    double *samples = malloc(sizeof(double) * bench_config.num_samples);
+    if (!samples) {
+        fprintf(stderr, "Error: Failed to allocate sample buffer\n");
+        return -1;
+    }
+    
+    for (int s = 0; s < bench_config.num_samples; s++) {
+        samples[s] = run_sample(b, num_switches);
+        if (samples[s] < 0) {
+            free(samples);
+            return -1;
+        }
+        printf("  Sample %d: %.2f ns/switch\n", s + 1, samples[s]);
+        fflush(stdout);
+    }
+    
+    double mean, min, max;
+    calculate_stats(samples, bench_config.num_samples, &mean, &min, &max);
+    free(samples);
+    
+    printf("\n%s Results:\n", b->label);
+    printf("  Mean:  %.2f ns/switch\n", mean);
+    printf("  Min:   %.2f ns/switch\n", min);
+    printf("  Max:   %.2f ns/switch\n", max);
+    printf("-------------------------------------------------------\n\n");
+    
+    /* Save results to file */
+    FILE *f = fopen(b->results_file, "w");
+    if (f) {
+        fprintf(f, "mean=%.2f\n", mean);
+        fprintf(f, "min=%.2f\n", min);
+        fprintf(f, "max=%.2f\n", max);
+        fclose(f);
+        printf("Results saved to %s\n\n", b->results_file);
+    }
+    
+    return 0;
+}
+
+/**
+ * Print command-line usage
+ */
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] [BENCH...]\n", prog);
+    printf("\n");
+    printf("BENCH is a benchmark or group name, or a glob; \"both\" (the default)\n");
+    printf("selects the coroutine group, \"all\" selects every benchmark.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -b, --bench=PATTERNS    Comma-separated names/globs to run\n");
+    printf("  -n, --switches=N        Switches per sample (default %d)\n", DEFAULT_NUM_SWITCHES);
+    printf("  -w, --warmup=N          Warmup switches per sample (default %d)\n", DEFAULT_WARMUP_SWITCHES);
+    printf("  -s, --samples=N         Samples per benchmark (default %d)\n", DEFAULT_NUM_SAMPLES);
+    printf("  -c, --calibrate[=MS]    Auto-pick switches so a sample takes MS ms (default %d)\n", DEFAULT_TARGET_MS);
+    printf("  -t, --time-budget=SEC   Calibrate so the whole run fits in SEC seconds\n");
+    printf("  -m, --max-coros=N       Largest coroutine count in sweeps (default: pool limit)\n");
+    printf("  -B, --backend=PATTERNS  Coroutine backends to run against (default: all)\n");
+    printf("  -T, --trace=FILE        Record switches and write Chrome trace JSON (make trace)\n");
+    printf("  -M, --metrics[=MS]      Publish live metrics to /dev/shm every MS ms (default %d)\n",
+           CORO_METRICS_DEFAULT_INTERVAL_MS);
+    printf("  -l, --list              List available benchmarks and backends and exit\n");
+    printf("  -h, --help              Show this help\n");
+    printf("\n");
+    printf("Counts accept k/M/G suffixes, e.g. --switches=2M. Suites read --switches\n");
+    printf("as their own unit per row (pings, wakes, lookups, cold switches, ...)\n");
+    printf("and clamp it to the most a row runs.\n");
+}
+
+/**
+ * Parse command-line options into config
+ * Returns: 0 to continue, 1 to exit successfully, -1 on error
+ */
+static int parse_args(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        { "bench",       required_argument, NULL, 'b' },
+        { "switches",    required_argument, NULL, 'n' },
+        { "warmup",      required_argument, NULL, 'w' },
+        { "samples",     required_argument, NULL, 's' },
+        { "calibrate",   optional_argument, NULL, 'c' },
+        { "time-budget", required_argument, NULL, 't' },
+        { "max-coros",   required_argument, NULL, 'm' },
+        { "backend",     required_argument, NULL, 'B' },
+        { "trace",       required_argument, NULL, 'T' },
+        { "metrics",     optional_argument, NULL, 'M' },
+        { "list",        no_argument,       NULL, 'l' },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    
+    int opt;
+    long long v;
+    while ((opt = getopt_long(argc, argv, "b:n:w:s:c::t:m:B:T:M::lh", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                if (add_patterns(optarg, bench_config.patterns,
+                                 &bench_config.num_patterns) < 0) return -1;
+                break;
+            case 'n':
+                if ((v = parse_count(optarg)) <= 0) goto bad_value;
+                bench_config.num_switches = v;
+                bench_config.switches_set = true;
+                break;
+            case 'w':
+                if ((v = parse_count(optarg)) < 0) goto bad_value;
+                bench_config.warmup_switches = v;
+                break;
+            case 's':
+                if ((v = parse_count(optarg)) <= 0 || v > 100000) goto bad_value;
+                bench_config.num_samples = (int)v;
+                break;
+            case 'c':
+                bench_config.calibrate = true;
+                if (optarg) {
+                    bench_config.target_ms = strtod(optarg, NULL);
+                    if (bench_config.target_ms <= 0) goto bad_value;
+                }
+                break;
+            case 't':
+                bench_config.calibrate = true;
+                bench_config.time_budget_s = strtod(optarg, NULL);
+                if (bench_config.time_budget_s <= 0) goto bad_value;
+                break;
+            case 'm':
+                if ((v = parse_count(optarg)) < 2) goto bad_value;
+                bench_config.max_coros = v;
+                break;
+            case 'B':
+                if (add_patterns(optarg, bench_config.backend_patterns,
+                                 &bench_config.num_backend_patterns) < 0) return -1;
+                break;
+            case 'T':
+#ifndef CORO_TRACE
+                fprintf(stderr, "Error: Tracing is compiled out; use bin/bench-trace (make trace)\n");
+                return -1;
+#endif
+                bench_config.trace_path = optarg;
+                break;
+            case 'M':
+                bench_config.metrics_interval_ms = CORO_METRICS_DEFAULT_INTERVAL_MS;
+                if (optarg) {
+                    if ((v = parse_count(optarg)) <= 0 || v > 3600000) goto bad_value;
+                    bench_config.metrics_interval_ms = (int)v;
+                }
+                break;
+            case 'l':
+                list_only = true;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 1;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+    
+    /* Positional arguments are benchmark patterns */
+    for (int i = optind; i < argc; i++) {
+        if (add_patterns(argv[i], bench_config.patterns, &bench_config.num_patterns) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+    
+bad_value:
+    fprintf(stderr, "Error: Invalid value '%s' for -%c\n", optarg, opt);
+    return -1;
+}
+
+/**
+ * Print benchmarks and backends for --list
+ */
+static void list_benchmarks(void) {
+    printf("Benchmarks:\n");
+    for (int i = 0; i < num_benchmarks; i++) {
+        printf("  %-18s %-10s %s\n", benchmarks[i].name, benchmarks[i].group,
+               benchmarks[i].label);
+    }
+    
+    printf("\nBackends:\n");
+    for (int i = 0; i < coro_backend_count(); i++) {
+        const coro_backend_t *backend = coro_backend_get(i);
+        printf("  %-12s max %-8d%s%s\n", backend->name, backend->max_coros,
+               coro_backend_has(backend, CORO_BACKEND_CAP_STACKFUL) ? " stackful" : "",
+               coro_backend_has(backend, CORO_BACKEND_CAP_DEEP_STACK) ? " deep-stack" : "");
+    }
+}
+
+/**
+ * Main benchmark driver
+ */
+int main(int argc, char *argv[]) {
+    int rc = parse_args(argc, argv);
+    if (rc != 0) {
+        return rc < 0 ? 1 : 0;
+    }
+    
+    coro_backend_register_builtin();
+    build_benchmarks();
+    
+    if (list_only) {
+        list_benchmarks();
+        return 0;
+    }
+    
+    int selected = 0;
+    for (int i = 0; i < num_benchmarks; i++) {
+        if (is_selected(&benchmarks[i])) selected++;
+    }
+    if (selected == 0) {
+        fprintf(stderr, "Error: No benchmark matches the selection (see --list)\n");
+        return 1;
+    }
+    
+    /*
+     * A time budget is split evenly over every selected benchmark, one
+     * share being num_samples + 1 samples; calibration and warmup are
+     * charged to the share (see run_benchmark).
+     */
+    double target_ms = bench_config.target_ms;
+    if (bench_config.time_budget_s > 0) {
+        target_ms = bench_config.time_budget_s * 1000.0 / (selected * (bench_config.num_samples + 1));
+    }
+    
+    printf("=======================================================\n");
+    printf("  Coroutine Context-Switch Benchmark Suite\n");
+    printf("=======================================================\n");
+    if (bench_config.calibrate) {
+        printf("Number of switches: auto (%.1f ms/sample)\n", target_ms);
+    } else {
+        printf("Number of switches: %lld\n", bench_config.num_switches);
+    }
+    printf("Number of samples: %d\n", bench_config.num_samples);
+    if (bench_config.trace_path) {
+        printf("Tracing switches to: %s\n", bench_config.trace_path);
+    }
+    if (bench_config.metrics_interval_ms > 0) {
+        if (coro_metrics_open(NULL, bench_config.metrics_interval_ms) < 0) {
+            return 1;
+        }
+        printf("Live metrics: /dev/shm%s (scripts/coro_metrics.py %d)\n", coro_metrics_name(),
+               (int)getpid());
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    coro_trace_enable(bench_config.trace_path != NULL);
+    for (int i = 0; i < num_benchmarks; i++) {
+        if (!is_selected(&benchmarks[i])) continue;
+        if (run_benchmark(&benchmarks[i], target_ms) < 0) {
+            coro_metrics_close();
+            return 1;
+        }
+    }
+    
+    /* Only the last CORO_TRACE_RING_SIZE events per thread are kept */
+    if (bench_config.trace_path) {
+        coro_trace_enable(false);
+        long long events = coro_trace_export_chrome(bench_config.trace_path);
+        if (events < 0) {
+            return 1;
         }
+        printf("Trace: %lld events written to %s\n\n", events, bench_config.trace_path);
     }
+    coro_metrics_close();
     
     printf("=======================================================\n");
     printf("Benchmark completed successfully!\n");
@@ -0,0 +1,421 @@
+/**
+ * bench_baseline.c
+ * Baseline Switching Primitives
+ *
+ * Reference points for the coroutine numbers, reported in the same
+ * ns/switch units and sample format:
+ *   - direct and indirect function calls (lower bound, no state switch)
+ *   - setjmp/longjmp (register save/restore without a stack switch)
+ *   - condvar, futex, pipe and eventfd ping-pong between two threads
+ *     pinned to CPUs (kernel-mediated switches)
+ *
+ * As in the coroutine benchmarks, one "switch" is a full round trip:
+ * control goes to the other side and comes back.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include "bench.h"
+
+/* ============================================================
+ * FUNCTION CALL BASELINES
+ * ============================================================ */
+
+static long long baseline_counter = 0;
+
+/* Callee kept out of line so the call is really made */
+__attribute__((noinline))
+static void baseline_callee(void) {
+    baseline_counter++;
+    __asm__ volatile("" ::: "memory");
+}
+
+/* Called through this pointer; volatile stops devirtualisation */
+static void (*volatile baseline_indirect)(void) = baseline_callee;
+
+/**
+ * Direct call to a non-inlined function
+ */
+double benchmark_call(long long num_switches, long long warmup_switches) {
+    for (long long i = 0; i < warmup_switches; i++) {
+        baseline_callee();
+    }
+    
+    long long start = get_time_ns();
+    for (long long i = 0; i < num_switches; i++) {
+        baseline_callee();
+    }
+    long long end = get_time_ns();
+    
+    return (double)(end - start) / num_switches;
+}
+
+/**
+ * Indirect call through a function pointer
+ */
+double benchmark_icall(long long num_switches, long long warmup_switches) {
+    for (long long i = 0; i < warmup_switches; i++) {
+        baseline_indirect();
+    }
+    
+    long long start = get_time_ns();
+    for (long long i = 0; i < num_switches; i++) {
+        baseline_indirect();
+    }
+    long long end = get_time_ns();
+    
+    return (double)(end - start) / num_switches;
+}
+
+/* ============================================================
+ * SETJMP/LONGJMP BASELINE
+ * ============================================================ */
+
+static jmp_buf baseline_jmp;
+
+/* Jump back to the setjmp point in the caller */
+__attribute__((noinline, noreturn))
+static void baseline_jump_back(void) {
+    baseline_counter++;
+    longjmp(baseline_jmp, 1);
+}
+
+/**
+ * setjmp, call, longjmp back: one save and one restore per switch
+ */
+double benchmark_setjmp(long long num_switches, long long warmup_switches) {
+    /* volatile: the loop counter must survive longjmp */
+    volatile long long i;
+    
+    for (i = 0; i < warmup_switches; i++) {
+        if (setjmp(baseline_jmp) == 0) {
+            baseline_jump_back();
+        }
+    }
+    
+    long long start = get_time_ns();
+    for (i = 0; i < num_switches; i++) {
+        if (setjmp(baseline_jmp) == 0) {
+            baseline_jump_back();
+        }
+    }
+    long long end = get_time_ns();
+    
+    return (double)(end - start) / num_switches;
+}
+
+/* ============================================================
+ * THREAD PING-PONG BASELINES
+ * ============================================================ */
+
+/* One ping-pong mechanism: ping runs on the main thread, pong on the partner */
+typedef struct {
+    const char *name;
+    int (*setup)(void);
+    void (*ping)(void);
+    void (*pong)(void);
+    void (*teardown)(void);
+} pingpong_ops_t;
+
+/* Partner thread arguments */
+typedef struct {
+    const pingpong_ops_t *ops;
+    long long rounds;
+    int cpu;                  /* CPU to pin to, -1 = unpinned */
+    bool pin_failed;
+} pingpong_partner_t;
+
+/* Mechanism last warned about running unpinned (once per row, not per sample) */
+static const pingpong_ops_t *pingpong_unpinned_warned = NULL;
+
+/**
+ * Pin the calling thread to one CPU
+ * Returns: 0 on success, -1 on failure
+ */
+static int pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+/**
+ * First two CPUs this thread may run on
+ * Returns: 0 on success, -1 if fewer than two are allowed
+ */
+static int pick_two_cpus(const cpu_set_t *allowed, int cpus[2]) {
+    int found = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && found < 2; cpu++) {
+        if (CPU_ISSET(cpu, allowed)) {
+            cpus[found++] = cpu;
+        }
+    }
+    return found == 2 ? 0 : -1;
+}
+
+static void *pingpong_partner(void *arg) {
+    pingpong_partner_t *p = (pingpong_partner_t *)arg;
+    
+    if (p->cpu >= 0 && pin_to_cpu(p->cpu) < 0) {
+        p->pin_failed = true;
+    }
+    for (long long i = 0; i < p->rounds; i++) {
+        p->ops->pong();
+    }
+    return NULL;
+}
+
+/**
+ * Run warmup + measured round trips against a pinned partner thread
+ * The partner answers exactly as many pings as are sent, so no
+ * separate stop protocol is needed.
+ */
+static double run_pingpong(const pingpong_ops_t *ops, long long num_switches,
+                           long long warmup_switches) {
+    if (ops->setup() < 0) {
+        fprintf(stderr, "Failed to set up %s ping-pong\n", ops->name);
+        return -1.0;
+    }
+    
+    pthread_t partner;
+    pingpong_partner_t args = { ops, warmup_switches + num_switches, -1, false };
+    
+    /*
+     * Main thread pinned to the first CPU it may use, partner to the
+     * second; with fewer than two, or if pinning fails, the row runs
+     * unpinned and is flagged on stderr
+     */
+    cpu_set_t saved;
+    int cpus[2];
+    const char *unpinned = NULL;
+    if (sched_getaffinity(0, sizeof(saved), &saved) != 0) {
+        unpinned = "cannot read CPU affinity";
+    } else if (pick_two_cpus(&saved, cpus) < 0) {
+        unpinned = "fewer than two CPUs allowed";
+    } else if (pin_to_cpu(cpus[0]) < 0) {
+        unpinned = "pthread_setaffinity_np failed";
+    } else {
+        args.cpu = cpus[1];
+    }
+    
+    if (pthread_create(&partner, NULL, pingpong_partner, &args) != 0) {
+        fprintf(stderr, "Failed to create %s partner thread\n", ops->name);
+        if (args.cpu >= 0) {
+            pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+        }
+        ops->teardown();
+        return -1.0;
+    }
+    
+    for (long long i = 0; i < warmup_switches; i++) {
+        ops->ping();
+    }
+    
+    long long start = get_time_ns();
+    for (long long i = 0; i < num_switches; i++) {
+        ops->ping();
+    }
+    long long end = get_time_ns();
+    
+    pthread_join(partner, NULL);
+    if (args.cpu >= 0) {
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    }
+    ops->teardown();
+    
+    if (args.pin_failed) {
+        unpinned = "pthread_setaffinity_np failed for the partner";
+    }
+    if (unpinned && pingpong_unpinned_warned != ops) {
+        fprintf(stderr, "Warning: %s ping-pong ran unpinned (%s); "
+                "numbers include scheduler placement\n", ops->name, unpinned);
+        pingpong_unpinned_warned = ops;
+    }
+    
+    return (double)(end - start) / num_switches;
+}
+
+/* --- pthread condition variable --- */
+
+static pthread_mutex_t cv_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cv_cond = PTHREAD_COND_INITIALIZER;
+static int cv_turn = 0;  /* 0 = main's turn, 1 = partner's turn */
+
+static int condvar_setup(void) {
+    cv_turn = 0;
+    return 0;
+}
+
+static void condvar_ping(void) {
+    pthread_mutex_lock(&cv_mutex);
+    cv_turn = 1;
+    pthread_cond_signal(&cv_cond);
+    while (cv_turn == 1) {
+        pthread_cond_wait(&cv_cond, &cv_mutex);
+    }
+    pthread_mutex_unlock(&cv_mutex);
+}
+
+static void condvar_pong(void) {
+    pthread_mutex_lock(&cv_mutex);
+    while (cv_turn == 0) {
+        pthread_cond_wait(&cv_cond, &cv_mutex);
+    }
+    cv_turn = 0;
+    pthread_cond_signal(&cv_cond);
+    pthread_mutex_unlock(&cv_mutex);
+}
+
+static void condvar_teardown(void) {
+}
+
+/* --- raw futex --- */
+
+static atomic_int futex_word = 0;  /* 0 = main's turn, 1 = partner's turn */
+
+static void futex_wait(atomic_int *addr, int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_int *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static int futex_setup(void) {
+    atomic_store(&futex_word, 0);
+    return 0;
+}
+
+static void futex_ping(void) {
+    atomic_store(&futex_word, 1);
+    futex_wake(&futex_word);
+    while (atomic_load(&futex_word) == 1) {
+        futex_wait(&futex_word, 1);
+    }
+}
+
+static void futex_pong(void) {
+    while (atomic_load(&futex_word) == 0) {
+        futex_wait(&futex_word, 0);
+    }
+    atomic_store(&futex_word, 0);
+    futex_wake(&futex_word);
+}
+
+static void futex_teardown(void) {
+}
+
+/* --- pipe pair --- */
+
+static int ping_pipe[2] = { -1, -1 };
+static int pong_pipe[2] = { -1, -1 };
+
+static int pipe_setup(void) {
+    if (pipe(ping_pipe) < 0) {
+        return -1;
+    }
+    if (pipe(pong_pipe) < 0) {
+        close(ping_pipe[0]);
+        close(ping_pipe[1]);
+        return -1;
+    }
+    return 0;
+}
+
+static void pipe_ping(void) {
+    char c = 1;
+    if (write(ping_pipe[1], &c, 1) != 1 || read(pong_pipe[0], &c, 1) != 1) {
+        perror("pipe ping");
+    }
+}
+
+static void pipe_pong(void) {
+    char c;
+    if (read(ping_pipe[0], &c, 1) != 1 || write(pong_pipe[1], &c, 1) != 1) {
+        perror("pipe pong");
+    }
+}
+
+static void pipe_teardown(void) {
+    close(ping_pipe[0]);
+    close(ping_pipe[1]);
+    close(pong_pipe[0]);
+    close(pong_pipe[1]);
+}
+
+/* --- eventfd pair --- */
+
+static int ping_efd = -1;
+static int pong_efd = -1;
+
+static int eventfd_setup(void) {
+    ping_efd = eventfd(0, 0);
+    pong_efd = eventfd(0, 0);
+    if (ping_efd < 0 || pong_efd < 0) {
+        if (ping_efd >= 0) close(ping_efd);
+        if (pong_efd >= 0) close(pong_efd);
+        return -1;
+    }
+    return 0;
+}
+
+static void eventfd_ping(void) {
+    uint64_t v = 1;
+    if (write(ping_efd, &v, sizeof(v)) != sizeof(v) ||
+        read(pong_efd, &v, sizeof(v)) != sizeof(v)) {
+        perror("eventfd ping");
+    }
+}
+
+static void eventfd_pong(void) {
+    uint64_t v;
+    if (read(ping_efd, &v, sizeof(v)) != sizeof(v) ||
+        write(pong_efd, &v, sizeof(v)) != sizeof(v)) {
+        perror("eventfd pong");
+    }
+}
+
+static void eventfd_teardown(void) {
+    close(ping_efd);
+    close(pong_efd);
+}
+
+static const pingpong_ops_t condvar_ops = {
+    "condvar", condvar_setup, condvar_ping, condvar_pong, condvar_teardown
+};
+static const pingpong_ops_t futex_ops = {
+    "futex", futex_setup, futex_ping, futex_pong, futex_teardown
+};
+static const pingpong_ops_t pipe_ops = {
+    "pipe", pipe_setup, pipe_ping, pipe_pong, pipe_teardown
+};
+static const pingpong_ops_t eventfd_ops = {
+    "eventfd", eventfd_setup, eventfd_ping, eventfd_pong, eventfd_teardown
+};
+
+double benchmark_condvar(long long num_switches, long long warmup_switches) {
+    return run_pingpong(&condvar_ops, num_switches, warmup_switches);
+}
+
+double benchmark_futex(long long num_switches, long long warmup_switches) {
+    return run_pingpong(&futex_ops, num_switches, warmup_switches);
+}
+
+double benchmark_pipe(long long num_switches, long long warmup_switches) {
+    return run_pingpong(&pipe_ops, num_switches, warmup_switches);
+}
+
+double benchmark_eventfd(long long num_switches, long long warmup_switches) {
+    return run_pingpong(&eventfd_ops, num_switches, warmup_switches);
+}
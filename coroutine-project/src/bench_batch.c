@@ -0,0 +1,303 @@
+/**
+ * bench_batch.c
+ * Batched Write Flushing Benchmark
+ *
+ * Sender coroutines share one loopback socket, either a connected UDP
+ * socket or one end of a TCP connection. Each sends one small message
+ * per reactor pass. A receiver coroutine on the same reactor drains the
+ * other end. With batching off every message is its own write() (the
+ * sender yields after it); with batching on the writes of one pass go
+ * out in one sendmmsg() or writev(). For 1 to 1024 senders the suite
+ * reports messages per second and write system calls per message.
+ */
+#define _GNU_SOURCE
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+#include "coro_reactor.h"
+#include "coro_ucontext.h"
+
+/* Messages per row (overridden by --switches) */
+#define BATCH_DEFAULT_MESSAGES 200000
+#define BATCH_MAX_MESSAGES 10000000
+
+/* Bytes per message */
+#define BATCH_MSG_BYTES 64
+
+/* Datagrams per recvmmsg() in the UDP receiver */
+#define BATCH_RECV_VLEN 64
+
+/* UDP receiver gives up this long after the last datagram */
+#define BATCH_DRAIN_MS 10
+
+/* UDP receive buffer asked for, so bursts of a whole pass fit */
+#define BATCH_RCVBUF (16 * 1024 * 1024)
+
+/* Messages in the --calibrate probe row */
+#define BATCH_PROBE_MESSAGES 2000
+
+/* Senders per row */
+static const int batch_senders[] = { 1, 16, 256, 1024 };
+#define BATCH_NUM_SENDERS ((int)(sizeof(batch_senders) / sizeof(batch_senders[0])))
+
+/* Shared state of one row */
+typedef struct {
+    coro_sched_t *sched;
+    bool udp;
+    bool batching;
+    int tx;                   /* Socket the senders share */
+    int rx;                   /* Receiving end */
+    int senders;
+    int per_sender;           /* Messages per sender */
+    int finished;             /* Senders done */
+    long long last_end_ns;    /* When the last sender finished */
+    long long received;       /* Datagrams (UDP) or bytes (TCP) */
+    long long expected;       /* Bytes the TCP receiver waits for */
+    int errors;
+} batch_run_t;
+
+/* Sender: one message per pass */
+static int batch_sender_step(void *arg) {
+    batch_run_t *run = arg;
+    char msg[BATCH_MSG_BYTES];
+    
+    memset(msg, 'b', sizeof(msg));
+    for (int i = 0; i < run->per_sender; i++) {
+        if (coro_io_write(run->tx, msg, sizeof(msg)) != (ssize_t)sizeof(msg)) {
+            run->errors++;
+            break;
+        }
+        /* A batched write already waited for the end of the pass */
+        if (!run->batching) {
+            run->sched->backend->yield();
+        }
+    }
+    run->finished++;
+    run->last_end_ns = get_time_ns();
+    return 1;
+}
+
+/* Receiver: drain the other end until every message is in (or lost) */
+static int batch_receiver_step(void *arg) {
+    batch_run_t *run = arg;
+    
+    if (!run->udp) {
+        char buf[16 * 1024];
+        while (run->received < run->expected) {
+            ssize_t n = coro_io_read(run->rx, buf, sizeof(buf));
+            if (n <= 0) {
+                run->errors++;
+                break;
+            }
+            run->received += n;
+        }
+        return 1;
+    }
+    
+    char bufs[BATCH_RECV_VLEN][BATCH_MSG_BYTES];
+    struct iovec iov[BATCH_RECV_VLEN];
+    struct mmsghdr msgs[BATCH_RECV_VLEN];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < BATCH_RECV_VLEN; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = sizeof(bufs[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (;;) {
+        int n = recvmmsg(run->rx, msgs, BATCH_RECV_VLEN, MSG_DONTWAIT, NULL);
+        if (n > 0) {
+            run->received += n;
+            continue;
+        }
+        if (coro_io_wait(run->rx, POLLIN, BATCH_DRAIN_MS) == 0 && run->finished == run->senders) {
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Open a loopback socket pair: connected UDP sockets or a TCP connection
+ * Returns: 0 on success, -1 on failure
+ */
+static int batch_open(batch_run_t *run) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int type = run->udp ? SOCK_DGRAM : SOCK_STREAM;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    int server = socket(AF_INET, type, 0);
+    run->tx = socket(AF_INET, type, 0);
+    run->rx = -1;
+    if (server < 0 || run->tx < 0 ||
+        bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(server, (struct sockaddr *)&addr, &len) < 0 ||
+        (!run->udp && listen(server, 1) < 0) ||
+        connect(run->tx, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Error: Failed to open loopback %s sockets\n", run->udp ? "UDP" : "TCP");
+        if (server >= 0) coro_io_close(server);
+        if (run->tx >= 0) coro_io_close(run->tx);
+        return -1;
+    }
+    
+    if (run->udp) {
+        int size = BATCH_RCVBUF;
+        if (setsockopt(server, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+            setsockopt(server, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+        run->rx = server;
+        return 0;
+    }
+    
+    run->rx = accept(server, NULL, NULL);
+    coro_io_close(server);
+    if (run->rx < 0) {
+        fprintf(stderr, "Error: Failed to accept loopback TCP connection\n");
+        coro_io_close(run->tx);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Run one row
+ * Returns: elapsed nanoseconds until the last sender finished, or -1 on failure
+ */
+static long long batch_measure(batch_run_t *run, long long *write_calls, long long *writes) {
+    coro_sched_t sched;
+    coro_reactor_t reactor;
+    long long elapsed = -1;
+    
+    if (batch_open(run) < 0) {
+        return -1;
+    }
+    if (coro_sched_init(&sched, &coro_ucontext_backend) < 0) goto out_sockets;
+    if (coro_reactor_init(&reactor, &sched) < 0) goto out_sched;
+    coro_reactor_set_batching(&reactor, run->batching);
+    
+    run->sched = &sched;
+    run->finished = 0;
+    run->received = 0;
+    run->errors = 0;
+    run->expected = (long long)run->senders * run->per_sender * BATCH_MSG_BYTES;
+    if (coro_sched_spawn(&sched, batch_receiver_step, run, 0) < 0) goto out;
+    for (int i = 0; i < run->senders; i++) {
+        if (coro_sched_spawn(&sched, batch_sender_step, run, 0) < 0) goto out;
+    }
+    
+    long long start = get_time_ns();
+    if (coro_reactor_run(&reactor) < 0 || run->errors) goto out;
+    elapsed = run->last_end_ns - start;
+    *write_calls = reactor.write_calls;
+    *writes = reactor.writes;
+    
+out:
+    coro_reactor_cleanup(&reactor);
+out_sched:
+    coro_sched_cleanup(&sched);
+out_sockets:
+    coro_io_close(run->tx);
+    coro_io_close(run->rx);
+    return elapsed;
+}
+
+/**
+ * Time one unbatched TCP message, the slowest mode per message
+ * Returns: ns per message, or -1 on failure
+ */
+static double batch_probe(void) {
+    batch_run_t run;
+    long long write_calls, writes;
+    
+    memset(&run, 0, sizeof(run));
+    run.senders = 1;
+    run.per_sender = BATCH_PROBE_MESSAGES;
+    long long elapsed = batch_measure(&run, &write_calls, &writes);
+    return elapsed > 0 ? (double)elapsed / BATCH_PROBE_MESSAGES : -1.0;
+}
+
+/**
+ * Batched vs unbatched small writes over loopback UDP and TCP
+ */
+int bench_batch(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    /* Two transports, each sender count batched and unbatched */
+    double probe_ns = bench_config.calibrate ? batch_probe() : 0.0;
+    int messages = (int)bench_suite_count(budget_ms / (2 * BATCH_NUM_SENDERS * 2), probe_ns,
+                                          BATCH_DEFAULT_MESSAGES, BATCH_MAX_MESSAGES);
+    
+    FILE *f = fopen("batch_results.txt", "w");
+    if (f) {
+        fprintf(f, "transport,senders,mode,messages,msgs_per_sec,syscalls_per_msg,delivered_pct\n");
+    }
+    
+    printf("  Senders share one loopback socket, one %d-byte message each per pass;\n",
+           BATCH_MSG_BYTES);
+    printf("  %d messages per row\n", messages);
+    printf("  %9s %8s %10s %10s %12s %12s %10s\n", "transport", "senders", "mode", "messages",
+           "msgs/s", "syscalls/msg", "delivered");
+    
+    int rc = 0;
+    for (int t = 0; t < 2 && rc == 0; t++) {
+        for (int c = 0; c < BATCH_NUM_SENDERS && rc == 0; c++) {
+            int senders = batch_senders[c];
+            if (senders + 1 > coro_ucontext_backend.max_coros) continue;
+            if (bench_config.max_coros > 0 && senders + 1 > bench_config.max_coros) continue;
+            
+            for (int b = 0; b <= 1; b++) {
+                batch_run_t run;
+                memset(&run, 0, sizeof(run));
+                run.udp = t == 0;
+                run.batching = b == 1;
+                run.senders = senders;
+                run.per_sender = messages / senders > 0 ? messages / senders : 1;
+                
+                long long write_calls = 0, writes = 0;
+                long long elapsed = batch_measure(&run, &write_calls, &writes);
+                if (elapsed <= 0 || writes == 0) {
+                    fprintf(stderr, "Error: Batch row (%s, %d senders) failed\n",
+                            run.udp ? "udp" : "tcp", senders);
+                    rc = -1;
+                    break;
+                }
+                
+                double rate = (double)writes * 1e9 / (double)elapsed;
+                double per_msg = (double)write_calls / (double)writes;
+                double delivered = run.udp ? 100.0 * (double)run.received / (double)writes
+                                           : 100.0 * (double)run.received /
+                                             ((double)writes * BATCH_MSG_BYTES);
+                const char *transport = run.udp ? "udp" : "tcp";
+                const char *mode = run.batching ? "batched" : "unbatched";
+                
+                printf("  %9s %8d %10s %10lld %12.0f %12.3f %9.1f%%\n", transport, senders, mode,
+                       writes, rate, per_msg, delivered);
+                fflush(stdout);
+                
+                if (f) {
+                    fprintf(f, "%s,%d,%s,%lld,%.0f,%.4f,%.2f\n", transport, senders, mode,
+                            writes, rate, per_msg, delivered);
+                }
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    return rc;
+}
@@ -0,0 +1,297 @@
+/**
+ * bench_busypoll.c
+ * Reactor Busy-Polling Benchmark
+ *
+ * A client thread ping-pongs 64-byte messages over loopback TCP with an
+ * echo coroutine on a reactor thread. Between pings the client pauses,
+ * so the reactor goes idle and waits in the mode under test: blocking in
+ * epoll_wait(), spinning for a fixed budget first, or spinning for an
+ * adaptive budget. The suite reports round-trip percentiles, the reactor
+ * thread's CPU use, and how many waits the spin caught.
+ */
+#define _GNU_SOURCE
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench.h"
+#include "coro_reactor.h"
+#include "coro_ucontext.h"
+
+/* Pings in the back-to-back row (overridden by --switches); paced rows run fewer */
+#define BUSYPOLL_DEFAULT_PINGS 20000
+#define BUSYPOLL_MAX_PINGS 1000000
+
+/* Pings of the --calibrate probe's back-to-back row; paced rows run fewer */
+#define BUSYPOLL_PROBE_PINGS 200
+
+/* Bytes per ping */
+#define BUSYPOLL_MSG_BYTES 64
+
+/* Spin limit of the spinning and adaptive modes */
+#define BUSYPOLL_SPIN_MAX_NS 200000ULL
+
+/* Client pause between pings, and the share of the pings each row runs */
+static const struct {
+    long long gap_ns;
+    int divisor;
+} busypoll_gaps[] = {
+    { 0, 1 },
+    { 50000, 2 },
+    { 1000000, 10 },
+};
+#define BUSYPOLL_NUM_GAPS ((int)(sizeof(busypoll_gaps) / sizeof(busypoll_gaps[0])))
+
+static const struct {
+    coro_poll_mode_t mode;
+    const char *name;
+} busypoll_modes[] = {
+    { CORO_POLL_BLOCK, "block" },
+    { CORO_POLL_SPIN, "spin" },
+    { CORO_POLL_ADAPTIVE, "adaptive" },
+};
+#define BUSYPOLL_NUM_MODES ((int)(sizeof(busypoll_modes) / sizeof(busypoll_modes[0])))
+
+/* Client thread state */
+typedef struct {
+    int fd;
+    int pings;
+    long long gap_ns;
+    double *rtt_us;           /* Round trip of each ping */
+    int done;                 /* Pings completed */
+} busypoll_client_t;
+
+/* Client: pause, ping, wait for the echo; then close its side */
+static void *busypoll_client(void *arg) {
+    busypoll_client_t *c = arg;
+    char msg[BUSYPOLL_MSG_BYTES];
+    
+    memset(msg, 'p', sizeof(msg));
+    for (int i = 0; i < c->pings; i++) {
+        if (c->gap_ns > 0) {
+            struct timespec gap = { 0, (long)c->gap_ns };
+            nanosleep(&gap, NULL);
+        }
+        
+        long long start = get_time_ns();
+        if (write(c->fd, msg, sizeof(msg)) != (ssize_t)sizeof(msg)) {
+            break;
+        }
+        size_t got = 0;
+        while (got < sizeof(msg)) {
+            ssize_t n = read(c->fd, msg + got, sizeof(msg) - got);
+            if (n <= 0) {
+                goto out;
+            }
+            got += (size_t)n;
+        }
+        c->rtt_us[i] = (double)(get_time_ns() - start) / 1000.0;
+        c->done++;
+    }
+    
+out:
+    shutdown(c->fd, SHUT_WR);
+    return NULL;
+}
+
+/* Server: echo until the client closes */
+static int busypoll_server_step(void *arg) {
+    int fd = *(int *)arg;
+    char buf[BUSYPOLL_MSG_BYTES];
+    
+    for (;;) {
+        ssize_t n = coro_io_read(fd, buf, sizeof(buf));
+        if (n <= 0 || coro_io_write(fd, buf, (size_t)n) != n) {
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Connect a loopback TCP pair with Nagle off on both ends
+ * Returns: 0 on success, -1 on failure
+ */
+static int busypoll_connect(int *client, int *server) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int one = 1;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    *client = socket(AF_INET, SOCK_STREAM, 0);
+    *server = -1;
+    if (listener >= 0 && *client >= 0 &&
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        getsockname(listener, (struct sockaddr *)&addr, &len) == 0 &&
+        listen(listener, 1) == 0 &&
+        connect(*client, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        *server = accept(listener, NULL, NULL);
+    }
+    if (listener >= 0) coro_io_close(listener);
+    if (*server < 0) {
+        fprintf(stderr, "Error: Failed to open loopback TCP connection\n");
+        if (*client >= 0) coro_io_close(*client);
+        return -1;
+    }
+    
+    setsockopt(*client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(*server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 0;
+}
+
+/**
+ * Run one row: the echo coroutine on this thread, the client on another
+ * Returns: 0 on success, -1 on failure
+ */
+static int busypoll_measure(coro_poll_mode_t mode, busypoll_client_t *client,
+                            double *cpu_pct, double *hit_pct) {
+    coro_sched_t sched;
+    coro_reactor_t reactor;
+    pthread_t thread;
+    int server;
+    int rc = -1;
+    
+    if (busypoll_connect(&client->fd, &server) < 0) {
+        return -1;
+    }
+    if (coro_sched_init(&sched, &coro_ucontext_backend) < 0) goto out_sockets;
+    if (coro_reactor_init(&reactor, &sched) < 0) goto out_sched;
+    coro_reactor_set_polling(&reactor, mode, BUSYPOLL_SPIN_MAX_NS);
+    if (coro_sched_spawn(&sched, busypoll_server_step, &server, 0) < 0) goto out;
+    if (pthread_create(&thread, NULL, busypoll_client, client) != 0) {
+        fprintf(stderr, "Error: Failed to create client thread\n");
+        goto out;
+    }
+    
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    long long start = get_time_ns();
+    long long steps = coro_reactor_run(&reactor);
+    long long elapsed = get_time_ns() - start;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    pthread_join(thread, NULL);
+    
+    if (steps >= 0 && elapsed > 0 && client->done == client->pings) {
+        double cpu_ns = (double)(cpu_end.tv_sec - cpu_start.tv_sec) * 1e9 +
+                        (double)(cpu_end.tv_nsec - cpu_start.tv_nsec);
+        *cpu_pct = 100.0 * cpu_ns / (double)elapsed;
+        *hit_pct = reactor.spins > 0 ? 100.0 * (double)reactor.spin_hits / (double)reactor.spins
+                                     : 0.0;
+        rc = 0;
+    }
+    
+out:
+    coro_reactor_cleanup(&reactor);
+out_sched:
+    coro_sched_cleanup(&sched);
+out_sockets:
+    coro_io_close(client->fd);
+    coro_io_close(server);
+    return rc;
+}
+
+/**
+ * Time every gap's row in block mode with a few pings
+ * Returns: ns per unit of the ping count across all rows, or -1 on failure
+ */
+static double busypoll_probe(void) {
+    double rtt_us[BUSYPOLL_PROBE_PINGS];
+    double ns = 0.0;
+    
+    for (int g = 0; g < BUSYPOLL_NUM_GAPS; g++) {
+        busypoll_client_t client;
+        memset(&client, 0, sizeof(client));
+        client.pings = BUSYPOLL_PROBE_PINGS / busypoll_gaps[g].divisor;
+        client.gap_ns = busypoll_gaps[g].gap_ns;
+        client.rtt_us = rtt_us;
+        
+        double cpu_pct, hit_pct;
+        long long start = get_time_ns();
+        if (busypoll_measure(CORO_POLL_BLOCK, &client, &cpu_pct, &hit_pct) < 0) {
+            return -1.0;
+        }
+        ns += (double)(get_time_ns() - start) / BUSYPOLL_PROBE_PINGS;
+    }
+    return ns * BUSYPOLL_NUM_MODES;
+}
+
+/**
+ * Blocking vs spinning vs adaptive reactor waits on a loopback ping-pong
+ */
+int bench_busypoll(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    double unit_ns = bench_config.calibrate ? busypoll_probe() : 0.0;
+    int pings = (int)bench_suite_count(budget_ms, unit_ns, BUSYPOLL_DEFAULT_PINGS,
+                                       BUSYPOLL_MAX_PINGS);
+    
+    FILE *f = fopen("busypoll_results.txt", "w");
+    if (f) {
+        fprintf(f, "gap_us,mode,pings,p50_us,p99_us,reactor_cpu_pct,spin_hit_pct\n");
+    }
+    
+    printf("  Client thread ping-pongs %d bytes with an echo coroutine;\n", BUSYPOLL_MSG_BYTES);
+    printf("  spin limit %llu us\n", BUSYPOLL_SPIN_MAX_NS / 1000);
+    printf("  %8s %10s %8s %10s %10s %12s %10s\n", "gap (us)", "mode", "pings", "p50 (us)",
+           "p99 (us)", "reactor CPU", "spin hits");
+    
+    int rc = 0;
+    for (int g = 0; g < BUSYPOLL_NUM_GAPS && rc == 0; g++) {
+        int n = pings / busypoll_gaps[g].divisor > 0 ? pings / busypoll_gaps[g].divisor : 1;
+        double *rtt_us = malloc(sizeof(double) * (size_t)n);
+        if (!rtt_us) {
+            fprintf(stderr, "Error: Failed to allocate round-trip samples\n");
+            rc = -1;
+            break;
+        }
+        
+        for (int m = 0; m < BUSYPOLL_NUM_MODES; m++) {
+            busypoll_client_t client;
+            memset(&client, 0, sizeof(client));
+            client.pings = n;
+            client.gap_ns = busypoll_gaps[g].gap_ns;
+            client.rtt_us = rtt_us;
+            
+            double cpu_pct = 0.0, hit_pct = 0.0;
+            if (busypoll_measure(busypoll_modes[m].mode, &client, &cpu_pct, &hit_pct) < 0) {
+                fprintf(stderr, "Error: Busy-poll row (%s) failed\n", busypoll_modes[m].name);
+                rc = -1;
+                break;
+            }
+            
+            qsort(rtt_us, (size_t)n, sizeof(double), bench_compare_double);
+            double p50 = bench_percentile(rtt_us, n, 500);
+            double p99 = bench_percentile(rtt_us, n, 990);
+            double gap_us = (double)busypoll_gaps[g].gap_ns / 1000.0;
+            
+            printf("  %8.0f %10s %8d %10.1f %10.1f %11.1f%% %9.1f%%\n", gap_us,
+                   busypoll_modes[m].name, n, p50, p99, cpu_pct, hit_pct);
+            fflush(stdout);
+            
+            if (f) {
+                fprintf(f, "%.0f,%s,%d,%.2f,%.2f,%.1f,%.1f\n", gap_us, busypoll_modes[m].name, n,
+                        p50, p99, cpu_pct, hit_pct);
+            }
+        }
+        free(rtt_us);
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    return rc;
+}
@@ -0,0 +1,244 @@
+/**
+ * bench_cls.c
+ * Coroutine-Local Storage Access Benchmark
+ *
+ * Compares the cost of reading and writing one per-context value through
+ * a _Thread_local (__thread) variable, pthread_getspecific/setspecific
+ * and a coroutine-local key, all from inside a ucontext coroutine. Only
+ * the coroutine-local key gives every coroutine its own value; the
+ * suite checks that before measuring.
+ */
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "bench.h"
+#include "coro_ucontext.h"
+
+/* Default accesses per sample (overridden by --switches) */
+#define CLS_DEFAULT_ACCESSES 20000000
+
+/* Samples per variant and operation */
+#define CLS_SAMPLES 5
+
+/* Keep the compiler from caching a value across accesses */
+#define CLS_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/* Storage variants */
+typedef enum {
+    CLS_THREAD = 0,           /* _Thread_local variable */
+    CLS_PTHREAD,              /* pthread_getspecific/setspecific */
+    CLS_CORO,                 /* coro_ucontext_local_get/set */
+    CLS_NUM_VARIANTS
+} cls_variant_t;
+
+static const char *const cls_variant_names[CLS_NUM_VARIANTS] = {
+    "__thread", "pthread_key", "coro_local"
+};
+
+static _Thread_local void *cls_thread_value;
+static pthread_key_t cls_pthread_key;
+static ucoro_local_key_t cls_coro_key;
+
+/* One measurement, run inside a coroutine */
+typedef struct {
+    cls_variant_t variant;
+    bool set;                 /* Measure set instead of get */
+    long long accesses;
+    double ns_per_access;
+    uintptr_t sink;
+} cls_run_t;
+
+/**
+ * Time accesses of one variant (get or set)
+ */
+static void cls_measure(cls_run_t *run) {
+    uintptr_t sum = 0;
+    long long n = run->accesses;
+    long long start = get_time_ns();
+    
+    switch (run->variant * 2 + run->set) {
+        case CLS_THREAD * 2:
+            for (long long i = 0; i < n; i++) {
+                sum += (uintptr_t)cls_thread_value;
+                CLS_BARRIER();
+            }
+            break;
+        case CLS_THREAD * 2 + 1:
+            for (long long i = 0; i < n; i++) {
+                cls_thread_value = (void *)(uintptr_t)i;
+                CLS_BARRIER();
+            }
+            break;
+        case CLS_PTHREAD * 2:
+            for (long long i = 0; i < n; i++) {
+                sum += (uintptr_t)pthread_getspecific(cls_pthread_key);
+                CLS_BARRIER();
+            }
+            break;
+        case CLS_PTHREAD * 2 + 1:
+            for (long long i = 0; i < n; i++) {
+                pthread_setspecific(cls_pthread_key, (void *)(uintptr_t)i);
+                CLS_BARRIER();
+            }
+            break;
+        case CLS_CORO * 2:
+            for (long long i = 0; i < n; i++) {
+                sum += (uintptr_t)coro_ucontext_local_get(cls_coro_key);
+                CLS_BARRIER();
+            }
+            break;
+        case CLS_CORO * 2 + 1:
+            for (long long i = 0; i < n; i++) {
+                coro_ucontext_local_set(cls_coro_key, (void *)(uintptr_t)i);
+                CLS_BARRIER();
+            }
+            break;
+    }
+    
+    run->ns_per_access = (double)(get_time_ns() - start) / (double)n;
+    run->sink = sum;
+}
+
+/* Worker: one measurement per resume */
+static void cls_worker(void *arg) {
+    for (;;) {
+        cls_measure(arg);
+        coro_ucontext_yield();
+    }
+}
+
+/* Isolation check: store own tag, let the other coroutine run, read it back */
+typedef struct {
+    uintptr_t tag;
+    bool ok;
+} cls_check_t;
+
+static void cls_check_worker(void *arg) {
+    cls_check_t *check = arg;
+    
+    coro_ucontext_local_set(cls_coro_key, (void *)check->tag);
+    coro_ucontext_yield();
+    check->ok = coro_ucontext_local_get(cls_coro_key) == (void *)check->tag;
+}
+
+/**
+ * Check that two interleaved coroutines and the main context each keep
+ * their own value
+ * Returns: 0 if isolated, -1 otherwise
+ */
+static int cls_check_isolation(void) {
+    cls_check_t checks[2] = { { 1, false }, { 2, false } };
+    int ids[2];
+    
+    coro_ucontext_local_set(cls_coro_key, (void *)(uintptr_t)3);
+    for (int i = 0; i < 2; i++) {
+        ids[i] = coro_ucontext_create(cls_check_worker, &checks[i]);
+        if (ids[i] < 0) {
+            return -1;
+        }
+    }
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 2; i++) {
+            coro_ucontext_resume(ids[i]);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        coro_ucontext_destroy(ids[i]);
+    }
+    
+    bool ok = checks[0].ok && checks[1].ok &&
+              coro_ucontext_local_get(cls_coro_key) == (void *)(uintptr_t)3;
+    coro_ucontext_local_set(cls_coro_key, NULL);
+    return ok ? 0 : -1;
+}
+
+/**
+ * Compare per-context storage access costs
+ */
+int bench_cls(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    if (pthread_key_create(&cls_pthread_key, NULL) != 0) {
+        fprintf(stderr, "Error: pthread_key_create failed\n");
+        return -1;
+    }
+    if (coro_ucontext_local_key_create(&cls_coro_key, NULL) < 0) {
+        pthread_key_delete(cls_pthread_key);
+        return -1;
+    }
+    
+    coro_ucontext_init();
+    int rc = 0;
+    cls_run_t run = { CLS_THREAD, false, 0, 0.0, 0 };
+    int id = -1;
+    
+    if (cls_check_isolation() < 0) {
+        fprintf(stderr, "Error: Coroutine-local values leaked between coroutines\n");
+        rc = -1;
+        goto out;
+    }
+    printf("  Isolation check (2 interleaved coroutines + main): ok\n");
+    
+    id = coro_ucontext_create(cls_worker, &run);
+    if (id < 0) {
+        rc = -1;
+        goto out;
+    }
+    
+    long long accesses = bench_config.switches_set ? bench_config.num_switches
+                                                   : CLS_DEFAULT_ACCESSES;
+    if (bench_config.calibrate) {
+        run.variant = CLS_PTHREAD;
+        run.accesses = CLS_DEFAULT_ACCESSES / 100;
+        coro_ucontext_resume(id);
+        if (run.ns_per_access > 0) {
+            accesses = (long long)(budget_ms / (CLS_NUM_VARIANTS * 2 * CLS_SAMPLES) * 1e6 /
+                                   run.ns_per_access);
+        }
+    }
+    
+    FILE *f = fopen("cls_results.txt", "w");
+    if (f) {
+        fprintf(f, "variant,get_ns,set_ns\n");
+    }
+    
+    printf("  Accesses from inside a ucontext coroutine (%lld per sample, %d samples):\n",
+           accesses, CLS_SAMPLES);
+    printf("  %14s %12s %12s\n", "storage", "get ns", "set ns");
+    
+    for (int v = 0; v < CLS_NUM_VARIANTS; v++) {
+        double ns[2] = { 0.0, 0.0 };
+        for (int s = 0; s < CLS_SAMPLES; s++) {
+            for (int set = 0; set <= 1; set++) {
+                run.variant = (cls_variant_t)v;
+                run.set = set;
+                run.accesses = accesses;
+                coro_ucontext_resume(id);
+                ns[set] += run.ns_per_access / CLS_SAMPLES;
+            }
+        }
+        printf("  %14s %12.2f %12.2f\n", cls_variant_names[v], ns[0], ns[1]);
+        if (f) {
+            fprintf(f, "%s,%.3f,%.3f\n", cls_variant_names[v], ns[0], ns[1]);
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    
+out:
+    if (id >= 0) {
+        coro_ucontext_destroy(id);
+    }
+    coro_ucontext_cleanup();
+    coro_ucontext_local_key_delete(cls_coro_key);
+    pthread_key_delete(cls_pthread_key);
+    return rc;
+}
@@ -0,0 +1,292 @@
+/**
+ * bench_cold.c
+ * Cold-Cache Switch Latency Benchmark
+ *
+ * The ping-pong loops keep the coroutine state in L1 and the branch
+ * predictor perfectly trained. Here every measured resume is preceded
+ * by a pass over a buffer larger than the caches and, optionally, by a
+ * burst of unpredictable branches and indirect calls, so each switch
+ * looks like the first resume of a long-idle connection coroutine.
+ *
+ * Each resume is timed individually; the cost of an empty timing
+ * interval is measured first and subtracted.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+
+/* Default measured cold switches per row (overridden by --switches) */
+#define COLD_DEFAULT_SWITCHES 200
+#define COLD_MAX_SWITCHES 10000
+
+/* Eviction buffer: twice the last-level cache, within these bounds */
+#define COLD_MIN_EVICT_BYTES (8LL * 1024 * 1024)
+#define COLD_MAX_EVICT_BYTES (64LL * 1024 * 1024)
+
+/* Iterations of the branch-history polluter */
+#define COLD_BRANCH_ITERATIONS 65536
+
+/* Idle coroutines per backend; a different one is resumed each time */
+#define COLD_NUM_COROS 64
+
+#define CACHE_LINE_SIZE 64
+
+/* Measurement modes, one table row each */
+typedef enum {
+    COLD_MODE_HOT = 0,      /* Back-to-back resumes, reference */
+    COLD_MODE_EVICT,        /* Caches evicted before each resume */
+    COLD_MODE_EVICT_BRANCH, /* Caches evicted and branch history polluted */
+    COLD_NUM_MODES
+} cold_mode_t;
+
+static const char *const cold_mode_names[COLD_NUM_MODES] = {
+    "hot", "cold", "cold+branch"
+};
+
+/* Step run on every resume: bump own state */
+static int cold_step(void *arg) {
+    long long *state = (long long *)arg;
+    (*state)++;
+    return 0;
+}
+
+/* ============================================================
+ * CACHE EVICTION AND BRANCH POLLUTION
+ * ============================================================ */
+
+static unsigned char *evict_buf;
+static size_t evict_size;
+
+/* Sink so the eviction and branch loops are not optimised away */
+static volatile unsigned long long cold_sink;
+
+/**
+ * Size the eviction buffer from the last-level cache size
+ */
+static size_t cold_evict_size(void) {
+    long long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc <= 0) {
+        llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    }
+    
+    long long size = llc > 0 ? 2 * llc : COLD_MAX_EVICT_BYTES;
+    if (size < COLD_MIN_EVICT_BYTES) size = COLD_MIN_EVICT_BYTES;
+    if (size > COLD_MAX_EVICT_BYTES) size = COLD_MAX_EVICT_BYTES;
+    return (size_t)size;
+}
+
+/**
+ * Write every cache line of the eviction buffer
+ */
+static void cold_evict_caches(void) {
+    unsigned long long sum = 0;
+    for (size_t i = 0; i < evict_size; i += CACHE_LINE_SIZE) {
+        evict_buf[i]++;
+        sum += evict_buf[i];
+    }
+    cold_sink = sum;
+}
+
+static unsigned long long cold_op0(unsigned long long x) { return x * 3 + 1; }
+static unsigned long long cold_op1(unsigned long long x) { return x ^ (x >> 5); }
+static unsigned long long cold_op2(unsigned long long x) { return x + 0x9E37; }
+static unsigned long long cold_op3(unsigned long long x) { return x << 1 | 1; }
+
+static unsigned long long (*const cold_ops[4])(unsigned long long) = {
+    cold_op0, cold_op1, cold_op2, cold_op3
+};
+
+/**
+ * Train the branch predictors on random conditional and indirect branches
+ */
+static void cold_pollute_branches(void) {
+    static unsigned long long state = 0x2545F4914F6CDD1DULL;
+    unsigned long long x = state, acc = 0;
+    
+    for (int i = 0; i < COLD_BRANCH_ITERATIONS; i++) {
+        bench_rand(&x);
+        if (x & 1) {
+            acc += x;
+        } else if (x & 2) {
+            acc ^= x;
+        }
+        acc = cold_ops[(x >> 8) & 3](acc);
+    }
+    
+    state = x;
+    cold_sink = acc;
+}
+
+/* ============================================================
+ * MEASUREMENT
+ * ============================================================ */
+
+/**
+ * Cost of an empty get_time_ns() interval, minimum of many tries
+ */
+static double timer_overhead_ns(void) {
+    long long best = -1;
+    for (int i = 0; i < 1000; i++) {
+        long long t0 = get_time_ns();
+        long long t1 = get_time_ns();
+        if (best < 0 || t1 - t0 < best) {
+            best = t1 - t0;
+        }
+    }
+    return (double)best;
+}
+
+/**
+ * Cost of one resume in each of the three modes together: two evictions
+ * and one branch pollution, the minimum of a few tries
+ */
+static double cold_unit_ns(void) {
+    long long best = -1;
+    for (int i = 0; i < 3; i++) {
+        long long t0 = get_time_ns();
+        cold_evict_caches();
+        cold_evict_caches();
+        cold_pollute_branches();
+        long long t1 = get_time_ns();
+        if (best < 0 || t1 - t0 < best) {
+            best = t1 - t0;
+        }
+    }
+    return (double)best;
+}
+
+/**
+ * Time count individually-measured resumes in the given mode
+ * Returns: 0 on success, -1 on error; samples[] holds ns per resume
+ */
+static int cold_measure(const coro_backend_t *backend, cold_mode_t mode,
+                        double *samples, long long count, double overhead) {
+    long long state[COLD_NUM_COROS] = { 0 };
+    int ids[COLD_NUM_COROS];
+    int created;
+    int rc = 0;
+    
+    backend->init();
+    for (created = 0; created < COLD_NUM_COROS; created++) {
+        ids[created] = backend->create(cold_step, &state[created]);
+        if (ids[created] < 0) {
+            fprintf(stderr, "Failed to create %s coroutines\n", backend->name);
+            rc = -1;
+            goto out;
+        }
+        /* Start it so every measured resume is a plain switch */
+        backend->resume(ids[created]);
+    }
+    
+    for (long long i = 0; i < count; i++) {
+        int id = ids[i % COLD_NUM_COROS];
+        
+        if (mode == COLD_MODE_HOT) {
+            backend->resume(id);
+        } else {
+            cold_evict_caches();
+            if (mode == COLD_MODE_EVICT_BRANCH) {
+                cold_pollute_branches();
+            }
+        }
+        
+        long long t0 = get_time_ns();
+        backend->resume(id);
+        long long t1 = get_time_ns();
+        
+        samples[i] = (double)(t1 - t0) - overhead;
+        if (samples[i] < 0) {
+            samples[i] = 0;
+        }
+    }
+    
+out:
+    for (int i = 0; i < created; i++) {
+        backend->destroy(ids[i]);
+    }
+    backend->cleanup();
+    return rc;
+}
+
+/**
+ * Run hot, cold and cold+branch measurements for every backend
+ */
+int bench_cold(double budget_ms) {
+    evict_size = cold_evict_size();
+    evict_buf = malloc(evict_size);
+    if (!evict_buf) {
+        fprintf(stderr, "Error: Failed to allocate cold-cache buffers\n");
+        return -1;
+    }
+    memset(evict_buf, 1, evict_size);
+    
+    /* The three mode rows of one backend cost about a unit per resume */
+    int num_backends = 0;
+    for (int b = 0; b < coro_backend_count(); b++) {
+        if (bench_backend_selected(coro_backend_get(b))) num_backends++;
+    }
+    double unit_ns = bench_config.calibrate ? cold_unit_ns() : 0.0;
+    long long count = bench_suite_count(num_backends > 0 ? budget_ms / num_backends : budget_ms,
+                                        unit_ns, COLD_DEFAULT_SWITCHES, COLD_MAX_SWITCHES);
+    double *samples = malloc(sizeof(double) * (size_t)count);
+    if (!samples) {
+        fprintf(stderr, "Error: Failed to allocate cold-cache buffers\n");
+        free(evict_buf);
+        return -1;
+    }
+    
+    double overhead = timer_overhead_ns();
+    printf("  Eviction buffer: %zu KB, timer overhead %.1f ns (subtracted)\n",
+           evict_size / 1024, overhead);
+    printf("  %d measured resumes per row\n", (int)count);
+    
+    FILE *f = fopen("cold_results.txt", "w");
+    if (f) {
+        fprintf(f, "backend,mode,mean,p50,p99,min,max\n");
+    }
+    
+    int rc = 0;
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        printf("\n  %s:\n", backend->name);
+        printf("  %12s %10s %10s %10s %10s %10s\n",
+               "mode", "mean", "p50", "p99", "min", "max");
+        
+        for (int m = 0; m < COLD_NUM_MODES; m++) {
+            if (cold_measure(backend, (cold_mode_t)m, samples, count, overhead) < 0) {
+                rc = -1;
+                break;
+            }
+            
+            double mean, min, max;
+            calculate_stats(samples, (int)count, &mean, &min, &max);
+            qsort(samples, (size_t)count, sizeof(double), bench_compare_double);
+            double p50 = bench_percentile(samples, count, 500);
+            double p99 = bench_percentile(samples, count, 990);
+            
+            printf("  %12s %10.1f %10.1f %10.1f %10.1f %10.1f  ns/switch\n",
+                   cold_mode_names[m], mean, p50, p99, min, max);
+            fflush(stdout);
+            
+            if (f) {
+                fprintf(f, "%s,%s,%.2f,%.2f,%.2f,%.2f,%.2f\n", backend->name,
+                        cold_mode_names[m], mean, p50, p99, min, max);
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    free(samples);
+    free(evict_buf);
+    evict_buf = NULL;
+    return rc;
+}
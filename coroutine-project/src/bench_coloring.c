@@ -0,0 +1,247 @@
+/**
+ * bench_coloring.c
+ * Stack Top Coloring Benchmark
+ *
+ * Stacks of the same size are handed out at the same alignment: arena
+ * slots exactly CORO_STACK_SIZE apart, malloc blocks nearly so. The hot
+ * top-of-stack lines of every coroutine then fall into the same L1/L2
+ * sets, and loads after a switch can stall on 4 KB aliasing. This suite
+ * cycles through N coroutines that each touch a few lines at the top of
+ * their stack, with and without coro_ucontext_set_stack_colors(), and
+ * reports switch latency and cache misses per switch.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "bench.h"
+#include "bench_perf.h"
+#include "coro_ucontext.h"
+
+/* Coroutine counts swept */
+static const int coloring_coro_counts[] = { 64, 512, 4096 };
+
+#define NUM_COLORING_COUNTS ((int)(sizeof(coloring_coro_counts) / sizeof(coloring_coro_counts[0])))
+
+/* Default measured switches per point (overridden by --switches) */
+#define COLORING_DEFAULT_SWITCHES 500000
+
+/* Every coroutine is resumed at least this many times per point */
+#define COLORING_MIN_ROUNDS 3
+
+/* Cache lines each coroutine touches at its stack top per resume */
+#define COLORING_HOT_LINES 8
+
+#define CACHE_LINE_SIZE 64
+
+/* Stack sources, each run without and with coloring */
+typedef enum {
+    COLORING_ARENA = 0,       /* Slots exactly CORO_STACK_SIZE apart */
+    COLORING_MALLOC,          /* Default malloc'd stacks */
+    COLORING_NUM_SOURCES
+} coloring_source_t;
+
+static const char *const coloring_source_names[COLORING_NUM_SOURCES] = {
+    "arena", "malloc"
+};
+
+/**
+ * Worker: read-modify-write COLORING_HOT_LINES lines near the top of
+ * its own stack on every resume
+ */
+static void coloring_worker(void *arg) {
+    volatile uint64_t hot[COLORING_HOT_LINES * CACHE_LINE_SIZE / sizeof(uint64_t)];
+    (void)arg;
+    
+    for (size_t i = 0; i < sizeof(hot) / sizeof(hot[0]); i++) {
+        hot[i] = i;
+    }
+    
+    for (;;) {
+        for (size_t i = 0; i < sizeof(hot) / sizeof(hot[0]); i += CACHE_LINE_SIZE / sizeof(uint64_t)) {
+            hot[i] = hot[i] + 1;
+        }
+        coro_ucontext_yield();
+    }
+}
+
+/**
+ * Measure one point: n coroutines from source, colored or not
+ * Returns: ns per switch, or -1 on error
+ */
+static double coloring_point(int n, coloring_source_t source, int colors, double target_ms,
+                             bench_perf_t *perf, double misses[BENCH_PERF_NUM_COUNTERS]) {
+    ucoro_stack_arena_t arena;
+    ucoro_attr_t attr;
+    int *ids = malloc(sizeof(int) * (size_t)n);
+    double ns_per_switch = -1.0;
+    int created = 0;
+    
+    if (!ids) {
+        fprintf(stderr, "Error: Failed to allocate %d coroutine ids\n", n);
+        return -1.0;
+    }
+    
+    coro_ucontext_attr_init(&attr);
+    attr.stack_size = CORO_STACK_SIZE;
+    if (source == COLORING_ARENA) {
+        if (coro_ucontext_arena_open(&arena, CORO_STACK_SIZE, (size_t)n,
+                                     UCORO_ARENA_SMALL_PAGES) < 0) {
+            free(ids);
+            return -1.0;
+        }
+        attr.provider = &arena.provider;
+    }
+    
+    coro_ucontext_init();
+    coro_ucontext_set_stack_colors(colors);
+    for (created = 0; created < n; created++) {
+        ids[created] = coro_ucontext_create_ex(coloring_worker, NULL, &attr);
+        if (ids[created] < 0) {
+            fprintf(stderr, "Failed to create ucontext coroutine %d of %d\n",
+                    created + 1, n);
+            goto out;
+        }
+    }
+    
+    /* First round starts every coroutine; the second probes the cost */
+    for (int i = 0; i < n; i++) {
+        coro_ucontext_resume(ids[i]);
+    }
+    long long start = get_time_ns();
+    for (int i = 0; i < n; i++) {
+        coro_ucontext_resume(ids[i]);
+    }
+    long long round_ns = get_time_ns() - start;
+    
+    long long switches = bench_config.switches_set ? bench_config.num_switches
+                                                   : COLORING_DEFAULT_SWITCHES;
+    if (bench_config.calibrate && round_ns > 0) {
+        switches = (long long)(target_ms * 1e6 / ((double)round_ns / n));
+    }
+    long long rounds = (switches + n - 1) / n;
+    if (rounds < COLORING_MIN_ROUNDS) {
+        rounds = COLORING_MIN_ROUNDS;
+    }
+    
+    long long counts[BENCH_PERF_NUM_COUNTERS];
+    bench_perf_start(perf);
+    start = get_time_ns();
+    
+    for (long long r = 0; r < rounds; r++) {
+        for (int i = 0; i < n; i++) {
+            coro_ucontext_resume(ids[i]);
+        }
+    }
+    
+    long long total_time = get_time_ns() - start;
+    bench_perf_stop(perf, counts);
+    
+    double total_switches = (double)rounds * n;
+    ns_per_switch = (double)total_time / total_switches;
+    for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+        misses[c] = counts[c] < 0 ? NAN : (double)counts[c] / total_switches;
+    }
+    
+out:
+    for (int i = 0; i < created; i++) {
+        coro_ucontext_destroy(ids[i]);
+    }
+    coro_ucontext_cleanup();
+    coro_ucontext_set_stack_colors(0);
+    if (source == COLORING_ARENA) {
+        coro_ucontext_arena_close(&arena);
+    }
+    free(ids);
+    return ns_per_switch;
+}
+
+/**
+ * Compare uncolored and colored stacks for every count and stack source
+ */
+int bench_coloring(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    bench_perf_t perf;
+    bool have_perf = bench_perf_open(&perf) > 0;
+    double target_ms = budget_ms / (NUM_COLORING_COUNTS * COLORING_NUM_SOURCES * 2);
+    
+    FILE *f = fopen("coloring_results.txt", "w");
+    if (f) {
+        fprintf(f, "stacks,coroutines,colors,ns_per_switch");
+        for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+            fprintf(f, ",%s_miss_per_switch", bench_perf_name(c));
+        }
+        fprintf(f, "\n");
+    }
+    
+    printf("  %d KB stacks, %d hot lines per coroutine, %d colors when on\n",
+           CORO_STACK_SIZE / 1024, COLORING_HOT_LINES, UCORO_STACK_COLORS_4K);
+    if (!have_perf) {
+        printf("  (hardware counters unavailable, miss rates shown as n/a)\n");
+    }
+    printf("\n  %8s %8s %8s %12s %9s", "stacks", "N", "colors", "ns/switch", "delta");
+    for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+        printf(" %9s/sw", bench_perf_name(c));
+    }
+    printf("\n");
+    
+    int rc = 0;
+    for (int s = 0; s < COLORING_NUM_SOURCES && rc == 0; s++) {
+        for (int k = 0; k < NUM_COLORING_COUNTS && rc == 0; k++) {
+            int n = coloring_coro_counts[k];
+            if (n > MAX_UCONTEXT_COROUTINES ||
+                (bench_config.max_coros > 0 && n > bench_config.max_coros)) {
+                continue;
+            }
+            
+            double plain_ns = 0.0;
+            for (int colored = 0; colored <= 1; colored++) {
+                int colors = colored ? UCORO_STACK_COLORS_4K : 0;
+                double misses[BENCH_PERF_NUM_COUNTERS];
+                
+                double ns = coloring_point(n, (coloring_source_t)s, colors, target_ms,
+                                           &perf, misses);
+                if (ns < 0) {
+                    rc = -1;
+                    break;
+                }
+                if (!colored) {
+                    plain_ns = ns;
+                }
+                
+                printf("  %8s %8d %8s %12.2f %+8.1f%%", coloring_source_names[s], n,
+                       colored ? "on" : "off", ns, (ns - plain_ns) / plain_ns * 100.0);
+                for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                    if (isnan(misses[c])) {
+                        printf(" %12s", "n/a");
+                    } else {
+                        printf(" %12.3f", misses[c]);
+                    }
+                }
+                printf("\n");
+                fflush(stdout);
+                
+                if (f) {
+                    fprintf(f, "%s,%d,%d,%.2f", coloring_source_names[s], n, colors, ns);
+                    for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                        fprintf(f, ",%.4f", misses[c]);
+                    }
+                    fprintf(f, "\n");
+                }
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    bench_perf_close(&perf);
+    return rc;
+}
@@ -0,0 +1,231 @@
+/**
+ * bench_density.c
+ * Stack Attribute Density and Create Throughput Benchmark
+ *
+ * Creates a population of suspended ucontext coroutines with
+ * coro_ucontext_create_ex() for a range of stack sizes and stack
+ * attributes, and reports how many coroutines fit per gigabyte of
+ * resident memory and how fast they are created.
+ *
+ * Configurations:
+ *   malloc          - malloc'd stacks, no guard (the create() default)
+ *   malloc+prefault - as above, every stack page touched at create time
+ *   mmap+guard      - one mapping per stack with a PROT_NONE guard page
+ *   arena           - stacks carved back to back from one mapping
+ *                     (coro_ucontext_arena_open), no per-stack headers
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <unistd.h>
+#include "bench.h"
+#include "coro_ucontext.h"
+
+/* Coroutines alive at once per point */
+#define DENSITY_DEFAULT_COROS 4096
+
+/* Coroutines per point in the --calibrate probe sweep */
+#define DENSITY_PROBE_COROS 64
+
+/* Stack sizes swept */
+static const size_t density_stack_sizes[] = {
+    4 * 1024, 8 * 1024, 16 * 1024, 64 * 1024, 256 * 1024
+};
+
+#define NUM_DENSITY_SIZES ((int)(sizeof(density_stack_sizes) / sizeof(density_stack_sizes[0])))
+
+/* ============================================================
+ * MEASUREMENT
+ * ============================================================ */
+
+/* Stack attribute configurations, one table row each per stack size */
+typedef enum {
+    DENSITY_MALLOC = 0,
+    DENSITY_MALLOC_PREFAULT,
+    DENSITY_MMAP_GUARD,
+    DENSITY_ARENA,
+    DENSITY_NUM_CONFIGS
+} density_config_t;
+
+static const char *const density_config_names[DENSITY_NUM_CONFIGS] = {
+    "malloc", "malloc+prefault", "mmap+guard", "arena"
+};
+
+/* Result of one point */
+typedef struct {
+    double virt_per_coro;     /* Stack + guard bytes reserved */
+    double rss_per_coro;      /* Resident growth with all coroutines suspended */
+    double create_ns;         /* coro_ucontext_create_ex() cost */
+} density_point_t;
+
+/* Worker: suspend once and stay suspended until destroyed */
+static void density_worker(void *arg) {
+    (void)arg;
+    coro_ucontext_yield();
+}
+
+/**
+ * Create n suspended coroutines with the given attributes
+ * Returns: 0 on success, -1 on error
+ */
+static int density_point(int n, const ucoro_attr_t *attr, density_point_t *point) {
+    int *ids = malloc(sizeof(int) * (size_t)n);
+    int created = 0;
+    int rc = 0;
+    
+    if (!ids) {
+        fprintf(stderr, "Error: Failed to allocate %d coroutine ids\n", n);
+        return -1;
+    }
+    
+    coro_ucontext_init();
+    long long rss_before = bench_rss_bytes();
+    long long start = get_time_ns();
+    
+    for (created = 0; created < n; created++) {
+        ids[created] = coro_ucontext_create_ex(density_worker, NULL, attr);
+        if (ids[created] < 0) {
+            fprintf(stderr, "Failed to create ucontext coroutine %d of %d\n",
+                    created + 1, n);
+            rc = -1;
+            goto out;
+        }
+    }
+    
+    point->create_ns = (double)(get_time_ns() - start) / n;
+    point->virt_per_coro = (double)(coro_ucontext_stack_bytes() +
+                                    (size_t)n * attr->guard_size) / n;
+    
+    /* First resume runs each coroutine up to its yield */
+    for (int i = 0; i < n; i++) {
+        coro_ucontext_resume(ids[i]);
+    }
+    point->rss_per_coro = (double)(bench_rss_bytes() - rss_before) / n;
+    
+out:
+    for (int i = 0; i < created; i++) {
+        coro_ucontext_destroy(ids[i]);
+    }
+    coro_ucontext_cleanup();
+    malloc_trim(0);
+    free(ids);
+    return rc;
+}
+
+/**
+ * Run one point: n coroutines of stack size index s in configuration c
+ * Returns: 0 on success, -1 on error; attr holds the attributes used
+ */
+static int density_config_point(int n, int s, density_config_t c, ucoro_attr_t *attr,
+                                density_point_t *point) {
+    ucoro_stack_arena_t arena;
+    
+    coro_ucontext_attr_init(attr);
+    attr->stack_size = density_stack_sizes[s];
+    if (c == DENSITY_MALLOC_PREFAULT) {
+        attr->prefault = true;
+    } else if (c == DENSITY_MMAP_GUARD) {
+        attr->guard_size = (size_t)sysconf(_SC_PAGESIZE);
+    } else if (c == DENSITY_ARENA) {
+        if (coro_ucontext_arena_open(&arena, attr->stack_size, (size_t)n,
+                                     UCORO_ARENA_SMALL_PAGES) < 0) {
+            return -1;
+        }
+        attr->provider = &arena.provider;
+    }
+    
+    int rc = density_point(n, attr, point);
+    if (c == DENSITY_ARENA) {
+        coro_ucontext_arena_close(&arena);
+    }
+    return rc;
+}
+
+/**
+ * Time the whole sweep at DENSITY_PROBE_COROS coroutines per point
+ * Returns: ns per coroutine of every point together, or -1 on error
+ */
+static double density_probe(void) {
+    ucoro_attr_t attr;
+    density_point_t point;
+    long long start = get_time_ns();
+    
+    for (int s = 0; s < NUM_DENSITY_SIZES; s++) {
+        for (int c = 0; c < DENSITY_NUM_CONFIGS; c++) {
+            if (density_config_point(DENSITY_PROBE_COROS, s, (density_config_t)c, &attr,
+                                     &point) < 0) {
+                return -1.0;
+            }
+        }
+    }
+    return (double)(get_time_ns() - start) / DENSITY_PROBE_COROS;
+}
+
+/**
+ * Sweep stack sizes and attribute configurations
+ */
+int bench_density(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    int max = DENSITY_DEFAULT_COROS;
+    if (max > MAX_UCONTEXT_COROUTINES) max = MAX_UCONTEXT_COROUTINES;
+    if (bench_config.max_coros > 0 && max > bench_config.max_coros) max = bench_config.max_coros;
+    
+    /* The probe times all points at once: one budget "row" is the whole sweep */
+    double unit_ns = bench_config.calibrate ? density_probe() : 0.0;
+    int n = (int)bench_suite_count(budget_ms, unit_ns, max, max);
+    
+    ucoro_attr_t attr;
+    density_point_t point;
+    
+    /* Touch the coroutine pool once so the first point is not charged for it */
+    coro_ucontext_attr_init(&attr);
+    attr.stack_size = density_stack_sizes[0];
+    if (density_point(n, &attr, &point) < 0) {
+        return -1;
+    }
+    
+    FILE *f = fopen("density_results.txt", "w");
+    if (f) {
+        fprintf(f, "config,stack_bytes,guard_bytes,coroutines,virt_per_coro,"
+                "rss_per_coro,coros_per_gb,create_ns\n");
+    }
+    
+    printf("  %d suspended coroutines per point\n\n", n);
+    printf("  %16s %8s %12s %12s %12s %10s\n", "config", "stack", "virt B/coro",
+           "RSS B/coro", "coros/GB", "create ns");
+    
+    int rc = 0;
+    for (int s = 0; s < NUM_DENSITY_SIZES && rc == 0; s++) {
+        for (int c = 0; c < DENSITY_NUM_CONFIGS; c++) {
+            rc = density_config_point(n, s, (density_config_t)c, &attr, &point);
+            if (rc < 0) {
+                break;
+            }
+            
+            double per_gb = point.rss_per_coro > 0 ? (1024.0 * 1024.0 * 1024.0) / point.rss_per_coro : 0;
+            printf("  %16s %6zuKB %12.0f %12.0f %12.0f %10.0f\n", density_config_names[c],
+                   attr.stack_size / 1024, point.virt_per_coro, point.rss_per_coro,
+                   per_gb, point.create_ns);
+            fflush(stdout);
+            
+            if (f) {
+                fprintf(f, "%s,%zu,%zu,%d,%.0f,%.0f,%.0f,%.1f\n", density_config_names[c],
+                        attr.stack_size, attr.guard_size, n, point.virt_per_coro,
+                        point.rss_per_coro, per_gb, point.create_ns);
+            }
+        }
+        printf("\n");
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    return rc;
+}
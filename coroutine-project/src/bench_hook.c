@@ -0,0 +1,471 @@
+/**
+ * bench_hook.c
+ * Hooked Blocking Echo Server Benchmark
+ *
+ * An echo server and its clients written as plain blocking socket code
+ * (accept, connect, poll, read, write, close) run as ucontext coroutines
+ * on one thread under a reactor (see coro_reactor.h). Loaded with
+ * LD_PRELOAD=lib/libcoro_hook.so, each call that would block parks its
+ * coroutine instead of the thread. For 1 to 2048 connections the suite
+ * reports round trips per second and their latency. It also times
+ * thousands of coroutines in usleep(), and the cost the shim adds to a
+ * call made outside coroutines.
+ * Without the shim the suite is skipped: the first read would block
+ * the thread that runs every coroutine.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "bench.h"
+#include "coro_reactor.h"
+#include "coro_ucontext.h"
+
+/* Round trips per row (overridden by --switches) */
+#define HOOK_DEFAULT_ROUND_TRIPS 50000
+#define HOOK_MAX_ROUND_TRIPS 1000000
+
+/* Round trips of the --calibrate probe row (one connection) */
+#define HOOK_PROBE_ROUND_TRIPS 1000
+
+/* Bytes per request and reply */
+#define HOOK_MSG_BYTES 64
+
+/* The server polls with an idle timeout before each read */
+#define HOOK_IDLE_TIMEOUT_MS 10000
+
+/* Sleep row: coroutines, sleeps each, and the usleep() length */
+#define HOOK_SLEEPERS 1000
+#define HOOK_SLEEPS 10
+#define HOOK_SLEEP_US 1000
+
+/* Calls timed for the pass-through cost */
+#define HOOK_PASSTHROUGH_CALLS 200000
+
+/* Connections per row */
+static const int hook_connections[] = { 1, 16, 256, 2048 };
+#define HOOK_NUM_ROWS ((int)(sizeof(hook_connections) / sizeof(hook_connections[0])))
+
+/* Shared state of one row */
+typedef struct {
+    coro_sched_t *sched;
+    int listen_fd;
+    struct sockaddr_in addr;
+    int connections;
+    int rounds;               /* Round trips per connection */
+    double *round_trip_us;
+    int num_round_trips;
+    int errors;
+    int *conn_fds;            /* Accepted connections, one per server coroutine */
+} hook_run_t;
+
+/* ============================================================
+ * BLOCKING ECHO CODE (no coroutine calls)
+ * ============================================================ */
+
+/**
+ * Write all of buf
+ * Returns: 0 on success, -1 on error
+ */
+static int echo_write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Read exactly len bytes
+ * Returns: 0 on success, -1 on error or end of stream
+ */
+static int echo_read_all(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * Echo one connection until the peer closes it or goes idle
+ */
+static void echo_serve(int fd) {
+    char buf[HOOK_MSG_BYTES * 4];
+    
+    for (;;) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, HOOK_IDLE_TIMEOUT_MS) <= 0) break;
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0 || echo_write_all(fd, buf, (size_t)n) < 0) break;
+    }
+    close(fd);
+}
+
+/**
+ * Connect, then send run->rounds requests and wait for each reply
+ * Returns: 0 on success, -1 on error
+ */
+static int echo_client(hook_run_t *run) {
+    char msg[HOOK_MSG_BYTES], reply[HOOK_MSG_BYTES];
+    int one = 1, rc = 0;
+    
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&run->addr, sizeof(run->addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    memset(msg, 'x', sizeof(msg));
+    for (int r = 0; r < run->rounds; r++) {
+        long long start = get_time_ns();
+        if (echo_write_all(fd, msg, sizeof(msg)) < 0 ||
+            echo_read_all(fd, reply, sizeof(reply)) < 0) {
+            rc = -1;
+            break;
+        }
+        run->round_trip_us[run->num_round_trips++] = (double)(get_time_ns() - start) / 1000.0;
+    }
+    close(fd);
+    return rc;
+}
+
+/* ============================================================
+ * COROUTINES
+ * ============================================================ */
+
+/* Server coroutine: one accepted connection */
+static int hook_server_step(void *arg) {
+    echo_serve(*(int *)arg);
+    return 1;
+}
+
+/* Listener: accept every connection and give it a server coroutine */
+static int hook_listener_step(void *arg) {
+    hook_run_t *run = arg;
+    
+    for (int i = 0; i < run->connections; i++) {
+        run->conn_fds[i] = accept(run->listen_fd, NULL, NULL);
+        if (run->conn_fds[i] < 0) {
+            run->errors++;
+            break;
+        }
+        if (coro_sched_spawn(run->sched, hook_server_step, &run->conn_fds[i], 0) < 0) {
+            close(run->conn_fds[i]);
+            run->errors++;
+        }
+    }
+    return 1;
+}
+
+/* Client coroutine */
+static int hook_client_step(void *arg) {
+    hook_run_t *run = arg;
+    if (echo_client(run) < 0) {
+        run->errors++;
+    }
+    return 1;
+}
+
+/* Sleeper coroutine: HOOK_SLEEPS blocking sleeps */
+static int hook_sleeper_step(void *arg) {
+    (void)arg;
+    for (int i = 0; i < HOOK_SLEEPS; i++) {
+        usleep(HOOK_SLEEP_US);
+    }
+    return 1;
+}
+
+/* ============================================================
+ * MEASUREMENT
+ * ============================================================ */
+
+/**
+ * Open a loopback listener on an ephemeral port
+ * Returns: the socket, or -1 on failure
+ */
+static int hook_listen(hook_run_t *run) {
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create listener: %s\n", strerror(errno));
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    
+    socklen_t len = sizeof(run->addr);
+    memset(&run->addr, 0, sizeof(run->addr));
+    run->addr.sin_family = AF_INET;
+    run->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&run->addr, sizeof(run->addr)) < 0 ||
+        listen(fd, run->connections) < 0 ||
+        getsockname(fd, (struct sockaddr *)&run->addr, &len) < 0) {
+        fprintf(stderr, "Error: Failed to listen on loopback: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Run one echo row: a listener, connections servers and as many clients
+ * Returns: elapsed nanoseconds, or -1 on failure
+ */
+static long long hook_echo_measure(hook_run_t *run, long long *waits) {
+    coro_sched_t sched;
+    coro_reactor_t reactor;
+    long long elapsed = -1;
+    
+    run->conn_fds = calloc((size_t)run->connections, sizeof(int));
+    if (!run->conn_fds) {
+        fprintf(stderr, "Error: Failed to allocate connections\n");
+        return -1;
+    }
+    run->listen_fd = hook_listen(run);
+    if (run->listen_fd < 0) {
+        free(run->conn_fds);
+        return -1;
+    }
+    if (coro_sched_init(&sched, &coro_ucontext_backend) < 0) {
+        close(run->listen_fd);
+        free(run->conn_fds);
+        return -1;
+    }
+    if (coro_reactor_init(&reactor, &sched) < 0) goto out_sched;
+    
+    run->sched = &sched;
+    run->num_round_trips = 0;
+    run->errors = 0;
+    if (coro_sched_spawn(&sched, hook_listener_step, run, 0) < 0) goto out;
+    for (int i = 0; i < run->connections; i++) {
+        if (coro_sched_spawn(&sched, hook_client_step, run, 0) < 0) goto out;
+    }
+    
+    long long start = get_time_ns();
+    if (coro_reactor_run(&reactor) < 0) goto out;
+    elapsed = get_time_ns() - start;
+    *waits = reactor.waits;
+    
+out:
+    coro_reactor_cleanup(&reactor);
+out_sched:
+    coro_sched_cleanup(&sched);
+    close(run->listen_fd);
+    free(run->conn_fds);
+    return run->errors ? -1 : elapsed;
+}
+
+/**
+ * Time HOOK_SLEEPERS coroutines each sleeping HOOK_SLEEPS times
+ * Returns: elapsed nanoseconds, or -1 on failure
+ */
+static long long hook_sleep_measure(void) {
+    coro_sched_t sched;
+    coro_reactor_t reactor;
+    long long elapsed = -1;
+    
+    if (coro_sched_init(&sched, &coro_ucontext_backend) < 0) {
+        return -1;
+    }
+    if (coro_reactor_init(&reactor, &sched) == 0) {
+        int spawned = 0;
+        while (spawned < HOOK_SLEEPERS &&
+               coro_sched_spawn(&sched, hook_sleeper_step, NULL, 0) >= 0) {
+            spawned++;
+        }
+        long long start = get_time_ns();
+        if (spawned == HOOK_SLEEPERS && coro_reactor_run(&reactor) >= 0) {
+            elapsed = get_time_ns() - start;
+        }
+        coro_reactor_cleanup(&reactor);
+    }
+    coro_sched_cleanup(&sched);
+    return elapsed;
+}
+
+/**
+ * ns per 1-byte write to /dev/null outside coroutines, through the shim
+ * (hooked) and as a direct system call
+ * Returns: 0 on success, -1 on failure
+ */
+static int hook_passthrough_measure(double *hooked_ns, double *direct_ns) {
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to open /dev/null\n");
+        return -1;
+    }
+    
+    char c = 0;
+    long long start = get_time_ns();
+    for (int i = 0; i < HOOK_PASSTHROUGH_CALLS; i++) {
+        if (write(fd, &c, 1) != 1) break;
+    }
+    *hooked_ns = (double)(get_time_ns() - start) / HOOK_PASSTHROUGH_CALLS;
+    
+    start = get_time_ns();
+    for (int i = 0; i < HOOK_PASSTHROUGH_CALLS; i++) {
+        if (syscall(SYS_write, fd, &c, 1) != 1) break;
+    }
+    *direct_ns = (double)(get_time_ns() - start) / HOOK_PASSTHROUGH_CALLS;
+    close(fd);
+    return 0;
+}
+
+/**
+ * Whether a row of conns connections fits the coroutine pool and --max-coros
+ */
+static bool hook_row_fits(int conns) {
+    int coros = 2 * conns + 1;
+    if (coros > coro_ucontext_backend.max_coros) return false;
+    return bench_config.max_coros <= 0 || coros <= bench_config.max_coros;
+}
+
+/**
+ * Time a one-connection echo row
+ * Returns: ns per round trip, or -1 on failure
+ */
+static double hook_probe(void) {
+    hook_run_t run;
+    long long waits;
+    
+    memset(&run, 0, sizeof(run));
+    run.round_trip_us = malloc(sizeof(double) * HOOK_PROBE_ROUND_TRIPS);
+    if (!run.round_trip_us) {
+        return -1.0;
+    }
+    run.connections = 1;
+    run.rounds = HOOK_PROBE_ROUND_TRIPS;
+    long long elapsed = hook_echo_measure(&run, &waits);
+    free(run.round_trip_us);
+    return elapsed > 0 ? (double)elapsed / HOOK_PROBE_ROUND_TRIPS : -1.0;
+}
+
+/**
+ * Hooked echo server throughput against connections
+ */
+int bench_hook(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    if (!coro_io_hooks_attached()) {
+        printf("  (hook library not loaded, skipped: run\n");
+        printf("   LD_PRELOAD=lib/libcoro_hook.so ./bin/bench hook, or make run-hook)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    struct rlimit nofile;
+    getrlimit(RLIMIT_NOFILE, &nofile);
+    
+    int rows = 0;
+    for (int c = 0; c < HOOK_NUM_ROWS; c++) {
+        if (hook_row_fits(hook_connections[c])) rows++;
+    }
+    double unit_ns = bench_config.calibrate ? hook_probe() : 0.0;
+    int round_trips = (int)bench_suite_count(rows > 0 ? budget_ms / rows : budget_ms, unit_ns,
+                                             HOOK_DEFAULT_ROUND_TRIPS, HOOK_MAX_ROUND_TRIPS);
+    
+    hook_run_t run;
+    int max_connections = hook_connections[HOOK_NUM_ROWS - 1];
+    size_t max_samples = (size_t)(round_trips > max_connections ? round_trips : max_connections);
+    run.round_trip_us = malloc(sizeof(double) * max_samples);
+    if (!run.round_trip_us) {
+        fprintf(stderr, "Error: Failed to allocate round-trip samples\n");
+        return -1;
+    }
+    
+    FILE *f = fopen("hook_results.txt", "w");
+    if (f) {
+        fprintf(f, "connections,coroutines,round_trips,round_trips_per_sec,p50_us,p99_us,"
+                   "waits_per_round_trip\n");
+    }
+    
+    printf("  Blocking echo server and clients on ucontext coroutines, one thread;\n");
+    printf("  %d-byte requests, %d round trips per row\n", HOOK_MSG_BYTES, round_trips);
+    printf("  %12s %11s %12s %14s %10s %10s %10s\n", "connections", "coroutines", "round trips",
+           "round trips/s", "p50 us", "p99 us", "waits/rt");
+    
+    int rc = 0;
+    for (int c = 0; c < HOOK_NUM_ROWS && rc == 0; c++) {
+        int conns = hook_connections[c];
+        int coros = 2 * conns + 1;
+        if (!hook_row_fits(conns)) continue;
+        if ((rlim_t)(2 * conns + 64) > nofile.rlim_cur) {
+            printf("  %12d (skipped: RLIMIT_NOFILE %llu)\n", conns,
+                   (unsigned long long)nofile.rlim_cur);
+            continue;
+        }
+        
+        run.connections = conns;
+        run.rounds = round_trips / conns > 0 ? round_trips / conns : 1;
+        long long waits = 0;
+        long long elapsed = hook_echo_measure(&run, &waits);
+        if (elapsed <= 0 || run.num_round_trips == 0) {
+            fprintf(stderr, "Error: Echo row with %d connections failed\n", conns);
+            rc = -1;
+            break;
+        }
+        
+        int n = run.num_round_trips;
+        qsort(run.round_trip_us, (size_t)n, sizeof(double), bench_compare_double);
+        double p50 = bench_percentile(run.round_trip_us, n, 500);
+        double p99 = bench_percentile(run.round_trip_us, n, 990);
+        double rate = (double)n * 1e9 / (double)elapsed;
+        double waits_per_rt = (double)waits / (double)n;
+        
+        printf("  %12d %11d %12d %14.0f %10.1f %10.1f %10.2f\n", conns, coros, n, rate, p50,
+               p99, waits_per_rt);
+        fflush(stdout);
+        
+        if (f) {
+            fprintf(f, "%d,%d,%d,%.0f,%.2f,%.2f,%.3f\n", conns, coros, n, rate, p50, p99,
+                    waits_per_rt);
+        }
+    }
+    
+    if (rc == 0) {
+        long long elapsed = hook_sleep_measure();
+        if (elapsed < 0) {
+            rc = -1;
+        } else {
+            printf("\n  %d coroutines x %d usleep(%d): %.1f ms (%.0f ms sequential)\n",
+                   HOOK_SLEEPERS, HOOK_SLEEPS, HOOK_SLEEP_US, (double)elapsed / 1e6,
+                   (double)HOOK_SLEEPERS * HOOK_SLEEPS * HOOK_SLEEP_US / 1000.0);
+        }
+    }
+    
+    double hooked_ns, direct_ns;
+    if (rc == 0 && hook_passthrough_measure(&hooked_ns, &direct_ns) == 0) {
+        printf("  write() outside coroutines: %.0f ns through the shim, %.0f ns direct\n",
+               hooked_ns, direct_ns);
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    free(run.round_trip_us);
+    return rc;
+}
@@ -0,0 +1,339 @@
+/**
+ * bench_hugestack.c
+ * Huge-Page Stack Arena Benchmark
+ *
+ * With tens of thousands of stackful coroutines every resume lands on a
+ * different stack, so each switch tends to miss the data TLB. This suite
+ * resumes N suspended ucontext coroutines in a fixed random order, with
+ * their stacks in:
+ *   malloc        - the default heap stacks
+ *   arena-4k      - one arena region with base pages only
+ *   arena-thp     - one arena region with madvise(MADV_HUGEPAGE)
+ *   arena-hugetlb - one arena region from the hugetlbfs pool
+ * and reports switch latency, dTLB misses per switch and how much of the
+ * process is actually backed by huge pages.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "bench.h"
+#include "bench_perf.h"
+#include "coro_ucontext.h"
+
+/* Stack size for every configuration; small so 100k+ stacks fit in RAM */
+#define HUGESTACK_STACK_SIZE (16 * 1024)
+
+/* Coroutine counts swept (capped by the pool limit and --max-coros) */
+static const int hugestack_coro_counts[] = { 10000, 100000, 1000000 };
+
+#define NUM_HUGESTACK_COUNTS ((int)(sizeof(hugestack_coro_counts) / sizeof(hugestack_coro_counts[0])))
+
+/* Default measured switches per point (overridden by --switches) */
+#define HUGESTACK_DEFAULT_SWITCHES 500000
+
+/* Every coroutine is resumed at least this many times per point (without a budget) */
+#define HUGESTACK_MIN_ROUNDS 2
+
+/* Stack placements, one table row each per coroutine count */
+typedef enum {
+    HUGESTACK_MALLOC = 0,
+    HUGESTACK_ARENA_4K,
+    HUGESTACK_ARENA_THP,
+    HUGESTACK_ARENA_HUGETLB,
+    HUGESTACK_NUM_CONFIGS
+} hugestack_config_t;
+
+static const char *const hugestack_config_names[HUGESTACK_NUM_CONFIGS] = {
+    "malloc", "arena-4k", "arena-thp", "arena-hugetlb"
+};
+
+/* Worker: touch one cache line of own stack per resume */
+static void hugestack_worker(void *arg) {
+    volatile long live[8];
+    (void)arg;
+    
+    live[0] = 0;
+    for (;;) {
+        live[0]++;
+        coro_ucontext_yield();
+    }
+}
+
+/**
+ * Bytes of this process backed by transparent or hugetlbfs huge pages
+ */
+static long long hugestack_huge_bytes(void) {
+    char line[256];
+    long long total_kb = 0, kb;
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %lld kB", &kb) == 1 ||
+            sscanf(line, "Private_Hugetlb: %lld kB", &kb) == 1) {
+            total_kb += kb;
+        }
+    }
+    fclose(f);
+    return total_kb * 1024;
+}
+
+/**
+ * Free bytes in the hugetlbfs pool (HugePages_Free * Hugepagesize)
+ * Returns: 0 if none are reserved or /proc/meminfo is unreadable
+ */
+static long long hugestack_hugetlb_free_bytes(void) {
+    char line[256];
+    long long free_pages = 0, page_kb = 0, v;
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "HugePages_Free: %lld", &v) == 1) {
+            free_pages = v;
+        } else if (sscanf(line, "Hugepagesize: %lld kB", &v) == 1) {
+            page_kb = v;
+        }
+    }
+    fclose(f);
+    return free_pages * page_kb * 1024;
+}
+
+/* Result of one point */
+typedef struct {
+    double ns_per_switch;
+    double dtlb_per_switch;   /* NAN if the counter is unavailable */
+    long long huge_bytes;     /* Huge-page backed bytes while all are live */
+} hugestack_point_t;
+
+/**
+ * Measure n coroutines with stacks placed according to config
+ * Returns: 0 on success, 1 if the configuration is unavailable, -1 on error
+ */
+static int hugestack_point(int n, hugestack_config_t config, double target_ms,
+                           bench_perf_t *perf, hugestack_point_t *point) {
+    ucoro_stack_arena_t arena;
+    ucoro_attr_t attr;
+    int *order = malloc(sizeof(int) * (size_t)n);
+    int created = 0;
+    int rc = 0;
+    
+    if (!order) {
+        fprintf(stderr, "Error: Failed to allocate %d coroutine ids\n", n);
+        return -1;
+    }
+    
+    long long setup_start = get_time_ns();
+    coro_ucontext_attr_init(&attr);
+    attr.stack_size = HUGESTACK_STACK_SIZE;
+    if (config != HUGESTACK_MALLOC) {
+        ucoro_arena_pages_t pages = config == HUGESTACK_ARENA_THP ? UCORO_ARENA_THP :
+                                    config == HUGESTACK_ARENA_HUGETLB ? UCORO_ARENA_HUGETLB :
+                                    UCORO_ARENA_SMALL_PAGES;
+        if (coro_ucontext_arena_open(&arena, HUGESTACK_STACK_SIZE, (size_t)n, pages) < 0) {
+            free(order);
+            return 1;
+        }
+        attr.provider = &arena.provider;
+    }
+    
+    coro_ucontext_init();
+    for (created = 0; created < n; created++) {
+        order[created] = coro_ucontext_create_ex(hugestack_worker, NULL, &attr);
+        if (order[created] < 0) {
+            fprintf(stderr, "Failed to create ucontext coroutine %d of %d\n",
+                    created + 1, n);
+            rc = -1;
+            goto out;
+        }
+    }
+    bench_shuffle(order, n);
+    
+    /*
+     * Warmup round starts every coroutine and doubles as calibration probe;
+     * under a budget the arena, the creates and this round are charged to
+     * the point, and a single measured round is allowed
+     */
+    long long start = get_time_ns();
+    for (int i = 0; i < n; i++) {
+        coro_ucontext_resume(order[i]);
+    }
+    long long round_ns = get_time_ns() - start;
+    point->huge_bytes = hugestack_huge_bytes();
+    
+    long long switches = bench_config.switches_set ? bench_config.num_switches
+                                                   : HUGESTACK_DEFAULT_SWITCHES;
+    long long min_rounds = HUGESTACK_MIN_ROUNDS;
+    if (bench_config.calibrate && round_ns > 0) {
+        double left_ms = target_ms - (double)(get_time_ns() - setup_start) / 1e6;
+        switches = left_ms > 0 ? (long long)(left_ms * 1e6 / ((double)round_ns / n)) : 0;
+        min_rounds = 1;
+    }
+    long long rounds = (switches + n - 1) / n;
+    if (rounds < min_rounds) {
+        rounds = min_rounds;
+    }
+    
+    long long counts[BENCH_PERF_NUM_COUNTERS];
+    bench_perf_start(perf);
+    start = get_time_ns();
+    
+    for (long long r = 0; r < rounds; r++) {
+        for (int i = 0; i < n; i++) {
+            coro_ucontext_resume(order[i]);
+        }
+    }
+    
+    long long total_time = get_time_ns() - start;
+    bench_perf_stop(perf, counts);
+    
+    double total_switches = (double)rounds * n;
+    point->ns_per_switch = (double)total_time / total_switches;
+    point->dtlb_per_switch = counts[BENCH_PERF_DTLB_MISS] < 0 ? NAN :
+                             (double)counts[BENCH_PERF_DTLB_MISS] / total_switches;
+    
+out:
+    for (int i = 0; i < created; i++) {
+        coro_ucontext_destroy(order[i]);
+    }
+    coro_ucontext_cleanup();
+    if (config != HUGESTACK_MALLOC) {
+        coro_ucontext_arena_close(&arena);
+    }
+    free(order);
+    return rc;
+}
+
+/**
+ * Sweep coroutine counts and stack placements
+ */
+int bench_hugestack(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    bench_perf_t perf;
+    bool have_perf = bench_perf_open(&perf) > 0;
+    
+    /* Huge pages make every stack resident; stay within half of RAM */
+    long long ram = (long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    
+    /* Probe the hugetlbfs pool once instead of failing one mmap per row */
+    long long hugetlb_free = hugestack_hugetlb_free_bytes();
+    
+    /* Count the points that will run so the budget is shared among them */
+    int points_left = 0;
+    for (int k = 0; k < NUM_HUGESTACK_COUNTS; k++) {
+        int n = hugestack_coro_counts[k];
+        if (n > MAX_UCONTEXT_COROUTINES ||
+            (bench_config.max_coros > 0 && n > bench_config.max_coros) ||
+            (long long)n * HUGESTACK_STACK_SIZE > ram / 2) {
+            continue;
+        }
+        points_left += HUGESTACK_NUM_CONFIGS;
+        if ((long long)n * HUGESTACK_STACK_SIZE > hugetlb_free) {
+            points_left--;
+        }
+    }
+    
+    FILE *f = fopen("hugestack_results.txt", "w");
+    if (f) {
+        fprintf(f, "coroutines,config,ns_per_switch,dtlb_miss_per_switch,huge_bytes\n");
+    }
+    
+    printf("  %d KB stacks, random resume order\n", HUGESTACK_STACK_SIZE / 1024);
+    if (!have_perf) {
+        printf("  (hardware counters unavailable, miss rates shown as n/a)\n");
+    }
+    if (hugetlb_free == 0) {
+        printf("  (no hugepages reserved, arena-hugetlb skipped: set vm.nr_hugepages)\n");
+    }
+    printf("\n  %10s %14s %12s %12s %10s\n", "N", "stacks", "ns/switch", "dTLB/sw", "huge MB");
+    
+    int rc = 0;
+    long long start = get_time_ns();
+    double fixed_ms_per_coro = 0.0;
+    for (int k = 0; k < NUM_HUGESTACK_COUNTS && rc == 0; k++) {
+        int n = hugestack_coro_counts[k];
+        
+        if (n > MAX_UCONTEXT_COROUTINES ||
+            (bench_config.max_coros > 0 && n > bench_config.max_coros)) {
+            printf("  %10d (skipped: above pool limit %d or --max-coros; "
+                   "see MAX_UCONTEXT_COROUTINES)\n", n, MAX_UCONTEXT_COROUTINES);
+            continue;
+        }
+        if ((long long)n * HUGESTACK_STACK_SIZE > ram / 2) {
+            printf("  %10d (skipped: %lld MB of stacks exceeds half of RAM)\n", n,
+                   (long long)n * HUGESTACK_STACK_SIZE >> 20);
+            continue;
+        }
+        
+        /* A point costs its share plus setup that grows with n: skip counts that cannot fit */
+        double left_ms = budget_ms - (double)(get_time_ns() - start) / 1e6;
+        if (bench_config.calibrate &&
+            (left_ms <= 0 || fixed_ms_per_coro * n * HUGESTACK_NUM_CONFIGS > left_ms)) {
+            printf("  %10d (time budget used up, larger counts skipped)\n", n);
+            break;
+        }
+        
+        for (int c = 0; c < HUGESTACK_NUM_CONFIGS; c++) {
+            if (c == HUGESTACK_ARENA_HUGETLB &&
+                (long long)n * HUGESTACK_STACK_SIZE > hugetlb_free) {
+                if (hugetlb_free == 0) {
+                    printf("  %10d %14s  (skipped: no hugepages)\n", n, hugestack_config_names[c]);
+                } else {
+                    printf("  %10d %14s  (skipped: only %lld MB of hugepages free)\n", n,
+                           hugestack_config_names[c], hugetlb_free >> 20);
+                }
+                continue;
+            }
+            
+            hugestack_point_t point = { 0 };
+            left_ms = budget_ms - (double)(get_time_ns() - start) / 1e6;
+            double target_ms = left_ms / points_left--;
+            long long point_start = get_time_ns();
+            int res = hugestack_point(n, (hugestack_config_t)c, target_ms, &perf, &point);
+            double fixed_ms = (double)(get_time_ns() - point_start) / 1e6 - target_ms;
+            if (fixed_ms / n > fixed_ms_per_coro) {
+                fixed_ms_per_coro = fixed_ms / n;
+            }
+            if (res < 0) {
+                rc = -1;
+                break;
+            }
+            if (res > 0) {
+                printf("  %10d %14s %12s %12s %10s\n", n, hugestack_config_names[c],
+                       "n/a", "n/a", "n/a");
+                continue;
+            }
+            
+            printf("  %10d %14s %12.2f", n, hugestack_config_names[c], point.ns_per_switch);
+            if (isnan(point.dtlb_per_switch)) {
+                printf(" %12s", "n/a");
+            } else {
+                printf(" %12.3f", point.dtlb_per_switch);
+            }
+            printf(" %10.1f\n", point.huge_bytes / (1024.0 * 1024.0));
+            fflush(stdout);
+            
+            if (f) {
+                fprintf(f, "%d,%s,%.2f,%.4f,%lld\n", n, hugestack_config_names[c],
+                        point.ns_per_switch, point.dtlb_per_switch, point.huge_bytes);
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    bench_perf_close(&perf);
+    return rc;
+}
@@ -0,0 +1,240 @@
+/**
+ * bench_idle.c
+ * Idle Strategy Benchmark
+ *
+ * A waker thread wakes a parked coroutine on a scheduler's home thread
+ * with coro_sched_wake_remote(), pausing between wakes so the home thread
+ * goes idle in coro_sched_wait_remote(). For each idle strategy the suite
+ * reports the wake latency (wake_remote call to the coroutine's step),
+ * the home thread's CPU use, and how many waits ended while spinning.
+ */
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+#include "coro_sched.h"
+#include "coro_stackless.h"
+
+/* Wakes in the 50 us row (overridden by --switches); slower rows run fewer */
+#define IDLE_DEFAULT_WAKES 10000
+#define IDLE_MAX_WAKES 1000000
+
+/* Wakes of the --calibrate probe's 50 us row; slower rows run fewer */
+#define IDLE_PROBE_WAKES 200
+
+/* Spin limit of the spin-then-yield and spin-then-park strategies */
+#define IDLE_SPIN_MAX_NS 200000ULL
+
+/* Waker pause between wakes, and the share of the wakes each row runs */
+static const struct {
+    long long gap_ns;
+    int divisor;
+} idle_gaps[] = {
+    { 50000, 1 },
+    { 1000000, 10 },
+};
+#define IDLE_NUM_GAPS ((int)(sizeof(idle_gaps) / sizeof(idle_gaps[0])))
+
+static const struct {
+    coro_sched_idle_t idle;
+    const char *name;
+} idle_modes[] = {
+    { CORO_IDLE_PARK, "park" },
+    { CORO_IDLE_SPIN, "spin" },
+    { CORO_IDLE_SPIN_YIELD, "spin-yield" },
+    { CORO_IDLE_SPIN_PARK, "spin-park" },
+};
+#define IDLE_NUM_MODES ((int)(sizeof(idle_modes) / sizeof(idle_modes[0])))
+
+/* Shared state of one row */
+typedef struct {
+    coro_sched_t *sched;
+    coro_sched_remote_t node;
+    int wakes;
+    long long gap_ns;
+    atomic_llong sent_ns;     /* When the last wake was sent */
+    atomic_int parked;        /* Coroutine is parking: the node may be reused */
+    double *latency_us;
+    int done;                 /* Wakes received */
+} idle_run_t;
+
+/* Coroutine: record the wake that resumed it, then park again */
+static int idle_step(void *arg) {
+    idle_run_t *run = arg;
+    long long sent = atomic_load(&run->sent_ns);
+    
+    if (sent > 0) {
+        run->latency_us[run->done++] = (double)(get_time_ns() - sent) / 1000.0;
+    }
+    if (run->done == run->wakes) {
+        return 1;
+    }
+    coro_sched_park(run->sched);
+    atomic_store(&run->parked, 1);
+    return 0;
+}
+
+/* Waker: pause, then wake the coroutine once it has parked */
+static void *idle_waker(void *arg) {
+    idle_run_t *run = arg;
+    
+    for (int i = 0; i < run->wakes; i++) {
+        struct timespec gap = { 0, (long)run->gap_ns };
+        nanosleep(&gap, NULL);
+        while (!atomic_load(&run->parked)) {
+            sched_yield();
+        }
+        atomic_store(&run->parked, 0);
+        atomic_store(&run->sent_ns, get_time_ns());
+        coro_sched_wake_remote(run->sched, &run->node);
+    }
+    return NULL;
+}
+
+/**
+ * Run one row with the home thread idling as idle says
+ * Returns: 0 on success, -1 on failure
+ */
+static int idle_measure(coro_sched_idle_t idle, idle_run_t *run, double *cpu_pct,
+                        double *hit_pct) {
+    coro_sched_t sched;
+    pthread_t thread;
+    int rc = -1;
+    
+    if (coro_sched_init(&sched, &coro_stackless_backend) < 0) {
+        return -1;
+    }
+    coro_sched_set_idle(&sched, idle, IDLE_SPIN_MAX_NS);
+    run->sched = &sched;
+    run->done = 0;
+    atomic_init(&run->sent_ns, 0);
+    atomic_init(&run->parked, 0);
+    run->node.id = coro_sched_spawn(&sched, idle_step, run, 0);
+    if (run->node.id < 0) goto out;
+    if (pthread_create(&thread, NULL, idle_waker, run) != 0) {
+        fprintf(stderr, "Error: Failed to create waker thread\n");
+        goto out;
+    }
+    
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    long long start = get_time_ns();
+    long long steps = coro_sched_run_all(&sched);
+    long long elapsed = get_time_ns() - start;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    pthread_join(thread, NULL);
+    
+    if (steps >= 0 && elapsed > 0 && run->done == run->wakes) {
+        double cpu_ns = (double)(cpu_end.tv_sec - cpu_start.tv_sec) * 1e9 +
+                        (double)(cpu_end.tv_nsec - cpu_start.tv_nsec);
+        *cpu_pct = 100.0 * cpu_ns / (double)elapsed;
+        *hit_pct = sched.idle_waits > 0 ? 100.0 * (double)sched.idle_hits /
+                                          (double)sched.idle_waits
+                                        : 0.0;
+        rc = 0;
+    }
+    
+out:
+    coro_sched_cleanup(&sched);
+    return rc;
+}
+
+/**
+ * Time every gap's row parking, with a few wakes
+ * Returns: ns per unit of the wake count across all rows, or -1 on failure
+ */
+static double idle_probe(void) {
+    double latency_us[IDLE_PROBE_WAKES];
+    double ns = 0.0;
+    
+    for (int g = 0; g < IDLE_NUM_GAPS; g++) {
+        idle_run_t run;
+        memset(&run, 0, sizeof(run));
+        run.wakes = IDLE_PROBE_WAKES / idle_gaps[g].divisor;
+        run.gap_ns = idle_gaps[g].gap_ns;
+        run.latency_us = latency_us;
+        
+        double cpu_pct, hit_pct;
+        long long start = get_time_ns();
+        if (idle_measure(CORO_IDLE_PARK, &run, &cpu_pct, &hit_pct) < 0) {
+            return -1.0;
+        }
+        ns += (double)(get_time_ns() - start) / IDLE_PROBE_WAKES;
+    }
+    return ns * IDLE_NUM_MODES;
+}
+
+/**
+ * Wake latency vs idle CPU of the home thread's idle strategies
+ */
+int bench_idle(double budget_ms) {
+    if (!bench_backend_selected(&coro_stackless_backend)) {
+        printf("  (stackless backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    double unit_ns = bench_config.calibrate ? idle_probe() : 0.0;
+    int wakes = (int)bench_suite_count(budget_ms, unit_ns, IDLE_DEFAULT_WAKES, IDLE_MAX_WAKES);
+    
+    FILE *f = fopen("idle_results.txt", "w");
+    if (f) {
+        fprintf(f, "gap_us,strategy,wakes,p50_us,p99_us,home_cpu_pct,spin_hit_pct\n");
+    }
+    
+    printf("  Waker thread wakes a parked coroutine after each pause;\n");
+    printf("  spin limit %llu us\n", IDLE_SPIN_MAX_NS / 1000);
+    printf("  %8s %12s %8s %10s %10s %10s %10s\n", "gap (us)", "strategy", "wakes", "p50 (us)",
+           "p99 (us)", "home CPU", "spin hits");
+    
+    int rc = 0;
+    for (int g = 0; g < IDLE_NUM_GAPS && rc == 0; g++) {
+        int n = wakes / idle_gaps[g].divisor > 0 ? wakes / idle_gaps[g].divisor : 1;
+        double *latency_us = malloc(sizeof(double) * (size_t)n);
+        if (!latency_us) {
+            fprintf(stderr, "Error: Failed to allocate wake samples\n");
+            rc = -1;
+            break;
+        }
+        
+        for (int m = 0; m < IDLE_NUM_MODES; m++) {
+            idle_run_t run;
+            memset(&run, 0, sizeof(run));
+            run.wakes = n;
+            run.gap_ns = idle_gaps[g].gap_ns;
+            run.latency_us = latency_us;
+            
+            double cpu_pct = 0.0, hit_pct = 0.0;
+            if (idle_measure(idle_modes[m].idle, &run, &cpu_pct, &hit_pct) < 0) {
+                fprintf(stderr, "Error: Idle row (%s) failed\n", idle_modes[m].name);
+                rc = -1;
+                break;
+            }
+            
+            qsort(latency_us, (size_t)n, sizeof(double), bench_compare_double);
+            double p50 = bench_percentile(latency_us, n, 500);
+            double p99 = bench_percentile(latency_us, n, 990);
+            double gap_us = (double)idle_gaps[g].gap_ns / 1000.0;
+            
+            printf("  %8.0f %12s %8d %10.1f %10.1f %9.1f%% %9.1f%%\n", gap_us,
+                   idle_modes[m].name, n, p50, p99, cpu_pct, hit_pct);
+            fflush(stdout);
+            
+            if (f) {
+                fprintf(f, "%.0f,%s,%d,%.2f,%.2f,%.1f,%.1f\n", gap_us, idle_modes[m].name, n,
+                        p50, p99, cpu_pct, hit_pct);
+            }
+        }
+        free(latency_us);
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    return rc;
+}
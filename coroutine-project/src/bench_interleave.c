@@ -0,0 +1,325 @@
+/**
+ * bench_interleave.c
+ * Interleaved Lookup (Group Prefetch) Benchmark
+ *
+ * Lookups chase INTERLEAVE_HOPS pointers each through a table much larger
+ * than the last-level cache, so nearly every hop is a cache miss. Run one
+ * after another, each hop waits out its miss. Run as a batch of stackless
+ * coroutines under coro_stackless_interleave(), each hop prefetches its
+ * node and yields (CORO_YIELD_PREFETCH), so up to a batch's worth of
+ * misses are in flight at once. The suite reports time per lookup for
+ * batch sizes 1 to 64, next to the sequential loop and a hand-written
+ * group-prefetch loop.
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "coro_stackless.h"
+
+/* Table nodes: 8M x 64 bytes = 512 MB */
+#define INTERLEAVE_NODES (8 * 1024 * 1024)
+
+/* Dependent loads per lookup */
+#define INTERLEAVE_HOPS 16
+
+/* Lookups per row (overridden by --switches) */
+#define INTERLEAVE_DEFAULT_LOOKUPS 200000
+#define INTERLEAVE_MAX_LOOKUPS 10000000
+
+/* Lookups per row of the --calibrate probe sweep */
+#define INTERLEAVE_PROBE_LOOKUPS 20000
+
+/* Chains advanced together by the hand-written group-prefetch loop */
+#define INTERLEAVE_GROUP_LOOP 16
+
+/* Coroutines per batch */
+static const int interleave_batches[] = { 1, 2, 4, 8, 16, 32, 64 };
+#define INTERLEAVE_NUM_BATCHES ((int)(sizeof(interleave_batches) / sizeof(interleave_batches[0])))
+
+/* One cache line per node */
+typedef struct {
+    uint32_t next;
+    uint32_t pad[15];
+} interleave_node_t;
+
+/* One coroutine's share of the lookups: every stride-th from first */
+typedef struct {
+    const interleave_node_t *nodes;
+    const uint32_t *starts;
+    int lookup;               /* Current lookup */
+    int end;
+    int stride;
+    int hop;
+    bool prefetch;            /* false = plain CORO_YIELD, for comparison */
+    uint32_t cur;
+    uint64_t sum;
+} interleave_chain_t;
+
+/**
+ * Link the nodes into one random cycle (Sattolo's algorithm), so a
+ * chase never settles into a cached loop
+ */
+static void interleave_build(interleave_node_t *nodes, int n) {
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < n; i++) {
+        nodes[i].next = (uint32_t)i;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(bench_rand(&state) % (unsigned long long)i);
+        uint32_t tmp = nodes[i].next;
+        nodes[i].next = nodes[j].next;
+        nodes[j].next = tmp;
+    }
+}
+
+/* Lookup coroutine: prefetch the next node and yield instead of stalling */
+static void interleave_lookup(coro_stackless_t *coro, void *arg) {
+    interleave_chain_t *c = arg;
+    
+    CORO_BEGIN(coro);
+    for (; c->lookup < c->end; c->lookup += c->stride) {
+        c->cur = c->starts[c->lookup];
+        for (c->hop = 0; c->hop < INTERLEAVE_HOPS; c->hop++) {
+            if (c->prefetch) {
+                CORO_YIELD_PREFETCH(coro, &c->nodes[c->cur]);
+            } else {
+                CORO_YIELD(coro);
+            }
+            c->cur = c->nodes[c->cur].next;
+        }
+        c->sum += c->cur;
+    }
+    CORO_END(coro);
+}
+
+/**
+ * Lookups one after another
+ * Returns: checksum of the end nodes
+ */
+static uint64_t interleave_sequential(const interleave_node_t *nodes, const uint32_t *starts,
+                                      int lookups) {
+    uint64_t sum = 0;
+    for (int i = 0; i < lookups; i++) {
+        uint32_t cur = starts[i];
+        for (int h = 0; h < INTERLEAVE_HOPS; h++) {
+            cur = nodes[cur].next;
+        }
+        sum += cur;
+    }
+    return sum;
+}
+
+/**
+ * Hand-written group prefetching: advance INTERLEAVE_GROUP_LOOP chains a
+ * hop at a time, prefetching all of them before loading any
+ * Returns: checksum of the end nodes
+ */
+static uint64_t interleave_group_loop(const interleave_node_t *nodes, const uint32_t *starts,
+                                      int lookups) {
+    uint32_t cur[INTERLEAVE_GROUP_LOOP];
+    uint64_t sum = 0;
+    
+    for (int i = 0; i < lookups; i += INTERLEAVE_GROUP_LOOP) {
+        int group = lookups - i < INTERLEAVE_GROUP_LOOP ? lookups - i : INTERLEAVE_GROUP_LOOP;
+        for (int g = 0; g < group; g++) {
+            cur[g] = starts[i + g];
+        }
+        for (int h = 0; h < INTERLEAVE_HOPS; h++) {
+            for (int g = 0; g < group; g++) {
+                __builtin_prefetch(&nodes[cur[g]], 0, 3);
+            }
+            for (int g = 0; g < group; g++) {
+                cur[g] = nodes[cur[g]].next;
+            }
+        }
+        for (int g = 0; g < group; g++) {
+            sum += cur[g];
+        }
+    }
+    return sum;
+}
+
+/**
+ * Run the lookups as batch interleaved coroutines
+ * Returns: elapsed nanoseconds, or -1 on failure
+ */
+static long long interleave_coroutines(const interleave_node_t *nodes, const uint32_t *starts,
+                                       int lookups, int batch, bool prefetch, uint64_t *sum) {
+    interleave_chain_t *chains = calloc((size_t)batch, sizeof(*chains));
+    int *ids = malloc(sizeof(int) * (size_t)batch);
+    long long elapsed = -1;
+    
+    if (!chains || !ids) {
+        fprintf(stderr, "Error: Failed to allocate %d lookup coroutines\n", batch);
+        goto out;
+    }
+    
+    coro_stackless_init();
+    for (int i = 0; i < batch; i++) {
+        chains[i].nodes = nodes;
+        chains[i].starts = starts;
+        chains[i].lookup = i;
+        chains[i].end = lookups;
+        chains[i].stride = batch;
+        chains[i].prefetch = prefetch;
+        ids[i] = coro_stackless_create(interleave_lookup, &chains[i]);
+        if (ids[i] < 0) {
+            fprintf(stderr, "Error: Failed to create lookup coroutine\n");
+            goto out_cleanup;
+        }
+    }
+    
+    long long start = get_time_ns();
+    coro_stackless_interleave(ids, batch);
+    elapsed = get_time_ns() - start;
+    
+    *sum = 0;
+    for (int i = 0; i < batch; i++) {
+        *sum += chains[i].sum;
+    }
+    
+out_cleanup:
+    coro_stackless_cleanup();
+out:
+    free(chains);
+    free(ids);
+    return elapsed;
+}
+
+/**
+ * Print and save one row
+ */
+static void interleave_report(FILE *f, const char *mode, int batch, int lookups,
+                              long long elapsed, double sequential_ns) {
+    double per_lookup = (double)elapsed / (double)lookups;
+    double speedup = sequential_ns > 0 ? sequential_ns / per_lookup : 1.0;
+    
+    printf("  %-22s %6d %12.1f %10.1f %9.2fx\n", mode, batch, per_lookup,
+           per_lookup / INTERLEAVE_HOPS, speedup);
+    fflush(stdout);
+    if (f) {
+        fprintf(f, "%s,%d,%d,%.2f,%.2f,%.3f\n", mode, batch, lookups, per_lookup,
+                per_lookup / INTERLEAVE_HOPS, speedup);
+    }
+}
+
+/**
+ * Run every row over the first lookups entries of starts; report them
+ * if report is set
+ * Returns: 0 on success, -1 on failure
+ */
+static int interleave_sweep(const interleave_node_t *nodes, const uint32_t *starts,
+                            int lookups, bool report, FILE *f) {
+    int rc = 0;
+    long long start = get_time_ns();
+    uint64_t expected = interleave_sequential(nodes, starts, lookups);
+    long long elapsed = get_time_ns() - start;
+    double sequential_ns = (double)elapsed / (double)lookups;
+    if (report) {
+        interleave_report(f, "sequential", 1, lookups, elapsed, 0.0);
+    }
+    
+    start = get_time_ns();
+    uint64_t sum = interleave_group_loop(nodes, starts, lookups);
+    elapsed = get_time_ns() - start;
+    if (sum != expected) {
+        fprintf(stderr, "Error: Group-prefetch loop checksum mismatch\n");
+        rc = -1;
+    }
+    if (report) {
+        interleave_report(f, "group-prefetch loop", INTERLEAVE_GROUP_LOOP, lookups, elapsed,
+                          sequential_ns);
+    }
+    
+    for (int b = 0; b <= INTERLEAVE_NUM_BATCHES && rc == 0; b++) {
+        /* The last row: a batch of 16 that yields without prefetching */
+        bool prefetch = b < INTERLEAVE_NUM_BATCHES;
+        int batch = prefetch ? interleave_batches[b] : 16;
+        
+        elapsed = interleave_coroutines(nodes, starts, lookups, batch, prefetch, &sum);
+        if (elapsed < 0) {
+            rc = -1;
+            break;
+        }
+        if (sum != expected) {
+            fprintf(stderr, "Error: Interleaved lookups (batch %d) checksum mismatch\n", batch);
+            rc = -1;
+            break;
+        }
+        if (report) {
+            interleave_report(f, prefetch ? "interleaved prefetch" : "interleaved no prefetch",
+                              batch, lookups, elapsed, sequential_ns);
+        }
+    }
+    return rc;
+}
+
+/**
+ * Sequential vs interleaved pointer-chasing lookups
+ */
+int bench_interleave(double budget_ms) {
+    if (!bench_backend_selected(&coro_stackless_backend)) {
+        printf("  (stackless backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    long long start = get_time_ns();
+    interleave_node_t *nodes = aligned_alloc(64, sizeof(*nodes) * (size_t)INTERLEAVE_NODES);
+    if (!nodes) {
+        fprintf(stderr, "Error: Failed to allocate the %zu MB lookup table\n",
+                sizeof(*nodes) * (size_t)INTERLEAVE_NODES >> 20);
+        return -1;
+    }
+    interleave_build(nodes, INTERLEAVE_NODES);
+    
+    unsigned long long state = 0xD1B54A32D192ED03ULL;
+    double unit_ns = 0.0;
+    if (bench_config.calibrate) {
+        unsigned long long probe_state = state;
+        uint32_t probe_starts[INTERLEAVE_PROBE_LOOKUPS];
+        for (int i = 0; i < INTERLEAVE_PROBE_LOOKUPS; i++) {
+            probe_starts[i] = (uint32_t)(bench_rand(&probe_state) % INTERLEAVE_NODES);
+        }
+        long long probe = get_time_ns();
+        if (interleave_sweep(nodes, probe_starts, INTERLEAVE_PROBE_LOOKUPS, false, NULL) == 0) {
+            unit_ns = (double)(get_time_ns() - probe) / INTERLEAVE_PROBE_LOOKUPS;
+        }
+    }
+    
+    /* Building the table comes out of the budget; the rest goes to the sweep */
+    double sweep_ms = budget_ms - (double)(get_time_ns() - start) / 1e6;
+    int lookups = (int)bench_suite_count(sweep_ms, unit_ns, INTERLEAVE_DEFAULT_LOOKUPS,
+                                         INTERLEAVE_MAX_LOOKUPS);
+    uint32_t *starts = malloc(sizeof(*starts) * (size_t)lookups);
+    if (!starts) {
+        fprintf(stderr, "Error: Failed to allocate %d lookup starts\n", lookups);
+        free(nodes);
+        return -1;
+    }
+    for (int i = 0; i < lookups; i++) {
+        starts[i] = (uint32_t)(bench_rand(&state) % INTERLEAVE_NODES);
+    }
+    
+    FILE *f = fopen("interleave_results.txt", "w");
+    if (f) {
+        fprintf(f, "mode,batch,lookups,ns_per_lookup,ns_per_hop,speedup\n");
+    }
+    
+    printf("  %d lookups of %d dependent hops through a %zu MB table\n", lookups,
+           INTERLEAVE_HOPS, sizeof(*nodes) * (size_t)INTERLEAVE_NODES >> 20);
+    printf("  %-22s %6s %12s %10s %10s\n", "mode", "batch", "ns/lookup", "ns/hop", "speedup");
+    
+    int rc = interleave_sweep(nodes, starts, lookups, true, f);
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    free(nodes);
+    free(starts);
+    return rc;
+}
@@ -0,0 +1,269 @@
+/**
+ * bench_offload.c
+ * Blocking-Call Offload Benchmark
+ *
+ * Coroutines on one scheduler offload calls to the helper pool, from 1
+ * to thousands at a time. For each concurrency the suite reports
+ * completed offloads per second and the round trip seen by the
+ * coroutine (submit to resume), for an empty call (pure overhead) and
+ * for a call that blocks for OFFLOAD_SLEEP_US.
+ * Stackful backends use coro_run_blocking(); the stackless backend
+ * submits from a step and picks the result up in the next one.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+#include "coro_offload.h"
+
+/* Helper threads */
+#define OFFLOAD_THREADS CORO_OFFLOAD_DEFAULT_THREADS
+
+/* Offloads per row (overridden by --switches); blocking rows do 1/10 */
+#define OFFLOAD_DEFAULT_CALLS 20000
+#define OFFLOAD_MAX_CALLS 1000000
+
+/* Empty calls of the --calibrate probe rows; the blocking probe does 1/10 */
+#define OFFLOAD_PROBE_CALLS 1000
+
+/* Duration of the blocking call */
+#define OFFLOAD_SLEEP_US 50
+
+/* Concurrent coroutines per row */
+static const int offload_concurrency[] = { 1, 16, 256, 4096 };
+#define OFFLOAD_NUM_CONCURRENCY ((int)(sizeof(offload_concurrency) / sizeof(offload_concurrency[0])))
+
+/* Shared state of one row */
+typedef struct {
+    coro_offload_fn_t fn;
+    double *round_trip_us;
+    int num_round_trips;
+} offload_run_t;
+
+/* One offloading coroutine */
+typedef struct {
+    offload_run_t *run;
+    bool stackful;
+    int remaining;
+    bool pending;             /* Step-style job in flight */
+    long long submit_ns;
+    coro_offload_job_t job;
+} offload_worker_t;
+
+/* Empty call: the round trip is pure overhead */
+static void *offload_noop(void *arg) {
+    return arg;
+}
+
+/* Blocking call */
+static void *offload_sleep(void *arg) {
+    struct timespec ts = { 0, OFFLOAD_SLEEP_US * 1000L };
+    nanosleep(&ts, NULL);
+    return arg;
+}
+
+/**
+ * Record one round trip
+ */
+static void offload_record(offload_run_t *run, long long start_ns) {
+    run->round_trip_us[run->num_round_trips++] = (double)(get_time_ns() - start_ns) / 1000.0;
+}
+
+/* Worker step: offload `remaining` calls */
+static int offload_step(void *arg) {
+    offload_worker_t *w = arg;
+    offload_run_t *run = w->run;
+    
+    if (w->stackful) {
+        for (; w->remaining > 0; w->remaining--) {
+            long long start = get_time_ns();
+            coro_run_blocking(run->fn, w);
+            offload_record(run, start);
+        }
+        return 1;
+    }
+    
+    if (w->pending) {
+        offload_record(run, w->submit_ns);
+        w->pending = false;
+        if (--w->remaining == 0) {
+            return 1;
+        }
+    }
+    w->submit_ns = get_time_ns();
+    if (coro_offload_submit(&w->job, run->fn, w) < 0) {
+        return 1;
+    }
+    w->pending = true;
+    return 0;
+}
+
+/**
+ * Run one row: coros coroutines sharing calls offloads
+ * Returns: elapsed nanoseconds, or -1 on failure
+ */
+static long long offload_measure(const coro_backend_t *backend, offload_run_t *run,
+                                 int coros, int calls) {
+    coro_sched_t sched;
+    offload_worker_t *workers = calloc((size_t)coros, sizeof(*workers));
+    if (!workers) {
+        fprintf(stderr, "Error: Failed to allocate offload workers\n");
+        return -1;
+    }
+    if (coro_sched_init(&sched, backend) < 0) {
+        free(workers);
+        return -1;
+    }
+    
+    long long elapsed = -1;
+    run->num_round_trips = 0;
+    for (int i = 0; i < coros; i++) {
+        workers[i].run = run;
+        workers[i].stackful = coro_backend_has(backend, CORO_BACKEND_CAP_STACKFUL);
+        workers[i].remaining = calls / coros + (i < calls % coros);
+        if (workers[i].remaining == 0) continue;
+        if (coro_sched_spawn(&sched, offload_step, &workers[i], 0) < 0) goto out;
+    }
+    
+    long long start = get_time_ns();
+    if (coro_sched_run_all(&sched) < 0) goto out;
+    elapsed = get_time_ns() - start;
+    
+out:
+    coro_sched_cleanup(&sched);
+    free(workers);
+    return elapsed;
+}
+
+/**
+ * Rows a backend runs per kind of call, within its pool and --max-coros
+ */
+static int offload_rows(const coro_backend_t *backend) {
+    int rows = 0;
+    for (int c = 0; c < OFFLOAD_NUM_CONCURRENCY; c++) {
+        int coros = offload_concurrency[c];
+        if (coros > backend->max_coros) continue;
+        if (bench_config.max_coros > 0 && coros > bench_config.max_coros) continue;
+        rows++;
+    }
+    return rows;
+}
+
+/**
+ * Time an empty and a blocking row of one coroutine, the slowest
+ * concurrency, on every selected backend
+ * Returns: ns per call of every row together, or -1 on failure
+ */
+static double offload_probe(void) {
+    offload_run_t run;
+    double ns = 0.0;
+    
+    run.round_trip_us = malloc(sizeof(double) * OFFLOAD_PROBE_CALLS);
+    if (!run.round_trip_us) {
+        return -1.0;
+    }
+    for (int b = 0; b < coro_backend_count(); b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        run.fn = offload_noop;
+        long long empty = offload_measure(backend, &run, 1, OFFLOAD_PROBE_CALLS);
+        run.fn = offload_sleep;
+        long long sleep = offload_measure(backend, &run, 1, OFFLOAD_PROBE_CALLS / 10);
+        if (empty <= 0 || sleep <= 0) {
+            ns = -1.0;
+            break;
+        }
+        /* Blocking rows run a tenth of the calls */
+        ns += offload_rows(backend) * (double)(empty + sleep) / OFFLOAD_PROBE_CALLS;
+    }
+    free(run.round_trip_us);
+    return ns;
+}
+
+/**
+ * Offload round trip and throughput against concurrency
+ */
+int bench_offload(double budget_ms) {
+    if (coro_offload_start(OFFLOAD_THREADS) < 0) {
+        return -1;
+    }
+    
+    double unit_ns = bench_config.calibrate ? offload_probe() : 0.0;
+    int calls = (int)bench_suite_count(budget_ms, unit_ns, OFFLOAD_DEFAULT_CALLS,
+                                       OFFLOAD_MAX_CALLS);
+    if (calls < 10) calls = 10;
+    
+    offload_run_t run;
+    run.round_trip_us = malloc(sizeof(double) * (size_t)calls);
+    if (!run.round_trip_us) {
+        fprintf(stderr, "Error: Failed to allocate round-trip samples\n");
+        coro_offload_stop();
+        return -1;
+    }
+    
+    FILE *f = fopen("offload_results.txt", "w");
+    if (f) {
+        fprintf(f, "backend,call,coroutines,calls,offloads_per_sec,mean_us,p50_us,p99_us\n");
+    }
+    
+    printf("  %d helper threads; empty call and %d us blocking call\n",
+           coro_offload_threads(), OFFLOAD_SLEEP_US);
+    
+    int rc = 0;
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        printf("\n  %s (%s):\n", backend->name,
+               coro_backend_has(backend, CORO_BACKEND_CAP_STACKFUL) ? "coro_run_blocking"
+                                                                    : "submit from step");
+        printf("  %8s %10s %8s %14s %10s %10s %10s\n", "call", "coroutines", "calls",
+               "offloads/s", "mean us", "p50 us", "p99 us");
+        
+        for (int sleep = 0; sleep <= 1 && rc == 0; sleep++) {
+            run.fn = sleep ? offload_sleep : offload_noop;
+            int row_calls = sleep ? calls / 10 : calls;
+            
+            for (int c = 0; c < OFFLOAD_NUM_CONCURRENCY; c++) {
+                int coros = offload_concurrency[c];
+                if (coros > backend->max_coros) continue;
+                if (bench_config.max_coros > 0 && coros > bench_config.max_coros) continue;
+                
+                long long elapsed = offload_measure(backend, &run, coros, row_calls);
+                if (elapsed <= 0 || run.num_round_trips == 0) {
+                    rc = -1;
+                    break;
+                }
+                
+                int n = run.num_round_trips;
+                double mean, min, max;
+                calculate_stats(run.round_trip_us, n, &mean, &min, &max);
+                qsort(run.round_trip_us, (size_t)n, sizeof(double), bench_compare_double);
+                double p50 = bench_percentile(run.round_trip_us, n, 500);
+                double p99 = bench_percentile(run.round_trip_us, n, 990);
+                double rate = (double)n * 1e9 / (double)elapsed;
+                const char *call = sleep ? "sleep" : "empty";
+                
+                printf("  %8s %10d %8d %14.0f %10.1f %10.1f %10.1f\n", call, coros, n, rate,
+                       mean, p50, p99);
+                fflush(stdout);
+                
+                if (f) {
+                    fprintf(f, "%s,%s,%d,%d,%.0f,%.2f,%.2f,%.2f\n", backend->name, call, coros,
+                            n, rate, mean, p50, p99);
+                }
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    coro_offload_stop();
+    free(run.round_trip_us);
+    return rc;
+}
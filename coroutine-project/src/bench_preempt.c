@@ -0,0 +1,364 @@
+/**
+ * bench_preempt.c
+ * Time-Slice Preemption Benchmark
+ *
+ * Short coroutines (a few microseconds of work, then a yield) share a
+ * round-robin loop with CPU-bound coroutines that compute for tens of
+ * milliseconds between yields. The suite records how long each short
+ * coroutine waits from its yield to its next resume, and how much work
+ * the CPU-bound ones get done, with preemption off and at two slices.
+ * A final check runs preemptible scheduler coroutines that wake each
+ * other and offload calls under a short slice, and fails if a forced
+ * yield landed inside the library's bookkeeping.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "coro_offload.h"
+#include "coro_sched.h"
+#include "coro_ucontext.h"
+
+/* Coroutines of each kind */
+#define PREEMPT_SHORT 16
+#define PREEMPT_CPU 2
+
+/* Work per short resume, and CPU-bound iterations between voluntary yields */
+#define PREEMPT_SHORT_WORK_NS 2000
+#define PREEMPT_CPU_CHUNK 20000000LL
+
+/* Run time per mode (overridden by --switches, in ms), and its bounds */
+#define PREEMPT_RUN_MS 1000
+#define PREEMPT_MIN_RUN_MS 100
+#define PREEMPT_MAX_RUN_MS 60000
+
+/* Wait samples kept per mode */
+#define PREEMPT_MAX_SAMPLES (1 << 18)
+
+/* Safety check: workers, sleepers they wake, rounds each, slice, and work between calls */
+#define PREEMPT_CHECK_COROS 8
+#define PREEMPT_CHECK_SLEEPERS 8
+#define PREEMPT_CHECK_ROUNDS 400
+#define PREEMPT_CHECK_SLICE_US 50
+#define PREEMPT_CHECK_CHUNK 20000
+
+/* Slices compared (0 = preemption off) */
+static const int preempt_slices_us[] = { 0, 1000, 200 };
+#define PREEMPT_NUM_MODES ((int)(sizeof(preempt_slices_us) / sizeof(preempt_slices_us[0])))
+
+/* Shared state of one mode */
+typedef struct {
+    double *wait_us;          /* Yield-to-resume wait of short coroutines */
+    int num_waits;
+    long long cpu_iterations; /* Finished CPU-bound iterations */
+} preempt_run_t;
+
+/* One short coroutine */
+typedef struct {
+    preempt_run_t *run;
+    long long yielded_ns;     /* 0 until its first yield */
+} preempt_short_t;
+
+/* One CPU-bound coroutine */
+typedef struct {
+    preempt_run_t *run;
+    uint64_t state;
+} preempt_cpu_t;
+
+/* Short coroutine: record the wait, a little work, yield */
+static void preempt_short_entry(void *arg) {
+    preempt_short_t *s = arg;
+    preempt_run_t *run = s->run;
+    
+    for (;;) {
+        long long now = get_time_ns();
+        if (s->yielded_ns && run->num_waits < PREEMPT_MAX_SAMPLES) {
+            run->wait_us[run->num_waits++] = (double)(now - s->yielded_ns) / 1000.0;
+        }
+        long long end = now + PREEMPT_SHORT_WORK_NS;
+        while (get_time_ns() < end) {
+        }
+        s->yielded_ns = get_time_ns();
+        coro_ucontext_yield();
+    }
+}
+
+/* CPU-bound coroutine: a long dependent chain between voluntary yields */
+static void preempt_cpu_entry(void *arg) {
+    preempt_cpu_t *c = arg;
+    
+    for (;;) {
+        uint64_t x = c->state;
+        for (long long i = 0; i < PREEMPT_CPU_CHUNK; i++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            __asm__ __volatile__("" : "+r"(x));
+            if ((i & 0xFFFF) == 0xFFFF) {
+                c->run->cpu_iterations += 0x10000;
+            }
+        }
+        c->state = x;
+        coro_ucontext_yield();
+    }
+}
+
+/**
+ * Run one mode for run_ms
+ * Returns: forced yields, or -1 on failure
+ */
+static long long preempt_measure(int slice_us, int run_ms, preempt_run_t *run) {
+    preempt_short_t shorts[PREEMPT_SHORT];
+    preempt_cpu_t cpus[PREEMPT_CPU];
+    int ids[PREEMPT_SHORT + PREEMPT_CPU];
+    int n = 0;
+    long long result = -1;
+    
+    coro_ucontext_init();
+    run->num_waits = 0;
+    run->cpu_iterations = 0;
+    
+    /* CPU-bound coroutines spread through the round-robin order */
+    ucoro_attr_t attr;
+    coro_ucontext_attr_init(&attr);
+    attr.preemptible = true;
+    for (int i = 0; i < PREEMPT_SHORT; i++) {
+        shorts[i] = (preempt_short_t){ run, 0 };
+        ids[n] = coro_ucontext_create(preempt_short_entry, &shorts[i]);
+        if (ids[n++] < 0) goto out;
+        
+        if (i % (PREEMPT_SHORT / PREEMPT_CPU) == 0) {
+            int c = i / (PREEMPT_SHORT / PREEMPT_CPU);
+            cpus[c] = (preempt_cpu_t){ run, (uint64_t)c + 1 };
+            ids[n] = coro_ucontext_create_ex(preempt_cpu_entry, &cpus[c], &attr);
+            if (ids[n++] < 0) goto out;
+        }
+    }
+    
+    if (slice_us > 0 && coro_ucontext_preempt_start(slice_us) < 0) {
+        goto out;
+    }
+    
+    long long before = coro_ucontext_preemptions();
+    long long end = get_time_ns() + run_ms * 1000000LL;
+    while (get_time_ns() < end) {
+        for (int i = 0; i < n; i++) {
+            coro_ucontext_resume_fast(ids[i]);
+        }
+    }
+    result = coro_ucontext_preemptions() - before;
+    coro_ucontext_preempt_stop();
+    
+out:
+    coro_ucontext_cleanup();
+    return result;
+}
+
+/* ============================================================
+ * SAFETY CHECK
+ * ============================================================ */
+
+/* Shared state of the check */
+typedef struct {
+    coro_sched_t *sched;
+    int sleepers[PREEMPT_CHECK_SLEEPERS];
+    int live;                 /* Workers not yet finished */
+    int errors;
+    ucoro_local_key_t key;
+} preempt_check_t;
+
+/* One worker */
+typedef struct {
+    preempt_check_t *check;
+    int rounds;
+    uint64_t state;
+} preempt_worker_t;
+
+/* Offloaded call: hand the argument back */
+static void *preempt_check_job(void *arg) {
+    return arg;
+}
+
+/* Sleeper step (not preemptible): park until the workers are done */
+static int preempt_sleeper_step(void *arg) {
+    preempt_check_t *c = arg;
+    
+    if (c->live == 0) {
+        return 1;
+    }
+    coro_sched_park(c->sched);
+    return 0;
+}
+
+/* Worker step (preemptible): compute, offload, set a local, wake the sleepers */
+static int preempt_check_step(void *arg) {
+    preempt_worker_t *w = arg;
+    preempt_check_t *c = w->check;
+    
+    uint64_t x = w->state;
+    for (int i = 0; i < PREEMPT_CHECK_CHUNK; i++) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        __asm__ __volatile__("" : "+r"(x));
+    }
+    w->state = x;
+    
+    if (coro_run_blocking(preempt_check_job, w) != w) {
+        c->errors++;
+    }
+    if (coro_ucontext_local_set(c->key, w) < 0 || coro_ucontext_local_get(c->key) != w) {
+        c->errors++;
+    }
+    
+    /* The last worker's wakes come after live reaches 0, so no sleeper is left parked */
+    bool done = ++w->rounds == PREEMPT_CHECK_ROUNDS;
+    if (done) {
+        c->live--;
+    }
+    for (int i = 0; i < PREEMPT_CHECK_SLEEPERS; i++) {
+        coro_sched_wake(c->sched, c->sleepers[i]);
+    }
+    return done ? 1 : 0;
+}
+
+/**
+ * Run the workers to completion with the timer at PREEMPT_CHECK_SLICE_US
+ * Returns: forced yields, or -1 on failure or an inconsistent result
+ */
+static long long preempt_check(void) {
+    preempt_worker_t workers[PREEMPT_CHECK_COROS];
+    preempt_check_t check = { .live = PREEMPT_CHECK_COROS };
+    coro_sched_t sched;
+    long long result = -1;
+    
+    if (coro_ucontext_local_key_create(&check.key, NULL) < 0) {
+        fprintf(stderr, "Error: No coroutine-local key for the preemption check\n");
+        return -1;
+    }
+    if (coro_sched_init(&sched, &coro_ucontext_backend) < 0) {
+        goto out_key;
+    }
+    if (coro_offload_start(2) < 0) {
+        goto out_sched;
+    }
+    
+    check.sched = &sched;
+    for (int i = 0; i < PREEMPT_CHECK_SLEEPERS; i++) {
+        check.sleepers[i] = coro_sched_spawn(&sched, preempt_sleeper_step, &check, 0);
+        if (check.sleepers[i] < 0) goto out_pool;
+    }
+    for (int i = 0; i < PREEMPT_CHECK_COROS; i++) {
+        workers[i] = (preempt_worker_t){ &check, 0, (uint64_t)i + 1 };
+        int id = coro_sched_spawn(&sched, preempt_check_step, &workers[i], 0);
+        if (id < 0 || coro_ucontext_set_preemptible(id, true) < 0) goto out_pool;
+    }
+    
+    if (coro_ucontext_preempt_start(PREEMPT_CHECK_SLICE_US) < 0) {
+        goto out_pool;
+    }
+    long long steps = coro_sched_run_all(&sched);
+    long long forced = coro_ucontext_preemptions();
+    coro_ucontext_preempt_stop();
+    
+    bool ok = steps >= 0 && check.errors == 0 && check.live == 0;
+    for (int i = 0; i < PREEMPT_CHECK_COROS; i++) {
+        ok = ok && workers[i].rounds == PREEMPT_CHECK_ROUNDS;
+    }
+    if (ok) {
+        result = forced;
+    } else {
+        fprintf(stderr, "Error: Preemption check inconsistent (%d errors, %d workers left)\n",
+                check.errors, check.live);
+    }
+    
+out_pool:
+    coro_offload_stop();
+out_sched:
+    coro_sched_cleanup(&sched);
+out_key:
+    coro_ucontext_local_key_delete(check.key);
+    return result;
+}
+
+/**
+ * Compare short-coroutine wait with and without time-slice preemption
+ */
+int bench_preempt(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    /* The check runs first, out of the budget */
+    long long start = get_time_ns();
+    long long forced = preempt_check();
+    if (forced < 0) {
+        return -1;
+    }
+    printf("  Check: %d preemptible scheduler coroutines, %d rounds of offload and\n",
+           PREEMPT_CHECK_COROS, PREEMPT_CHECK_ROUNDS);
+    printf("  wake each at a %d us slice: %lld forced yields, consistent\n\n",
+           PREEMPT_CHECK_SLICE_US, forced);
+    double rows_ms = budget_ms - (double)(get_time_ns() - start) / 1e6;
+    
+    /* A row's unit is one millisecond; with preemption off a row runs a CPU chunk at least */
+    int run_ms = (int)bench_suite_count(rows_ms / PREEMPT_NUM_MODES, 1e6, PREEMPT_RUN_MS,
+                                        PREEMPT_MAX_RUN_MS);
+    if (run_ms < PREEMPT_MIN_RUN_MS) run_ms = PREEMPT_MIN_RUN_MS;
+    
+    preempt_run_t run;
+    run.wait_us = malloc(sizeof(double) * PREEMPT_MAX_SAMPLES);
+    if (!run.wait_us) {
+        fprintf(stderr, "Error: Failed to allocate wait samples\n");
+        return -1;
+    }
+    
+    FILE *f = fopen("preempt_results.txt", "w");
+    if (f) {
+        fprintf(f, "slice_us,resumes,p50_us,p99_us,max_us,preemptions,cpu_mops\n");
+    }
+    
+    printf("  %d short coroutines (%d us per resume) and %d CPU-bound ones,\n",
+           PREEMPT_SHORT, PREEMPT_SHORT_WORK_NS / 1000, PREEMPT_CPU);
+    printf("  round-robin for %d ms per mode; short-coroutine yield-to-resume wait:\n",
+           run_ms);
+    printf("  %10s %10s %10s %10s %10s %12s %10s\n", "slice", "resumes", "p50 us",
+           "p99 us", "max us", "preemptions", "cpu Mop/s");
+    
+    int rc = 0;
+    for (int m = 0; m < PREEMPT_NUM_MODES; m++) {
+        long long forced = preempt_measure(preempt_slices_us[m], run_ms, &run);
+        if (forced < 0 || run.num_waits == 0) {
+            rc = -1;
+            break;
+        }
+        
+        int count = run.num_waits;
+        qsort(run.wait_us, (size_t)count, sizeof(double), bench_compare_double);
+        double p50 = bench_percentile(run.wait_us, count, 500);
+        double p99 = bench_percentile(run.wait_us, count, 990);
+        double max = run.wait_us[count - 1];
+        double mops = (double)run.cpu_iterations / (run_ms * 1000.0);
+        
+        char slice[16];
+        if (preempt_slices_us[m] > 0) {
+            snprintf(slice, sizeof(slice), "%d us", preempt_slices_us[m]);
+        } else {
+            snprintf(slice, sizeof(slice), "off");
+        }
+        printf("  %10s %10d %10.1f %10.1f %10.1f %12lld %10.1f\n", slice, count, p50, p99,
+               max, forced, mops);
+        fflush(stdout);
+        
+        if (f) {
+            fprintf(f, "%d,%d,%.2f,%.2f,%.2f,%lld,%.2f\n", preempt_slices_us[m], count, p50,
+                    p99, max, forced, mops);
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    free(run.wait_us);
+    return rc;
+}
@@ -0,0 +1,240 @@
+/**
+ * bench_scaling.c
+ * Coroutine Count Scaling Benchmark
+ *
+ * The ping-pong benchmarks keep two coroutines hot in L1. This suite
+ * instead resumes N suspended coroutines one after another, for N on a
+ * log scale from 2 up to the pool limit, so that the per-switch cost
+ * shows where each implementation falls off the cache and TLB cliff.
+ *
+ * Two resume orders are measured:
+ *   round-robin - coroutines in creation (memory) order
+ *   random      - a fixed random permutation, defeating the prefetcher
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "bench_perf.h"
+
+/* Smallest coroutine count in the sweep */
+#define SCALING_MIN_COROS 2
+
+/* Default measured switches per point (overridden by --switches) */
+#define SCALING_DEFAULT_SWITCHES 1000000
+
+/* Every coroutine is resumed at least this many times per point (without --calibrate) */
+#define SCALING_MIN_ROUNDS 3
+
+/* Per-coroutine state: one cache line, like a small connection object */
+typedef struct {
+    long long count;
+    char pad[56];
+} scaling_conn_t;
+
+/* Step run on every resume: bump own state */
+static int scaling_step(void *arg) {
+    scaling_conn_t *conn = (scaling_conn_t *)arg;
+    conn->count++;
+    return 0;
+}
+
+/* ============================================================
+ * SWEEP
+ * ============================================================ */
+
+/**
+ * Largest coroutine count to sweep for a backend
+ */
+static int scaling_limit(const coro_backend_t *backend) {
+    long long limit = backend->max_coros;
+    if (bench_config.max_coros > 0 && bench_config.max_coros < limit) {
+        limit = bench_config.max_coros;
+    }
+    return (int)limit;
+}
+
+/**
+ * Measure one point: N coroutines resumed in the given order
+ * Returns: ns per switch, or -1 on error
+ */
+static double scaling_point(const coro_backend_t *backend, int n, bool shuffled,
+                            double target_ms, bench_perf_t *perf,
+                            double misses[BENCH_PERF_NUM_COUNTERS]) {
+    scaling_conn_t *conns = calloc((size_t)n, sizeof(scaling_conn_t));
+    int *order = malloc(sizeof(int) * (size_t)n);
+    double ns_per_switch = -1.0;
+    int created = 0;
+    
+    if (!conns || !order) {
+        fprintf(stderr, "Error: Failed to allocate %d scaling coroutines\n", n);
+        goto out;
+    }
+    
+    long long setup_start = get_time_ns();
+    backend->init();
+    for (created = 0; created < n; created++) {
+        order[created] = backend->create(scaling_step, &conns[created]);
+        if (order[created] < 0) {
+            fprintf(stderr, "Failed to create %s coroutine %d of %d\n",
+                    backend->name, created + 1, n);
+            goto out;
+        }
+    }
+    if (shuffled) {
+        bench_shuffle(order, n);
+    }
+    
+    /* Warmup round starts every coroutine and doubles as calibration probe */
+    long long start = get_time_ns();
+    for (int i = 0; i < n; i++) {
+        backend->resume(order[i]);
+    }
+    long long round_ns = get_time_ns() - start;
+    
+    long long switches = bench_config.switches_set ? bench_config.num_switches
+                                                   : SCALING_DEFAULT_SWITCHES;
+    long long min_rounds = SCALING_MIN_ROUNDS;
+    if (bench_config.calibrate && round_ns > 0) {
+        /* Creating and warming up the coroutines is charged to the point */
+        double left_ms = target_ms - (double)(get_time_ns() - setup_start) / 1e6;
+        switches = left_ms > 0 ? (long long)(left_ms * 1e6 / ((double)round_ns / n)) : 0;
+        min_rounds = 1;
+    }
+    long long rounds = (switches + n - 1) / n;
+    if (rounds < min_rounds) {
+        rounds = min_rounds;
+    }
+    
+    long long counts[BENCH_PERF_NUM_COUNTERS];
+    bench_perf_start(perf);
+    start = get_time_ns();
+    
+    for (long long r = 0; r < rounds; r++) {
+        for (int i = 0; i < n; i++) {
+            backend->resume(order[i]);
+        }
+    }
+    
+    long long total_time = get_time_ns() - start;
+    bench_perf_stop(perf, counts);
+    
+    double total_switches = (double)rounds * n;
+    ns_per_switch = (double)total_time / total_switches;
+    for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+        misses[c] = counts[c] < 0 ? NAN : (double)counts[c] / total_switches;
+    }
+    
+out:
+    for (int i = 0; i < created; i++) {
+        backend->destroy(order[i]);
+    }
+    backend->cleanup();
+    free(order);
+    free(conns);
+    return ns_per_switch;
+}
+
+/**
+ * Run the scaling sweep for every backend and resume order
+ */
+int bench_scaling(double budget_ms) {
+    bench_perf_t perf;
+    bool have_perf = bench_perf_open(&perf) > 0;
+    
+    /* Each sweep (backend and order) gets an equal share of the budget */
+    int num_sweeps = 0;
+    for (int b = 0; b < coro_backend_count(); b++) {
+        if (bench_backend_selected(coro_backend_get(b))) num_sweeps += 2;
+    }
+    double sweep_ms = num_sweeps > 0 ? budget_ms / num_sweeps : budget_ms;
+    
+    FILE *f = fopen("scaling_results.txt", "w");
+    if (f) {
+        fprintf(f, "backend,order,coroutines,ns_per_switch");
+        for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+            fprintf(f, ",%s_miss_per_switch", bench_perf_name(c));
+        }
+        fprintf(f, "\n");
+    }
+    
+    if (!have_perf) {
+        printf("  (hardware counters unavailable, miss rates shown as n/a)\n");
+    }
+    
+    int rc = 0;
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        for (int shuffled = 0; shuffled <= 1 && rc == 0; shuffled++) {
+            const char *order_name = shuffled ? "random" : "round-robin";
+            
+            printf("\n  %s, %s order:\n", backend->name, order_name);
+            printf("  %10s %12s", "N", "ns/switch");
+            for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                printf(" %9s/sw", bench_perf_name(c));
+            }
+            printf("\n");
+            
+            int num_points = 0;
+            for (long long n = SCALING_MIN_COROS; n <= scaling_limit(backend); n *= 2) {
+                num_points++;
+            }
+            
+            /*
+             * Calibrated points share what is left of the sweep's budget. The
+             * fixed cost of a point (create, warmup, destroy) doubles with N;
+             * once the next one would not fit, the larger counts are skipped.
+             */
+            long long sweep_start = get_time_ns();
+            double fixed_ms = 0.0;
+            for (long long n = SCALING_MIN_COROS; n <= scaling_limit(backend); n *= 2) {
+                double left_ms = sweep_ms - (double)(get_time_ns() - sweep_start) / 1e6;
+                if (bench_config.calibrate && (left_ms <= 0 || 2 * fixed_ms > left_ms)) {
+                    printf("  %10lld  (time budget used up, larger counts skipped)\n", n);
+                    break;
+                }
+                double target_ms = left_ms / num_points--;
+                
+                double misses[BENCH_PERF_NUM_COUNTERS];
+                long long point_start = get_time_ns();
+                double ns = scaling_point(backend, (int)n, shuffled, target_ms, &perf, misses);
+                fixed_ms = (double)(get_time_ns() - point_start) / 1e6 - target_ms;
+                if (ns < 0) {
+                    rc = -1;
+                    break;
+                }
+                
+                printf("  %10lld %12.2f", n, ns);
+                for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                    if (isnan(misses[c])) {
+                        printf(" %12s", "n/a");
+                    } else {
+                        printf(" %12.3f", misses[c]);
+                    }
+                }
+                printf("\n");
+                fflush(stdout);
+                
+                if (f) {
+                    fprintf(f, "%s,%s,%lld,%.2f", backend->name, order_name, n, ns);
+                    for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                        fprintf(f, ",%.4f", misses[c]);
+                    }
+                    fprintf(f, "\n");
+                }
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    bench_perf_close(&perf);
+    return rc;
+}
@@ -0,0 +1,318 @@
+/**
+ * bench_sched.c
+ * Mixed-Workload Scheduling Latency Benchmark
+ *
+ * Thousands of low-priority "bulk" coroutines stay runnable, each doing a
+ * short burst of work per step. A handful of handler coroutines sleep
+ * parked and are woken together in bursts, as if by an event loop; the
+ * suite records how long each handler waits between its wake and its
+ * first instruction. Half of the handlers carry a tight deadline and
+ * half a loose one.
+ *
+ * Modes:
+ *   fifo      - handlers queued with the bulk coroutines (plain round-robin)
+ *   priority  - handlers in priority class 0, bulk in class 7
+ *   deadline  - handlers in the earliest-deadline-first class
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "coro_sched.h"
+
+/* Runnable low-priority coroutines */
+#define SCHED_BULK 4096
+
+/* Handler coroutines woken per burst */
+#define SCHED_HANDLERS 8
+
+/* Default bursts per mode (overridden by --switches) */
+#define SCHED_DEFAULT_BURSTS 200
+#define SCHED_MAX_BURSTS 100000
+
+/* Bursts per backend in the --calibrate probe */
+#define SCHED_PROBE_BURSTS 5
+
+/* Work per bulk step and per handler step */
+#define SCHED_BULK_WORK_NS 500
+#define SCHED_HANDLER_WORK_NS 4000
+
+/* Deadlines relative to the wake (even handlers tight, odd loose) */
+#define SCHED_TIGHT_NS 25000
+#define SCHED_LOOSE_NS 1000000
+
+/* Quiet time between the last handler of a burst and the next burst */
+#define SCHED_GAP_NS 100000
+
+/* Bulk priority class */
+#define SCHED_BULK_PRIORITY (CORO_SCHED_PRIORITIES - 1)
+
+/* Scheduling modes */
+typedef enum {
+    SCHED_MODE_FIFO = 0,
+    SCHED_MODE_PRIORITY,
+    SCHED_MODE_DEADLINE,
+    SCHED_NUM_MODES
+} sched_mode_t;
+
+static const char *const sched_mode_names[SCHED_NUM_MODES] = {
+    "fifo", "priority", "deadline"
+};
+
+/* Shared state of one run */
+typedef struct {
+    coro_sched_t sched;
+    long long bulk_steps;
+    double *latency_us;       /* Wake-to-run latency of every handler step */
+    int num_latencies;
+    int outstanding;          /* Handlers woken and not yet done */
+    int tight_runs;
+    int tight_misses;
+} sched_run_t;
+
+/* One handler coroutine */
+typedef struct {
+    sched_run_t *run;
+    bool tight;
+    bool pending;             /* Woken for a burst */
+    long long woken_ns;
+    long long deadline_ns;
+} sched_handler_t;
+
+/**
+ * Spin for about ns nanoseconds
+ */
+static void sched_spin(long long ns) {
+    long long end = get_time_ns() + ns;
+    while (get_time_ns() < end) {
+    }
+}
+
+/* Bulk step: a short slice of work, never finishes */
+static int sched_bulk_step(void *arg) {
+    sched_run_t *run = arg;
+    sched_spin(SCHED_BULK_WORK_NS);
+    run->bulk_steps++;
+    return 0;
+}
+
+/* Handler step: record the wake latency, work, park again */
+static int sched_handler_step(void *arg) {
+    sched_handler_t *h = arg;
+    sched_run_t *run = h->run;
+    
+    if (h->pending) {
+        long long start = get_time_ns();
+        run->latency_us[run->num_latencies++] = (double)(start - h->woken_ns) / 1000.0;
+        sched_spin(SCHED_HANDLER_WORK_NS);
+        if (h->tight) {
+            run->tight_runs++;
+            if (get_time_ns() > h->deadline_ns) {
+                run->tight_misses++;
+            }
+        }
+        h->pending = false;
+        run->outstanding--;
+    }
+    coro_sched_park(&run->sched);
+    return 0;
+}
+
+/**
+ * Run one mode: spawn bulk and handlers, then wake bursts until done
+ * Returns: elapsed nanoseconds, or -1 on failure
+ */
+static long long sched_measure(const coro_backend_t *backend, sched_mode_t mode,
+                               sched_run_t *run, int bulk, int bursts) {
+    sched_handler_t handlers[SCHED_HANDLERS];
+    int ids[SCHED_HANDLERS];
+    
+    if (coro_sched_init(&run->sched, backend) < 0) {
+        return -1;
+    }
+    run->bulk_steps = 0;
+    run->num_latencies = 0;
+    run->outstanding = 0;
+    run->tight_runs = 0;
+    run->tight_misses = 0;
+    
+    long long elapsed = -1;
+    int handler_priority = mode == SCHED_MODE_FIFO ? SCHED_BULK_PRIORITY : 0;
+    
+    /* Handlers first, so their first step (which parks them) runs at once */
+    for (int i = 0; i < SCHED_HANDLERS; i++) {
+        handlers[i] = (sched_handler_t){ run, i % 2 == 0, false, 0, 0 };
+        ids[i] = coro_sched_spawn(&run->sched, sched_handler_step, &handlers[i],
+                                  handler_priority);
+        if (ids[i] < 0) goto out;
+    }
+    for (int i = 0; i < bulk; i++) {
+        if (coro_sched_spawn(&run->sched, sched_bulk_step, run, SCHED_BULK_PRIORITY) < 0) {
+            goto out;
+        }
+    }
+    for (int i = 0; i < SCHED_HANDLERS; i++) {
+        if (coro_sched_run_one(&run->sched) < 0) goto out;
+    }
+    
+    unsigned long long rng = 0x9E3779B97F4A7C15ULL;
+    long long start = get_time_ns();
+    long long next_burst = start;
+    int burst = 0;
+    
+    while (burst < bursts || run->outstanding > 0) {
+        long long now = get_time_ns();
+        if (burst < bursts && run->outstanding == 0 && now >= next_burst) {
+            int order[SCHED_HANDLERS];
+            for (int i = 0; i < SCHED_HANDLERS; i++) {
+                order[i] = i;
+            }
+            for (int i = SCHED_HANDLERS - 1; i > 0; i--) {
+                int j = (int)(bench_rand(&rng) % (unsigned long long)(i + 1));
+                int tmp = order[i];
+                order[i] = order[j];
+                order[j] = tmp;
+            }
+            
+            for (int k = 0; k < SCHED_HANDLERS; k++) {
+                sched_handler_t *h = &handlers[order[k]];
+                h->pending = true;
+                h->woken_ns = now;
+                h->deadline_ns = now + (h->tight ? SCHED_TIGHT_NS : SCHED_LOOSE_NS);
+                if (mode == SCHED_MODE_DEADLINE) {
+                    coro_sched_wake_deadline(&run->sched, ids[order[k]],
+                                             (uint64_t)h->deadline_ns);
+                } else {
+                    coro_sched_wake(&run->sched, ids[order[k]]);
+                }
+            }
+            run->outstanding = SCHED_HANDLERS;
+            burst++;
+        }
+        
+        int was_outstanding = run->outstanding;
+        if (coro_sched_run_one(&run->sched) < 0) goto out;
+        if (was_outstanding > 0 && run->outstanding == 0) {
+            next_burst = get_time_ns() + SCHED_GAP_NS;
+        }
+    }
+    elapsed = get_time_ns() - start;
+    
+out:
+    coro_sched_cleanup(&run->sched);
+    return elapsed;
+}
+
+/**
+ * Runnable bulk coroutines for a backend, within its pool and --max-coros
+ */
+static int sched_bulk(const coro_backend_t *backend) {
+    int bulk = SCHED_BULK;
+    if (bulk > backend->max_coros - SCHED_HANDLERS) {
+        bulk = backend->max_coros - SCHED_HANDLERS;
+    }
+    if (bench_config.max_coros > 0 && bulk > bench_config.max_coros) {
+        bulk = (int)bench_config.max_coros;
+    }
+    return bulk;
+}
+
+/**
+ * Time a few FIFO bursts, the slowest mode, on every selected backend
+ * Returns: ns per burst of one mode across the backends, or -1 on failure
+ */
+static double sched_probe(sched_run_t *run) {
+    double ns = 0.0;
+    for (int b = 0; b < coro_backend_count(); b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        long long elapsed = sched_measure(backend, SCHED_MODE_FIFO, run, sched_bulk(backend),
+                                          SCHED_PROBE_BURSTS);
+        if (elapsed < 0) {
+            return -1.0;
+        }
+        ns += (double)elapsed / SCHED_PROBE_BURSTS;
+    }
+    return ns;
+}
+
+/**
+ * Measure handler wake latency under a runnable bulk load
+ */
+int bench_sched(double budget_ms) {
+    sched_run_t run;
+    double unit_ns = 0.0;
+    
+    if (bench_config.calibrate) {
+        run.latency_us = malloc(sizeof(double) * SCHED_PROBE_BURSTS * SCHED_HANDLERS);
+        if (run.latency_us) {
+            unit_ns = sched_probe(&run);
+            free(run.latency_us);
+        }
+    }
+    int bursts = (int)bench_suite_count(budget_ms / SCHED_NUM_MODES, unit_ns,
+                                        SCHED_DEFAULT_BURSTS, SCHED_MAX_BURSTS);
+    
+    run.latency_us = malloc(sizeof(double) * (size_t)bursts * SCHED_HANDLERS);
+    if (!run.latency_us) {
+        fprintf(stderr, "Error: Failed to allocate latency samples\n");
+        return -1;
+    }
+    
+    FILE *f = fopen("sched_results.txt", "w");
+    if (f) {
+        fprintf(f, "backend,mode,bulk,p50_us,p99_us,p999_us,max_us,tight_miss_pct,"
+                   "bulk_steps_per_sec\n");
+    }
+    
+    printf("  %d handlers woken per burst (%d us work, deadlines %d us / %d us),\n",
+           SCHED_HANDLERS, SCHED_HANDLER_WORK_NS / 1000, SCHED_TIGHT_NS / 1000,
+           SCHED_LOOSE_NS / 1000);
+    printf("  %d bursts; bulk coroutines do %d ns per step\n", bursts, SCHED_BULK_WORK_NS);
+    
+    int rc = 0;
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        int bulk = sched_bulk(backend);
+        printf("\n  %s, %d runnable bulk coroutines:\n", backend->name, bulk);
+        printf("  %10s %10s %10s %10s %10s %10s %14s\n", "mode", "p50 us", "p99 us",
+               "p99.9 us", "max us", "tight miss", "bulk steps/s");
+        
+        for (int m = 0; m < SCHED_NUM_MODES; m++) {
+            long long elapsed = sched_measure(backend, (sched_mode_t)m, &run, bulk, bursts);
+            if (elapsed < 0) {
+                rc = -1;
+                break;
+            }
+            
+            int n = run.num_latencies;
+            qsort(run.latency_us, (size_t)n, sizeof(double), bench_compare_double);
+            double p50 = bench_percentile(run.latency_us, n, 500);
+            double p99 = bench_percentile(run.latency_us, n, 990);
+            double p999 = bench_percentile(run.latency_us, n, 999);
+            double max = run.latency_us[n - 1];
+            double miss = run.tight_runs ? 100.0 * run.tight_misses / run.tight_runs : 0.0;
+            double steps_per_sec = (double)run.bulk_steps * 1e9 / (double)elapsed;
+            
+            printf("  %10s %10.1f %10.1f %10.1f %10.1f %9.1f%% %14.0f\n",
+                   sched_mode_names[m], p50, p99, p999, max, miss, steps_per_sec);
+            fflush(stdout);
+            
+            if (f) {
+                fprintf(f, "%s,%s,%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.0f\n", backend->name,
+                        sched_mode_names[m], bulk, p50, p99, p999, max, miss, steps_per_sec);
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    free(run.latency_us);
+    return rc;
+}
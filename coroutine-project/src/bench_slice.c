@@ -0,0 +1,276 @@
+/**
+ * bench_slice.c
+ * Time-Slice Check (coro_maybe_yield) Cost Benchmark
+ *
+ * A worker coroutine runs a short dependent loop under the scheduler and
+ * checks for a yield once per iteration. The suite reports the cost per
+ * iteration of:
+ *   none         - no check (baseline)
+ *   maybe/alone  - coro_maybe_yield with nothing else ready
+ *   maybe/ready  - another coroutine ready, slice not used up
+ *   maybe/20us   - another coroutine ready, 20 us slices (does yield)
+ *   macro/ready  - as maybe/ready, with CORO_MAYBE_YIELD in a native
+ *                  stackless coroutine resumed from the step (stackless only)
+ *   always       - yield every iteration, another coroutine ready
+ * On the stackless backend the check is coro_sched_should_yield() and a
+ * yield ends the step; on stackful backends it is coro_maybe_yield().
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bench.h"
+#include "coro_sched.h"
+#include "coro_stackless.h"
+
+/* Default loop iterations per row (overridden by --switches) */
+#define SLICE_DEFAULT_ITERATIONS 10000000LL
+#define SLICE_MAX_ITERATIONS 10000000000LL
+
+/* Iterations of the --calibrate probe rows */
+#define SLICE_PROBE_ITERATIONS 100000LL
+
+/* "always" yields every iteration: it runs this share of the iterations */
+#define SLICE_ALWAYS_DIVISOR 100
+
+/* Slice that no row uses up, and the short slice of maybe/20us */
+#define SLICE_LONG_US 10000000
+#define SLICE_SHORT_US 20
+
+/* Rows */
+typedef enum {
+    SLICE_NONE = 0,
+    SLICE_MAYBE_ALONE,
+    SLICE_MAYBE_READY,
+    SLICE_MAYBE_SHORT,
+    SLICE_MACRO_READY,
+    SLICE_ALWAYS,
+    SLICE_NUM_MODES
+} slice_mode_t;
+
+static const char *const slice_mode_names[SLICE_NUM_MODES] = {
+    "none", "maybe/alone", "maybe/ready", "maybe/20us", "macro/ready", "always"
+};
+
+/* Worker state, kept across early step returns */
+typedef struct {
+    slice_mode_t mode;
+    bool stackful;            /* Check with coro_maybe_yield() */
+    long long iterations;
+    long long done;
+    uint64_t x;
+    long long yields;
+    bool finished;
+    bool stop;                /* Tells the companion to finish */
+    int native;               /* Native coroutine of macro/ready, or -1 */
+} slice_worker_t;
+
+/* One iteration of work the compiler cannot drop */
+#define SLICE_WORK(x) do { \
+    (x) = (x) * 6364136223846793005ULL + 1442695040888963407ULL; \
+    __asm__ __volatile__("" : "+r"(x)); \
+} while (0)
+
+/* Native stackless coroutine of macro/ready: its state lives in the worker */
+static void slice_native(coro_stackless_t *coro, void *arg) {
+    slice_worker_t *w = arg;
+    
+    CORO_BEGIN(coro);
+    while (w->done < w->iterations) {
+        SLICE_WORK(w->x);
+        w->done++;
+        CORO_MAYBE_YIELD(coro);
+    }
+    CORO_END(coro);
+}
+
+/* Worker step: the loop for its mode */
+static int slice_worker_step(void *arg) {
+    slice_worker_t *w = arg;
+    uint64_t x = w->x;
+    long long i = w->done, n = w->iterations;
+    
+    switch (w->mode) {
+        case SLICE_NONE:
+            for (; i < n; i++) {
+                SLICE_WORK(x);
+            }
+            break;
+        case SLICE_MACRO_READY:
+            if (coro_stackless_resume(w->native) == 0) {
+                w->yields++;
+                return 0;
+            }
+            coro_stackless_destroy(w->native);
+            w->native = -1;
+            x = w->x;
+            i = w->done;
+            break;
+        case SLICE_ALWAYS:
+            if (i < n) {
+                SLICE_WORK(x);
+                w->x = x;
+                w->done = i + 1;
+                w->yields++;
+                return 0;
+            }
+            break;
+        default:
+            if (w->stackful) {
+                for (; i < n; i++) {
+                    SLICE_WORK(x);
+                    if (coro_maybe_yield()) {
+                        w->yields++;
+                    }
+                }
+            } else {
+                while (i < n) {
+                    SLICE_WORK(x);
+                    i++;
+                    if (coro_sched_should_yield()) {
+                        w->x = x;
+                        w->done = i;
+                        w->yields++;
+                        return 0;
+                    }
+                }
+            }
+            break;
+    }
+    
+    w->x = x;
+    w->done = i;
+    w->finished = true;
+    w->stop = true;
+    return 1;
+}
+
+/* Companion: stays ready until the worker is done */
+static int slice_companion_step(void *arg) {
+    slice_worker_t *w = arg;
+    return w->stop ? 1 : 0;
+}
+
+/**
+ * Run one row
+ * Returns: ns per iteration, or -1 on failure
+ */
+static double slice_measure(const coro_backend_t *backend, slice_mode_t mode,
+                            long long iterations, long long *yields) {
+    coro_sched_t sched;
+    slice_worker_t w = { mode, coro_backend_has(backend, CORO_BACKEND_CAP_STACKFUL),
+                         iterations, 0, 1, 0, false, false, -1 };
+    
+    if (coro_sched_init(&sched, backend) < 0) {
+        return -1;
+    }
+    if (mode == SLICE_MACRO_READY) {
+        w.native = coro_stackless_create(slice_native, &w);
+        if (w.native < 0) {
+            coro_sched_cleanup(&sched);
+            return -1;
+        }
+    }
+    coro_sched_set_slice(&sched, mode == SLICE_MAYBE_SHORT ? SLICE_SHORT_US : SLICE_LONG_US);
+    
+    double ns = -1;
+    if (coro_sched_spawn(&sched, slice_worker_step, &w, 0) < 0) goto out;
+    if (mode != SLICE_NONE && mode != SLICE_MAYBE_ALONE &&
+        coro_sched_spawn(&sched, slice_companion_step, &w, 0) < 0) {
+        goto out;
+    }
+    
+    long long start = get_time_ns();
+    while (!w.finished) {
+        if (coro_sched_run_one(&sched) <= 0) goto out;
+    }
+    ns = (double)(get_time_ns() - start) / (double)iterations;
+    coro_sched_run(&sched);
+    *yields = w.yields;
+    
+out:
+    coro_sched_cleanup(&sched);
+    return ns;
+}
+
+/**
+ * Time a maybe/ready and an always row on every selected backend
+ * Returns: ns per iteration of a whole backend table across the backends,
+ *          or -1 on failure
+ */
+static double slice_probe(void) {
+    double ns = 0.0;
+    long long yields;
+    
+    for (int b = 0; b < coro_backend_count(); b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        double check = slice_measure(backend, SLICE_MAYBE_READY, SLICE_PROBE_ITERATIONS, &yields);
+        double always = slice_measure(backend, SLICE_ALWAYS,
+                                      SLICE_PROBE_ITERATIONS / SLICE_ALWAYS_DIVISOR, &yields);
+        if (check < 0 || always < 0) {
+            return -1.0;
+        }
+        ns += check * (SLICE_NUM_MODES - 1) + always / SLICE_ALWAYS_DIVISOR;
+    }
+    return ns;
+}
+
+/**
+ * Cost of the time-slice check when it does not yield
+ */
+int bench_slice(double budget_ms) {
+    double unit_ns = bench_config.calibrate ? slice_probe() : 0.0;
+    long long iterations = bench_suite_count(budget_ms, unit_ns, SLICE_DEFAULT_ITERATIONS,
+                                             SLICE_MAX_ITERATIONS);
+    
+    FILE *f = fopen("slice_results.txt", "w");
+    if (f) {
+        fprintf(f, "backend,mode,ns_per_iteration,overhead_ns,yields\n");
+    }
+    
+    printf("  %lld loop iterations per row, one check per iteration\n", iterations);
+    
+    int rc = 0;
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        printf("\n  %s (%s):\n", backend->name,
+               coro_backend_has(backend, CORO_BACKEND_CAP_STACKFUL) ? "coro_maybe_yield()"
+                                                                    : "should_yield + return");
+        printf("  %14s %12s %12s %12s\n", "mode", "ns/iter", "overhead", "yields");
+        
+        double base = 0.0;
+        for (int m = 0; m < SLICE_NUM_MODES; m++) {
+            if (m == SLICE_MACRO_READY && coro_backend_has(backend, CORO_BACKEND_CAP_STACKFUL)) {
+                continue;
+            }
+            long long n = m == SLICE_ALWAYS ? iterations / SLICE_ALWAYS_DIVISOR : iterations;
+            long long yields = 0;
+            double ns = slice_measure(backend, (slice_mode_t)m, n > 0 ? n : 1, &yields);
+            if (ns < 0) {
+                rc = -1;
+                break;
+            }
+            if (m == SLICE_NONE) {
+                base = ns;
+            }
+            
+            printf("  %14s %12.2f %12.2f %12lld\n", slice_mode_names[m], ns, ns - base, yields);
+            fflush(stdout);
+            
+            if (f) {
+                fprintf(f, "%s,%s,%.3f,%.3f,%lld\n", backend->name, slice_mode_names[m], ns,
+                        ns - base, yields);
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    return rc;
+}
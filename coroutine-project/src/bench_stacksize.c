@@ -0,0 +1,278 @@
+/**
+ * bench_stacksize.c
+ * Stack High-Water Mark and Adaptive Stack Sizing Benchmark
+ *
+ * Every ucontext coroutine normally gets CORO_STACK_SIZE bytes of
+ * stack. This suite starts a mix of entry functions with small, medium
+ * and large frames, profiles their painted stacks, and then compares the
+ * stack memory of the same population with fixed and adaptive sizing.
+ *
+ * Phases:
+ *   fixed    - every coroutine gets CORO_STACK_SIZE, stacks unpainted
+ *   training - a few coroutines per function run on painted stacks
+ *   adaptive - profiled functions get their fitted size class
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include "bench.h"
+#include "coro_ucontext.h"
+
+/* Coroutines alive at once in the fixed and adaptive phases */
+#define STACKSIZE_DEFAULT_COROS 100000
+
+/* Coroutines in the --calibrate probe phase */
+#define STACKSIZE_PROBE_COROS 2000
+
+/* Painted coroutines run per function in the training phase */
+#define STACKSIZE_TRAIN_COROS (2 * UCORO_STACK_ADAPT_SAMPLES)
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Keep bytes of live data on the stack across one yield
+ */
+static void stacksize_run(size_t bytes) {
+    volatile char live[bytes];
+    
+    for (size_t i = 0; i < bytes; i += CACHE_LINE_SIZE) {
+        live[i] = (char)i;
+    }
+    coro_ucontext_yield();
+    live[0]++;
+}
+
+static void stacksize_small(void *arg)  { (void)arg; stacksize_run(1024); }
+static void stacksize_medium(void *arg) { (void)arg; stacksize_run(6 * 1024); }
+static void stacksize_large(void *arg)  { (void)arg; stacksize_run(20 * 1024); }
+
+/* Entry functions and their share of the population (percent) */
+typedef struct {
+    const char *name;
+    ucoro_func_t func;
+    int percent;
+} stacksize_workload_t;
+
+static const stacksize_workload_t stacksize_workloads[] = {
+    { "small (1 KB)",   stacksize_small,  70 },
+    { "medium (6 KB)",  stacksize_medium, 20 },
+    { "large (20 KB)",  stacksize_large,  10 },
+};
+
+#define NUM_STACKSIZE_WORKLOADS ((int)(sizeof(stacksize_workloads) / sizeof(stacksize_workloads[0])))
+
+/* Memory of one phase */
+typedef struct {
+    size_t stack_bytes;       /* Stack bytes allocated */
+    long long rss_bytes;      /* Resident set growth with all coroutines live */
+    double create_ns;         /* Create + first resume, per coroutine */
+} stacksize_usage_t;
+
+/**
+ * Entry function of the i-th coroutine, following the workload shares
+ */
+static ucoro_func_t stacksize_func(int i) {
+    int pct = i % 100;
+    for (int w = 0; w < NUM_STACKSIZE_WORKLOADS; w++) {
+        if (pct < stacksize_workloads[w].percent) {
+            return stacksize_workloads[w].func;
+        }
+        pct -= stacksize_workloads[w].percent;
+    }
+    return stacksize_workloads[0].func;
+}
+
+/**
+ * Start n coroutines, measure memory while all are suspended, then
+ * let them finish so their stacks are checked and recorded
+ * Returns: 0 on success, -1 on error
+ */
+static int stacksize_phase(int n, stacksize_usage_t *usage) {
+    int *ids = malloc(sizeof(int) * (size_t)n);
+    int created = 0;
+    int rc = 0;
+    
+    if (!ids) {
+        fprintf(stderr, "Error: Failed to allocate %d coroutine ids\n", n);
+        return -1;
+    }
+    
+    coro_ucontext_init();
+    long long rss_before = bench_rss_bytes();
+    long long start = get_time_ns();
+    
+    for (created = 0; created < n; created++) {
+        ids[created] = coro_ucontext_create(stacksize_func(created), NULL);
+        if (ids[created] < 0) {
+            fprintf(stderr, "Failed to create ucontext coroutine %d of %d\n",
+                    created + 1, n);
+            rc = -1;
+            goto out;
+        }
+        coro_ucontext_resume(ids[created]);
+    }
+    
+    usage->create_ns = (double)(get_time_ns() - start) / n;
+    usage->stack_bytes = coro_ucontext_stack_bytes();
+    usage->rss_bytes = bench_rss_bytes() - rss_before;
+    
+    for (int i = 0; i < n; i++) {
+        coro_ucontext_resume(ids[i]);
+    }
+    
+out:
+    for (int i = 0; i < created; i++) {
+        coro_ucontext_destroy(ids[i]);
+    }
+    coro_ucontext_cleanup();
+    malloc_trim(0);
+    free(ids);
+    return rc;
+}
+
+/**
+ * Run STACKSIZE_TRAIN_COROS painted coroutines of every function to completion
+ */
+static int stacksize_train(void) {
+    coro_ucontext_init();
+    for (int w = 0; w < NUM_STACKSIZE_WORKLOADS; w++) {
+        for (int i = 0; i < STACKSIZE_TRAIN_COROS; i++) {
+            int id = coro_ucontext_create(stacksize_workloads[w].func, NULL);
+            if (id < 0) {
+                coro_ucontext_cleanup();
+                return -1;
+            }
+            while (coro_ucontext_resume(id) == 0) {
+            }
+            coro_ucontext_destroy(id);
+        }
+    }
+    coro_ucontext_cleanup();
+    return 0;
+}
+
+/**
+ * Profile of a workload's entry function (NULL if none recorded)
+ */
+static const ucoro_stack_profile_t *stacksize_profile(ucoro_func_t func) {
+    for (int i = 0; i < coro_ucontext_stack_profile_count(); i++) {
+        const ucoro_stack_profile_t *prof = coro_ucontext_stack_profile(i);
+        if (prof->func == func) {
+            return prof;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Print one phase and append it to the results file
+ */
+static void stacksize_print_usage(FILE *f, const char *phase, int n,
+                                  const stacksize_usage_t *u) {
+    printf("  %10s %14.1f %14.1f %12.1f %12.0f\n", phase,
+           u->stack_bytes / (1024.0 * 1024.0), u->rss_bytes / (1024.0 * 1024.0),
+           (double)u->stack_bytes / n, u->create_ns);
+    if (f) {
+        fprintf(f, "phase,%s,%d,%zu,%lld,%.1f,,,\n", phase, n, u->stack_bytes,
+                u->rss_bytes, u->create_ns);
+    }
+}
+
+/**
+ * Compare fixed and adaptive stack sizing for a mixed population
+ */
+int bench_stacksize(double budget_ms) {
+    if (!bench_backend_selected(&coro_ucontext_backend)) {
+        printf("  (ucontext backend not selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    int max = STACKSIZE_DEFAULT_COROS;
+    if (max > MAX_UCONTEXT_COROUTINES) max = MAX_UCONTEXT_COROUTINES;
+    if (bench_config.max_coros > 0 && max > bench_config.max_coros) max = bench_config.max_coros;
+    
+    /* Cost per coroutine of a whole phase; the fixed and adaptive phases share the budget */
+    double unit_ns = 0.0;
+    if (bench_config.calibrate) {
+        stacksize_usage_t probe;
+        long long start = get_time_ns();
+        coro_ucontext_set_stack_mode(UCORO_STACK_FIXED);
+        if (stacksize_phase(STACKSIZE_PROBE_COROS, &probe) == 0) {
+            unit_ns = (double)(get_time_ns() - start) / STACKSIZE_PROBE_COROS;
+        }
+    }
+    int n = (int)bench_suite_count(budget_ms / 2, unit_ns, max, max);
+    
+    FILE *f = fopen("stacksize_results.txt", "w");
+    if (f) {
+        fprintf(f, "kind,name,coroutines,stack_bytes,rss_bytes,create_ns,"
+                "mean_used,max_used,stack_class\n");
+    }
+    
+    stacksize_usage_t fixed, adaptive;
+    int rc = 0;
+    
+    coro_ucontext_stack_profile_reset();
+    coro_ucontext_set_stack_mode(UCORO_STACK_FIXED);
+    if (stacksize_phase(n, &fixed) < 0) {
+        rc = -1;
+        goto out;
+    }
+    
+    coro_ucontext_set_stack_mode(UCORO_STACK_ADAPTIVE);
+    if (stacksize_train() < 0) {
+        rc = -1;
+        goto out;
+    }
+    
+    printf("  Stack profiles after %d runs per function:\n", STACKSIZE_TRAIN_COROS);
+    printf("  %14s %8s %12s %12s %12s\n", "function", "samples", "mean used", "max used", "class");
+    for (int w = 0; w < NUM_STACKSIZE_WORKLOADS; w++) {
+        const ucoro_stack_profile_t *prof = stacksize_profile(stacksize_workloads[w].func);
+        if (!prof || prof->samples == 0) continue;
+        
+        printf("  %14s %8lld %10zu B %10zu B %10zu B\n", stacksize_workloads[w].name,
+               prof->samples, prof->total_used / (size_t)prof->samples,
+               prof->max_used, prof->stack_class);
+        if (f) {
+            fprintf(f, "profile,%s,%lld,,,,%zu,%zu,%zu\n", stacksize_workloads[w].name,
+                    prof->samples, prof->total_used / (size_t)prof->samples,
+                    prof->max_used, prof->stack_class);
+        }
+    }
+    
+    if (stacksize_phase(n, &adaptive) < 0) {
+        rc = -1;
+        goto out;
+    }
+    
+    printf("\n  %d live coroutines (%d%% small, %d%% medium, %d%% large):\n", n,
+           stacksize_workloads[0].percent, stacksize_workloads[1].percent,
+           stacksize_workloads[2].percent);
+    printf("  %10s %14s %14s %12s %12s\n", "sizing", "stack MB", "RSS MB", "B/coro", "create ns");
+    stacksize_print_usage(f, "fixed", n, &fixed);
+    stacksize_print_usage(f, "adaptive", n, &adaptive);
+    
+    double saved = (double)fixed.stack_bytes - (double)adaptive.stack_bytes;
+    printf("\n  Stack memory saved: %.1f MB (%.1f%%), resident: %.1f MB\n",
+           saved / (1024.0 * 1024.0), 100.0 * saved / (double)fixed.stack_bytes,
+           (fixed.rss_bytes - adaptive.rss_bytes) / (1024.0 * 1024.0));
+    
+    for (int w = 0; w < NUM_STACKSIZE_WORKLOADS; w++) {
+        const ucoro_stack_profile_t *prof = stacksize_profile(stacksize_workloads[w].func);
+        if (prof && prof->overflows > 0) {
+            printf("  %s: %lld canary overruns\n", stacksize_workloads[w].name,
+                   prof->overflows);
+        }
+    }
+    
+out:
+    printf("-------------------------------------------------------\n\n");
+    coro_ucontext_set_stack_mode(UCORO_STACK_FIXED);
+    if (f) {
+        fclose(f);
+    }
+    return rc;
+}
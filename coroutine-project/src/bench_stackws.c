@@ -0,0 +1,274 @@
+/**
+ * bench_stackws.c
+ * Stack Working-Set Benchmark for Stackful Coroutines
+ *
+ * The ping-pong coroutines in bench.c touch almost no stack, so their
+ * numbers are best-case switches. Here every coroutine keeps a live
+ * array of 256 B to 32 KB on its own stack and reads and writes one
+ * word per cache line of it between yields. With many coroutines the
+ * combined working set leaves the caches, showing how switch cost and
+ * memory bandwidth scale with the amount of live stack per coroutine.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "bench.h"
+#include "bench_perf.h"
+
+/* Working-set sweep (bytes); 0 is the no-touch baseline */
+#define STACKWS_MIN_BYTES 256
+#define STACKWS_MAX_BYTES (32 * 1024)
+
+/* Coroutine counts measured for every working-set size */
+static const int stackws_coro_counts[] = { 64, 1024, 16384 };
+
+#define NUM_STACKWS_COUNTS ((int)(sizeof(stackws_coro_counts) / sizeof(stackws_coro_counts[0])))
+
+/* Default measured switches per point (overridden by --switches) */
+#define STACKWS_DEFAULT_SWITCHES 200000
+
+/* Every coroutine is resumed at least this many times per point (without --calibrate) */
+#define STACKWS_MIN_ROUNDS 3
+
+#define CACHE_LINE_SIZE 64
+
+/* Capabilities a backend needs to run this benchmark */
+#define STACKWS_REQUIRED_CAPS (CORO_BACKEND_CAP_STACKFUL | CORO_BACKEND_CAP_DEEP_STACK)
+
+/* Backend and working-set size for the coroutines being created */
+static const coro_backend_t *stackws_backend;
+static size_t stackws_bytes;
+
+/**
+ * Worker: keeps stackws_bytes of live data on its own stack and
+ * read-modify-writes one word per cache line of it on every resume
+ */
+static void stackws_worker(void *arg) {
+    (void)arg;
+    size_t words = stackws_bytes / sizeof(uint64_t);
+    volatile uint64_t live[words > 0 ? words : 1];
+    
+    for (size_t i = 0; i < words; i++) {
+        live[i] = i;
+    }
+    
+    for (;;) {
+        for (size_t i = 0; i < words; i += CACHE_LINE_SIZE / sizeof(uint64_t)) {
+            live[i] = live[i] + 1;
+        }
+        stackws_backend->yield();
+    }
+}
+
+/**
+ * Measure one point: n coroutines with the current working-set size
+ * Returns: ns per switch, or -1 on error
+ */
+static double stackws_point(int n, double target_ms, bench_perf_t *perf,
+                            double misses[BENCH_PERF_NUM_COUNTERS]) {
+    const coro_backend_t *backend = stackws_backend;
+    int *ids = malloc(sizeof(int) * (size_t)n);
+    double ns_per_switch = -1.0;
+    int created = 0;
+    
+    if (!ids) {
+        fprintf(stderr, "Error: Failed to allocate %d coroutine ids\n", n);
+        return -1.0;
+    }
+    
+    long long setup_start = get_time_ns();
+    backend->init();
+    for (created = 0; created < n; created++) {
+        ids[created] = backend->create_stackful(stackws_worker, NULL);
+        if (ids[created] < 0) {
+            fprintf(stderr, "Failed to create %s coroutine %d of %d\n",
+                    backend->name, created + 1, n);
+            goto out;
+        }
+    }
+    
+    /* First round initialises every working set and probes the cost */
+    for (int i = 0; i < n; i++) {
+        backend->resume(ids[i]);
+    }
+    long long start = get_time_ns();
+    for (int i = 0; i < n; i++) {
+        backend->resume(ids[i]);
+    }
+    long long round_ns = get_time_ns() - start;
+    
+    long long switches = bench_config.switches_set ? bench_config.num_switches
+                                                   : STACKWS_DEFAULT_SWITCHES;
+    long long min_rounds = STACKWS_MIN_ROUNDS;
+    if (bench_config.calibrate && round_ns > 0) {
+        /* Creating the coroutines and both warmup rounds are charged to the point */
+        double left_ms = target_ms - (double)(get_time_ns() - setup_start) / 1e6;
+        switches = left_ms > 0 ? (long long)(left_ms * 1e6 / ((double)round_ns / n)) : 0;
+        min_rounds = 1;
+    }
+    long long rounds = (switches + n - 1) / n;
+    if (rounds < min_rounds) {
+        rounds = min_rounds;
+    }
+    
+    long long counts[BENCH_PERF_NUM_COUNTERS];
+    bench_perf_start(perf);
+    start = get_time_ns();
+    
+    for (long long r = 0; r < rounds; r++) {
+        for (int i = 0; i < n; i++) {
+            backend->resume(ids[i]);
+        }
+    }
+    
+    long long total_time = get_time_ns() - start;
+    bench_perf_stop(perf, counts);
+    
+    double total_switches = (double)rounds * n;
+    ns_per_switch = (double)total_time / total_switches;
+    for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+        misses[c] = counts[c] < 0 ? NAN : (double)counts[c] / total_switches;
+    }
+    
+out:
+    for (int i = 0; i < created; i++) {
+        backend->destroy(ids[i]);
+    }
+    backend->cleanup();
+    free(ids);
+    return ns_per_switch;
+}
+
+/**
+ * Check whether a backend can run the working-set sweep
+ */
+static bool stackws_usable(const coro_backend_t *backend) {
+    return bench_backend_selected(backend) &&
+           coro_backend_has(backend, STACKWS_REQUIRED_CAPS);
+}
+
+/**
+ * Run the stack working-set sweep for every stackful backend
+ */
+int bench_stackws(double budget_ms) {
+    bench_perf_t perf;
+    bool have_perf = bench_perf_open(&perf) > 0;
+    
+    int num_backends = 0;
+    for (int b = 0; b < coro_backend_count(); b++) {
+        if (stackws_usable(coro_backend_get(b))) num_backends++;
+    }
+    if (num_backends == 0) {
+        printf("  (no selected backend with deep stackful coroutines, skipped)\n");
+        bench_perf_close(&perf);
+        return BENCH_SKIPPED;
+    }
+    
+    int num_sizes = 1;
+    for (size_t ws = STACKWS_MIN_BYTES; ws <= STACKWS_MAX_BYTES; ws *= 2) {
+        num_sizes++;
+    }
+    
+    /* Each table (backend and coroutine count) gets an equal share of the budget */
+    double table_ms = budget_ms / (num_backends * NUM_STACKWS_COUNTS);
+    
+    FILE *f = fopen("stackws_results.txt", "w");
+    if (f) {
+        fprintf(f, "backend,coroutines,stack_bytes,ns_per_switch,extra_ns,gb_per_s");
+        for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+            fprintf(f, ",%s_miss_per_switch", bench_perf_name(c));
+        }
+        fprintf(f, "\n");
+    }
+    
+    if (!have_perf) {
+        printf("  (hardware counters unavailable, miss rates shown as n/a)\n");
+    }
+    
+    int rc = 0;
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        if (!stackws_usable(coro_backend_get(b))) continue;
+        stackws_backend = coro_backend_get(b);
+        
+        for (int k = 0; k < NUM_STACKWS_COUNTS && rc == 0; k++) {
+            int n = stackws_coro_counts[k];
+            if (n > stackws_backend->max_coros ||
+                (bench_config.max_coros > 0 && n > bench_config.max_coros)) {
+                continue;
+            }
+            
+            printf("\n  %s, %d coroutines:\n", stackws_backend->name, n);
+            printf("  %10s %12s %10s %9s", "stack WS", "ns/switch", "extra ns", "GB/s");
+            for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                printf(" %9s/sw", bench_perf_name(c));
+            }
+            printf("\n");
+            
+            /*
+             * Calibrated points share what is left of the table's budget; once
+             * the next one's fixed cost (create, warmup, destroy) would not
+             * fit, the larger working sets are skipped.
+             */
+            double baseline_ns = 0.0;
+            int points_left = num_sizes;
+            long long table_start = get_time_ns();
+            double fixed_ms = 0.0;
+            for (size_t ws = 0; ws <= STACKWS_MAX_BYTES;
+                 ws = ws ? ws * 2 : STACKWS_MIN_BYTES) {
+                double misses[BENCH_PERF_NUM_COUNTERS];
+                stackws_bytes = ws;
+                
+                double left_ms = table_ms - (double)(get_time_ns() - table_start) / 1e6;
+                if (bench_config.calibrate && ws > 0 && (left_ms <= 0 || 2 * fixed_ms > left_ms)) {
+                    printf("  %8zu B  (time budget used up, larger working sets skipped)\n", ws);
+                    break;
+                }
+                double target_ms = left_ms / points_left--;
+                
+                long long point_start = get_time_ns();
+                double ns = stackws_point(n, target_ms, &perf, misses);
+                fixed_ms = (double)(get_time_ns() - point_start) / 1e6 - target_ms;
+                if (ns < 0) {
+                    rc = -1;
+                    break;
+                }
+                if (ws == 0) {
+                    baseline_ns = ns;
+                }
+                
+                /* Bytes of live stack read and written per nanosecond */
+                double gbps = (double)ws / ns;
+                
+                printf("  %8zu B %12.2f %10.2f %9.2f", ws, ns, ns - baseline_ns, gbps);
+                for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                    if (isnan(misses[c])) {
+                        printf(" %12s", "n/a");
+                    } else {
+                        printf(" %12.3f", misses[c]);
+                    }
+                }
+                printf("\n");
+                fflush(stdout);
+                
+                if (f) {
+                    fprintf(f, "%s,%d,%zu,%.2f,%.2f,%.3f", stackws_backend->name, n, ws,
+                            ns, ns - baseline_ns, gbps);
+                    for (int c = 0; c < BENCH_PERF_NUM_COUNTERS; c++) {
+                        fprintf(f, ",%.4f", misses[c]);
+                    }
+                    fprintf(f, "\n");
+                }
+            }
+        }
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    bench_perf_close(&perf);
+    return rc;
+}
@@ -0,0 +1,291 @@
+/**
+ * bench_stats.c
+ * Run Time Accounting Overhead Benchmark
+ *
+ * Measures what coro_stats_enable(true) adds to a ping-pong switch on
+ * every selected backend, then runs a small mixed workload (one hog
+ * that spins on every resume, several light coroutines) and prints the
+ * per-function totals the stats API reports for it. A last check parks
+ * a scheduler coroutine and confirms its blocked time is not reported
+ * as ready wait.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "coro_sched.h"
+#include "coro_stats.h"
+
+/* Default measured switches per sample (overridden by --switches) */
+#define STATS_DEFAULT_SWITCHES 1000000
+#define STATS_MAX_SWITCHES 10000000000LL
+
+/* Alternating off/on samples per backend */
+#define STATS_SAMPLES 3
+
+/* Mixed workload: one hog, light coroutines, rounds of resumes */
+#define STATS_HOG_SPIN_NS 20000
+#define STATS_LIGHT_COROS 15
+#define STATS_MIX_ROUNDS 200
+
+/* Park check: time the coroutine stays parked, and the wait it may report */
+#define STATS_PARK_NS 2000000
+#define STATS_PARK_MAX_WAIT_NS (STATS_PARK_NS / 10)
+
+/* Hog: busy for STATS_HOG_SPIN_NS on every resume */
+static int stats_hog_step(void *arg) {
+    (void)arg;
+    long long until = get_time_ns() + STATS_HOG_SPIN_NS;
+    while (get_time_ns() < until) {
+    }
+    return 0;
+}
+
+/* Light: does almost nothing per resume */
+static int stats_light_step(void *arg) {
+    (*(long long *)arg)++;
+    return 0;
+}
+
+/* Parked: parks on its first resume, finishes on the second */
+typedef struct {
+    coro_sched_t *sched;
+    int resumes;
+} stats_park_t;
+
+static int stats_parked_step(void *arg) {
+    stats_park_t *p = arg;
+    if (p->resumes++ == 0) {
+        coro_sched_park(p->sched);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Park a scheduler coroutine for STATS_PARK_NS, wake it, and read back
+ * the longest wait accounted to it
+ * Returns: 0 on success, -1 on error
+ */
+static int stats_check_park(const coro_backend_t *backend, double *max_wait_ns) {
+    coro_sched_t sched;
+    stats_park_t park = { &sched, 0 };
+    int rc = -1;
+    
+    backend->init();
+    if (coro_sched_init(&sched, backend) < 0) {
+        backend->cleanup();
+        return -1;
+    }
+    coro_stats_reset();
+    coro_stats_enable(true);
+    
+    int id = coro_sched_spawn(&sched, stats_parked_step, &park, 0);
+    if (id < 0) {
+        fprintf(stderr, "Failed to create %s coroutine\n", backend->name);
+        goto out;
+    }
+    coro_sched_run(&sched);
+    
+    long long until = get_time_ns() + STATS_PARK_NS;
+    while (get_time_ns() < until) {
+    }
+    coro_sched_wake(&sched, id);
+    coro_sched_run(&sched);
+    
+    for (int i = 0; i < coro_stats_func_count(); i++) {
+        coro_stats_t st;
+        coro_stats_func(i, &st);
+        if (st.func == (coro_stats_func_t)stats_parked_step && st.backend == backend->name) {
+            *max_wait_ns = st.max_wait_ns;
+            rc = park.resumes == 2 ? 0 : -1;
+        }
+    }
+    
+out:
+    coro_stats_enable(false);
+    coro_sched_cleanup(&sched);
+    return rc;
+}
+
+/**
+ * Mean ping-pong cost with accounting off and on, samples interleaved
+ * Returns: 0 on success, -1 on error
+ */
+static int stats_overhead(const coro_backend_t *backend, long long switches,
+                          double *off_ns, double *on_ns) {
+    *off_ns = *on_ns = 0.0;
+    for (int s = 0; s < STATS_SAMPLES; s++) {
+        for (int on = 0; on <= 1; on++) {
+            coro_stats_enable(on);
+            double ns = benchmark_pingpong(backend, switches, bench_config.warmup_switches);
+            coro_stats_enable(false);
+            if (ns < 0) {
+                return -1;
+            }
+            *(on ? on_ns : off_ns) += ns / STATS_SAMPLES;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Run the hog/light mix round-robin with accounting on
+ * Returns: 0 on success, -1 on error
+ */
+static int stats_mix(const coro_backend_t *backend) {
+    int ids[STATS_LIGHT_COROS + 1];
+    long long light_counter = 0;
+    int created = 0;
+    int rc = 0;
+    
+    backend->init();
+    coro_stats_enable(true);
+    for (created = 0; created <= STATS_LIGHT_COROS; created++) {
+        ids[created] = created == 0 ? backend->create(stats_hog_step, NULL)
+                                    : backend->create(stats_light_step, &light_counter);
+        if (ids[created] < 0) {
+            fprintf(stderr, "Failed to create %s coroutine\n", backend->name);
+            rc = -1;
+            goto out;
+        }
+    }
+    
+    for (int r = 0; r < STATS_MIX_ROUNDS; r++) {
+        for (int i = 0; i <= STATS_LIGHT_COROS; i++) {
+            backend->resume(ids[i]);
+        }
+    }
+    
+out:
+    coro_stats_enable(false);
+    for (int i = 0; i < created; i++) {
+        backend->destroy(ids[i]);
+    }
+    backend->cleanup();
+    return rc;
+}
+
+/**
+ * Switches per sample that fit row_ms, probing the switch cost with
+ * accounting off and on: an off/on pair, warmups included, takes row_ms
+ * Returns: the switch count
+ */
+static long long stats_switches(const coro_backend_t *backend, double row_ms) {
+    double unit_ns = 0.0;
+    
+    if (bench_config.calibrate) {
+        double off = benchmark_pingpong(backend, STATS_DEFAULT_SWITCHES / 100, 0);
+        coro_stats_enable(true);
+        double on = benchmark_pingpong(backend, STATS_DEFAULT_SWITCHES / 100, 0);
+        coro_stats_enable(false);
+        if (off > 0 && on > 0) {
+            unit_ns = off + on;
+            row_ms -= (double)bench_config.warmup_switches * unit_ns / 1e6;
+        }
+    }
+    return bench_suite_count(row_ms, unit_ns, STATS_DEFAULT_SWITCHES, STATS_MAX_SWITCHES);
+}
+
+/**
+ * Measure accounting overhead and show per-function totals
+ */
+int bench_stats(double budget_ms) {
+    int num_backends = 0;
+    for (int b = 0; b < coro_backend_count(); b++) {
+        if (bench_backend_selected(coro_backend_get(b))) num_backends++;
+    }
+    if (num_backends == 0) {
+        printf("  (no backend selected, skipped)\n");
+        return BENCH_SKIPPED;
+    }
+    
+    FILE *f = fopen("stats_results.txt", "w");
+    if (f) {
+        fprintf(f, "kind,backend,name,off_ns,on_ns,coroutines,resumes,"
+                "mean_run_ns,max_run_ns,mean_wait_ns,max_wait_ns\n");
+    }
+    
+    printf("  Ping-pong with accounting off and on (%d samples each):\n", STATS_SAMPLES);
+    printf("  %12s %12s %12s %12s\n", "backend", "off ns/sw", "on ns/sw", "delta ns");
+    
+    /* The mixed workloads' hog spins and the park checks come out of the budget first */
+    double mix_ms = (double)num_backends *
+                    ((double)STATS_MIX_ROUNDS * STATS_HOG_SPIN_NS + STATS_PARK_NS) / 1e6;
+    double row_ms = (budget_ms - mix_ms) / (num_backends * STATS_SAMPLES);
+    
+    int rc = 0;
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        long long switches = stats_switches(backend, row_ms);
+        double off_ns, on_ns;
+        if (stats_overhead(backend, switches, &off_ns, &on_ns) < 0) {
+            rc = -1;
+            break;
+        }
+        printf("  %12s %12.2f %12.2f %+12.2f\n", backend->name, off_ns, on_ns, on_ns - off_ns);
+        fflush(stdout);
+        if (f) {
+            fprintf(f, "overhead,%s,,%.2f,%.2f,,,,,,\n", backend->name, off_ns, on_ns);
+        }
+    }
+    
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        coro_stats_reset();
+        if (stats_mix(backend) < 0) {
+            rc = -1;
+            break;
+        }
+        
+        printf("\n  %s: 1 hog (%d us per resume) + %d light coroutines, %d rounds:\n",
+               backend->name, STATS_HOG_SPIN_NS / 1000, STATS_LIGHT_COROS, STATS_MIX_ROUNDS);
+        printf("  %8s %6s %8s %12s %12s %12s %12s\n", "function", "coros", "resumes",
+               "mean run ns", "max run ns", "mean wait ns", "max wait ns");
+        for (int i = 0; i < coro_stats_func_count(); i++) {
+            coro_stats_t st;
+            coro_stats_func(i, &st);
+            
+            const char *name = st.func == (coro_stats_func_t)stats_hog_step ? "hog" :
+                               st.func == (coro_stats_func_t)stats_light_step ? "light" : NULL;
+            if (!name || st.backend != backend->name || st.resumes == 0) continue;
+            
+            printf("  %8s %6lld %8lld %12.0f %12.0f %12.0f %12.0f\n", name, st.coroutines,
+                   st.resumes, st.run_ns / st.resumes, st.max_run_ns,
+                   st.wait_ns / st.resumes, st.max_wait_ns);
+            if (f) {
+                fprintf(f, "func,%s,%s,,,%lld,%lld,%.0f,%.0f,%.0f,%.0f\n", backend->name, name,
+                        st.coroutines, st.resumes, st.run_ns / st.resumes, st.max_run_ns,
+                        st.wait_ns / st.resumes, st.max_wait_ns);
+            }
+        }
+    }
+    
+    printf("\n");
+    for (int b = 0; b < coro_backend_count() && rc == 0; b++) {
+        const coro_backend_t *backend = coro_backend_get(b);
+        if (!bench_backend_selected(backend)) continue;
+        
+        double max_wait_ns = 0.0;
+        if (stats_check_park(backend, &max_wait_ns) < 0 ||
+            max_wait_ns > STATS_PARK_MAX_WAIT_NS) {
+            fprintf(stderr, "Error: %s coroutine parked %d ms reported %.0f ns of ready wait\n",
+                    backend->name, STATS_PARK_NS / 1000000, max_wait_ns);
+            rc = -1;
+            break;
+        }
+        printf("  Park check (%s, parked %d ms): ok, max wait %.0f ns\n", backend->name,
+               STATS_PARK_NS / 1000000, max_wait_ns);
+    }
+    printf("-------------------------------------------------------\n\n");
+    
+    if (f) {
+        fclose(f);
+    }
+    return rc;
+}
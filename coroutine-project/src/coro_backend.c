@@ -0,0 +1,76 @@
+/**
+ * coro_backend.c
+ * Coroutine Backend Registry
+ *
+ * A fixed-size table of backend descriptors. Registration happens at
+ * startup, before any coroutine is created, so no locking is done.
+ */
+#define _GNU_SOURCE
+
+#include "coro_backend.h"
+#include "coro_stackless.h"
+#include "coro_ucontext.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Registered backends, in registration order */
+static const coro_backend_t *backends[CORO_BACKEND_MAX];
+static int num_backends = 0;
+
+/**
+ * Register a backend
+ */
+int coro_backend_register(const coro_backend_t *backend) {
+    if (!backend || !backend->name || !backend->create || !backend->resume) {
+        return -1;
+    }
+    
+    if (coro_backend_find(backend->name)) {
+        return -1;
+    }
+    
+    if (num_backends >= CORO_BACKEND_MAX) {
+        fprintf(stderr, "Error: Maximum coroutine backends reached\n");
+        return -1;
+    }
+    
+    backends[num_backends++] = backend;
+    return 0;
+}
+
+/**
+ * Register the built-in backends
+ */
+void coro_backend_register_builtin(void) {
+    coro_backend_register(&coro_stackless_backend);
+    coro_backend_register(&coro_ucontext_backend);
+}
+
+/**
+ * Number of registered backends
+ */
+int coro_backend_count(void) {
+    return num_backends;
+}
+
+/**
+ * Get a backend by registration index
+ */
+const coro_backend_t *coro_backend_get(int index) {
+    if (index < 0 || index >= num_backends) {
+        return NULL;
+    }
+    return backends[index];
+}
+
+/**
+ * Find a backend by name
+ */
+const coro_backend_t *coro_backend_find(const char *name) {
+    for (int i = 0; i < num_backends; i++) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            return backends[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,103 @@
+/**
+ * coro_hook.c
+ * LD_PRELOAD Shim for Blocking Calls
+ *
+ * Built as lib/libcoro_hook.so. It defines read, write, connect, accept,
+ * poll, usleep and close; in a program started with
+ *     LD_PRELOAD=lib/libcoro_hook.so ./program
+ * these come before libc's, and each forwards to the coro_io_ call of
+ * the libcoro inside the program (coro_reactor.h). That call yields in
+ * a reactor coroutine and makes the plain system call anywhere else.
+ *
+ * The shim finds libcoro by the coro_io_hooks symbol. libcoro.so exports
+ * it; a program linked with libcoro.a must export it itself (bin/bench
+ * links with --export-dynamic-symbol). Without the table, or with one of
+ * another version, every call goes to the next definition, libc's.
+ */
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include "coro_reactor.h"
+
+/* libcoro's table, NULL = pass every call on */
+static const coro_io_hooks_t *hooks = NULL;
+
+/* Next definitions (libc's) */
+static ssize_t (*next_read)(int, void *, size_t);
+static ssize_t (*next_write)(int, const void *, size_t);
+static int (*next_connect)(int, const struct sockaddr *, socklen_t);
+static int (*next_accept)(int, struct sockaddr *, socklen_t *);
+static int (*next_poll)(struct pollfd *, nfds_t, int);
+static int (*next_usleep)(useconds_t);
+static int (*next_close)(int);
+
+static pthread_once_t resolve_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Look up the next definitions and libcoro's table
+ */
+static void resolve(void) {
+    next_read = (ssize_t (*)(int, void *, size_t))dlsym(RTLD_NEXT, "read");
+    next_write = (ssize_t (*)(int, const void *, size_t))dlsym(RTLD_NEXT, "write");
+    next_connect = (int (*)(int, const struct sockaddr *, socklen_t))dlsym(RTLD_NEXT, "connect");
+    next_accept = (int (*)(int, struct sockaddr *, socklen_t *))dlsym(RTLD_NEXT, "accept");
+    next_poll = (int (*)(struct pollfd *, nfds_t, int))dlsym(RTLD_NEXT, "poll");
+    next_usleep = (int (*)(useconds_t))dlsym(RTLD_NEXT, "usleep");
+    next_close = (int (*)(int))dlsym(RTLD_NEXT, "close");
+    
+    const coro_io_hooks_t *table = dlsym(RTLD_DEFAULT, CORO_IO_HOOKS_SYMBOL);
+    if (table && table->version == CORO_IO_HOOKS_VERSION) {
+        table->attach();
+        hooks = table;
+    }
+}
+
+/* Resolve on load; calls made by earlier constructors resolve on demand */
+__attribute__((constructor)) static void hook_init(void) {
+    pthread_once(&resolve_once, resolve);
+}
+
+#define HOOK_RESOLVE() pthread_once(&resolve_once, resolve)
+
+/* ============================================================
+ * INTERPOSED CALLS
+ * ============================================================ */
+
+ssize_t read(int fd, void *buf, size_t count) {
+    HOOK_RESOLVE();
+    return hooks ? hooks->read(fd, buf, count) : next_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    HOOK_RESOLVE();
+    return hooks ? hooks->write(fd, buf, count) : next_write(fd, buf, count);
+}
+
+/* glibc declares the address as a transparent union under _GNU_SOURCE */
+int connect(int fd, __CONST_SOCKADDR_ARG addr, socklen_t len) {
+    HOOK_RESOLVE();
+    return hooks ? hooks->connect(fd, addr.__sockaddr__, len)
+                 : next_connect(fd, addr.__sockaddr__, len);
+}
+
+int accept(int fd, __SOCKADDR_ARG addr, socklen_t *restrict len) {
+    HOOK_RESOLVE();
+    return hooks ? hooks->accept(fd, addr.__sockaddr__, len)
+                 : next_accept(fd, addr.__sockaddr__, len);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    HOOK_RESOLVE();
+    return hooks ? hooks->poll(fds, nfds, timeout) : next_poll(fds, nfds, timeout);
+}
+
+int usleep(useconds_t usec) {
+    HOOK_RESOLVE();
+    return hooks ? hooks->usleep(usec) : next_usleep(usec);
+}
+
+int close(int fd) {
+    HOOK_RESOLVE();
+    return hooks ? hooks->close(fd) : next_close(fd);
+}
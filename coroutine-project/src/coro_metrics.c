@@ -0,0 +1,286 @@
+/**
+ * coro_metrics.c
+ * Per-Thread Counter Blocks and the Shared-Memory Publisher
+ *
+ * A thread's block lives in its TLS and is put on the published list
+ * when the thread creates its first coroutine. The list only changes
+ * under publish_lock: on thread exit a key destructor folds the block's
+ * final counts into one "retired" block and takes it off the list, so
+ * the publisher never reads freed TLS, totals never go backwards, and
+ * the exited thread's slot goes to the next thread that attaches.
+ */
+#define _GNU_SOURCE
+
+#include "coro_metrics.h"
+#include "coro_stackless.h"
+#include "coro_ucontext.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+_Thread_local coro_metrics_thread_t coro_metrics_thread;
+
+/* Every attached block, newest first (guarded by publish_lock) */
+static coro_metrics_thread_t *metrics_threads = NULL;
+static int metrics_num_threads = 0;
+
+/* Sum of every exited thread's counts, published as tid 0 once one has exited */
+static coro_metrics_thread_t metrics_retired;
+static bool metrics_any_retired = false;
+static pthread_key_t exit_key;
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+/* Open segment and its publisher */
+static coro_metrics_shm_t *segment = NULL;
+static size_t segment_size = 0;
+static char segment_name[64];
+static pthread_t publisher;
+static pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t publish_cond = PTHREAD_COND_INITIALIZER;
+static bool publisher_stop = false;
+
+/**
+ * Monotonic time in nanoseconds
+ */
+static long long metrics_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Thread exit: fold the thread's counts into the retired block and
+ * free its slot
+ */
+static void retire_thread(void *arg) {
+    coro_metrics_thread_t *t = arg;
+    
+    pthread_mutex_lock(&publish_lock);
+    for (coro_metrics_thread_t **p = &metrics_threads; *p; p = &(*p)->next) {
+        if (*p != t) continue;
+        
+        for (int b = 0; b < CORO_METRICS_NUM_BACKENDS; b++) {
+            coro_metrics_live_t *from = &t->backend[b], *to = &metrics_retired.backend[b];
+            coro_metrics_add(&to->resumes, (int64_t)atomic_load(&from->resumes));
+            coro_metrics_add(&to->creates, (int64_t)atomic_load(&from->creates));
+            coro_metrics_add(&to->destroys, (int64_t)atomic_load(&from->destroys));
+            coro_metrics_add(&to->stack_bytes, (int64_t)atomic_load(&from->stack_bytes));
+        }
+        metrics_any_retired = true;
+        *p = t->next;
+        metrics_num_threads--;
+        break;
+    }
+    pthread_mutex_unlock(&publish_lock);
+}
+
+/**
+ * Create the thread exit key
+ */
+static void create_exit_key(void) {
+    pthread_key_create(&exit_key, retire_thread);
+}
+
+/**
+ * Put the calling thread's block on the published list
+ */
+void coro_metrics_attach(void) {
+    coro_metrics_thread_t *t = &coro_metrics_thread;
+    if (t->attached) {
+        return;
+    }
+    t->attached = true;
+    pthread_once(&exit_key_once, create_exit_key);
+    
+    /* One slot stays free for the retired block */
+    pthread_mutex_lock(&publish_lock);
+    if (metrics_num_threads < CORO_METRICS_MAX_THREADS - 1) {
+        t->tid = (int32_t)gettid();
+        t->next = metrics_threads;
+        metrics_threads = t;
+        metrics_num_threads++;
+        pthread_setspecific(exit_key, t);
+    }
+    pthread_mutex_unlock(&publish_lock);
+}
+
+/**
+ * Copy one block into a segment entry
+ */
+static void publish_thread(coro_metrics_thread_shm_t *out, coro_metrics_thread_t *t) {
+    out->tid = t->tid;
+    for (int b = 0; b < CORO_METRICS_NUM_BACKENDS; b++) {
+        coro_metrics_live_t *live = &t->backend[b];
+        out->backend[b].resumes = atomic_load_explicit(&live->resumes, memory_order_relaxed);
+        out->backend[b].creates = atomic_load_explicit(&live->creates, memory_order_relaxed);
+        out->backend[b].destroys = atomic_load_explicit(&live->destroys, memory_order_relaxed);
+        out->backend[b].stack_bytes = atomic_load_explicit(&live->stack_bytes,
+                                                           memory_order_relaxed);
+    }
+}
+
+/**
+ * Copy every block, then the retired block, into the segment under its seqlock
+ * Caller holds publish_lock.
+ */
+static void publish_locked(void) {
+    if (!segment) {
+        return;
+    }
+    
+    uint64_t seq = atomic_load_explicit(&segment->seq, memory_order_relaxed);
+    atomic_store_explicit(&segment->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    
+    coro_metrics_thread_shm_t *out = (coro_metrics_thread_shm_t *)(segment + 1);
+    uint32_t n = 0;
+    for (coro_metrics_thread_t *t = metrics_threads; t && n < CORO_METRICS_MAX_THREADS;
+         t = t->next, n++) {
+        publish_thread(&out[n], t);
+    }
+    if (metrics_any_retired && n < CORO_METRICS_MAX_THREADS) {
+        publish_thread(&out[n++], &metrics_retired);
+    }
+    segment->num_threads = n;
+    segment->publish_ns = (uint64_t)metrics_time_ns();
+    segment->publishes++;
+    
+    atomic_store_explicit(&segment->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * Publish immediately
+ */
+void coro_metrics_publish(void) {
+    pthread_mutex_lock(&publish_lock);
+    publish_locked();
+    pthread_mutex_unlock(&publish_lock);
+}
+
+/**
+ * Publisher thread: publish every interval until stopped
+ */
+static void *publisher_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&publish_lock);
+    while (!publisher_stop) {
+        publish_locked();
+        
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        long long ns = deadline.tv_nsec + (long long)segment->interval_ms * 1000000LL;
+        deadline.tv_sec += ns / 1000000000LL;
+        deadline.tv_nsec = ns % 1000000000LL;
+        while (!publisher_stop &&
+               pthread_cond_timedwait(&publish_cond, &publish_lock, &deadline) != ETIMEDOUT) {
+        }
+    }
+    pthread_mutex_unlock(&publish_lock);
+    return NULL;
+}
+
+/**
+ * Create the segment and start publishing
+ */
+int coro_metrics_open(const char *name, int interval_ms) {
+    if (segment) {
+        fprintf(stderr, "Error: Metrics segment %s is already open\n", segment_name);
+        return -1;
+    }
+    if (interval_ms <= 0) {
+        interval_ms = CORO_METRICS_DEFAULT_INTERVAL_MS;
+    }
+    if (name) {
+        snprintf(segment_name, sizeof(segment_name), "%s", name);
+    } else {
+        snprintf(segment_name, sizeof(segment_name), "/coro-metrics.%d", (int)getpid());
+    }
+    
+    int fd = shm_open(segment_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create shared memory %s: %s\n", segment_name,
+                strerror(errno));
+        return -1;
+    }
+    
+    size_t size = sizeof(coro_metrics_shm_t) +
+                  CORO_METRICS_MAX_THREADS * sizeof(coro_metrics_thread_shm_t);
+    if (ftruncate(fd, (off_t)size) < 0) {
+        fprintf(stderr, "Error: Failed to size shared memory %s: %s\n", segment_name,
+                strerror(errno));
+        close(fd);
+        shm_unlink(segment_name);
+        return -1;
+    }
+    
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "Error: Failed to map shared memory %s: %s\n", segment_name,
+                strerror(errno));
+        shm_unlink(segment_name);
+        return -1;
+    }
+    
+    /* The layout fields go in before magic, so readers never see a half-set header */
+    coro_metrics_shm_t *shm = mem;
+    shm->version = CORO_METRICS_VERSION;
+    shm->header_size = sizeof(coro_metrics_shm_t);
+    shm->thread_size = sizeof(coro_metrics_thread_shm_t);
+    shm->max_threads = CORO_METRICS_MAX_THREADS;
+    shm->num_backends = CORO_METRICS_NUM_BACKENDS;
+    shm->pid = (int32_t)getpid();
+    shm->interval_ms = (uint32_t)interval_ms;
+    shm->capacity[CORO_METRICS_STACKLESS] = MAX_COROUTINES;
+    shm->capacity[CORO_METRICS_UCONTEXT] = MAX_UCONTEXT_COROUTINES;
+    atomic_thread_fence(memory_order_release);
+    shm->magic = CORO_METRICS_MAGIC;
+    
+    pthread_mutex_lock(&publish_lock);
+    segment = shm;
+    segment_size = size;
+    publisher_stop = false;
+    pthread_mutex_unlock(&publish_lock);
+    
+    if (pthread_create(&publisher, NULL, publisher_main, NULL) != 0) {
+        fprintf(stderr, "Error: Failed to start the metrics publisher\n");
+        segment = NULL;
+        munmap(mem, size);
+        shm_unlink(segment_name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Publish once more, stop the publisher and unlink the segment
+ */
+void coro_metrics_close(void) {
+    if (!segment) {
+        return;
+    }
+    
+    pthread_mutex_lock(&publish_lock);
+    publisher_stop = true;
+    pthread_cond_signal(&publish_cond);
+    pthread_mutex_unlock(&publish_lock);
+    pthread_join(publisher, NULL);
+    
+    coro_metrics_publish();
+    munmap(segment, segment_size);
+    shm_unlink(segment_name);
+    segment = NULL;
+}
+
+/**
+ * Name of the open segment
+ */
+const char *coro_metrics_name(void) {
+    return segment ? segment_name : NULL;
+}
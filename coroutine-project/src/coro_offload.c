@@ -0,0 +1,154 @@
+/**
+ * coro_offload.c
+ * Blocking-Call Offload Pool Implementation
+ *
+ * Jobs live in the submitting coroutine (its stack or step state), so the
+ * pool allocates nothing per call: the queue is an intrusive FIFO under
+ * one mutex, and a finished job goes back through the home scheduler's
+ * remote wake inbox.
+ */
+#define _GNU_SOURCE
+
+#include "coro_offload.h"
+#include "coro_ucontext.h"
+#include <pthread.h>
+#include <stdio.h>
+
+/* Queue and helper threads */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static coro_offload_job_t *queue_head = NULL;
+static coro_offload_job_t *queue_tail = NULL;
+static bool pool_stop = false;
+static pthread_t pool_threads[CORO_OFFLOAD_MAX_THREADS];
+static int pool_num_threads = 0;
+
+/**
+ * Helper thread: run queued calls until stopped and drained
+ */
+static void *helper_main(void *arg) {
+    (void)arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (!queue_head && !pool_stop) {
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        }
+        coro_offload_job_t *job = queue_head;
+        if (!job) {
+            pthread_mutex_unlock(&pool_lock);
+            return NULL;
+        }
+        queue_head = job->next;
+        if (!queue_head) {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&pool_lock);
+        
+        job->result = job->fn(job->arg);
+        coro_sched_wake_remote(job->home, &job->remote);
+    }
+}
+
+/**
+ * Start the helper threads
+ */
+int coro_offload_start(int threads) {
+    if (pool_num_threads > 0) {
+        fprintf(stderr, "Error: Offload pool already started\n");
+        return -1;
+    }
+    if (threads <= 0) {
+        threads = CORO_OFFLOAD_DEFAULT_THREADS;
+    }
+    if (threads > CORO_OFFLOAD_MAX_THREADS) {
+        threads = CORO_OFFLOAD_MAX_THREADS;
+    }
+    
+    pool_stop = false;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool_threads[i], NULL, helper_main, NULL) != 0) {
+            fprintf(stderr, "Error: Failed to start offload thread %d\n", i);
+            break;
+        }
+        pool_num_threads++;
+    }
+    return pool_num_threads > 0 ? 0 : -1;
+}
+
+/**
+ * Drain the queue and join the helper threads
+ */
+void coro_offload_stop(void) {
+    pthread_mutex_lock(&pool_lock);
+    pool_stop = true;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+    
+    for (int i = 0; i < pool_num_threads; i++) {
+        pthread_join(pool_threads[i], NULL);
+    }
+    pool_num_threads = 0;
+}
+
+/**
+ * Number of helper threads
+ */
+int coro_offload_threads(void) {
+    return pool_num_threads;
+}
+
+/**
+ * Queue a call and park the running coroutine
+ */
+int coro_offload_submit(coro_offload_job_t *job, coro_offload_fn_t fn, void *arg) {
+    coro_sched_t *s = coro_sched_running;
+    if (!s || s->current < 0 || pool_num_threads == 0) {
+        return -1;
+    }
+    
+    job->remote.id = s->current;
+    job->home = s;
+    job->fn = fn;
+    job->arg = arg;
+    job->result = NULL;
+    job->next = NULL;
+    
+    /* Parked before the step returns, so an early wake is never lost */
+    coro_sched_park(s);
+    
+    /* A preemptible caller switched out holding pool_lock would deadlock its thread */
+    coro_ucontext_preempt_disable_fast();
+    pthread_mutex_lock(&pool_lock);
+    if (queue_tail) {
+        queue_tail->next = job;
+    } else {
+        queue_head = job;
+    }
+    queue_tail = job;
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+    coro_ucontext_preempt_enable_fast();
+    return 0;
+}
+
+/**
+ * Run a blocking call on the pool from a stackful coroutine
+ */
+void *coro_run_blocking(coro_offload_fn_t fn, void *arg) {
+    coro_sched_t *s = coro_sched_running;
+    if (!s || !s->backend->yield) {
+        return fn(arg);
+    }
+    
+    /* Not preempted between queueing and parking: the yield below is the park */
+    coro_offload_job_t job;
+    coro_ucontext_preempt_disable_fast();
+    if (coro_offload_submit(&job, fn, arg) < 0) {
+        coro_ucontext_preempt_enable_fast();
+        return fn(arg);
+    }
+    s->backend->yield();
+    coro_ucontext_preempt_enable_fast();
+    return job.result;
+}
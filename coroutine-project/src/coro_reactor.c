@@ -0,0 +1,1193 @@
+/**
+ * coro_reactor.c
+ * I/O Reactor and Blocking-Call Hooks Implementation
+ *
+ * Descriptor state is one table indexed by fd: the coroutines waiting
+ * to read and to write, and edges that arrived while nobody waited.
+ * Registration is edge-triggered and done once per descriptor, so a
+ * wait costs no epoll_ctl(). Timers live on the waiters' stacks in a
+ * binary min-heap. The coro_io_ calls make raw system calls so they
+ * never re-enter the LD_PRELOAD shim.
+ *
+ * Batched writes queue on their descriptor's entry, and descriptors with
+ * a queue are linked into the reactor's dirty list, so a flush visits
+ * only those.
+ */
+#define _GNU_SOURCE
+
+#include "coro_reactor.h"
+#include "coro_ucontext.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+
+/* Descriptor flags */
+#define IO_FD_TRACKED 0x01    /* Entry set up, O_NONBLOCK checked */
+#define IO_FD_FORCED 0x02     /* O_NONBLOCK set by us: keep blocking semantics */
+#define IO_FD_READABLE 0x04   /* Input edge not yet consumed by a waiter */
+#define IO_FD_WRITABLE 0x08   /* Output edge not yet consumed by a waiter */
+#define IO_FD_TYPED 0x10      /* Socket type checked for batching */
+#define IO_FD_DGRAM 0x20      /* Message socket: batches go out with sendmmsg() */
+#define IO_FD_BLOCKED 0x40    /* Queued writes wait for an output edge */
+#define IO_FD_DIRTY 0x80      /* On the reactor's dirty list */
+
+/* A waiter that finds another coroutine in its slot rechecks this often */
+#define IO_SHARED_RECHECK_NS 1000000ULL
+
+/* Batched write, on the writer's stack until it is resumed */
+typedef struct io_write_req {
+    struct io_write_req *next;
+    const char *buf;
+    size_t len;
+    size_t done;              /* Bytes written so far (streams) */
+    const struct sockaddr *addr;  /* Datagram destination, NULL = connected */
+    socklen_t addr_len;
+    int id;                   /* Writer to resume */
+    ssize_t result;
+    int err;                  /* errno when result is -1 */
+} io_write_req_t;
+
+/* State of one descriptor */
+typedef struct {
+    coro_reactor_t *reactor;  /* Registered with, NULL = in no epoll set */
+    int reader;               /* Coroutine waiting for input, -1 = none */
+    int writer;               /* Coroutine waiting for output, -1 = none */
+    uint8_t flags;
+    int next_dirty;           /* Next descriptor on the dirty list */
+    io_write_req_t *wq_head;  /* Batched writes, oldest first */
+    io_write_req_t *wq_tail;
+} io_fd_t;
+
+static io_fd_t io_fds[CORO_IO_MAX_FDS];
+
+static atomic_bool io_attached;
+
+_Thread_local coro_reactor_t *coro_reactor_current = NULL;
+
+/* ============================================================
+ * TIMER HEAP
+ * ============================================================ */
+
+/**
+ * Put t at heap position i and record the position
+ */
+static void timer_place(coro_reactor_t *r, int i, coro_io_timer_t *t) {
+    r->timers[i] = t;
+    t->heap_index = i;
+}
+
+/**
+ * Move the timer at position i towards the root while it is earlier
+ */
+static void timer_sift_up(coro_reactor_t *r, int i) {
+    coro_io_timer_t *t = r->timers[i];
+    
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (r->timers[parent]->deadline_ns <= t->deadline_ns) break;
+        timer_place(r, i, r->timers[parent]);
+        i = parent;
+    }
+    timer_place(r, i, t);
+}
+
+/**
+ * Move the timer at position i towards the leaves while it is later
+ */
+static void timer_sift_down(coro_reactor_t *r, int i) {
+    coro_io_timer_t *t = r->timers[i];
+    
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= r->num_timers) break;
+        if (child + 1 < r->num_timers &&
+            r->timers[child + 1]->deadline_ns < r->timers[child]->deadline_ns) {
+            child++;
+        }
+        if (r->timers[child]->deadline_ns >= t->deadline_ns) break;
+        timer_place(r, i, r->timers[child]);
+        i = child;
+    }
+    timer_place(r, i, t);
+}
+
+/**
+ * Queue a timer
+ */
+static void timer_add(coro_reactor_t *r, coro_io_timer_t *t) {
+    timer_place(r, r->num_timers++, t);
+    timer_sift_up(r, t->heap_index);
+}
+
+/**
+ * Take a timer out of the heap if it is still queued
+ */
+static void timer_remove(coro_reactor_t *r, coro_io_timer_t *t) {
+    int i = t->heap_index;
+    if (i < 0) {
+        return;
+    }
+    
+    t->heap_index = -1;
+    if (--r->num_timers > i) {
+        coro_io_timer_t *last = r->timers[r->num_timers];
+        timer_place(r, i, last);
+        timer_sift_up(r, i);
+        timer_sift_down(r, last->heap_index);
+    }
+}
+
+/**
+ * Wake the coroutines whose timers have expired
+ */
+static void timer_expire(coro_reactor_t *r) {
+    if (r->num_timers == 0) {
+        return;
+    }
+    
+    uint64_t now = coro_sched_now_ns();
+    while (r->num_timers > 0 && r->timers[0]->deadline_ns <= now) {
+        coro_io_timer_t *t = r->timers[0];
+        timer_remove(r, t);
+        coro_sched_wake(r->sched, t->id);
+    }
+}
+
+/* ============================================================
+ * DESCRIPTOR STATE
+ * ============================================================ */
+
+/**
+ * Reactor of the calling stackful coroutine
+ * Returns: the reactor, or NULL outside a coroutine it runs
+ */
+static inline coro_reactor_t *io_reactor(void) {
+    coro_reactor_t *r = coro_reactor_current;
+    if (!r || coro_sched_running != r->sched || r->sched->current < 0 ||
+        !r->sched->backend->yield) {
+        return NULL;
+    }
+    return r;
+}
+
+static pthread_once_t io_restore_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Give fd back the blocking mode io_track() took away, if it did
+ */
+static void io_restore(int fd) {
+    if (fd < 0 || fd >= CORO_IO_MAX_FDS || !(io_fds[fd].flags & IO_FD_FORCED)) {
+        return;
+    }
+    
+    int fl = fcntl(fd, F_GETFL);
+    if (fl >= 0 && (fl & O_NONBLOCK)) {
+        fcntl(fd, F_SETFL, fl & ~O_NONBLOCK);
+    }
+    io_fds[fd].flags &= (uint8_t)~IO_FD_FORCED;
+}
+
+/**
+ * At exit, restore every descriptor still open in forced non-blocking mode
+ * (the file description may be shared, e.g. a terminal or an inherited pipe)
+ */
+static void io_restore_all(void) {
+    for (int fd = 0; fd < CORO_IO_MAX_FDS; fd++) {
+        io_restore(fd);
+    }
+}
+
+static void io_restore_register(void) {
+    atexit(io_restore_all);
+}
+
+/**
+ * Set up fd's entry on first use from a coroutine and make it non-blocking
+ * Returns: the entry, or NULL if fd is out of range or not open
+ */
+static io_fd_t *io_track(int fd) {
+    if (fd < 0 || fd >= CORO_IO_MAX_FDS) {
+        return NULL;
+    }
+    
+    io_fd_t *e = &io_fds[fd];
+    if (!(e->flags & IO_FD_TRACKED)) {
+        int fl = fcntl(fd, F_GETFL);
+        if (fl < 0) {
+            return NULL;
+        }
+        e->reactor = NULL;
+        e->reader = -1;
+        e->writer = -1;
+        e->flags = IO_FD_TRACKED | (e->flags & IO_FD_DIRTY);
+        if (!(fl & O_NONBLOCK) && fcntl(fd, F_SETFL, fl | O_NONBLOCK) == 0) {
+            e->flags |= IO_FD_FORCED;
+            pthread_once(&io_restore_once, io_restore_register);
+        }
+    }
+    return e;
+}
+
+/**
+ * Resume the oldest batched writer of e with its result
+ */
+static void io_write_done(coro_reactor_t *r, io_fd_t *e, ssize_t result, int err) {
+    io_write_req_t *req = e->wq_head;
+    
+    e->wq_head = req->next;
+    if (!e->wq_head) {
+        e->wq_tail = NULL;
+    }
+    req->result = result;
+    req->err = err;
+    if (result >= 0) {
+        r->writes++;
+    }
+    coro_sched_wake(r->sched, req->id);
+}
+
+/**
+ * Drop fd's state (closed or newly created); its waiters retry and fail
+ * A dirty entry stays linked, with an empty queue, until the next flush.
+ */
+static void io_forget(int fd) {
+    if (fd < 0 || fd >= CORO_IO_MAX_FDS) {
+        return;
+    }
+    
+    io_fd_t *e = &io_fds[fd];
+    coro_reactor_t *r = coro_reactor_current;
+    if (r && e->reactor == r) {
+        if (e->reader >= 0) coro_sched_wake(r->sched, e->reader);
+        if (e->writer >= 0) coro_sched_wake(r->sched, e->writer);
+    }
+    while (r && e->wq_head) {
+        io_write_done(r, e, -1, EBADF);
+    }
+    e->reactor = NULL;
+    e->reader = -1;
+    e->writer = -1;
+    e->flags &= IO_FD_DIRTY;
+    e->wq_head = NULL;
+    e->wq_tail = NULL;
+}
+
+/**
+ * Add fd to r's epoll set (edge-triggered, input and output) once
+ * Returns: 0 on success, -1 if fd cannot be polled (e.g. a regular file)
+ */
+static int io_register(coro_reactor_t *r, int fd, io_fd_t *e) {
+    if (e->reactor == r) {
+        return 0;
+    }
+    if (e->reactor) {
+        epoll_ctl(e->reactor->epfd, EPOLL_CTL_DEL, fd, NULL);
+        e->reactor = NULL;
+    }
+    
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    e->reactor = r;
+    return 0;
+}
+
+/**
+ * Park the running coroutine until it is woken or due_ns (0 = no timer)
+ */
+static void io_park(coro_reactor_t *r, uint64_t due_ns) {
+    coro_sched_t *s = r->sched;
+    coro_io_timer_t timer = { due_ns, s->current, -1 };
+    
+    if (due_ns) {
+        timer_add(r, &timer);
+    }
+    r->waits++;
+    coro_sched_park(s);
+    s->backend->yield();
+    timer_remove(r, &timer);
+}
+
+/**
+ * Deadline of a wait that has to share its slot with another coroutine
+ */
+static uint64_t io_shared_due(uint64_t deadline_ns) {
+    uint64_t recheck = coro_sched_now_ns() + IO_SHARED_RECHECK_NS;
+    return deadline_ns && deadline_ns < recheck ? deadline_ns : recheck;
+}
+
+/**
+ * Wait in the reactor for an edge in bit (IO_FD_READABLE/WRITABLE) or
+ * the deadline (0 = none); an edge that arrived earlier is consumed
+ * Returns: 1 if the caller should retry, 0 on timeout, -1 if fd cannot be polled
+ */
+static int io_wait_fd(coro_reactor_t *r, int fd, io_fd_t *e, uint8_t bit, uint64_t deadline_ns) {
+    if (e->flags & bit) {
+        e->flags &= (uint8_t)~bit;
+        return 1;
+    }
+    if (io_register(r, fd, e) < 0) {
+        return -1;
+    }
+    
+    int *slot = bit == IO_FD_READABLE ? &e->reader : &e->writer;
+    bool shared = *slot >= 0;
+    if (shared) {
+        io_park(r, io_shared_due(deadline_ns));
+    } else {
+        *slot = r->sched->current;
+        io_park(r, deadline_ns);
+        *slot = -1;
+    }
+    
+    bool ready = (e->flags & bit) != 0;
+    e->flags &= (uint8_t)~bit;
+    if (!ready && deadline_ns && coro_sched_now_ns() >= deadline_ns) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Wait in ppoll() for events on fd, outside coroutines
+ */
+static void io_wait_thread(int fd, short events) {
+    struct pollfd p = { fd, events, 0 };
+    ppoll(&p, 1, NULL, NULL);
+}
+
+/**
+ * After EAGAIN on fd, wait until the call may succeed if its caller
+ * expects blocking behaviour
+ * Returns: true to retry the call, false to return EAGAIN (errno is kept)
+ */
+static bool io_retry(int fd, short events) {
+    if (fd < 0 || fd >= CORO_IO_MAX_FDS || !(io_fds[fd].flags & IO_FD_FORCED)) {
+        errno = EAGAIN;
+        return false;
+    }
+    
+    coro_reactor_t *r = io_reactor();
+    if (!r) {
+        io_wait_thread(fd, events);
+        return true;
+    }
+    uint8_t bit = events == POLLIN ? IO_FD_READABLE : IO_FD_WRITABLE;
+    if (io_wait_fd(r, fd, &io_fds[fd], bit, 0) < 0) {
+        errno = EAGAIN;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Wake the coroutines waiting on fd for what epoll reported
+ */
+static void io_dispatch(coro_reactor_t *r, int fd, uint32_t events) {
+    if (fd < 0 || fd >= CORO_IO_MAX_FDS) {
+        return;
+    }
+    
+    io_fd_t *e = &io_fds[fd];
+    if (e->reactor != r) {
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        e->flags |= IO_FD_READABLE;
+        if (e->reader >= 0) coro_sched_wake(r->sched, e->reader);
+    }
+    if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+        e->flags |= IO_FD_WRITABLE;
+        if (e->writer >= 0) coro_sched_wake(r->sched, e->writer);
+    }
+}
+
+/* ============================================================
+ * BATCHED WRITES
+ * ============================================================ */
+
+/**
+ * Queue a write on fd and park the running coroutine until the flush
+ * Returns: the write's result (errno set on -1)
+ */
+static ssize_t io_write_batched(coro_reactor_t *r, int fd, io_fd_t *e, const void *buf,
+                                size_t len, const struct sockaddr *addr, socklen_t addr_len) {
+    if (!(e->flags & IO_FD_TYPED)) {
+        int type = SOCK_STREAM;
+        socklen_t type_len = sizeof(type);
+        if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len) == 0 && type != SOCK_STREAM) {
+            e->flags |= IO_FD_DGRAM;
+        }
+        e->flags |= IO_FD_TYPED;
+    }
+    
+    io_write_req_t req = { NULL, buf, len, 0, addr, addr_len, r->sched->current, -1, 0 };
+    if (e->wq_tail) {
+        e->wq_tail->next = &req;
+    } else {
+        e->wq_head = &req;
+    }
+    e->wq_tail = &req;
+    if (!(e->flags & IO_FD_DIRTY)) {
+        e->flags |= IO_FD_DIRTY;
+        e->next_dirty = r->dirty;
+        r->dirty = fd;
+    }
+    
+    io_park(r, 0);
+    if (req.result < 0) {
+        errno = req.err;
+    }
+    return req.result;
+}
+
+/**
+ * Leave e's queue until the next output edge
+ */
+static void io_flush_blocked(coro_reactor_t *r, int fd, io_fd_t *e) {
+    e->flags = (uint8_t)((e->flags | IO_FD_BLOCKED) & ~IO_FD_WRITABLE);
+    if (io_register(r, fd, e) < 0) {
+        while (e->wq_head) {
+            io_write_done(r, e, -1, EAGAIN);
+        }
+    }
+}
+
+/**
+ * Write a stream descriptor's queue with writev(), oldest first
+ */
+static void io_flush_stream(coro_reactor_t *r, int fd, io_fd_t *e) {
+    struct iovec iov[CORO_IO_BATCH_MAX];
+    
+    while (e->wq_head) {
+        int n = 0;
+        for (io_write_req_t *q = e->wq_head; q && n < CORO_IO_BATCH_MAX; q = q->next) {
+            iov[n].iov_base = (void *)(q->buf + q->done);
+            iov[n].iov_len = q->len - q->done;
+            n++;
+        }
+        
+        ssize_t w = syscall(SYS_writev, fd, iov, n);
+        r->write_calls++;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                io_flush_blocked(r, fd, e);
+                return;
+            }
+            int err = errno;
+            while (e->wq_head) {
+                io_write_done(r, e, -1, err);
+            }
+            return;
+        }
+        
+        /* A partly written request stays at the head */
+        for (io_write_req_t *q = e->wq_head; q; q = e->wq_head) {
+            size_t left = q->len - q->done;
+            if ((size_t)w < left) {
+                q->done += (size_t)w;
+                break;
+            }
+            w -= (ssize_t)left;
+            io_write_done(r, e, (ssize_t)q->len, 0);
+        }
+    }
+}
+
+/**
+ * Send a message socket's queue with sendmmsg(), one datagram per request
+ */
+static void io_flush_dgram(coro_reactor_t *r, int fd, io_fd_t *e) {
+    struct mmsghdr msgs[CORO_IO_BATCH_MAX];
+    struct iovec iov[CORO_IO_BATCH_MAX];
+    
+    while (e->wq_head) {
+        int n = 0;
+        for (io_write_req_t *q = e->wq_head; q && n < CORO_IO_BATCH_MAX; q = q->next) {
+            iov[n].iov_base = (void *)q->buf;
+            iov[n].iov_len = q->len;
+            memset(&msgs[n], 0, sizeof(msgs[n]));
+            msgs[n].msg_hdr.msg_name = (void *)q->addr;
+            msgs[n].msg_hdr.msg_namelen = q->addr_len;
+            msgs[n].msg_hdr.msg_iov = &iov[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+            n++;
+        }
+        
+        int sent = (int)syscall(SYS_sendmmsg, fd, msgs, n, 0);
+        r->write_calls++;
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                io_flush_blocked(r, fd, e);
+                return;
+            }
+            /* The first datagram failed; the ones behind it are retried */
+            io_write_done(r, e, -1, errno);
+            continue;
+        }
+        for (int i = 0; i < sent; i++) {
+            io_write_done(r, e, (ssize_t)msgs[i].msg_len, 0);
+        }
+    }
+}
+
+/**
+ * Flush every dirty descriptor that is not waiting for an output edge
+ */
+static void reactor_flush(coro_reactor_t *r) {
+    int fd = r->dirty;
+    
+    r->dirty = -1;
+    while (fd >= 0) {
+        io_fd_t *e = &io_fds[fd];
+        int next = e->next_dirty;
+        
+        if ((e->flags & IO_FD_BLOCKED) && (e->flags & IO_FD_WRITABLE)) {
+            e->flags &= (uint8_t)~(IO_FD_BLOCKED | IO_FD_WRITABLE);
+        }
+        if (e->wq_head && !(e->flags & IO_FD_BLOCKED)) {
+            if (e->flags & IO_FD_DGRAM) {
+                io_flush_dgram(r, fd, e);
+            } else {
+                io_flush_stream(r, fd, e);
+            }
+        }
+        
+        if (e->wq_head) {
+            e->next_dirty = r->dirty;
+            r->dirty = fd;
+        } else {
+            e->flags &= (uint8_t)~(IO_FD_DIRTY | IO_FD_BLOCKED);
+        }
+        fd = next;
+    }
+}
+
+/* ============================================================
+ * REACTOR
+ * ============================================================ */
+
+/**
+ * Remote wake while the home thread is in epoll_wait()
+ */
+static void reactor_notify(void *ctx) {
+    coro_reactor_t *r = ctx;
+    eventfd_write(r->wake_fd, 1);
+}
+
+/**
+ * Create the epoll set and the remote-wake eventfd
+ */
+int coro_reactor_init(coro_reactor_t *r, coro_sched_t *s) {
+    r->sched = s;
+    r->num_timers = 0;
+    r->max_timers = s->backend->max_coros;
+    r->waits = 0;
+    r->polls = 0;
+    r->batch_writes = false;
+    r->dirty = -1;
+    r->write_calls = 0;
+    r->writes = 0;
+    r->poll_mode = CORO_POLL_BLOCK;
+    r->spin_max_ns = 0;
+    r->spin_ns = 0;
+    r->spins = 0;
+    r->spin_hits = 0;
+    r->blocks = 0;
+    r->timers = malloc(sizeof(*r->timers) * (size_t)r->max_timers);
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = r->wake_fd;
+    if (!r->timers || r->epfd < 0 || r->wake_fd < 0 ||
+        epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wake_fd, &ev) < 0) {
+        fprintf(stderr, "Error: Failed to create reactor: %s\n", strerror(errno));
+        free(r->timers);
+        if (r->epfd >= 0) syscall(SYS_close, r->epfd);
+        if (r->wake_fd >= 0) syscall(SYS_close, r->wake_fd);
+        return -1;
+    }
+    
+    coro_sched_set_notify(s, reactor_notify, r);
+    return 0;
+}
+
+/**
+ * Forget the descriptors registered here and close the epoll set
+ */
+void coro_reactor_cleanup(coro_reactor_t *r) {
+    for (int fd = r->dirty; fd >= 0; fd = io_fds[fd].next_dirty) {
+        io_fds[fd].wq_head = NULL;
+        io_fds[fd].wq_tail = NULL;
+        io_fds[fd].flags &= (uint8_t)~(IO_FD_DIRTY | IO_FD_BLOCKED);
+    }
+    r->dirty = -1;
+    for (int fd = 0; fd < CORO_IO_MAX_FDS; fd++) {
+        if (io_fds[fd].reactor == r) {
+            io_fds[fd].reactor = NULL;
+            io_fds[fd].reader = -1;
+            io_fds[fd].writer = -1;
+        }
+    }
+    coro_sched_set_notify(r->sched, NULL, NULL);
+    syscall(SYS_close, r->epfd);
+    syscall(SYS_close, r->wake_fd);
+    free(r->timers);
+    r->timers = NULL;
+}
+
+/**
+ * Turn write batching on or off
+ */
+void coro_reactor_set_batching(coro_reactor_t *r, bool on) {
+    r->batch_writes = on;
+}
+
+/**
+ * Set the idle strategy and restart the adaptive budget
+ */
+void coro_reactor_set_polling(coro_reactor_t *r, coro_poll_mode_t mode, uint64_t spin_max_ns) {
+    r->poll_mode = mode;
+    r->spin_max_ns = mode == CORO_POLL_BLOCK ? 0 : spin_max_ns;
+    r->spin_ns = 0;
+}
+
+/**
+ * Poll without waiting until an event, a remote wake, or end_ns
+ * Returns: result of the last epoll_wait()
+ */
+static int reactor_spin(coro_reactor_t *r, struct epoll_event *events, uint64_t end_ns) {
+    coro_sched_t *s = r->sched;
+    int n;
+    
+    do {
+        n = epoll_wait(r->epfd, events, CORO_REACTOR_EVENTS, 0);
+        r->polls++;
+        if (n != 0 || atomic_load(&s->inbox)) {
+            break;
+        }
+    } while (coro_sched_now_ns() < end_ns);
+    return n;
+}
+
+/**
+ * Resize the adaptive budget after a wait that blocked: double it if the
+ * wait ended with an event within spin_max_ns, otherwise halve it
+ */
+static void reactor_adapt(coro_reactor_t *r, uint64_t idle_ns, bool event) {
+    if (event && idle_ns <= r->spin_max_ns) {
+        r->spin_ns = r->spin_ns > 0 ? r->spin_ns * 2 : CORO_REACTOR_SPIN_START_NS;
+        if (r->spin_ns > r->spin_max_ns) {
+            r->spin_ns = r->spin_max_ns;
+        }
+    } else {
+        r->spin_ns /= 2;
+        if (r->spin_ns < CORO_REACTOR_SPIN_START_NS) {
+            r->spin_ns = 0;
+        }
+    }
+}
+
+/**
+ * Collect I/O readiness and expired timers
+ */
+int coro_reactor_poll(coro_reactor_t *r, int timeout_ms) {
+    coro_sched_t *s = r->sched;
+    int timeout = timeout_ms;
+    
+    /* epoll_wait() counts whole milliseconds: round up so timers are never early */
+    if (timeout != 0 && r->num_timers > 0) {
+        uint64_t now = coro_sched_now_ns();
+        uint64_t due = r->timers[0]->deadline_ns;
+        int ms = due <= now ? 0 : (int)((due - now + 999999) / 1000000);
+        if (timeout < 0 || ms < timeout) {
+            timeout = ms;
+        }
+    }
+    
+    struct epoll_event events[CORO_REACTOR_EVENTS];
+    uint64_t idle_start = 0;
+    bool block = true;
+    int n = 0;
+    
+    /* Spin first, in case the next event comes before a sleep would pay off */
+    if (timeout != 0 && r->poll_mode != CORO_POLL_BLOCK) {
+        uint64_t budget = r->poll_mode == CORO_POLL_SPIN ? r->spin_max_ns : r->spin_ns;
+        idle_start = coro_sched_now_ns();
+        if (timeout > 0 && budget > (uint64_t)timeout * 1000000ULL) {
+            budget = (uint64_t)timeout * 1000000ULL;
+        }
+        if (budget > 0) {
+            r->spins++;
+            n = reactor_spin(r, events, idle_start + budget);
+            if (n != 0 || atomic_load(&s->inbox)) {
+                r->spin_hits += n > 0;
+                block = false;
+            } else if (timeout > 0) {
+                /* Take off whole milliseconds only, so timers are never early */
+                timeout -= (int)((coro_sched_now_ns() - idle_start) / 1000000);
+            }
+        }
+    }
+    
+    if (block) {
+        /* Same handshake as coro_sched_wait_remote(), with the eventfd as wake */
+        bool sleeping = timeout != 0;
+        if (sleeping) {
+            atomic_store(&s->sleeping, 1);
+            if (atomic_load(&s->inbox)) {
+                timeout = 0;
+            }
+        }
+        
+        n = epoll_wait(r->epfd, events, CORO_REACTOR_EVENTS, timeout);
+        if (sleeping) {
+            atomic_store(&s->sleeping, 0);
+        }
+        r->polls++;
+        if (timeout != 0) {
+            r->blocks++;
+            if (r->poll_mode == CORO_POLL_ADAPTIVE) {
+                reactor_adapt(r, coro_sched_now_ns() - idle_start, n > 0);
+            }
+        }
+    }
+    if (n < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Error: epoll_wait failed: %s\n", strerror(errno));
+            return -1;
+        }
+        n = 0;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == r->wake_fd) {
+            eventfd_t value;
+            eventfd_read(r->wake_fd, &value);
+        } else {
+            io_dispatch(r, events[i].data.fd, events[i].events);
+        }
+    }
+    timer_expire(r);
+    return n;
+}
+
+/**
+ * Alternate between the runnable coroutines and the reactor
+ */
+long long coro_reactor_run(coro_reactor_t *r) {
+    coro_sched_t *s = r->sched;
+    coro_reactor_t *prev = coro_reactor_current;
+    long long steps = 0;
+    
+    coro_reactor_current = r;
+    while (s->live > 0) {
+        int batch = coro_sched_ready_count(s);
+        for (int i = 0; i < batch; i++) {
+            int rc = coro_sched_run_one(s);
+            if (rc < 0) {
+                steps = -1;
+                goto out;
+            }
+            if (rc == 0) break;
+            steps++;
+        }
+        if (r->dirty >= 0) {
+            reactor_flush(r);
+        }
+        if (s->live > 0 && coro_reactor_poll(r, s->ready > 0 ? 0 : -1) < 0) {
+            steps = -1;
+            break;
+        }
+    }
+    
+out:
+    coro_reactor_current = prev;
+    return steps;
+}
+
+/* ============================================================
+ * BLOCKING CALLS
+ * ============================================================ */
+
+/**
+ * Check for a stackful coroutine run by a reactor
+ */
+bool coro_io_in_coroutine(void) {
+    return io_reactor() != NULL;
+}
+
+/**
+ * Park until fd is ready for events or timeout_ms passes
+ */
+static int io_wait(int fd, short events, int timeout_ms) {
+    coro_reactor_t *r = io_reactor();
+    io_fd_t *e = r ? io_track(fd) : NULL;
+    if (!e) {
+        return -1;
+    }
+    
+    uint64_t deadline = timeout_ms >= 0 ? coro_sched_now_ns() + (uint64_t)timeout_ms * 1000000ULL
+                                        : 0;
+    return io_wait_fd(r, fd, e, (events & POLLIN) ? IO_FD_READABLE : IO_FD_WRITABLE, deadline);
+}
+
+/**
+ * read(2), yielding while no input is available
+ */
+static ssize_t io_read(int fd, void *buf, size_t count) {
+    if (io_reactor()) {
+        io_track(fd);
+    }
+    for (;;) {
+        ssize_t n = syscall(SYS_read, fd, buf, count);
+        if (n >= 0 || errno != EAGAIN || !io_retry(fd, POLLIN)) {
+            return n;
+        }
+    }
+}
+
+/**
+ * write(2), yielding while the descriptor is full, or queued for the
+ * end of the pass when batching
+ */
+static ssize_t io_write(int fd, const void *buf, size_t count) {
+    coro_reactor_t *r = io_reactor();
+    if (r) {
+        io_fd_t *e = io_track(fd);
+        if (r->batch_writes && count > 0 && e && (e->flags & IO_FD_FORCED)) {
+            return io_write_batched(r, fd, e, buf, count, NULL, 0);
+        }
+    }
+    for (;;) {
+        ssize_t n = syscall(SYS_write, fd, buf, count);
+        if (r) {
+            r->write_calls++;
+            r->writes += n >= 0;
+        }
+        if (n >= 0 || errno != EAGAIN || !io_retry(fd, POLLOUT)) {
+            return n;
+        }
+    }
+}
+
+/**
+ * sendto(2), yielding while the socket is full, or queued for the end
+ * of the pass when batching (flags must be 0 to be batched)
+ */
+static ssize_t io_sendto(int fd, const void *buf, size_t len, int flags,
+                         const struct sockaddr *addr, socklen_t addr_len) {
+    coro_reactor_t *r = io_reactor();
+    if (r) {
+        io_fd_t *e = io_track(fd);
+        if (r->batch_writes && flags == 0 && e && (e->flags & IO_FD_FORCED)) {
+            return io_write_batched(r, fd, e, buf, len, addr, addr_len);
+        }
+    }
+    for (;;) {
+        ssize_t n = syscall(SYS_sendto, fd, buf, len, flags, addr, addr_len);
+        if (r) {
+            r->write_calls++;
+            r->writes += n >= 0;
+        }
+        if (n >= 0 || errno != EAGAIN || !io_retry(fd, POLLOUT)) {
+            return n;
+        }
+    }
+}
+
+/**
+ * connect(2), yielding until the connection is established or fails
+ */
+static int io_connect(int fd, const struct sockaddr *addr, socklen_t len) {
+    if (io_reactor()) {
+        io_track(fd);
+    }
+    if (syscall(SYS_connect, fd, addr, len) == 0) {
+        return 0;
+    }
+    if (errno != EINPROGRESS) {
+        return -1;
+    }
+    
+    static const struct timespec no_wait = { 0, 0 };
+    struct pollfd p = { fd, POLLOUT, 0 };
+    do {
+        if (!io_retry(fd, POLLOUT)) {
+            errno = EINPROGRESS;
+            return -1;
+        }
+    } while (ppoll(&p, 1, &no_wait, NULL) == 0);
+    
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0) {
+        return -1;
+    }
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * accept(2), yielding until a connection arrives
+ */
+static int io_accept(int fd, struct sockaddr *addr, socklen_t *len) {
+    if (io_reactor()) {
+        io_track(fd);
+    }
+    for (;;) {
+        int conn = (int)syscall(SYS_accept4, fd, addr, len, 0);
+        if (conn >= 0) {
+            io_forget(conn);
+            return conn;
+        }
+        if (errno != EAGAIN || !io_retry(fd, POLLIN)) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * Park until one of fds may be ready or the deadline (0 = none)
+ * Slots other coroutines hold fall back to rechecking every
+ * IO_SHARED_RECHECK_NS.
+ */
+static void io_wait_any(coro_reactor_t *r, const struct pollfd *fds, nfds_t nfds,
+                        uint64_t deadline_ns) {
+    int id = r->sched->current;
+    bool shared = false, pending = false;
+    
+    for (nfds_t i = 0; i < nfds; i++) {
+        io_fd_t *e = io_track(fds[i].fd);
+        if (!e || io_register(r, fds[i].fd, e) < 0) {
+            shared = true;
+            continue;
+        }
+        if (fds[i].events & POLLIN) {
+            pending |= (e->flags & IO_FD_READABLE) != 0;
+            if (e->reader < 0) e->reader = id;
+            else if (e->reader != id) shared = true;
+        }
+        if (fds[i].events & POLLOUT) {
+            pending |= (e->flags & IO_FD_WRITABLE) != 0;
+            if (e->writer < 0) e->writer = id;
+            else if (e->writer != id) shared = true;
+        }
+    }
+    
+    if (!pending) {
+        io_park(r, shared ? io_shared_due(deadline_ns) : deadline_ns);
+    }
+    
+    for (nfds_t i = 0; i < nfds; i++) {
+        int fd = fds[i].fd;
+        if (fd < 0 || fd >= CORO_IO_MAX_FDS) continue;
+        io_fd_t *e = &io_fds[fd];
+        if (fds[i].events & POLLIN) {
+            if (e->reader == id) e->reader = -1;
+            e->flags &= (uint8_t)~IO_FD_READABLE;
+        }
+        if (fds[i].events & POLLOUT) {
+            if (e->writer == id) e->writer = -1;
+            e->flags &= (uint8_t)~IO_FD_WRITABLE;
+        }
+    }
+}
+
+/**
+ * poll(2), yielding until a descriptor is ready or the timeout
+ */
+static int io_poll(struct pollfd *fds, nfds_t nfds, int timeout_ms) {
+    coro_reactor_t *r = io_reactor();
+    if (!r) {
+        struct timespec ts = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        return ppoll(fds, nfds, timeout_ms < 0 ? NULL : &ts, NULL);
+    }
+    
+    static const struct timespec no_wait = { 0, 0 };
+    uint64_t deadline = timeout_ms > 0 ? coro_sched_now_ns() + (uint64_t)timeout_ms * 1000000ULL
+                                       : 0;
+    for (;;) {
+        int n = ppoll(fds, nfds, &no_wait, NULL);
+        if (n != 0 || timeout_ms == 0) {
+            return n;
+        }
+        if (deadline && coro_sched_now_ns() >= deadline) {
+            return 0;
+        }
+        io_wait_any(r, fds, nfds, deadline);
+    }
+}
+
+/**
+ * usleep(3), yielding until the time has passed
+ */
+static int io_usleep(useconds_t usec) {
+    coro_reactor_t *r = io_reactor();
+    if (!r) {
+        struct timespec ts = { usec / 1000000, (long)(usec % 1000000) * 1000L };
+        return nanosleep(&ts, NULL);
+    }
+    
+    io_park(r, coro_sched_now_ns() + (uint64_t)usec * 1000ULL);
+    return 0;
+}
+
+/**
+ * close(2), restoring the descriptor's blocking mode and resetting its
+ * state first
+ */
+static int io_close(int fd) {
+    io_restore(fd);
+    io_forget(fd);
+    return (int)syscall(SYS_close, fd);
+}
+
+/* ============================================================
+ * ENTRY POINTS
+ * ============================================================ */
+
+/*
+ * A preemptible coroutine switched out halfway through a call would
+ * leave the descriptor table and timer heap to the next coroutine half
+ * updated, so every call runs with preemption deferred.
+ */
+
+/**
+ * Park until fd is ready for events or timeout_ms passes
+ */
+int coro_io_wait(int fd, short events, int timeout_ms) {
+    coro_ucontext_preempt_disable_fast();
+    int rc = io_wait(fd, events, timeout_ms);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * read(2) on the reactor
+ */
+ssize_t coro_io_read(int fd, void *buf, size_t count) {
+    coro_ucontext_preempt_disable_fast();
+    ssize_t rc = io_read(fd, buf, count);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * write(2) on the reactor
+ */
+ssize_t coro_io_write(int fd, const void *buf, size_t count) {
+    coro_ucontext_preempt_disable_fast();
+    ssize_t rc = io_write(fd, buf, count);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * sendto(2) on the reactor
+ */
+ssize_t coro_io_sendto(int fd, const void *buf, size_t len, int flags,
+                       const struct sockaddr *addr, socklen_t addr_len) {
+    coro_ucontext_preempt_disable_fast();
+    ssize_t rc = io_sendto(fd, buf, len, flags, addr, addr_len);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * connect(2) on the reactor
+ */
+int coro_io_connect(int fd, const struct sockaddr *addr, socklen_t len) {
+    coro_ucontext_preempt_disable_fast();
+    int rc = io_connect(fd, addr, len);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * accept(2) on the reactor
+ */
+int coro_io_accept(int fd, struct sockaddr *addr, socklen_t *len) {
+    coro_ucontext_preempt_disable_fast();
+    int rc = io_accept(fd, addr, len);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * poll(2) on the reactor
+ */
+int coro_io_poll(struct pollfd *fds, nfds_t nfds, int timeout_ms) {
+    coro_ucontext_preempt_disable_fast();
+    int rc = io_poll(fds, nfds, timeout_ms);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * usleep(3) on the reactor
+ */
+int coro_io_usleep(useconds_t usec) {
+    coro_ucontext_preempt_disable_fast();
+    int rc = io_usleep(usec);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * close(2) on the reactor
+ */
+int coro_io_close(int fd) {
+    coro_ucontext_preempt_disable_fast();
+    int rc = io_close(fd);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/* ============================================================
+ * HOOK TABLE
+ * ============================================================ */
+
+/**
+ * Record that the LD_PRELOAD shim found the table
+ */
+static void io_attach(void) {
+    atomic_store(&io_attached, true);
+}
+
+const coro_io_hooks_t coro_io_hooks = {
+    CORO_IO_HOOKS_VERSION,
+    io_attach,
+    coro_io_read,
+    coro_io_write,
+    coro_io_connect,
+    coro_io_accept,
+    coro_io_poll,
+    coro_io_usleep,
+    coro_io_close,
+};
+
+/**
+ * Check whether the shim has attached
+ */
+bool coro_io_hooks_attached(void) {
+    return atomic_load(&io_attached);
+}
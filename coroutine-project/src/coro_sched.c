@@ -0,0 +1,620 @@
+/**
+ * coro_sched.c
+ * Priority and Deadline Scheduler Implementation
+ *
+ * Priority classes are singly linked FIFOs threaded through the task
+ * table, with a bitmap of the non-empty ones; the deadline class is a
+ * binary min-heap of coroutine IDs keyed by deadline, each task keeping
+ * its heap position so a deadline can be moved in O(log n).
+ */
+#define _GNU_SOURCE
+
+#include "coro_sched.h"
+#include "coro_stats.h"
+#include "coro_ucontext.h"
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+_Thread_local coro_sched_t *coro_sched_running = NULL;
+_Thread_local uint64_t coro_sched_slice_end = UINT64_MAX;
+_Thread_local int coro_sched_clock_countdown = CORO_SCHED_CLOCK_STRIDE;
+
+/* ============================================================
+ * DEADLINE HEAP
+ * ============================================================ */
+
+/**
+ * Put id at heap position i and record the position
+ */
+static void heap_place(coro_sched_t *s, int i, int id) {
+    s->heap[i] = id;
+    s->tasks[id].heap_index = i;
+}
+
+/**
+ * Move the entry at position i towards the root while it is earlier
+ */
+static void heap_sift_up(coro_sched_t *s, int i) {
+    int id = s->heap[i];
+    uint64_t deadline = s->tasks[id].deadline_ns;
+    
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (s->tasks[s->heap[parent]].deadline_ns <= deadline) break;
+        heap_place(s, i, s->heap[parent]);
+        i = parent;
+    }
+    heap_place(s, i, id);
+}
+
+/**
+ * Move the entry at position i towards the leaves while it is later
+ */
+static void heap_sift_down(coro_sched_t *s, int i) {
+    int id = s->heap[i];
+    uint64_t deadline = s->tasks[id].deadline_ns;
+    
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s->heap_size) break;
+        if (child + 1 < s->heap_size &&
+            s->tasks[s->heap[child + 1]].deadline_ns < s->tasks[s->heap[child]].deadline_ns) {
+            child++;
+        }
+        if (s->tasks[s->heap[child]].deadline_ns >= deadline) break;
+        heap_place(s, i, s->heap[child]);
+        i = child;
+    }
+    heap_place(s, i, id);
+}
+
+/**
+ * Remove and return the earliest-deadline coroutine
+ */
+static int heap_pop(coro_sched_t *s) {
+    int id = s->heap[0];
+    
+    if (--s->heap_size > 0) {
+        heap_place(s, 0, s->heap[s->heap_size]);
+        heap_sift_down(s, 0);
+    }
+    return id;
+}
+
+/* ============================================================
+ * RUN QUEUE
+ * ============================================================ */
+
+/**
+ * Queue a coroutine at the back of its class
+ */
+static void enqueue(coro_sched_t *s, int id) {
+    coro_sched_task_t *t = &s->tasks[id];
+    
+    t->state = CORO_SCHED_READY;
+    s->ready++;
+    
+    if (t->priority == CORO_SCHED_DEADLINE) {
+        heap_place(s, s->heap_size++, id);
+        heap_sift_up(s, t->heap_index);
+        return;
+    }
+    
+    coro_sched_fifo_t *q = &s->fifo[t->priority];
+    t->next = -1;
+    if (q->tail >= 0) {
+        s->tasks[q->tail].next = id;
+    } else {
+        q->head = id;
+        s->nonempty |= 1u << t->priority;
+    }
+    q->tail = id;
+}
+
+/**
+ * Parked time is blocked, not ready: keep it out of the wait accounting
+ */
+static void mark_parked(coro_sched_t *s, int id) {
+    s->tasks[id].state = CORO_SCHED_PARKED;
+    if (s->backend->stats) {
+        coro_stats_parked(&s->backend->stats[id]);
+    }
+}
+
+/**
+ * Wait accounting restarts when a parked coroutine is woken
+ */
+static void mark_woken(coro_sched_t *s, int id) {
+    if (s->backend->stats) {
+        coro_stats_ready(&s->backend->stats[id]);
+    }
+    enqueue(s, id);
+}
+
+/**
+ * Take the next coroutine to run (deadline class first)
+ * Returns: coroutine ID, or -1 if nothing is runnable
+ */
+static int dequeue(coro_sched_t *s) {
+    int id;
+    
+    if (s->heap_size > 0) {
+        id = heap_pop(s);
+    } else if (s->nonempty) {
+        int p = __builtin_ctz(s->nonempty);
+        coro_sched_fifo_t *q = &s->fifo[p];
+        id = q->head;
+        q->head = s->tasks[id].next;
+        if (q->head < 0) {
+            q->tail = -1;
+            s->nonempty &= ~(1u << p);
+        }
+    } else {
+        return -1;
+    }
+    
+    s->ready--;
+    return id;
+}
+
+/* ============================================================
+ * SCHEDULER API
+ * ============================================================ */
+
+/**
+ * Initialize a scheduler and its backend
+ */
+int coro_sched_init(coro_sched_t *s, const coro_backend_t *backend) {
+    s->backend = backend;
+    s->tasks = calloc((size_t)backend->max_coros, sizeof(*s->tasks));
+    s->heap = malloc(sizeof(int) * (size_t)backend->max_coros);
+    if (!s->tasks || !s->heap) {
+        fprintf(stderr, "Error: Failed to allocate scheduler for %d coroutines\n",
+                backend->max_coros);
+        free(s->tasks);
+        free(s->heap);
+        return -1;
+    }
+    
+    for (int p = 0; p < CORO_SCHED_PRIORITIES; p++) {
+        s->fifo[p].head = s->fifo[p].tail = -1;
+    }
+    s->nonempty = 0;
+    s->heap_size = 0;
+    s->ready = 0;
+    s->live = 0;
+    s->current = -1;
+    s->park_current = false;
+    s->slice_ticks = 0;
+    atomic_init(&s->inbox, NULL);
+    atomic_init(&s->sleeping, 0);
+    s->notify = NULL;
+    s->notify_ctx = NULL;
+    s->idle = CORO_IDLE_PARK;
+    s->spin_max_ns = 0;
+    s->spin_ns = 0;
+    s->idle_waits = 0;
+    s->idle_hits = 0;
+    
+    backend->init();
+    return 0;
+}
+
+/**
+ * Destroy managed coroutines and free the scheduler
+ */
+void coro_sched_cleanup(coro_sched_t *s) {
+    for (int id = 0; id < s->backend->max_coros && s->live > 0; id++) {
+        if (s->tasks[id].state != CORO_SCHED_FREE) {
+            s->backend->destroy(id);
+            s->live--;
+        }
+    }
+    s->backend->cleanup();
+    free(s->tasks);
+    free(s->heap);
+    s->tasks = NULL;
+    s->heap = NULL;
+}
+
+/**
+ * Create a coroutine in a class and queue it
+ * Like every entry point that changes the run queue, it runs with
+ * preemption deferred: a preemptible stackful caller switched out
+ * halfway would leave the queue to the next coroutine half updated.
+ */
+static int spawn(coro_sched_t *s, coro_step_fn_t step, void *arg, int priority,
+                 uint64_t deadline_ns) {
+    coro_ucontext_preempt_disable_fast();
+    int id = s->backend->create(step, arg);
+    if (id >= 0) {
+        coro_sched_task_t *t = &s->tasks[id];
+        t->priority = (int8_t)priority;
+        t->deadline_ns = deadline_ns;
+        s->live++;
+        enqueue(s, id);
+    }
+    coro_ucontext_preempt_enable_fast();
+    return id;
+}
+
+/**
+ * Create a runnable coroutine in a priority class
+ */
+int coro_sched_spawn(coro_sched_t *s, coro_step_fn_t step, void *arg, int priority) {
+    if (priority < 0 || priority >= CORO_SCHED_PRIORITIES) {
+        fprintf(stderr, "Error: Priority %d out of range 0..%d\n", priority,
+                CORO_SCHED_PRIORITIES - 1);
+        return -1;
+    }
+    return spawn(s, step, arg, priority, 0);
+}
+
+/**
+ * Create a runnable coroutine in the deadline class
+ */
+int coro_sched_spawn_deadline(coro_sched_t *s, coro_step_fn_t step, void *arg,
+                              uint64_t deadline_ns) {
+    return spawn(s, step, arg, CORO_SCHED_DEADLINE, deadline_ns);
+}
+
+/**
+ * Park the running coroutine after its step
+ */
+void coro_sched_park(coro_sched_t *s) {
+    s->park_current = true;
+}
+
+/**
+ * Make a parked coroutine runnable (preemption deferred by the caller)
+ */
+static int wake(coro_sched_t *s, int id) {
+    switch (s->tasks[id].state) {
+        case CORO_SCHED_PARKED:
+            mark_woken(s, id);
+            return 0;
+        case CORO_SCHED_RUNNING:
+            s->park_current = false;
+            return 0;
+        case CORO_SCHED_READY:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Make a parked coroutine runnable
+ */
+int coro_sched_wake(coro_sched_t *s, int id) {
+    if (id < 0 || id >= s->backend->max_coros) {
+        return -1;
+    }
+    
+    coro_ucontext_preempt_disable_fast();
+    int rc = wake(s, id);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * Move a coroutine into the deadline class (preemption deferred by the caller)
+ */
+static int wake_deadline(coro_sched_t *s, int id, uint64_t deadline_ns) {
+    coro_sched_task_t *t = &s->tasks[id];
+    switch (t->state) {
+        case CORO_SCHED_PARKED:
+            t->priority = CORO_SCHED_DEADLINE;
+            t->deadline_ns = deadline_ns;
+            mark_woken(s, id);
+            return 0;
+        case CORO_SCHED_RUNNING:
+            t->priority = CORO_SCHED_DEADLINE;
+            t->deadline_ns = deadline_ns;
+            s->park_current = false;
+            return 0;
+        case CORO_SCHED_READY:
+            if (t->priority != CORO_SCHED_DEADLINE) {
+                return -1;
+            }
+            t->deadline_ns = deadline_ns;
+            heap_sift_up(s, t->heap_index);
+            heap_sift_down(s, t->heap_index);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * Wake a coroutine into the deadline class
+ */
+int coro_sched_wake_deadline(coro_sched_t *s, int id, uint64_t deadline_ns) {
+    if (id < 0 || id >= s->backend->max_coros) {
+        return -1;
+    }
+    
+    coro_ucontext_preempt_disable_fast();
+    int rc = wake_deadline(s, id, deadline_ns);
+    coro_ucontext_preempt_enable_fast();
+    return rc;
+}
+
+/**
+ * coro_trace_clock() ticks per nanosecond, measured once over about 2 ms
+ */
+static double clock_ticks_per_ns(void) {
+    static double rate = 0.0;
+    if (rate > 0.0) {
+        return rate;
+    }
+    
+    uint64_t start_ns = coro_sched_now_ns();
+    uint64_t start_ticks = coro_trace_clock();
+    uint64_t elapsed_ns;
+    do {
+        elapsed_ns = coro_sched_now_ns() - start_ns;
+    } while (elapsed_ns < 2000000);
+    rate = (double)(coro_trace_clock() - start_ticks) / (double)elapsed_ns;
+    return rate;
+}
+
+/**
+ * Set the time slice checked by coro_maybe_yield()
+ */
+void coro_sched_set_slice(coro_sched_t *s, int slice_us) {
+    if (slice_us <= 0) {
+        s->slice_ticks = 0;
+        return;
+    }
+    s->slice_ticks = (uint64_t)((double)slice_us * 1000.0 * clock_ticks_per_ns());
+    if (s->slice_ticks == 0) {
+        s->slice_ticks = 1;
+    }
+}
+
+/**
+ * Run the next coroutine for one step
+ */
+int coro_sched_run_one(coro_sched_t *s) {
+    if (atomic_load_explicit(&s->inbox, memory_order_relaxed)) {
+        coro_sched_poll_remote(s);
+    }
+    
+    int id = dequeue(s);
+    if (id < 0) {
+        return 0;
+    }
+    
+    coro_sched_task_t *t = &s->tasks[id];
+    t->state = CORO_SCHED_RUNNING;
+    s->current = id;
+    s->park_current = false;
+    
+    /* Nested schedulers (a step running another scheduler) restore ours */
+    coro_sched_t *prev_running = coro_sched_running;
+    uint64_t prev_slice_end = coro_sched_slice_end;
+    int prev_countdown = coro_sched_clock_countdown;
+    coro_sched_running = s;
+    coro_sched_slice_end = s->slice_ticks ? coro_trace_clock() + s->slice_ticks : UINT64_MAX;
+    coro_sched_clock_countdown = CORO_SCHED_CLOCK_STRIDE;
+    
+    int rc = s->backend->resume(id);
+    
+    coro_sched_running = prev_running;
+    coro_sched_slice_end = prev_slice_end;
+    coro_sched_clock_countdown = prev_countdown;
+    s->current = -1;
+    if (rc < 0) {
+        mark_parked(s, id);
+        return -1;
+    }
+    if (rc == 1) {
+        s->backend->destroy(id);
+        t->state = CORO_SCHED_FREE;
+        s->live--;
+    } else if (s->park_current) {
+        mark_parked(s, id);
+    } else {
+        enqueue(s, id);
+    }
+    return 1;
+}
+
+/**
+ * Run until nothing is runnable
+ */
+long long coro_sched_run(coro_sched_t *s) {
+    long long steps = 0;
+    int rc;
+    
+    while ((rc = coro_sched_run_one(s)) > 0) {
+        steps++;
+    }
+    return rc < 0 ? -1 : steps;
+}
+
+/**
+ * Run until every coroutine has finished
+ */
+long long coro_sched_run_all(coro_sched_t *s) {
+    long long steps = 0;
+    
+    while (s->live > 0) {
+        int rc = coro_sched_run_one(s);
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc > 0) {
+            steps++;
+        } else {
+            coro_sched_wait_remote(s);
+        }
+    }
+    return steps;
+}
+
+/* ============================================================
+ * REMOTE WAKES
+ * ============================================================ */
+
+/**
+ * Push a wake onto the inbox and rouse a sleeping home thread
+ */
+void coro_sched_wake_remote(coro_sched_t *s, coro_sched_remote_t *node) {
+    coro_sched_remote_t *head = atomic_load_explicit(&s->inbox, memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!atomic_compare_exchange_weak(&s->inbox, &head, node));
+    
+    /* node may be gone once the home thread sees it; only s is used below */
+    if (atomic_exchange(&s->sleeping, 0) == 1) {
+        if (s->notify) {
+            s->notify(s->notify_ctx);
+        } else {
+            syscall(SYS_futex, &s->sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+    }
+}
+
+/**
+ * Set the wake used for a home thread sleeping outside the futex
+ */
+void coro_sched_set_notify(coro_sched_t *s, coro_sched_notify_fn_t fn, void *ctx) {
+    s->notify = fn;
+    s->notify_ctx = ctx;
+}
+
+/**
+ * Apply arrived remote wakes in arrival order
+ */
+int coro_sched_poll_remote(coro_sched_t *s) {
+    coro_sched_remote_t *node = atomic_exchange_explicit(&s->inbox, NULL, memory_order_acquire);
+    coro_sched_remote_t *fifo = NULL;
+    int count = 0;
+    
+    while (node) {
+        coro_sched_remote_t *next = node->next;
+        node->next = fifo;
+        fifo = node;
+        node = next;
+    }
+    while (fifo) {
+        coro_sched_remote_t *next = fifo->next;
+        coro_sched_wake(s, fifo->id);
+        fifo = next;
+        count++;
+    }
+    return count;
+}
+
+/* ============================================================
+ * IDLE WAITS
+ * ============================================================ */
+
+/**
+ * Spin-wait hint to the CPU
+ */
+static inline void idle_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+/**
+ * Spin on the inbox until it is non-empty or end_ns passes
+ * Returns: true if a wake arrived
+ */
+static bool idle_spin(coro_sched_t *s, uint64_t end_ns) {
+    while (!atomic_load_explicit(&s->inbox, memory_order_relaxed)) {
+        if (end_ns != UINT64_MAX && coro_sched_now_ns() >= end_ns) {
+            return false;
+        }
+        idle_relax();
+    }
+    return true;
+}
+
+/**
+ * Sleep on the futex until the inbox is non-empty
+ */
+static void idle_park(coro_sched_t *s) {
+    while (!atomic_load(&s->inbox)) {
+        atomic_store(&s->sleeping, 1);
+        if (atomic_load(&s->inbox)) {
+            break;
+        }
+        syscall(SYS_futex, &s->sleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+    }
+    atomic_store(&s->sleeping, 0);
+}
+
+/**
+ * Resize the CORO_IDLE_SPIN_PARK budget after a sleep of idle_ns
+ */
+static void idle_adapt(coro_sched_t *s, uint64_t idle_ns) {
+    if (idle_ns <= s->spin_max_ns) {
+        s->spin_ns = s->spin_ns > 0 ? s->spin_ns * 2 : CORO_SCHED_SPIN_START_NS;
+        if (s->spin_ns > s->spin_max_ns) {
+            s->spin_ns = s->spin_max_ns;
+        }
+    } else {
+        s->spin_ns /= 2;
+        if (s->spin_ns < CORO_SCHED_SPIN_START_NS) {
+            s->spin_ns = 0;
+        }
+    }
+}
+
+/**
+ * Set the idle strategy and restart the adaptive budget
+ */
+void coro_sched_set_idle(coro_sched_t *s, coro_sched_idle_t idle, uint64_t spin_max_ns) {
+    s->idle = idle;
+    s->spin_max_ns = idle == CORO_IDLE_PARK || idle == CORO_IDLE_SPIN ? 0 : spin_max_ns;
+    s->spin_ns = 0;
+}
+
+/**
+ * Wait until the inbox is non-empty
+ */
+void coro_sched_wait_remote(coro_sched_t *s) {
+    if (atomic_load(&s->inbox)) {
+        return;
+    }
+    s->idle_waits++;
+    
+    uint64_t start = s->idle == CORO_IDLE_PARK ? 0 : coro_sched_now_ns();
+    switch (s->idle) {
+    case CORO_IDLE_SPIN:
+        idle_spin(s, UINT64_MAX);
+        s->idle_hits++;
+        break;
+    case CORO_IDLE_SPIN_YIELD:
+        if (idle_spin(s, start + s->spin_max_ns)) {
+            s->idle_hits++;
+            break;
+        }
+        while (!atomic_load(&s->inbox)) {
+            sched_yield();
+        }
+        break;
+    case CORO_IDLE_SPIN_PARK:
+        if (s->spin_ns > 0 && idle_spin(s, start + s->spin_ns)) {
+            s->idle_hits++;
+            break;
+        }
+        idle_park(s);
+        idle_adapt(s, coro_sched_now_ns() - start);
+        break;
+    default:
+        idle_park(s);
+        break;
+    }
+}
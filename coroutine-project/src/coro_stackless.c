@@ -6,20 +6,34 @@
  * save their execution point and resume from there on the next call.
  * No separate stack is maintained, making context switches extremely fast.
  */
+#define _GNU_SOURCE
 
 #include "coro_stackless.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-/* Global coroutine pool */
-static coro_stackless_t coro_pool[MAX_COROUTINES];
+/* Global coroutine pool (extern for the inline fast path in the header) */
+coro_stackless_t coro_stackless_pool[MAX_COROUTINES];
 static bool initialized = false;
-static int current_coro_id = -1;
+int coro_stackless_current = -1;
 
 /* Coroutine function storage */
-static coro_func_t coro_functions[MAX_COROUTINES];
-static void *coro_args[MAX_COROUTINES];
+coro_func_t coro_stackless_funcs[MAX_COROUTINES];
+void *coro_stackless_args[MAX_COROUTINES];
+
+/* Run time accounting (see coro_stats.h) */
+coro_stats_counters_t coro_stackless_stats[MAX_COROUTINES];
+
+/*
+ * Slot allocation: destroyed slots go on a free stack, untouched slots
+ * are handed out from the high-water mark. Only [0, pool_high_water)
+ * has ever been used, so create is O(1) and init/cleanup only touch
+ * the part of the pool that was actually used.
+ */
+static int free_slots[MAX_COROUTINES];
+static int num_free_slots = 0;
+static int pool_high_water = 0;
 
 /**
  * Initialize the coroutine system
@@ -27,17 +41,12 @@ static void *coro_args[MAX_COROUTINES];
 void coro_stackless_init(void) {
     if (initialized) return;
     
-    memset(coro_pool, 0, sizeof(coro_pool));
-    memset(coro_functions, 0, sizeof(coro_functions));
-    memset(coro_args, 0, sizeof(coro_args));
+    memset(coro_stackless_pool, 0, sizeof(coro_stackless_pool[0]) * pool_high_water);
+    memset(coro_stackless_funcs, 0, sizeof(coro_stackless_funcs[0]) * pool_high_water);
+    memset(coro_stackless_args, 0, sizeof(coro_stackless_args[0]) * pool_high_water);
     
-    for (int i = 0; i < MAX_COROUTINES; i++) {
-        coro_pool[i].id = i;
-        coro_pool[i].active = false;
-        coro_pool[i].state = CORO_STATE_INIT;
-        coro_pool[i].resume_point = 0;
-        coro_pool[i].user_data = NULL;
-    }
+    num_free_slots = 0;
+    pool_high_water = 0;
     
     initialized = true;
 }
@@ -46,18 +55,22 @@ void coro_stackless_init(void) {
  * Find an available coroutine slot
  */
 static int find_free_slot(void) {
-    for (int i = 0; i < MAX_COROUTINES; i++) {
-        if (!coro_pool[i].active) {
-            return i;
-        }
+    if (num_free_slots > 0) {
+        return free_slots[--num_free_slots];
+    }
+    
+    if (pool_high_water < MAX_COROUTINES) {
+        int slot = pool_high_water++;
+        coro_stackless_pool[slot].id = slot;
+        return slot;
     }
     return -1;
 }
 
 /**
- * Create a new coroutine
+ * Create a coroutine whose run time is summed under stats_func
  */
-int coro_stackless_create(coro_func_t func, void *arg) {
+static int create_coroutine(coro_func_t func, void *arg, coro_stats_func_t stats_func) {
     if (!initialized) {
         coro_stackless_init();
     }
@@ -68,17 +81,28 @@ int coro_stackless_create(coro_func_t func, void *arg) {
         return -1;
     }
     
-    coro_pool[slot].active = true;
-    coro_pool[slot].state = CORO_STATE_INIT;
-    coro_pool[slot].resume_point = 0;
-    coro_pool[slot].user_data = NULL;
+    coro_stackless_pool[slot].active = true;
+    coro_stackless_pool[slot].state = CORO_STATE_INIT;
+    coro_stackless_pool[slot].resume_point = 0;
+    coro_stackless_pool[slot].user_data = NULL;
     
-    coro_functions[slot] = func;
-    coro_args[slot] = arg;
+    coro_stackless_funcs[slot] = func;
+    coro_stackless_args[slot] = arg;
+    coro_stats_attach(&coro_stackless_stats[slot], stats_func, coro_stackless_backend.name);
+    coro_metrics_attach_once();
+    CORO_METRICS_COUNT(CORO_METRICS_STACKLESS, creates, 1);
+    CORO_PROBE3(coro_stackless, create, slot, func, arg);
     
     return slot;
 }
 
+/**
+ * Create a new coroutine
+ */
+int coro_stackless_create(coro_func_t func, void *arg) {
+    return create_coroutine(func, arg, (coro_stats_func_t)func);
+}
+
 /**
  * Resume execution of a coroutine
  */
@@ -87,33 +111,61 @@ int coro_stackless_resume(int coro_id) {
         return -1;
     }
     
-    if (!coro_pool[coro_id].active) {
+    if (!coro_stackless_pool[coro_id].active) {
         return -1;
     }
     
-    if (coro_pool[coro_id].state == CORO_STATE_FINISHED) {
-        return 1;
-    }
-    
-    /* Save previous coroutine context */
-    int prev_coro = current_coro_id;
-    current_coro_id = coro_id;
-    
-    /* Set state to running */
-    coro_pool[coro_id].state = CORO_STATE_RUNNING;
+    return coro_stackless_resume_fast(coro_id);
+}
+
+/**
+ * Resume path taken by coro_stackless_resume_fast() while accounting is on
+ */
+int coro_stackless_resume_accounted(int coro_id) {
+    coro_stackless_t *coro = &coro_stackless_pool[coro_id];
+    int prev_coro = coro_stackless_current;
+    coro_stackless_current = coro_id;
     
-    /* Execute the coroutine function */
-    coro_functions[coro_id](&coro_pool[coro_id], coro_args[coro_id]);
+    uint64_t start = coro_stats_run_begin(&coro_stackless_stats[coro_id]);
+    CORO_PROBE1(coro_stackless, resume, coro_id);
+    CORO_TRACE_EVENT(CORO_TRACE_STACKLESS, CORO_TRACE_RESUME, coro_id);
+    coro->state = CORO_STATE_RUNNING;
+    coro_stackless_funcs[coro_id](coro, coro_stackless_args[coro_id]);
     
-    /* Check final state */
-    if (coro_pool[coro_id].state == CORO_STATE_RUNNING) {
-        coro_pool[coro_id].state = CORO_STATE_SUSPENDED;
+    if (coro->state == CORO_STATE_RUNNING) {
+        coro->state = CORO_STATE_SUSPENDED;
+    }
+    bool finished = coro->state == CORO_STATE_FINISHED;
+    coro_stats_run_end(&coro_stackless_stats[coro_id], start, finished);
+    if (finished) {
+        CORO_PROBE1(coro_stackless, finish, coro_id);
+    } else {
+        CORO_PROBE1(coro_stackless, yield, coro_id);
     }
+    CORO_TRACE_EVENT(CORO_TRACE_STACKLESS, finished ? CORO_TRACE_FINISH : CORO_TRACE_YIELD,
+                     coro_id);
     
-    /* Restore previous context */
-    current_coro_id = prev_coro;
+    coro_stackless_current = prev_coro;
+    return finished ? 1 : 0;
+}
+
+/**
+ * Round-robin a batch, compacting out finished coroutines as it goes
+ */
+long long coro_stackless_interleave(int *ids, int count) {
+    long long resumes = 0;
     
-    return (coro_pool[coro_id].state == CORO_STATE_FINISHED) ? 1 : 0;
+    while (count > 0) {
+        int live = 0;
+        for (int i = 0; i < count; i++) {
+            if (coro_stackless_resume_fast(ids[i]) == 0) {
+                ids[live++] = ids[i];
+            }
+        }
+        resumes += count;
+        count = live;
+    }
+    return resumes;
 }
 
 /**
@@ -131,24 +183,34 @@ void coro_stackless_destroy(int coro_id) {
         return;
     }
     
-    coro_pool[coro_id].active = false;
-    coro_pool[coro_id].state = CORO_STATE_INIT;
-    coro_pool[coro_id].resume_point = 0;
-    coro_pool[coro_id].user_data = NULL;
+    if (!coro_stackless_pool[coro_id].active) {
+        return;
+    }
+    
+    CORO_PROBE1(coro_stackless, destroy, coro_id);
+    CORO_METRICS_COUNT(CORO_METRICS_STACKLESS, destroys, 1);
+    coro_stackless_pool[coro_id].active = false;
+    coro_stackless_pool[coro_id].state = CORO_STATE_INIT;
+    coro_stackless_pool[coro_id].resume_point = 0;
+    coro_stackless_pool[coro_id].user_data = NULL;
+    
+    coro_stackless_funcs[coro_id] = NULL;
+    coro_stackless_args[coro_id] = NULL;
     
-    coro_functions[coro_id] = NULL;
-    coro_args[coro_id] = NULL;
+    free_slots[num_free_slots++] = coro_id;
 }
 
 /**
  * Cleanup entire coroutine system
  */
 void coro_stackless_cleanup(void) {
-    for (int i = 0; i < MAX_COROUTINES; i++) {
-        if (coro_pool[i].active) {
+    for (int i = 0; i < pool_high_water; i++) {
+        if (coro_stackless_pool[i].active) {
             coro_stackless_destroy(i);
         }
     }
+    num_free_slots = 0;
+    pool_high_water = 0;
     initialized = false;
 }
 
@@ -159,5 +221,58 @@ coro_state_t coro_stackless_get_state(int coro_id) {
     if (coro_id < 0 || coro_id >= MAX_COROUTINES) {
         return CORO_STATE_INIT;
     }
-    return coro_pool[coro_id].state;
+    return coro_stackless_pool[coro_id].state;
+}
+
+/**
+ * Get a coroutine's accounting counters
+ */
+int coro_stackless_get_stats(int coro_id, coro_stats_t *out) {
+    if (coro_id < 0 || coro_id >= MAX_COROUTINES || !coro_stackless_pool[coro_id].active) {
+        return -1;
+    }
+    coro_stats_convert(&coro_stackless_stats[coro_id], out);
+    return 0;
 }
+
+/* ============================================================
+ * BACKEND INTERFACE
+ * ============================================================ */
+
+/* Step functions of coroutines created through the backend interface */
+static coro_step_fn_t coro_steps[MAX_COROUTINES];
+
+/**
+ * State machine with a single state: run one step per resume
+ */
+static void step_trampoline(coro_stackless_t *coro, void *arg) {
+    if (coro_steps[coro->id](arg)) {
+        coro->state = CORO_STATE_FINISHED;
+    }
+}
+
+/**
+ * Create a coroutine running a step function (accounted under step)
+ */
+static int backend_create(coro_step_fn_t step, void *arg) {
+    int id = create_coroutine(step_trampoline, arg, (coro_stats_func_t)step);
+    if (id >= 0) {
+        coro_steps[id] = step;
+    }
+    return id;
+}
+
+const coro_backend_t coro_stackless_backend = {
+    .name = "stackless",
+    .label = "Stackless",
+    .caps = 0,
+    .max_coros = MAX_COROUTINES,
+    .init = coro_stackless_init,
+    .cleanup = coro_stackless_cleanup,
+    .create = backend_create,
+    .create_stackful = NULL,
+    .resume = coro_stackless_resume,
+    .yield = NULL,
+    .destroy = coro_stackless_destroy,
+    .stats = coro_stackless_stats,
+};
@@ -0,0 +1,142 @@
+/**
+ * coro_stats.c
+ * Per-Entry-Function Accounting Totals and Tick Conversion
+ */
+#define _GNU_SOURCE
+
+#include "coro_stats.h"
+#include <string.h>
+#include <time.h>
+
+bool coro_stats_enabled = false;
+
+/* Totals of one entry function (counters first: func_stats points at them) */
+typedef struct {
+    coro_stats_counters_t counters;
+    coro_stats_func_t func;
+    const char *backend;
+    long long coroutines;
+} func_totals_t;
+
+static func_totals_t func_totals[CORO_STATS_MAX_FUNCS];
+static int num_func_totals = 0;
+
+/* Time origin: clock and CLOCK_MONOTONIC at coro_stats_enable(true) */
+static uint64_t origin_ticks = 0;
+static long long origin_ns = 0;
+
+/**
+ * Monotonic time in nanoseconds
+ */
+static long long stats_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Clock ticks per nanosecond, measured since accounting was enabled
+ */
+static double ticks_per_ns(void) {
+    long long elapsed_ns = stats_time_ns() - origin_ns;
+    if (origin_ns == 0 || elapsed_ns <= 0) {
+        return 1.0;
+    }
+    return (double)(coro_trace_clock() - origin_ticks) / (double)elapsed_ns;
+}
+
+/**
+ * Start or stop accounting
+ */
+void coro_stats_enable(bool enable) {
+    if (enable && origin_ns == 0) {
+        origin_ticks = coro_trace_clock();
+        origin_ns = stats_time_ns();
+    }
+    coro_stats_enabled = enable;
+}
+
+/**
+ * Clear every per-function total
+ * Functions stay registered, so live coroutines keep valid links.
+ */
+void coro_stats_reset(void) {
+    for (int i = 0; i < num_func_totals; i++) {
+        memset(&func_totals[i].counters, 0, sizeof(func_totals[i].counters));
+        func_totals[i].coroutines = 0;
+    }
+}
+
+/**
+ * Find or add the totals of an entry function (NULL if the table is full)
+ */
+static func_totals_t *find_func_totals(coro_stats_func_t func, const char *backend) {
+    for (int i = 0; i < num_func_totals; i++) {
+        if (func_totals[i].func == func && func_totals[i].backend == backend) {
+            return &func_totals[i];
+        }
+    }
+    if (num_func_totals == CORO_STATS_MAX_FUNCS) {
+        return NULL;
+    }
+    
+    func_totals_t *t = &func_totals[num_func_totals++];
+    memset(t, 0, sizeof(*t));
+    t->func = func;
+    t->backend = backend;
+    return t;
+}
+
+/**
+ * Reset a coroutine's counters and link them to its function's totals
+ */
+void coro_stats_attach(coro_stats_counters_t *c, coro_stats_func_t func, const char *backend) {
+    memset(c, 0, sizeof(*c));
+    
+    if (!coro_stats_enabled) {
+        return;
+    }
+    
+    func_totals_t *t = find_func_totals(func, backend);
+    if (t) {
+        t->coroutines++;
+        c->func_stats = &t->counters;
+    }
+    c->ready_since = coro_trace_clock();
+}
+
+/**
+ * Convert raw counters to nanoseconds
+ */
+void coro_stats_convert(const coro_stats_counters_t *c, coro_stats_t *out) {
+    double rate = ticks_per_ns();
+    
+    memset(out, 0, sizeof(*out));
+    out->resumes = c->resumes;
+    out->run_ns = (double)c->run_ticks / rate;
+    out->max_run_ns = (double)c->max_run_ticks / rate;
+    out->wait_ns = (double)c->wait_ticks / rate;
+    out->max_wait_ns = (double)c->max_wait_ticks / rate;
+}
+
+/**
+ * Number of entry functions with totals
+ */
+int coro_stats_func_count(void) {
+    return num_func_totals;
+}
+
+/**
+ * Totals of one entry function by index
+ */
+int coro_stats_func(int index, coro_stats_t *out) {
+    if (index < 0 || index >= num_func_totals) {
+        return -1;
+    }
+    
+    coro_stats_convert(&func_totals[index].counters, out);
+    out->func = func_totals[index].func;
+    out->backend = func_totals[index].backend;
+    out->coroutines = func_totals[index].coroutines;
+    return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * coro_trace.c
+ * Coroutine Switch Tracer and Chrome Trace Exporter
+ *
+ * Rings are allocated on a thread's first event and pushed onto a
+ * lock-free list; they live until the process exits so the exporter
+ * can read them after the traced threads are gone.
+ */
+#define _GNU_SOURCE
+
+#include "coro_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+bool coro_trace_enabled = false;
+_Thread_local coro_trace_ring_t *coro_trace_ring = NULL;
+
+/* Every ring ever attached, newest first */
+static _Atomic(coro_trace_ring_t *) trace_rings = NULL;
+static atomic_int trace_num_threads = 0;
+
+/* Time origin: clock and CLOCK_MONOTONIC at coro_trace_enable(true) */
+static uint64_t origin_tsc = 0;
+static long long origin_ns = 0;
+
+static const char *const backend_names[] = { "stackless", "ucontext" };
+
+/**
+ * Monotonic time in nanoseconds
+ */
+static long long trace_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Allocate the calling thread's ring and push it onto the ring list
+ */
+coro_trace_ring_t *coro_trace_ring_attach(void) {
+    coro_trace_ring_t *ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+    
+    ring->thread_index = atomic_fetch_add(&trace_num_threads, 1);
+    ring->next = atomic_load(&trace_rings);
+    while (!atomic_compare_exchange_weak(&trace_rings, &ring->next, ring)) {
+    }
+    
+    coro_trace_ring = ring;
+    return ring;
+}
+
+/**
+ * Start or stop recording
+ */
+void coro_trace_enable(bool enable) {
+    if (enable) {
+        origin_tsc = coro_trace_clock();
+        origin_ns = trace_time_ns();
+    }
+    coro_trace_enabled = enable;
+}
+
+/**
+ * Drop every recorded event
+ */
+void coro_trace_reset(void) {
+    for (coro_trace_ring_t *ring = atomic_load(&trace_rings); ring; ring = ring->next) {
+        atomic_store(&ring->head, 0);
+    }
+}
+
+/**
+ * Export one ring; resume opens a slice, yield and finish close it
+ * Events closing a slice whose resume was overwritten are dropped.
+ * Returns: number of events written
+ */
+static long long export_ring(FILE *f, coro_trace_ring_t *ring, double ticks_per_us,
+                             bool *first) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t start = head > CORO_TRACE_RING_SIZE ? head - CORO_TRACE_RING_SIZE : 0;
+    long long written = 0;
+    int depth = 0;
+    
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"coroutine thread %d\"}}",
+            *first ? "" : ",", ring->thread_index, ring->thread_index);
+    *first = false;
+    
+    for (uint64_t i = start; i < head; i++) {
+        const coro_trace_record_t *rec = &ring->records[i & (CORO_TRACE_RING_SIZE - 1)];
+        const char *backend = rec->backend < 2 ? backend_names[rec->backend] : "unknown";
+        double ts = (double)(int64_t)(rec->tsc - origin_tsc) / ticks_per_us;
+        
+        if (rec->event == CORO_TRACE_RESUME) {
+            depth++;
+            fprintf(f, ",\n{\"name\":\"%s %d\",\"cat\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":%d,\"args\":{\"coro\":%d}}",
+                    backend, rec->coro_id, backend, ts, ring->thread_index, rec->coro_id);
+        } else {
+            if (depth == 0) {
+                continue;
+            }
+            depth--;
+            fprintf(f, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                    ts, ring->thread_index);
+            if (rec->event == CORO_TRACE_FINISH) {
+                fprintf(f, ",\n{\"name\":\"finish %d\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                        rec->coro_id, backend, ts, ring->thread_index);
+            }
+        }
+        written++;
+    }
+    return written;
+}
+
+/**
+ * Write all rings as Chrome trace JSON
+ */
+long long coro_trace_export_chrome(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot open trace file %s\n", path);
+        return -1;
+    }
+    
+    /* Clock ticks per microsecond, measured since the trace was enabled */
+    double ticks_per_us = 1000.0;
+    long long elapsed_ns = trace_time_ns() - origin_ns;
+    if (origin_ns > 0 && elapsed_ns > 0) {
+        ticks_per_us = (double)(coro_trace_clock() - origin_tsc) * 1000.0 / (double)elapsed_ns;
+    }
+    
+    long long written = 0;
+    bool first = true;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (coro_trace_ring_t *ring = atomic_load(&trace_rings); ring; ring = ring->next) {
+        written += export_ring(f, ring, ticks_per_us, &first);
+    }
+    fprintf(f, "\n]}\n");
+    
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Error: Failed to write trace file %s\n", path);
+        return -1;
+    }
+    return written;
+}
@@ -6,17 +6,43 @@
  * separate stacks. Context switches involve saving/restoring CPU registers
  * and switching stack pointers, which is slower than stackless approach.
  */
+#define _GNU_SOURCE
 
 #include "coro_ucontext.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
-/* Global coroutine pool */
-static coro_ucontext_t ucoro_pool[MAX_UCONTEXT_COROUTINES];
+/* Global coroutine pool (extern for the inline fast path in the header) */
+coro_ucontext_t coro_ucontext_pool[MAX_UCONTEXT_COROUTINES];
 static bool initialized = false;
-static int current_ucoro_id = -1;
-static ucontext_t main_context;
+int coro_ucontext_current = -1;
+ucontext_t coro_ucontext_main;
+
+/* Run time accounting (see coro_stats.h) */
+coro_stats_counters_t coro_ucontext_stats[MAX_UCONTEXT_COROUTINES];
+
+/* Coroutine-local storage: the main context's slots and the key table */
+static void *main_locals[UCORO_LOCAL_KEYS];
+void **coro_ucontext_locals = main_locals;
+static bool local_key_used[UCORO_LOCAL_KEYS];
+static void (*local_key_destructors[UCORO_LOCAL_KEYS])(void *);
+
+/* Preemption timer, the handler it replaced, and forced yields so far */
+static timer_t preempt_timer;
+static bool preempt_running = false;
+static struct sigaction preempt_old_action;
+static volatile long long preemptions = 0;
+
+/* glibc before 2.35 only has the raw field */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
 
 /* Coroutine function storage */
 typedef struct {
@@ -27,25 +53,51 @@ typedef struct {
 
 static coro_wrapper_args_t wrapper_args[MAX_UCONTEXT_COROUTINES];
 
+/* Free-slot stack and high-water mark (see coro_stackless.c) */
+static int free_ucoro_slots[MAX_UCONTEXT_COROUTINES];
+static int num_free_ucoro_slots = 0;
+static int ucoro_high_water = 0;
+
+/* Stack sizing mode and per-function stack profiles */
+static ucoro_stack_mode_t stack_mode = UCORO_STACK_FIXED;
+static ucoro_stack_profile_t stack_profiles[UCORO_MAX_STACK_PROFILES];
+static int num_stack_profiles = 0;
+static size_t stack_bytes_allocated = 0;
+
+/* Stack top coloring: number of colors and the next one handed out */
+static int stack_colors = 0;
+static unsigned int next_stack_color = 0;
+
+/* Word written over painted stack memory */
+#define UCORO_PAINT_WORD 0x5AC3A55AC35A3CA5ULL
+
+static void record_stack_usage(coro_ucontext_t *coro, ucoro_func_t func);
+static void release_locals(coro_ucontext_t *coro);
+
 /**
  * Wrapper function that runs the user's coroutine function
  */
 static void coro_wrapper(void) {
-    int id = current_ucoro_id;
+    int id = coro_ucontext_current;
     
     if (id >= 0 && id < MAX_UCONTEXT_COROUTINES) {
-        ucoro_pool[id].state = UCORO_STATE_RUNNING;
+        coro_ucontext_pool[id].state = UCORO_STATE_RUNNING;
+        coro_ucontext_pool[id].preempt_ticks = 0;
         
         /* Execute user function */
         wrapper_args[id].func(wrapper_args[id].arg);
         
+        /* Still on the coroutine stack, so the high-water mark is final */
+        record_stack_usage(&coro_ucontext_pool[id], wrapper_args[id].func);
+        
         /* Mark as finished */
-        ucoro_pool[id].state = UCORO_STATE_FINISHED;
+        CORO_PROBE1(coro_ucontext, finish, id);
+        coro_ucontext_pool[id].state = UCORO_STATE_FINISHED;
     }
     
     /* Return to caller */
-    if (ucoro_pool[id].caller) {
-        setcontext(ucoro_pool[id].caller);
+    if (coro_ucontext_pool[id].caller) {
+        setcontext(coro_ucontext_pool[id].caller);
     }
 }
 
@@ -55,28 +107,448 @@ static void coro_wrapper(void) {
 void coro_ucontext_init(void) {
     if (initialized) return;
     
-    memset(ucoro_pool, 0, sizeof(ucoro_pool));
-    memset(wrapper_args, 0, sizeof(wrapper_args));
+    memset(coro_ucontext_pool, 0, sizeof(coro_ucontext_pool[0]) * ucoro_high_water);
+    memset(wrapper_args, 0, sizeof(wrapper_args[0]) * ucoro_high_water);
     
-    for (int i = 0; i < MAX_UCONTEXT_COROUTINES; i++) {
-        ucoro_pool[i].id = i;
-        ucoro_pool[i].active = false;
-        ucoro_pool[i].state = UCORO_STATE_INIT;
-        ucoro_pool[i].stack = NULL;
-        ucoro_pool[i].caller = NULL;
-    }
+    num_free_ucoro_slots = 0;
+    ucoro_high_water = 0;
+    preemptions = 0;
     
     initialized = true;
 }
 
+/* ============================================================
+ * STACK PROVIDERS
+ * ============================================================ */
+
+/**
+ * Round up to a multiple of the page size
+ */
+static size_t page_round(size_t bytes) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) / page * page;
+}
+
+static void *malloc_stack_alloc(size_t size, size_t guard_size, void *ctx) {
+    (void)ctx;
+    if (guard_size > 0) {
+        return NULL;
+    }
+    return malloc(size);
+}
+
+static void malloc_stack_free(void *stack, size_t size, size_t guard_size, void *ctx) {
+    (void)size;
+    (void)guard_size;
+    (void)ctx;
+    free(stack);
+}
+
+/**
+ * One private mapping per stack, guard pages at the low end
+ */
+static void *mmap_stack_alloc(size_t size, size_t guard_size, void *ctx) {
+    (void)ctx;
+    size = page_round(size);
+    guard_size = page_round(guard_size);
+    
+    char *base = mmap(NULL, size + guard_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    if (guard_size > 0 && mprotect(base, guard_size, PROT_NONE) != 0) {
+        munmap(base, size + guard_size);
+        return NULL;
+    }
+    return base + guard_size;
+}
+
+static void mmap_stack_free(void *stack, size_t size, size_t guard_size, void *ctx) {
+    (void)ctx;
+    size = page_round(size);
+    guard_size = page_round(guard_size);
+    munmap((char *)stack - guard_size, size + guard_size);
+}
+
+const ucoro_stack_provider_t coro_ucontext_malloc_stacks = {
+    .name = "malloc",
+    .alloc = malloc_stack_alloc,
+    .free = malloc_stack_free,
+    .ctx = NULL,
+};
+
+const ucoro_stack_provider_t coro_ucontext_mmap_stacks = {
+    .name = "mmap",
+    .alloc = mmap_stack_alloc,
+    .free = mmap_stack_free,
+    .ctx = NULL,
+};
+
+static void *arena_stack_alloc(size_t size, size_t guard_size, void *ctx) {
+    ucoro_stack_arena_t *arena = (ucoro_stack_arena_t *)ctx;
+    
+    if (guard_size > 0 || size > arena->slot_size) {
+        return NULL;
+    }
+    
+    if (arena->free_list) {
+        void *stack = arena->free_list;
+        arena->free_list = *(void **)stack;
+        return stack;
+    }
+    
+    if (arena->next >= arena->num_slots) {
+        return NULL;
+    }
+    return arena->base + arena->slot_size * arena->next++;
+}
+
+static void arena_stack_free(void *stack, size_t size, size_t guard_size, void *ctx) {
+    ucoro_stack_arena_t *arena = (ucoro_stack_arena_t *)ctx;
+    (void)size;
+    (void)guard_size;
+    
+    *(void **)stack = arena->free_list;
+    arena->free_list = stack;
+}
+
+/**
+ * Map a huge-page aligned region with THP enabled or disabled
+ */
+static char *map_aligned_region(size_t size, int advice) {
+    size_t span = size + UCORO_HUGE_PAGE_SIZE;
+    char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    
+    /* Trim to a huge-page aligned start so THP can back whole stacks */
+    char *base = (char *)(((uintptr_t)raw + UCORO_HUGE_PAGE_SIZE - 1) &
+                          ~(uintptr_t)(UCORO_HUGE_PAGE_SIZE - 1));
+    if (base > raw) {
+        munmap(raw, (size_t)(base - raw));
+    }
+    size_t tail = (size_t)(raw + span - (base + size));
+    if (tail > 0) {
+        munmap(base + size, tail);
+    }
+    
+    madvise(base, size, advice);
+    return base;
+}
+
+/**
+ * Map a stack arena
+ */
+int coro_ucontext_arena_open(ucoro_stack_arena_t *arena, size_t stack_size,
+                             size_t num_stacks, ucoro_arena_pages_t pages) {
+    memset(arena, 0, sizeof(*arena));
+    arena->slot_size = page_round(stack_size);
+    arena->num_slots = num_stacks;
+    arena->pages = pages;
+    
+    size_t bytes = arena->slot_size * num_stacks;
+    arena->region_size = (bytes + UCORO_HUGE_PAGE_SIZE - 1) / UCORO_HUGE_PAGE_SIZE *
+                         UCORO_HUGE_PAGE_SIZE;
+    
+    if (pages == UCORO_ARENA_HUGETLB) {
+        arena->base = mmap(NULL, arena->region_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (arena->base == MAP_FAILED) {
+            arena->base = NULL;
+        }
+    } else {
+        arena->base = map_aligned_region(arena->region_size,
+                                         pages == UCORO_ARENA_THP ? MADV_HUGEPAGE
+                                                                  : MADV_NOHUGEPAGE);
+    }
+    
+    if (!arena->base) {
+        fprintf(stderr, "Error: Failed to map %zu MB stack arena%s\n",
+                arena->region_size >> 20,
+                pages == UCORO_ARENA_HUGETLB ? " (are vm.nr_hugepages reserved?)" : "");
+        return -1;
+    }
+    
+    arena->provider.name = pages == UCORO_ARENA_HUGETLB ? "arena-hugetlb" :
+                           pages == UCORO_ARENA_THP ? "arena-thp" : "arena";
+    arena->provider.alloc = arena_stack_alloc;
+    arena->provider.free = arena_stack_free;
+    arena->provider.ctx = arena;
+    return 0;
+}
+
+/**
+ * Unmap a stack arena
+ */
+void coro_ucontext_arena_close(ucoro_stack_arena_t *arena) {
+    if (arena->base) {
+        munmap(arena->base, arena->region_size);
+        arena->base = NULL;
+    }
+}
+
+/* ============================================================
+ * STACK PAINTING AND ADAPTIVE SIZING
+ * ============================================================ */
+
+/**
+ * Find the stack profile of an entry function, adding it if missing
+ * Returns: profile, or NULL if the table is full
+ */
+static ucoro_stack_profile_t *find_stack_profile(ucoro_func_t func) {
+    for (int i = 0; i < num_stack_profiles; i++) {
+        if (stack_profiles[i].func == func) {
+            return &stack_profiles[i];
+        }
+    }
+    
+    if (num_stack_profiles >= UCORO_MAX_STACK_PROFILES) {
+        return NULL;
+    }
+    
+    ucoro_stack_profile_t *prof = &stack_profiles[num_stack_profiles++];
+    memset(prof, 0, sizeof(*prof));
+    prof->func = func;
+    return prof;
+}
+
+/**
+ * Smallest size class holding a stack with the given high-water mark
+ */
+static size_t stack_class_for(size_t used) {
+    size_t need = used + used / 4 + UCORO_STACK_HEADROOM;
+    size_t size = UCORO_STACK_MIN_CLASS;
+    
+    while (size < need && size < CORO_STACK_SIZE) {
+        size *= 2;
+    }
+    return size < CORO_STACK_SIZE ? size : CORO_STACK_SIZE;
+}
+
+/**
+ * Fill the lowest bytes of a stack with the paint word
+ */
+static void paint_stack(char *stack, size_t bytes) {
+    uint64_t *words = (uint64_t *)stack;
+    for (size_t i = 0; i < bytes / sizeof(uint64_t); i++) {
+        words[i] = UCORO_PAINT_WORD;
+    }
+}
+
+/**
+ * Count painted bytes that are still untouched, from the stack bottom
+ */
+static size_t untouched_bytes(const char *stack, size_t bytes) {
+    const uint64_t *words = (const uint64_t *)stack;
+    size_t i = 0;
+    while (i < bytes / sizeof(uint64_t) && words[i] == UCORO_PAINT_WORD) {
+        i++;
+    }
+    return i * sizeof(uint64_t);
+}
+
+/**
+ * Next stack top offset for a stack of size bytes
+ * The offset is a whole number of cache lines below size / UCORO_STACK_COLOR_MAX_SHARE.
+ */
+static size_t next_color_offset(size_t size) {
+    if (stack_colors <= 1) {
+        return 0;
+    }
+    
+    size_t lines = size / UCORO_STACK_COLOR_MAX_SHARE / UCORO_STACK_COLOR_STRIDE;
+    if (lines == 0) {
+        return 0;
+    }
+    
+    size_t color = next_stack_color++ % (unsigned int)stack_colors;
+    return (color % lines) * UCORO_STACK_COLOR_STRIDE;
+}
+
+/**
+ * Allocate, paint and optionally prefault a coroutine stack
+ * An explicit attr->stack_size overrides the stack mode's size, but
+ * painting still follows the mode.
+ * Returns: 0 on success, -1 if out of memory
+ */
+static int alloc_stack(coro_ucontext_t *coro, ucoro_func_t func, const ucoro_attr_t *attr) {
+    size_t size = attr->stack_size ? attr->stack_size : CORO_STACK_SIZE;
+    size_t guard = attr->guard_size;
+    ucoro_paint_t paint = UCORO_PAINT_NONE;
+    const ucoro_stack_provider_t *provider = attr->provider;
+    
+    if (!provider) {
+        provider = guard > 0 ? &coro_ucontext_mmap_stacks : &coro_ucontext_malloc_stacks;
+    }
+    
+    if (stack_mode != UCORO_STACK_FIXED) {
+        ucoro_stack_profile_t *prof = find_stack_profile(func);
+        paint = prof ? UCORO_PAINT_FULL : UCORO_PAINT_NONE;
+        
+        /* Profiled functions get their class and only a canary */
+        if (stack_mode == UCORO_STACK_ADAPTIVE && prof && attr->stack_size == 0 &&
+            prof->stack_class > 0 && prof->stack_class < CORO_STACK_SIZE) {
+            size = prof->stack_class;
+            paint = UCORO_PAINT_CANARY;
+        }
+    }
+    
+    /* Guard pages only make sense on page-aligned stacks */
+    if (guard > 0) {
+        size = page_round(size);
+        guard = page_round(guard);
+    }
+    
+    coro->stack = (char *)provider->alloc(size, guard, provider->ctx);
+    if (!coro->stack) {
+        return -1;
+    }
+    
+    coro->stack_size = size;
+    coro->stack_color = next_color_offset(size);
+    coro->guard_size = guard;
+    coro->stack_provider = provider;
+    coro->stack_paint = paint;
+    if (paint == UCORO_PAINT_FULL) {
+        paint_stack(coro->stack, size);
+    } else if (paint == UCORO_PAINT_CANARY) {
+        paint_stack(coro->stack, UCORO_STACK_CANARY_BYTES);
+    }
+    
+    if (attr->prefault && paint != UCORO_PAINT_FULL) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        for (size_t off = 0; off < size; off += page) {
+            ((volatile char *)coro->stack)[off] = 0;
+        }
+    }
+    
+    stack_bytes_allocated += size;
+    CORO_METRICS_COUNT(CORO_METRICS_UCONTEXT, stack_bytes, (int64_t)size);
+    return 0;
+}
+
+/**
+ * Return a coroutine stack to its provider
+ */
+static void free_stack(coro_ucontext_t *coro) {
+    if (coro->stack) {
+        coro->stack_provider->free(coro->stack, coro->stack_size, coro->guard_size,
+                                   coro->stack_provider->ctx);
+        stack_bytes_allocated -= coro->stack_size;
+        CORO_METRICS_COUNT(CORO_METRICS_UCONTEXT, stack_bytes, -(int64_t)coro->stack_size);
+        coro->stack = NULL;
+        coro->stack_size = 0;
+    }
+}
+
+/**
+ * Record the high-water mark of a painted stack, or check its canary
+ */
+static void record_stack_usage(coro_ucontext_t *coro, ucoro_func_t func) {
+    if (coro->stack_paint == UCORO_PAINT_NONE || !coro->stack) {
+        return;
+    }
+    
+    ucoro_stack_profile_t *prof = find_stack_profile(func);
+    if (!prof) {
+        return;
+    }
+    
+    size_t painted = coro->stack_paint == UCORO_PAINT_FULL ? coro->stack_size
+                                                           : UCORO_STACK_CANARY_BYTES;
+    size_t untouched = untouched_bytes(coro->stack, painted);
+    
+    /* Paint reached at the very bottom: the stack was (nearly) overrun */
+    if (untouched == 0) {
+        if (prof->overflows++ == 0) {
+            fprintf(stderr, "Warning: ucontext stack of %zu bytes overrun, "
+                    "falling back to %d byte stacks for this function\n",
+                    coro->stack_size, CORO_STACK_SIZE);
+        }
+        prof->stack_class = CORO_STACK_SIZE;
+    }
+    
+    if (coro->stack_paint == UCORO_PAINT_CANARY) {
+        return;
+    }
+    
+    size_t used = coro->stack_size - coro->stack_color - untouched;
+    prof->samples++;
+    prof->total_used += used;
+    if (used > prof->max_used) {
+        prof->max_used = used;
+    }
+    
+    if (prof->overflows == 0 && prof->samples >= UCORO_STACK_ADAPT_SAMPLES) {
+        prof->stack_class = stack_class_for(prof->max_used);
+    }
+}
+
+/**
+ * Set the number of stack top colors for coroutines created from now on
+ */
+void coro_ucontext_set_stack_colors(int colors) {
+    stack_colors = colors;
+    next_stack_color = 0;
+}
+
+/**
+ * Set the stack sizing mode for coroutines created from now on
+ */
+void coro_ucontext_set_stack_mode(ucoro_stack_mode_t mode) {
+    stack_mode = mode;
+}
+
+/**
+ * Number of entry functions with a stack profile
+ */
+int coro_ucontext_stack_profile_count(void) {
+    return num_stack_profiles;
+}
+
+/**
+ * Get a stack profile by index
+ */
+const ucoro_stack_profile_t *coro_ucontext_stack_profile(int index) {
+    if (index < 0 || index >= num_stack_profiles) {
+        return NULL;
+    }
+    return &stack_profiles[index];
+}
+
+/**
+ * Forget all stack profiles
+ */
+void coro_ucontext_stack_profile_reset(void) {
+    num_stack_profiles = 0;
+}
+
+/**
+ * Total bytes of stack allocated to live coroutines
+ */
+size_t coro_ucontext_stack_bytes(void) {
+    return stack_bytes_allocated;
+}
+
+/* ============================================================
+ * COROUTINE MANAGEMENT
+ * ============================================================ */
+
 /**
  * Find an available coroutine slot
  */
 static int find_free_ucoro_slot(void) {
-    for (int i = 0; i < MAX_UCONTEXT_COROUTINES; i++) {
-        if (!ucoro_pool[i].active) {
-            return i;
-        }
+    if (num_free_ucoro_slots > 0) {
+        return free_ucoro_slots[--num_free_ucoro_slots];
+    }
+    
+    if (ucoro_high_water < MAX_UCONTEXT_COROUTINES) {
+        int slot = ucoro_high_water++;
+        coro_ucontext_pool[slot].id = slot;
+        return slot;
     }
     return -1;
 }
@@ -85,6 +557,37 @@ static int find_free_ucoro_slot(void) {
  * Create a new stackful coroutine
  */
 int coro_ucontext_create(ucoro_func_t func, void *arg) {
+    return coro_ucontext_create_ex(func, arg, NULL);
+}
+
+/**
+ * Fill attributes with the defaults
+ */
+void coro_ucontext_attr_init(ucoro_attr_t *attr) {
+    attr->stack_size = 0;
+    attr->guard_size = 0;
+    attr->prefault = false;
+    attr->preemptible = false;
+    attr->provider = NULL;
+}
+
+/**
+ * Create a coroutine whose run time is summed under stats_func
+ */
+static int create_coroutine(ucoro_func_t func, void *arg, const ucoro_attr_t *attr,
+                            coro_stats_func_t stats_func) {
+    ucoro_attr_t defaults;
+    
+    if (!attr) {
+        coro_ucontext_attr_init(&defaults);
+        attr = &defaults;
+    }
+    
+    if (attr->stack_size != 0 && attr->stack_size < UCORO_STACK_MIN_CLASS) {
+        fprintf(stderr, "Error: Coroutine stack size below %d bytes\n", UCORO_STACK_MIN_CLASS);
+        return -1;
+    }
+    
     if (!initialized) {
         coro_ucontext_init();
     }
@@ -94,23 +597,32 @@ int coro_ucontext_create(ucoro_func_t func, void *arg) {
         fprintf(stderr, "Error: Maximum ucontext coroutines reached\n");
         return -1;
     }
+    coro_metrics_attach_once();
     
-    /* Allocate stack */
-    char *stack = (char *)malloc(CORO_STACK_SIZE);
-    if (!stack) {
+    /* Allocate stack (size and painting depend on attr and the stack mode) */
+    if (alloc_stack(&coro_ucontext_pool[slot], func, attr) < 0) {
         fprintf(stderr, "Error: Failed to allocate coroutine stack\n");
+        free_ucoro_slots[num_free_ucoro_slots++] = slot;
         return -1;
     }
     
+    /* Read before getcontext(), which may return twice */
+    coro_ucontext_pool[slot].preemptible = attr->preemptible;
+    coro_ucontext_pool[slot].preempt_disabled = 0;
+    coro_ucontext_pool[slot].preempt_ticks = -1;
+    coro_ucontext_pool[slot].preempt_pending = 0;
+    
     /* Initialize context */
-    if (getcontext(&ucoro_pool[slot].context) == -1) {
-        free(stack);
+    if (getcontext(&coro_ucontext_pool[slot].context) == -1) {
+        free_stack(&coro_ucontext_pool[slot]);
+        free_ucoro_slots[num_free_ucoro_slots++] = slot;
         return -1;
     }
     
-    ucoro_pool[slot].context.uc_stack.ss_sp = stack;
-    ucoro_pool[slot].context.uc_stack.ss_size = CORO_STACK_SIZE;
-    ucoro_pool[slot].context.uc_link = NULL;
+    coro_ucontext_pool[slot].context.uc_stack.ss_sp = coro_ucontext_pool[slot].stack;
+    coro_ucontext_pool[slot].context.uc_stack.ss_size = coro_ucontext_pool[slot].stack_size -
+                                                        coro_ucontext_pool[slot].stack_color;
+    coro_ucontext_pool[slot].context.uc_link = NULL;
     
     /* Store function and arguments */
     wrapper_args[slot].func = func;
@@ -118,17 +630,29 @@ int coro_ucontext_create(ucoro_func_t func, void *arg) {
     wrapper_args[slot].coro_id = slot;
     
     /* Create context */
-    makecontext(&ucoro_pool[slot].context, coro_wrapper, 0);
+    makecontext(&coro_ucontext_pool[slot].context, coro_wrapper, 0);
     
     /* Set coroutine as active */
-    ucoro_pool[slot].active = true;
-    ucoro_pool[slot].state = UCORO_STATE_INIT;
-    ucoro_pool[slot].stack = stack;
-    ucoro_pool[slot].caller = &main_context;
+    coro_ucontext_pool[slot].active = true;
+    coro_ucontext_pool[slot].state = UCORO_STATE_INIT;
+    coro_ucontext_pool[slot].caller = &coro_ucontext_main;
+    coro_stats_attach(&coro_ucontext_stats[slot], stats_func, coro_ucontext_backend.name);
+    CORO_METRICS_COUNT(CORO_METRICS_UCONTEXT, creates, 1);
+    CORO_PROBE3(coro_ucontext, create, slot, func, arg);
     
     return slot;
 }
 
+/**
+ * Create a new stackful coroutine with explicit stack attributes
+ */
+int coro_ucontext_create_ex(ucoro_func_t func, void *arg, const ucoro_attr_t *attr) {
+    coro_ucontext_preempt_disable_fast();
+    int id = create_coroutine(func, arg, attr, (coro_stats_func_t)func);
+    coro_ucontext_preempt_enable_fast();
+    return id;
+}
+
 /**
  * Resume execution of a coroutine
  */
@@ -137,35 +661,45 @@ int coro_ucontext_resume(int coro_id) {
         return -1;
     }
     
-    if (!ucoro_pool[coro_id].active) {
+    if (!coro_ucontext_pool[coro_id].active) {
         return -1;
     }
     
-    if (ucoro_pool[coro_id].state == UCORO_STATE_FINISHED) {
-        return 1;
-    }
-    
-    /* Save current coroutine ID */
-    int prev_id = current_ucoro_id;
-    current_ucoro_id = coro_id;
+    return coro_ucontext_resume_fast(coro_id);
+}
+
+/**
+ * Resume path taken by coro_ucontext_resume_fast() while accounting is on
+ */
+int coro_ucontext_resume_accounted(int coro_id) {
+    coro_ucontext_t *coro = &coro_ucontext_pool[coro_id];
+    int prev_id = coro_ucontext_current;
+    void **prev_locals = coro_ucontext_locals;
+    coro_ucontext_current = coro_id;
+    coro_ucontext_locals = coro->locals;
     
-    /* Switch to coroutine context */
-    ucoro_pool[coro_id].state = UCORO_STATE_RUNNING;
-    swapcontext(&main_context, &ucoro_pool[coro_id].context);
+    uint64_t start = coro_stats_run_begin(&coro_ucontext_stats[coro_id]);
+    CORO_PROBE1(coro_ucontext, resume, coro_id);
+    CORO_TRACE_EVENT(CORO_TRACE_UCONTEXT, CORO_TRACE_RESUME, coro_id);
+    coro->state = UCORO_STATE_RUNNING;
+    swapcontext(&coro_ucontext_main, &coro->context);
     
-    /* Returned from coroutine */
-    current_ucoro_id = prev_id;
+    coro_ucontext_current = prev_id;
+    coro_ucontext_locals = prev_locals;
+    bool finished = coro->state == UCORO_STATE_FINISHED;
+    coro_stats_run_end(&coro_ucontext_stats[coro_id], start, finished);
+    CORO_TRACE_EVENT(CORO_TRACE_UCONTEXT, finished ? CORO_TRACE_FINISH : CORO_TRACE_YIELD,
+                     coro_id);
     
-    return (ucoro_pool[coro_id].state == UCORO_STATE_FINISHED) ? 1 : 0;
+    return finished ? 1 : 0;
 }
 
 /**
  * Yield execution back to caller
  */
 void coro_ucontext_yield(void) {
-    if (current_ucoro_id >= 0 && current_ucoro_id < MAX_UCONTEXT_COROUTINES) {
-        ucoro_pool[current_ucoro_id].state = UCORO_STATE_SUSPENDED;
-        swapcontext(&ucoro_pool[current_ucoro_id].context, &main_context);
+    if (coro_ucontext_current >= 0 && coro_ucontext_current < MAX_UCONTEXT_COROUTINES) {
+        coro_ucontext_yield_fast();
     }
 }
 
@@ -177,25 +711,44 @@ void coro_ucontext_destroy(int coro_id) {
         return;
     }
     
-    if (ucoro_pool[coro_id].stack) {
-        free(ucoro_pool[coro_id].stack);
-        ucoro_pool[coro_id].stack = NULL;
+    if (!coro_ucontext_pool[coro_id].active) {
+        return;
+    }
+    
+    CORO_PROBE1(coro_ucontext, destroy, coro_id);
+    CORO_METRICS_COUNT(CORO_METRICS_UCONTEXT, destroys, 1);
+    coro_ucontext_preempt_disable_fast();
+    
+    /* Coroutines destroyed while suspended still contribute their mark */
+    if (coro_ucontext_pool[coro_id].state == UCORO_STATE_RUNNING ||
+        coro_ucontext_pool[coro_id].state == UCORO_STATE_SUSPENDED) {
+        record_stack_usage(&coro_ucontext_pool[coro_id], wrapper_args[coro_id].func);
     }
     
-    ucoro_pool[coro_id].active = false;
-    ucoro_pool[coro_id].state = UCORO_STATE_INIT;
-    ucoro_pool[coro_id].caller = NULL;
+    free_stack(&coro_ucontext_pool[coro_id]);
+    release_locals(&coro_ucontext_pool[coro_id]);
+    
+    coro_ucontext_pool[coro_id].active = false;
+    coro_ucontext_pool[coro_id].state = UCORO_STATE_INIT;
+    coro_ucontext_pool[coro_id].caller = NULL;
+    
+    free_ucoro_slots[num_free_ucoro_slots++] = coro_id;
+    coro_ucontext_preempt_enable_fast();
 }
 
 /**
  * Cleanup entire coroutine system
  */
 void coro_ucontext_cleanup(void) {
-    for (int i = 0; i < MAX_UCONTEXT_COROUTINES; i++) {
-        if (ucoro_pool[i].active) {
+    for (int i = 0; i < ucoro_high_water; i++) {
+        if (coro_ucontext_pool[i].active) {
             coro_ucontext_destroy(i);
         }
+        free(coro_ucontext_pool[i].locals);
+        coro_ucontext_pool[i].locals = NULL;
     }
+    num_free_ucoro_slots = 0;
+    ucoro_high_water = 0;
     initialized = false;
 }
 
@@ -206,5 +759,300 @@ ucoro_state_t coro_ucontext_get_state(int coro_id) {
     if (coro_id < 0 || coro_id >= MAX_UCONTEXT_COROUTINES) {
         return UCORO_STATE_INIT;
     }
-    return ucoro_pool[coro_id].state;
+    return coro_ucontext_pool[coro_id].state;
 }
+
+/**
+ * Get a coroutine's accounting counters
+ */
+int coro_ucontext_get_stats(int coro_id, coro_stats_t *out) {
+    if (coro_id < 0 || coro_id >= MAX_UCONTEXT_COROUTINES || !coro_ucontext_pool[coro_id].active) {
+        return -1;
+    }
+    coro_stats_convert(&coro_ucontext_stats[coro_id], out);
+    return 0;
+}
+
+/* ============================================================
+ * COROUTINE-LOCAL STORAGE
+ * ============================================================ */
+
+/*
+ * Each descriptor carries an array of UCORO_LOCAL_KEYS slots, allocated
+ * on the first set and kept with the pool slot for later coroutines.
+ * Resume points coro_ucontext_locals at the coroutine's array and
+ * restores the previous one when it yields, so a get is one load
+ * through a global pointer.
+ */
+
+/**
+ * Create a coroutine-local storage key
+ */
+int coro_ucontext_local_key_create(ucoro_local_key_t *key, void (*destructor)(void *)) {
+    for (int k = 0; k < UCORO_LOCAL_KEYS; k++) {
+        if (!local_key_used[k]) {
+            local_key_used[k] = true;
+            local_key_destructors[k] = destructor;
+            *key = k;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Error: All %d coroutine-local keys are in use\n", UCORO_LOCAL_KEYS);
+    return -1;
+}
+
+/**
+ * Delete a key and drop its values everywhere
+ */
+void coro_ucontext_local_key_delete(ucoro_local_key_t key) {
+    if (key < 0 || key >= UCORO_LOCAL_KEYS || !local_key_used[key]) {
+        return;
+    }
+    
+    main_locals[key] = NULL;
+    for (int i = 0; i < ucoro_high_water; i++) {
+        if (coro_ucontext_pool[i].locals) {
+            coro_ucontext_pool[i].locals[key] = NULL;
+        }
+    }
+    local_key_used[key] = false;
+    local_key_destructors[key] = NULL;
+}
+
+/**
+ * Set the running context's value for key
+ */
+int coro_ucontext_local_set(ucoro_local_key_t key, void *value) {
+    if (key < 0 || key >= UCORO_LOCAL_KEYS || !local_key_used[key]) {
+        return -1;
+    }
+    
+    if (!coro_ucontext_locals) {
+        /* First set in this coroutine: attach its slot array */
+        coro_ucontext_t *coro = &coro_ucontext_pool[coro_ucontext_current];
+        coro_ucontext_preempt_disable_fast();
+        coro->locals = calloc(UCORO_LOCAL_KEYS, sizeof(void *));
+        coro_ucontext_locals = coro->locals;
+        coro_ucontext_preempt_enable_fast();
+        if (!coro->locals) {
+            return -1;
+        }
+    }
+    coro_ucontext_locals[key] = value;
+    return 0;
+}
+
+/**
+ * Run destructors on a destroyed coroutine's values and clear its slots
+ */
+static void release_locals(coro_ucontext_t *coro) {
+    if (!coro->locals) {
+        return;
+    }
+    
+    for (int k = 0; k < UCORO_LOCAL_KEYS; k++) {
+        void *value = coro->locals[k];
+        coro->locals[k] = NULL;
+        if (value && local_key_destructors[k]) {
+            local_key_destructors[k](value);
+        }
+    }
+}
+
+/* ============================================================
+ * PREEMPTION
+ * ============================================================ */
+
+/**
+ * Timer tick: count it against the running coroutine's slice and, once
+ * the slice is used up, yield on its behalf
+ * The tick count is -1 from a yield until the coroutine is back on its
+ * own stack, so a tick that lands inside swapcontext never switches.
+ */
+static void preempt_handler(int sig) {
+    (void)sig;
+    int id = coro_ucontext_current;
+    if (id < 0) {
+        return;
+    }
+    
+    coro_ucontext_t *coro = &coro_ucontext_pool[id];
+    if (!coro->preemptible || coro->state != UCORO_STATE_RUNNING ||
+        coro->preempt_ticks < 0) {
+        return;
+    }
+    if (++coro->preempt_ticks <= UCORO_PREEMPT_TICKS) {
+        return;
+    }
+    if (coro->preempt_disabled > 0) {
+        coro->preempt_pending = 1;
+        return;
+    }
+    
+    /* Resumed here later; returning then continues the interrupted code */
+    int saved_errno = errno;
+    preemptions++;
+    coro_ucontext_yield_fast();
+    errno = saved_errno;
+}
+
+/**
+ * Start the preemption timer for the calling thread
+ */
+int coro_ucontext_preempt_start(int slice_us) {
+    if (preempt_running) {
+        fprintf(stderr, "Error: Preemption already started\n");
+        return -1;
+    }
+    if (slice_us <= 0) {
+        fprintf(stderr, "Error: Preemption slice must be positive\n");
+        return -1;
+    }
+    
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = preempt_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(UCORO_PREEMPT_SIGNAL, &action, &preempt_old_action) < 0) {
+        fprintf(stderr, "Error: Failed to install preemption handler: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = UCORO_PREEMPT_SIGNAL;
+    event.sigev_notify_thread_id = gettid();
+    if (timer_create(CLOCK_MONOTONIC, &event, &preempt_timer) < 0) {
+        fprintf(stderr, "Error: Failed to create preemption timer: %s\n", strerror(errno));
+        sigaction(UCORO_PREEMPT_SIGNAL, &preempt_old_action, NULL);
+        return -1;
+    }
+    
+    long long tick_ns = (long long)slice_us * 1000 / UCORO_PREEMPT_TICKS;
+    if (tick_ns < 1) {
+        tick_ns = 1;
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = tick_ns / 1000000000LL;
+    spec.it_interval.tv_nsec = tick_ns % 1000000000LL;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(preempt_timer, 0, &spec, NULL) < 0) {
+        fprintf(stderr, "Error: Failed to arm preemption timer: %s\n", strerror(errno));
+        timer_delete(preempt_timer);
+        sigaction(UCORO_PREEMPT_SIGNAL, &preempt_old_action, NULL);
+        return -1;
+    }
+    
+    preempt_running = true;
+    return 0;
+}
+
+/**
+ * Stop the preemption timer
+ */
+void coro_ucontext_preempt_stop(void) {
+    if (!preempt_running) {
+        return;
+    }
+    
+    /* A tick already queued is still handled, by our handler */
+    timer_delete(preempt_timer);
+    sigaction(UCORO_PREEMPT_SIGNAL, &preempt_old_action, NULL);
+    preempt_running = false;
+}
+
+/**
+ * Defer preemption of the running coroutine (fenced like the inline version)
+ */
+void coro_ucontext_preempt_disable(void) {
+    coro_ucontext_preempt_disable_fast();
+}
+
+/**
+ * End a preemption-disabled region, yielding if a slice expired in it
+ */
+void coro_ucontext_preempt_enable(void) {
+    if (coro_ucontext_current < 0) {
+        return;
+    }
+    
+    /*
+     * The fence keeps the region's code before the count, as in the
+     * inline version; the caller's errno survives the coroutines run
+     * meanwhile
+     */
+    coro_ucontext_t *coro = &coro_ucontext_pool[coro_ucontext_current];
+    atomic_signal_fence(memory_order_seq_cst);
+    if (--coro->preempt_disabled == 0 && coro->preempt_pending) {
+        int saved_errno = errno;
+        coro->preempt_pending = 0;
+        preemptions++;
+        coro_ucontext_yield_fast();
+        errno = saved_errno;
+    }
+}
+
+/**
+ * Set whether a live coroutine may be preempted
+ */
+int coro_ucontext_set_preemptible(int coro_id, bool preemptible) {
+    if (coro_id < 0 || coro_id >= MAX_UCONTEXT_COROUTINES || !coro_ucontext_pool[coro_id].active) {
+        return -1;
+    }
+    
+    coro_ucontext_pool[coro_id].preemptible = preemptible;
+    return 0;
+}
+
+/**
+ * Number of forced yields
+ */
+long long coro_ucontext_preemptions(void) {
+    return preemptions;
+}
+
+/* ============================================================
+ * BACKEND INTERFACE
+ * ============================================================ */
+
+/* Step functions of coroutines created through the backend interface */
+static coro_step_fn_t ucoro_steps[MAX_UCONTEXT_COROUTINES];
+
+/**
+ * Entry function that runs one step per resume
+ */
+static void step_entry(void *arg) {
+    coro_step_fn_t step = ucoro_steps[coro_ucontext_current];
+    
+    while (step(arg) == 0) {
+        coro_ucontext_yield();
+    }
+}
+
+/**
+ * Create a coroutine running a step function (accounted under step)
+ */
+static int backend_create(coro_step_fn_t step, void *arg) {
+    int id = create_coroutine(step_entry, arg, NULL, (coro_stats_func_t)step);
+    if (id >= 0) {
+        ucoro_steps[id] = step;
+    }
+    return id;
+}
+
+const coro_backend_t coro_ucontext_backend = {
+    .name = "ucontext",
+    .label = "Ucontext",
+    .caps = CORO_BACKEND_CAP_STACKFUL | CORO_BACKEND_CAP_DEEP_STACK,
+    .max_coros = MAX_UCONTEXT_COROUTINES,
+    .init = coro_ucontext_init,
+    .cleanup = coro_ucontext_cleanup,
+    .create = backend_create,
+    .create_stackful = coro_ucontext_create,
+    .resume = coro_ucontext_resume,
+    .yield = coro_ucontext_yield,
+    .destroy = coro_ucontext_destroy,
+    .stats = coro_ucontext_stats,
+};